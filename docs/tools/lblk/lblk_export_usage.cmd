@@ -0,0 +1 @@
+lblk export --help
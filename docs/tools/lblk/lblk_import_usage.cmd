@@ -0,0 +1 @@
+lblk import --help
@@ -0,0 +1 @@
+zoned export --help
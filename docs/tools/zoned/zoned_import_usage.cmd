@@ -0,0 +1 @@
+zoned import --help
@@ -314,6 +314,98 @@ exit:
 	return err < 0 ? err : 0;
 }
 
+static int
+sub_async_scan(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint32_t nsid = cli->args.nsid;
+
+	const uint32_t qd = cli->args.qdepth ? cli->args.qdepth : DEFAULT_QD;
+	uint64_t slba = cli->args.slba;
+	uint64_t elba = cli->args.elba;
+	uint64_t nchunks = 0;
+	uint64_t nbytes = 0;
+
+	struct xnvme_rstream *rs = NULL;
+	FILE *fp = NULL;
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+	if (!(cli->given[XNVMEC_OPT_SLBA] && cli->given[XNVMEC_OPT_ELBA])) {
+		err = lba_range(cli, &slba, &elba);
+		if (err) {
+			xnvmec_perr("lba_range()", err);
+			goto exit;
+		}
+	}
+
+	if (cli->args.data_output) {
+		fp = fopen(cli->args.data_output, "wb");
+		if (!fp) {
+			err = -errno;
+			xnvmec_perr("fopen()", err);
+			goto exit;
+		}
+	}
+
+	xnvmec_pinf("Scan nsect: %"PRIu64", [0x%016"PRIx64",0x%016"PRIx64"], "
+		    "qd: %u, uri: '%s'", elba + 1 - slba, slba, elba, qd,
+		    cli->args.uri);
+
+	xnvmec_timer_start(cli);
+
+	err = xnvme_rstream_init(dev, &rs, nsid, slba, elba, 0, qd);
+	if (err) {
+		xnvmec_perr("xnvme_rstream_init()", err);
+		goto exit;
+	}
+
+	for (;;) {
+		struct xnvme_rstream_chunk *chunk = NULL;
+
+		err = xnvme_rstream_next(rs, &chunk);
+		if (err) {
+			xnvmec_perr("xnvme_rstream_next()", err);
+			goto exit;
+		}
+		if (!chunk) {
+			break;
+		}
+
+		// Chunks arrive in LBA order, thus appending gives the range as-is
+		if (fp && (fwrite(chunk->buf, 1, chunk->nbytes, fp) != chunk->nbytes)) {
+			err = -EIO;
+			xnvmec_perr("fwrite()", err);
+			goto exit;
+		}
+		nchunks += 1;
+		nbytes += chunk->nbytes;
+
+		err = xnvme_rstream_put(rs, chunk);
+		if (err) {
+			xnvmec_perr("xnvme_rstream_put()", err);
+			goto exit;
+		}
+	}
+
+	xnvmec_timer_stop(cli);
+	xnvmec_timer_bw_pr(cli, "wall-clock", nbytes);
+
+exit:
+	xnvmec_pinf("scan: {nchunks: %"PRIu64", nbytes: %"PRIu64"}", nchunks,
+		    nbytes);
+
+	xnvme_rstream_term(rs);
+	if (fp && fclose(fp) && !err) {
+		err = -errno;
+		xnvmec_perr("fclose()", err);
+	}
+
+	return err < 0 ? err : 0;
+}
+
 //
 // Command-Line Interface (CLI) definition
 //
@@ -333,6 +425,19 @@ static struct xnvmec_sub subs[] = {
 		}
 	},
 
+	{
+		"scan",
+		"Read the LBAs [SLBA,ELBA] in order via a read-stream",
+		"Read the LBAs [SLBA,ELBA] in order via a read-stream",
+		sub_async_scan, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LOPT},
+		}
+	},
+
 	{
 		"write",
 		"Write the LBAs [SLBA,ELBA]",
@@ -0,0 +1,368 @@
+/**
+ * The User space library for Key-Value Namespaces based on xNVMe, the
+ * Cross-platform libraries and tools for NVMe devices
+ *
+ * Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * @headerfile libkvs.h
+ */
+#ifndef __LIBKVS_H
+#define __LIBKVS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libxnvme.h>
+
+#define KVS_KEY_NBYTES_MAX 16	///< Maximum key length in bytes
+#define KVS_NKVF 16		///< Number of KV formats in Identify Namespace
+
+/**
+ * Key-Value Command Set opcodes
+ *
+ * @see KV Command Set Specification Section 3, figure KVOPCODES
+ *
+ * @enum kvs_cmd_opc
+ */
+enum kvs_cmd_opc {
+	KVS_CMD_OPC_STORE	= 0x01,	///< KVS_CMD_OPC_STORE
+	KVS_CMD_OPC_RETRIEVE	= 0x02,	///< KVS_CMD_OPC_RETRIEVE
+	KVS_CMD_OPC_LIST	= 0x06,	///< KVS_CMD_OPC_LIST
+	KVS_CMD_OPC_DELETE	= 0x10,	///< KVS_CMD_OPC_DELETE
+	KVS_CMD_OPC_EXIST	= 0x14,	///< KVS_CMD_OPC_EXIST
+};
+
+/**
+ * Produces a string representation of the given ::kvs_cmd_opc
+ *
+ * @param opc the enum value to produce a string representation of
+ *
+ * @return On success, a string representation is returned. On error, the string
+ * "KVS_CMD_OPC_ENOSYS" is returned.
+ */
+const char *
+kvs_cmd_opc_str(enum kvs_cmd_opc opc);
+
+/**
+ * Command-set specific status codes related to Key-Value Namespaces, these
+ * have Status Code Type 0x1
+ *
+ * @see KV Command Set Specification Section 3.3
+ *
+ * @enum kvs_status_code
+ */
+enum kvs_status_code {
+	KVS_SC_INVALID_VALUE_SIZE	= 0x85,	///< KVS_SC_INVALID_VALUE_SIZE
+	KVS_SC_INVALID_KEY_SIZE		= 0x86,	///< KVS_SC_INVALID_KEY_SIZE
+	KVS_SC_KEY_NOT_EXISTS		= 0x87,	///< KVS_SC_KEY_NOT_EXISTS
+	KVS_SC_UNRECOVERED		= 0x88,	///< KVS_SC_UNRECOVERED
+	KVS_SC_KEY_EXISTS		= 0x89,	///< KVS_SC_KEY_EXISTS
+};
+
+/**
+ * Produces a string representation of the given ::kvs_status_code
+ *
+ * @param sc the enum value to produce a string representation of
+ *
+ * @return On success, a string representation is returned. On error, the string
+ * "KVS_SC_ENOSYS" is returned.
+ */
+const char *
+kvs_status_code_str(enum kvs_status_code sc);
+
+/**
+ * Store Options, see kvs_cmd_store()
+ *
+ * @enum kvs_store_opts
+ */
+enum kvs_store_opts {
+	KVS_STORE_OPT_MUST_EXIST	= 0x1,	///< Fail when the key does not exist
+	KVS_STORE_OPT_MUST_NOT_EXIST	= 0x2,	///< Fail when the key exists
+};
+
+/**
+ * NVMe Command Accessor for the commands of the Key-Value Command Set, the
+ * key is split over command dwords 2-3 and 14-15
+ *
+ * @struct kvs_cmd_kv
+ */
+struct kvs_cmd_kv {
+	uint32_t cdw00_01[2];		///< Command dword 0 to 1
+
+	/* cdw 02-03 */
+	uint64_t key_hi;		///< Key bytes 15:08
+
+	uint32_t cdw04_09[6];		///< Command dword 4 to 9
+
+	/* cdw 10 */
+	uint32_t vsz;			///< Value Size, or Host Buffer Size
+
+	/* cdw 11 */
+	uint32_t kl		: 8;	///< Key Length, in bytes
+	uint32_t so		: 8;	///< Store Options, see ::kvs_store_opts
+	uint32_t rsvd		: 16;
+
+	uint32_t cdw12_13[2];		///< Command dword 12 to 13
+
+	/* cdw 14-15 */
+	uint64_t key_lo;		///< Key bytes 07:00
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_cmd_kv) == 64, "Incorrect size")
+
+/**
+ * NVMe Command Accessors for the Key-Value Command Set
+ *
+ * @struct kvs_cmd
+ */
+struct kvs_cmd {
+	union {
+		struct xnvme_spec_cmd base;
+		struct xnvme_spec_cmd_common common;
+		struct kvs_cmd_kv kv;
+		uint32_t cdw[16];
+	};
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_cmd) == 64, "Incorrect size")
+
+/**
+ * Set the key of the given command
+ *
+ * @param cmd Pointer to the command
+ * @param key Pointer to the key
+ * @param klen Length of the key, in bytes, at most ::KVS_KEY_NBYTES_MAX
+ */
+void
+kvs_cmd_set_key(struct kvs_cmd *cmd, const void *key, uint8_t klen);
+
+/**
+ * Retrieve the key of the given command
+ *
+ * @param cmd Pointer to the command
+ * @param key Pointer to a buffer of ::KVS_KEY_NBYTES_MAX bytes
+ *
+ * @return The length of the key in bytes.
+ */
+uint8_t
+kvs_cmd_get_key(const struct kvs_cmd *cmd, void *key);
+
+/**
+ * KV Format, describing the limits of keys and values
+ *
+ * @struct kvs_kvf
+ */
+struct kvs_kvf {
+	uint16_t kml;		///< Maximum Key Length, in bytes
+	uint8_t rsvd2;
+	uint8_t rp;		///< Relative Performance
+	uint32_t mvl;		///< Maximum Value Length, in bytes
+	uint32_t mnk;		///< Maximum Number of Keys, 0 when not reported
+	uint8_t rsvd12[4];
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_kvf) == 16, "Incorrect size")
+
+/**
+ * I/O Command Set specific Identify Namespace data structure for Key-Value
+ * Namespaces
+ *
+ * @struct kvs_idfy_ns
+ */
+struct kvs_idfy_ns {
+	uint64_t nsze;		///< Namespace Size, in bytes
+	uint8_t rsvd8[8];
+	uint64_t nuse;		///< Namespace Utilization, in bytes
+	uint8_t nsfeat;		///< Namespace Features
+	uint8_t nkvf;		///< Number of KV Formats, zero-based
+	uint8_t nmic;		///< Namespace Multi-path I/O and Sharing Cap.
+	uint8_t rescap;		///< Reservation Capabilities
+	uint8_t fpi;		///< Format Progress Indicator
+	uint8_t rsvd29[3];
+	uint32_t novg;		///< Namespace Optimal Value Granularity
+	uint32_t anagrpid;	///< ANA Group Identifier
+	uint8_t rsvd40[3];
+	uint8_t nsattr;		///< Namespace Attributes
+	uint16_t nvmsetid;	///< NVM Set Identifier
+	uint16_t endgid;	///< Endurance Group Identifier
+	uint8_t rsvd48[24];
+
+	struct kvs_kvf kvf[KVS_NKVF];	///< KV Formats
+
+	uint8_t rsvd328[3768];
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_idfy_ns) == 4096, "Incorrect size")
+
+/**
+ * Prints the given ::kvs_idfy_ns to the given output stream
+ *
+ * @param stream output stream used for printing
+ * @param idfy pointer to the structure to print
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned
+ */
+int
+kvs_idfy_ns_fpr(FILE *stream, const struct kvs_idfy_ns *idfy, int opts);
+
+/**
+ * Prints the given ::kvs_idfy_ns to stdout
+ *
+ * @param idfy pointer to ::kvs_idfy_ns
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned
+ */
+int
+kvs_idfy_ns_pr(const struct kvs_idfy_ns *idfy, int opts);
+
+/**
+ * Representation of the NVMe Identify Namespace command completion result
+ *
+ * @struct kvs_idfy
+ */
+struct kvs_idfy {
+	union {
+		struct xnvme_spec_idfy base;
+		struct kvs_idfy_ns ns;
+	};
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_idfy) == 4096, "Incorrect size")
+
+/**
+ * Header of the data returned by the List command, the header is followed
+ * by 'nkeys' entries, each is a 16-bit key length followed by the key, and
+ * padded to a multiple of 4 bytes
+ *
+ * @struct kvs_list_hdr
+ */
+struct kvs_list_hdr {
+	uint32_t nkeys;		///< Number of keys returned
+};
+XNVME_STATIC_ASSERT(sizeof(struct kvs_list_hdr) == 4, "Incorrect size")
+
+/**
+ * Iterate over the keys of the data returned by the List command
+ *
+ * @param buf Pointer to the data returned by the List command
+ * @param buf_nbytes Size of 'buf' in bytes
+ * @param ofz Pointer to the offset of the next entry, initialize to 0
+ * @param key Pointer to a buffer of ::KVS_KEY_NBYTES_MAX bytes
+ *
+ * @return On success, the length of the key is returned. When no keys remain,
+ * 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_list_next(const void *buf, uint32_t buf_nbytes, uint32_t *ofz, void *key);
+
+/**
+ * Submit, and optionally wait for completion of, a KV Store command
+ *
+ * @see xnvme_cmd_opts
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param key Pointer to the key
+ * @param klen Length of the key, in bytes, at most ::KVS_KEY_NBYTES_MAX
+ * @param vbuf Pointer to the value, allocated with xnvme_buf_alloc()
+ * @param vlen Length of the value in bytes
+ * @param sopts Store options, see ::kvs_store_opts
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_cmd_store(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	      uint8_t klen, const void *vbuf, uint32_t vlen, uint8_t sopts,
+	      int opts, struct xnvme_req *ret);
+
+/**
+ * Submit, and optionally wait for completion of, a KV Retrieve command. The
+ * size of the value is returned in the completion dword 0, the value is
+ * truncated to the size of the buffer when larger.
+ *
+ * @see xnvme_cmd_opts
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param key Pointer to the key
+ * @param klen Length of the key, in bytes, at most ::KVS_KEY_NBYTES_MAX
+ * @param vbuf Pointer to the buffer to retrieve into, allocated with
+ * xnvme_buf_alloc()
+ * @param vbuf_nbytes Size of 'vbuf' in bytes
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_cmd_retrieve(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+		 uint8_t klen, void *vbuf, uint32_t vbuf_nbytes, int opts,
+		 struct xnvme_req *ret);
+
+/**
+ * Submit, and optionally wait for completion of, a KV Delete command
+ *
+ * @see xnvme_cmd_opts
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param key Pointer to the key
+ * @param klen Length of the key, in bytes, at most ::KVS_KEY_NBYTES_MAX
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_cmd_delete(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	       uint8_t klen, int opts, struct xnvme_req *ret);
+
+/**
+ * Submit, and optionally wait for completion of, a KV Exist command, the
+ * command completes with ::KVS_SC_KEY_NOT_EXISTS when the key does not exist
+ *
+ * @see xnvme_cmd_opts
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param key Pointer to the key
+ * @param klen Length of the key, in bytes, at most ::KVS_KEY_NBYTES_MAX
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_cmd_exist(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	      uint8_t klen, int opts, struct xnvme_req *ret);
+
+/**
+ * Submit, and optionally wait for completion of, a KV List command, listing
+ * the keys from the given key and onwards, see ::kvs_list_hdr and
+ * kvs_list_next()
+ *
+ * @see xnvme_cmd_opts
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param key Pointer to the key to list from
+ * @param klen Length of the key, in bytes, 0 lists from the first key
+ * @param buf Pointer to the buffer to list into, allocated with
+ * xnvme_buf_alloc()
+ * @param buf_nbytes Size of 'buf' in bytes
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+kvs_cmd_list(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	     uint8_t klen, void *buf, uint32_t buf_nbytes, int opts,
+	     struct xnvme_req *ret);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBKVS_H */
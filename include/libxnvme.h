@@ -30,7 +30,10 @@ extern "C" {
 enum xnvme_pr {
 	XNVME_PR_DEF = 0x0,	///< XNVME_PR_DEF: Default options
 	XNVME_PR_YAML = 0x1,	///< XNVME_PR_YAML: Print formatted as YAML
-	XNVME_PR_TERSE = 0x2	///< XNVME_PR_TERSE: Print without formatting
+	XNVME_PR_TERSE = 0x2,	///< XNVME_PR_TERSE: Print without formatting
+	XNVME_PR_CSV = 0x4,	///< XNVME_PR_CSV: Header-line, then a row per entry
+	XNVME_PR_JSONL = 0x8,	///< XNVME_PR_JSONL: A JSON object per entry/line
+	XNVME_PR_BIN = 0x10	///< XNVME_PR_BIN: Entries as stored in memory
 };
 
 /**
@@ -90,6 +93,17 @@ struct xnvme_be_attr {
 
 	int nschemes;		///< Number of schemes in 'schemes'
 	int enabled;		///< Whether the backend is 'enabled'
+	int caps;		///< Capabilities, see ::xnvme_be_caps
+	int _rsvd;
+};
+
+/**
+ * Enumeration of backend capabilities
+ *
+ * @enum xnvme_be_caps
+ */
+enum xnvme_be_caps {
+	XNVME_BE_CAP_LINK	= 0x1 << 0,	///< XNVME_BE_CAP_LINK: Native linking, see XNVME_CMD_LINK
 };
 
 /**
@@ -262,6 +276,9 @@ enum xnvme_cmd_opts {
 
 	XNVME_CMD_UPLD_SGLD	= 0x1 << 2,	///< XNVME_CMD_UPLD_SGLD: User-managed SGL data
 	XNVME_CMD_UPLD_SGLM	= 0x1 << 3,	///< XNVME_CMD_UPLD_SGLM: User-managed SGL meta
+
+	XNVME_CMD_LINK		= 0x1 << 4,	///< XNVME_CMD_LINK: Link with next command, see xnvme_async_chain()
+	XNVME_CMD_BUFSEL	= 0x1 << 5,	///< XNVME_CMD_BUFSEL: 'dbuf' is a buffer-group, see xnvme_bufgrp_read()
 };
 
 #define XNVME_CMD_MASK_IOMD ( XNVME_CMD_SYNC | XNVME_CMD_ASYNC )
@@ -714,6 +731,9 @@ struct xnvme_req {
 
 		///< Per request backend specific data
 		uint8_t be_rsvd[8];
+
+		///< Buffer selected for a read via xnvme_bufgrp_read()
+		void *dbuf;
 	} async;
 
 	///< Fields for request-pool
@@ -768,6 +788,386 @@ xnvme_req_cpl_status(struct xnvme_req *req)
 	return req->cpl.status.sc || req->cpl.status.sct;
 }
 
+/**
+ * Submit a batch of Read or Write commands via the given asynchronous context
+ * and wait for all of them to complete
+ *
+ * Command 'i' transfers 'nlb' + 1 LBAs, starting at 'slbas[i]', to/from
+ * 'buf' at offset i * (nlb + 1) * lba_nbytes. Thus, the cost of a call is per
+ * batch rather than per command, which is useful for language-bindings.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context as initialized with xnvme_async_init()
+ * @param opcode Either XNVME_SPEC_OPC_READ or XNVME_SPEC_OPC_WRITE
+ * @param nsid Namespace Identifier
+ * @param slbas Array of 'nentries' start LBAs
+ * @param nlb The number of LBAs per command. NOTE: nlb is a zero-based value
+ * @param buf Pointer to buffer as allocated with xnvme_buf_alloc()
+ * @param nentries Number of commands in the batch
+ * @param cpl Optional array of 'nentries', filled with the completions
+ *
+ * @return On success, the number of commands completing with an error-status
+ * is returned, that is, 0 when all succeeded. On error, negative `errno` is
+ * returned.
+ */
+int
+xnvme_async_batch_rw(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		     uint8_t opcode, uint32_t nsid, const uint64_t *slbas,
+		     uint16_t nlb, void *buf, uint32_t nentries,
+		     struct xnvme_spec_cpl *cpl);
+
+/**
+ * A command in a chain, see xnvme_async_chain()
+ *
+ * @struct xnvme_async_link
+ */
+struct xnvme_async_link {
+	struct xnvme_spec_cmd cmd;	///< The command to submit
+	void *dbuf;			///< Data buffer, or NULL
+	size_t dbuf_nbytes;		///< Size of 'dbuf' in bytes
+	void *mbuf;			///< Meta-data buffer, or NULL
+	size_t mbuf_nbytes;		///< Size of 'mbuf' in bytes
+
+	///< Completion of the command, with 'req.async.cb' and
+	///< 'req.async.cb_arg' provided by the caller
+	struct xnvme_req req;
+
+	///< Fields for the library-side scheduling of the chain
+	struct {
+		struct xnvme_dev *dev;
+		struct xnvme_async_link *next;
+		xnvme_async_cb cb;
+		void *cb_arg;
+	} sched;
+};
+
+/**
+ * Submit a chain of commands, command 'i + 1' is started once command 'i' has
+ * completed successfully. When a command fails, the remaining commands in the
+ * chain are not executed and complete with the generic status-code
+ * ::XNVME_SPEC_SC_ABORT_REQ instead. Each command completes via the callback
+ * of its 'req'.
+ *
+ * Backends with native support, ::XNVME_BE_CAP_LINK, e.g. IOSQE_IO_LINK on
+ * liou, receive the chain in a single submission. Otherwise, the library
+ * submits the next command from the completion-callback of its predecessor,
+ * thus, the chain progresses via xnvme_async_poke() / xnvme_async_wait()
+ * either way. A failure to submit the next command, including a transient
+ * -EBUSY, is not retried: it aborts the rest of the chain, which completes
+ * with ::XNVME_SPEC_SC_ABORT_REQ as if a command had failed.
+ *
+ * The links are owned by the library until the last of them has completed.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context as initialized with xnvme_async_init()
+ * @param links Array of 'nlinks' commands
+ * @param nlinks Number of commands in the chain
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EBUSY when the context cannot fit the chain, in which case nothing has been
+ * submitted, and the call can be retried after reaping completions.
+ */
+int
+xnvme_async_chain(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		  struct xnvme_async_link *links, uint32_t nlinks);
+
+/**
+ * An item of a batch of reads, see xnvme_mget_submit()
+ *
+ * @struct xnvme_mget_item
+ */
+struct xnvme_mget_item {
+	uint64_t slba;			///< The LBA to start reading from
+	uint16_t nlb;			///< Number of LBAs, NOTE: zero-based
+	void *dbuf;			///< Pointer to data-payload
+	struct xnvme_spec_cpl cpl;	///< Completion of the item
+};
+
+/**
+ * Opaque multi-get handle as provided by xnvme_mget_init()
+ *
+ * Submits batches of reads on an asynchronous context, calling a single
+ * function once all reads of a batch have completed. Requests for the reads
+ * come from a pool of the handle, sized at initialization, thus bounding the
+ * number of reads outstanding via the handle.
+ *
+ * @note A handle is not thread-safe; use a handle per asynchronous context
+ *
+ * @struct xnvme_mget
+ */
+struct xnvme_mget;
+
+/**
+ * Signature of the function called when all reads of a batch have completed
+ *
+ * @param items The items of the batch, as given to xnvme_mget_submit()
+ * @param nitems Number of items in the batch
+ * @param nerrs Number of items completed with an error status
+ * @param cb_arg User callback argument
+ */
+typedef void (*xnvme_mget_cb)(struct xnvme_mget_item *items, uint32_t nitems,
+			      uint32_t nerrs, void *cb_arg);
+
+/**
+ * Setup multi-get on the given asynchronous context
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context as initialized with xnvme_async_init()
+ * @param mg Pointer-pointer to the initialized handle
+ * @param capacity Maximum number of outstanding reads via the handle, at
+ * most the depth of the context, and also the maximum size of a batch
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_mget_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		struct xnvme_mget **mg, uint32_t capacity);
+
+/**
+ * Submit a batch of reads, the given function is called via
+ * xnvme_async_poke() / xnvme_async_wait() once all of them have completed
+ *
+ * @note The items must remain valid until the function is called. When
+ * submission fails after some items are submitted, then the remaining items
+ * complete with ::XNVME_SPEC_SC_INTERNAL.
+ *
+ * @param mg Handle as initialized with xnvme_mget_init()
+ * @param nsid Namespace Identifier
+ * @param items Array of reads, the completion of each is stored in it
+ * @param nitems Number of items in the array
+ * @param cb Function called when all reads of the batch have completed
+ * @param cb_arg User callback argument
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EBUSY when the pool of the handle cannot hold the batch, in which case
+ * completions must be reaped before submitting it again.
+ */
+int
+xnvme_mget_submit(struct xnvme_mget *mg, uint32_t nsid,
+		  struct xnvme_mget_item *items, uint32_t nitems,
+		  xnvme_mget_cb cb, void *cb_arg);
+
+/**
+ * Submit a batch of reads and wait for all of them to complete
+ *
+ * @param mg Handle as initialized with xnvme_mget_init()
+ * @param nsid Namespace Identifier
+ * @param items Array of reads, the completion of each is stored in it
+ * @param nitems Number of items in the array
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EIO when any of the items completed with an error status.
+ */
+int
+xnvme_mget_read(struct xnvme_mget *mg, uint32_t nsid,
+		struct xnvme_mget_item *items, uint32_t nitems);
+
+/**
+ * Release the given handle, reads submitted via it must have completed
+ *
+ * @param mg Handle as initialized with xnvme_mget_init()
+ */
+void
+xnvme_mget_term(struct xnvme_mget *mg);
+
+/**
+ * Opaque group of buffers, from which buffers for reads are selected when
+ * data arrives rather than when the read is submitted
+ *
+ * @see xnvme_bufgrp_init
+ *
+ * @struct xnvme_bufgrp
+ */
+struct xnvme_bufgrp;
+
+/**
+ * Allocate a group of 'nbufs' buffers of 'buf_nbytes' each, for reads
+ * submitted via xnvme_bufgrp_read() on the given asynchronous context
+ *
+ * On liou, the buffers are provided to the kernel (IORING_OP_PROVIDE_BUFFERS)
+ * and a buffer is selected when the read completes, thus, the amount of
+ * outstanding reads is not bound by the amount of buffers. On other backends,
+ * and kernels without provided buffers, the buffer is taken from a
+ * library-managed pool at submission.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context as initialized with xnvme_async_init()
+ * @param nbufs Amount of buffers in the group, at most 65536
+ * @param buf_nbytes Size of each buffer in bytes
+ * @param grp Pointer to the buffer-group to initialize
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_bufgrp_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		  uint32_t nbufs, uint32_t buf_nbytes,
+		  struct xnvme_bufgrp **grp);
+
+/**
+ * Tear down the given buffer-group, reads via the group must have completed
+ *
+ * @param grp The buffer-group to tear down
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_bufgrp_term(struct xnvme_bufgrp *grp);
+
+/**
+ * Submit a read of 'nlb' + 1 LBAs, starting at 'slba', into a buffer from the
+ * given group. The buffer is available via 'req->async.dbuf' on completion,
+ * and must be handed back with xnvme_bufgrp_put() when it is non-NULL, which
+ * it can be on error as well.
+ *
+ * @param grp Buffer-group as initialized with xnvme_bufgrp_init()
+ * @param nsid Namespace Identifier
+ * @param slba Start LBA
+ * @param nlb The number of LBAs to read. NOTE: nlb is a zero-based value
+ * @param req Request with 'async.cb' and 'async.cb_arg' set
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EBUSY when the library-managed pool is exhausted.
+ */
+int
+xnvme_bufgrp_read(struct xnvme_bufgrp *grp, uint32_t nsid, uint64_t slba,
+		  uint16_t nlb, struct xnvme_req *req);
+
+/**
+ * Hand a buffer, as obtained via 'req->async.dbuf', back to the given group
+ *
+ * @param grp Buffer-group as initialized with xnvme_bufgrp_init()
+ * @param buf The buffer to hand back
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EAGAIN when the buffer could not be provided due to a full submission
+ * queue, in which case the call can be retried after reaping completions.
+ */
+int
+xnvme_bufgrp_put(struct xnvme_bufgrp *grp, void *buf);
+
+#define XNVME_GCOMMIT_DEPTH 64
+
+/**
+ * Enable group commit of the synchronous IO commands of the given device
+ *
+ * Reads, writes and flushes without meta-data, submitted with XNVME_CMD_SYNC
+ * from any thread, are then funnelled into a shared asynchronous context of
+ * the given 'depth'; one of the waiting callers submits the pending commands
+ * as a batch and processes completions on behalf of all callers, each caller
+ * is woken on its own completion. Other commands are passed on as is, as are
+ * flushes on backends whose asynchronous path does not serve them, e.g. laio.
+ *
+ * Group commit can also be enabled with the device identifier option
+ * 'gcommit=1', using a depth of XNVME_GCOMMIT_DEPTH.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param depth Depth of the shared asynchronous context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_gcommit_init(struct xnvme_dev *dev, uint16_t depth);
+
+/**
+ * Disable group commit, there must be no synchronous commands in-flight
+ *
+ * @param dev Device handle with group commit enabled by xnvme_gcommit_init()
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_gcommit_term(struct xnvme_dev *dev);
+
+/**
+ * Statistics of a simulated device, that is, a device opened via the 'sim'
+ * backend; all times are in nanoseconds of virtual time
+ *
+ * @struct xnvme_sim_stats
+ */
+struct xnvme_sim_stats {
+	uint64_t now;		///< The virtual clock of the device
+	uint64_t nreads;	///< Number of reads submitted
+	uint64_t nwrites;	///< Number of writes submitted
+	uint64_t nflushes;	///< Number of flushes submitted
+	uint64_t read_nbytes;	///< Number of bytes read
+	uint64_t write_nbytes;	///< Number of bytes written
+	uint64_t busy;		///< Service time accumulated over all channels
+	uint64_t gc_nstalls;	///< Number of garbage-collection stalls
+	uint64_t gc_stall;	///< Stall time accumulated over all channels
+};
+
+/**
+ * Retrieve the virtual clock of the given simulated device
+ *
+ * Time only advances when commands are completed; by synchronous commands, by
+ * xnvme_async_poke() / xnvme_async_wait() and by xnvme_sim_run()
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() of a 'sim' uri
+ * @param now Pointer to the virtual time, in nanoseconds
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_sim_get_time(struct xnvme_dev *dev, uint64_t *now);
+
+/**
+ * Advance the virtual clock of the given simulated device to 'until',
+ * completing, in order of completion time, the commands of the given context
+ * which are due by then
+ *
+ * The clock is at the completion time of the command when its callback is
+ * invoked; commands submitted by the callback are thus timed from then on.
+ * This is what allows modelling open-loop arrivals, which
+ * xnvme_async_poke() does not, as it advances the clock to the next
+ * completion whenever nothing is due.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() of a 'sim' uri
+ * @param ctx Asynchronous context, NULL to advance the clock only
+ * @param until The virtual time to advance to, in nanoseconds, the clock is
+ * left as is when it is already past it
+ *
+ * @return On success, the number of completions processed is returned. On
+ * error, negative `errno` is returned.
+ */
+int
+xnvme_sim_run(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+	      uint64_t until);
+
+/**
+ * Retrieve the statistics of the given simulated device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() of a 'sim' uri
+ * @param stats Pointer to the statistics to fill
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_sim_get_stats(struct xnvme_dev *dev, struct xnvme_sim_stats *stats);
+
+/**
+ * Prints the given ::xnvme_sim_stats to the given output stream
+ *
+ * @param stream output stream used for printing
+ * @param stats pointer to the statistics to print
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned.
+ */
+int
+xnvme_sim_stats_fpr(FILE *stream, const struct xnvme_sim_stats *stats,
+		    int opts);
+
+/**
+ * Prints the given ::xnvme_sim_stats to stdout
+ *
+ * @param stats pointer to the statistics to print
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned.
+ */
+int
+xnvme_sim_stats_pr(const struct xnvme_sim_stats *stats, int opts);
+
 /**
  * Representation of the type of device / geo / namespace
  *
@@ -776,7 +1176,8 @@ xnvme_req_cpl_status(struct xnvme_req *req)
 enum xnvme_geo_type {
 	XNVME_GEO_UNKNOWN = 0x0,
 	XNVME_GEO_CONVENTIONAL = 0x1,
-	XNVME_GEO_ZONED = 0x2
+	XNVME_GEO_ZONED = 0x2,
+	XNVME_GEO_KV = 0x3
 };
 
 /**
@@ -806,7 +1207,16 @@ struct xnvme_geo {
 	uint32_t lba_nbytes;	///< Size of an LBA in bytes
 	uint8_t lba_extended;	///< Extended LBA: 1=Supported, 0=Not-Supported
 
-	uint8_t _rsvd[15];
+	uint8_t _pad;
+
+	// Optimal IO boundaries in unit of LBAs, NOTE: zero-based values,
+	// 0 when not reported by the device
+	uint16_t npwg;		///< Preferred write granularity
+	uint16_t npwa;		///< Preferred write alignment
+	uint16_t npdg;		///< Preferred deallocate granularity
+	uint16_t nows;		///< Optimal write size
+
+	uint8_t _rsvd[6];
 };
 XNVME_STATIC_ASSERT(sizeof(struct xnvme_geo) == 64, "Incorrect size")
 
@@ -1104,7 +1514,9 @@ xnvme_cmd_sanitize(struct xnvme_dev *dev, uint8_t sanact, uint8_t ause,
  * @param opts command options, see ::xnvme_cmd_opts
  * @param req Pointer to structure for NVMe completion and async. context
  *
- * @return On success, 0 is returned. On error, negative `errno` is returned.
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EINVAL when 'dev' has no LBA size, e.g. a controller handle, see
+ * xnvme_dev_get_nslist()
  */
 int
 xnvme_cmd_write(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
@@ -1123,13 +1535,71 @@ xnvme_cmd_write(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
  * @param opts command options, see ::xnvme_cmd_opts
  * @param req Pointer to structure for NVMe completion and async. context
  *
- * @return On success, 0 is returned. On error, negative `errno` is returned.
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EINVAL when 'dev' has no LBA size, e.g. a controller handle, see
+ * xnvme_dev_get_nslist()
  */
 int
 xnvme_cmd_read(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	       uint16_t nlb, void *dbuf, void *mbuf, int opts,
 	       struct xnvme_req *req);
 
+/**
+ * Prepared command, a template built once with xnvme_cmd_prep_init() and
+ * submitted via xnvme_cmd_prep_pass(), which patches only the LBA-range of the
+ * template, thus avoiding setting up a command for every IO
+ *
+ * Command-fields not covered by xnvme_cmd_prep_init(), e.g. FUA, can be set
+ * directly in 'cmd' after initialization.
+ *
+ * NOTE: the template is modified on submission, thus a prepared command must
+ * only be used by a single thread at a time
+ *
+ * @struct xnvme_cmd_prep
+ */
+struct xnvme_cmd_prep {
+	struct xnvme_spec_cmd cmd;	///< Command-template
+	struct xnvme_dev *dev;		///< Device to submit to
+	uint32_t lba_nbytes;		///< Data-payload bytes per LBA
+	uint32_t oob_nbytes;		///< Meta-payload bytes per LBA
+	int opts;			///< Command options, see ::xnvme_cmd_opts
+};
+
+/**
+ * Initialize the given prepared command for an IO command with the LBA-range
+ * layout of Read / Write, that is, 'slba' in cdw10-11 and 'nlb' in cdw12
+ *
+ * @param prep Pointer to the prepared command to initialize
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param opcode Command opcode, e.g. XNVME_SPEC_OPC_READ
+ * @param nsid Namespace Identifier
+ * @param opts command options, see ::xnvme_cmd_opts
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EINVAL when 'dev' has no LBA size, e.g. a controller handle
+ */
+int
+xnvme_cmd_prep_init(struct xnvme_cmd_prep *prep, struct xnvme_dev *dev,
+		    uint8_t opcode, uint32_t nsid, int opts);
+
+/**
+ * Submit, and optionally wait for completion of, an instance of the given
+ * prepared command
+ *
+ * @param prep Pointer to a prepared command initialized by
+ * xnvme_cmd_prep_init()
+ * @param slba The LBA to start the command at
+ * @param nlb The number of LBAs. NOTE: nlb is a zero-based value
+ * @param dbuf Pointer to data-payload
+ * @param mbuf Pointer to meta-payload
+ * @param req Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_cmd_prep_pass(struct xnvme_cmd_prep *prep, uint64_t slba, uint16_t nlb,
+		    void *dbuf, void *mbuf, struct xnvme_req *req);
+
 /**
  * Creates a handle to given device identifier
  *
@@ -1239,6 +1709,57 @@ xnvme_dev_get_nsid(const struct xnvme_dev *dev);
 uint8_t
 xnvme_dev_get_csi(const struct xnvme_dev *dev);
 
+/**
+ * Retrieve the identifiers of the active namespaces of the controller
+ * associated with the given device, in increasing order
+ *
+ * A controller handle, e.g. via SPDK with 'nsid=0', has no namespace of its
+ * own; IO is issued to any of its namespaces by setting the nsid of the
+ * command, thus one asynchronous context serves all namespaces. The geometry
+ * of the handle has no LBA size, thus xnvme_cmd_read(), xnvme_cmd_write() and
+ * xnvme_cmd_prep_init() fail with -EINVAL; IO is issued via xnvme_cmd_pass()
+ * with the payload size given explicitly, from the geometry retrieved with
+ * xnvme_dev_get_ns_geo().
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsids Array to store the namespace identifiers in
+ * @param nnsids Length of the 'nsids' array
+ *
+ * @return On success, the number of active namespaces is returned, which can
+ * exceed 'nnsids'. On error, negative `errno` is returned.
+ */
+int
+xnvme_dev_get_nslist(struct xnvme_dev *dev, uint32_t *nsids, uint32_t nnsids);
+
+/**
+ * Derive the geometry of the given namespace via the given device, e.g. for
+ * the namespaces of a controller handle
+ *
+ * NOTE: the namespace is described as conventional, that is, zoned specifics
+ * are not derived
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param geo Pointer to the geometry to fill
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_dev_get_ns_geo(struct xnvme_dev *dev, uint32_t nsid,
+		     struct xnvme_geo *geo);
+
+/**
+ * Returns the number of commands whose payload was staged via a bounce-buffer
+ * by the backend, since `dev` was opened, as done by the SPDK backend for
+ * buffers not allocated with xnvme_buf_alloc()
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ *
+ * @return The number of bounced commands is returned.
+ */
+uint64_t
+xnvme_dev_get_nbounced(const struct xnvme_dev *dev);
+
 /**
  * Returns the internal backend state of the given `dev`
  *
@@ -1260,6 +1781,440 @@ xnvme_dev_get_be_state(const struct xnvme_dev *dev);
  */
 uint64_t xnvme_dev_get_ssw(const struct xnvme_dev *dev);
 
+/**
+ * Opaque read-ahead handle as provided by xnvme_prefetch_init()
+ *
+ * Detects sequential streams among reads issued via xnvme_prefetch_read()
+ * and reads ahead of them, asynchronously, into a pool of buffers. The
+ * read-ahead window of a stream starts at a single buffer and doubles every
+ * time the stream continues sequentially. Reads covered by prefetched
+ * buffers are served from them, otherwise they are issued synchronously.
+ *
+ * @note A handle is not thread-safe; use a handle per thread
+ *
+ * @struct xnvme_prefetch
+ */
+struct xnvme_prefetch;
+
+/**
+ * Read-ahead statistics
+ *
+ * @struct xnvme_prefetch_stats
+ */
+struct xnvme_prefetch_stats {
+	uint64_t hits;		///< Reads served entirely by prefetched buffers
+	uint64_t misses;	///< Reads issued, fully or in part, to device
+	uint64_t prefetched;	///< Number of read-ahead commands submitted
+	uint64_t wasted;	///< Prefetched buffers dropped without being read
+};
+
+/**
+ * Setup read-ahead for the given device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param pf Pointer-pointer to the initialized handle
+ * @param nbufs Number of read-ahead buffers, also the maximum number of
+ * outstanding read-ahead commands, must be a power of 2 in the range [1,4096]
+ * @param buf_nbytes Size of each read-ahead buffer in bytes, must be a
+ * multiple of the LBA size, 0 means the maximum-data-transfer-size
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_prefetch_init(struct xnvme_dev *dev, struct xnvme_prefetch **pf,
+		    uint16_t nbufs, uint32_t buf_nbytes);
+
+/**
+ * Wait for outstanding read-ahead and release the given handle
+ *
+ * @param pf Handle as initialized with xnvme_prefetch_init()
+ */
+void
+xnvme_prefetch_term(struct xnvme_prefetch *pf);
+
+/**
+ * Read via the given read-ahead handle, semantics as xnvme_cmd_read() with
+ * XNVME_CMD_SYNC and without meta-data
+ *
+ * @param pf Handle as initialized with xnvme_prefetch_init()
+ * @param nsid Namespace Identifier
+ * @param slba The LBA to start reading from
+ * @param nlb The number of LBAs to read. NOTE: nlb is a zero-based value
+ * @param dbuf Pointer to data-payload
+ * @param req Pointer to structure for NVMe completion
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_prefetch_read(struct xnvme_prefetch *pf, uint32_t nsid, uint64_t slba,
+		    uint16_t nlb, void *dbuf, struct xnvme_req *req);
+
+/**
+ * Drop prefetched data in the given LBA range, e.g. when it is written by
+ * other means than the read-ahead handle
+ *
+ * @param pf Handle as initialized with xnvme_prefetch_init()
+ * @param slba The first LBA of the range
+ * @param nlb The number of LBAs in the range. NOTE: nlb is a zero-based value
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_prefetch_invalidate(struct xnvme_prefetch *pf, uint64_t slba,
+			  uint16_t nlb);
+
+/**
+ * Retrieve the read-ahead statistics of the given handle
+ *
+ * @param pf Handle as initialized with xnvme_prefetch_init()
+ *
+ * @return On success, pointer to statistics is returned.
+ */
+const struct xnvme_prefetch_stats *
+xnvme_prefetch_get_stats(const struct xnvme_prefetch *pf);
+
+/**
+ * Prints the given ::xnvme_prefetch_stats to the given output stream
+ *
+ * @param stream output stream used for printing
+ * @param stats pointer to the statistics to print
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned.
+ */
+int
+xnvme_prefetch_stats_fpr(FILE *stream, const struct xnvme_prefetch_stats *stats,
+			 int opts);
+
+/**
+ * Prints the given ::xnvme_prefetch_stats to stdout
+ *
+ * @param stats pointer to the statistics to print
+ * @param opts printer options, see ::xnvme_pr
+ *
+ * @return On success, the number of characters printed is returned.
+ */
+int
+xnvme_prefetch_stats_pr(const struct xnvme_prefetch_stats *stats, int opts);
+
+/**
+ * Opaque ordered read-stream over a range of LBAs, as provided by
+ * xnvme_rstream_init()
+ *
+ * The range is read in chunks via a ring of buffers with one entry more than
+ * the queue-depth. Chunks are read asynchronously, and handed out by
+ * xnvme_rstream_next() in LBA order as they complete. A chunk is re-used, for
+ * reading a following part of the range, when returned by xnvme_rstream_put().
+ * Memory use is thus bounded by the ring, regardless of the size of the range,
+ * and the device is kept at the given queue-depth as long as the caller holds
+ * no more than a single chunk at a time.
+ *
+ * @note A handle is not thread-safe; use a handle per thread
+ *
+ * @struct xnvme_rstream
+ */
+struct xnvme_rstream;
+
+/**
+ * A chunk of the range as handed out by xnvme_rstream_next()
+ *
+ * @struct xnvme_rstream_chunk
+ */
+struct xnvme_rstream_chunk {
+	uint64_t slba;		///< First LBA of the chunk
+	uint32_t nlb;		///< Number of LBAs in the chunk, NOT zero-based
+	uint32_t nbytes;	///< Size of the chunk in bytes
+	void *buf;		///< Payload of the chunk
+};
+
+/**
+ * Setup a read-stream over the LBAs [slba, elba] of the given device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param rs Pointer-pointer to the initialized handle
+ * @param nsid Namespace Identifier
+ * @param slba The first LBA of the range
+ * @param elba The last LBA of the range
+ * @param chunk_nbytes Size of each chunk in bytes, must be a multiple of the
+ * LBA size and at most the maximum-data-transfer-size, as each chunk is read
+ * with a single command, 0 means the maximum-data-transfer-size. On zoned
+ * devices, chunks are clipped at zone boundaries.
+ * @param qd Maximum number of outstanding reads, must be a power of 2 in the
+ * range [1,2048]
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_rstream_init(struct xnvme_dev *dev, struct xnvme_rstream **rs,
+		   uint32_t nsid, uint64_t slba, uint64_t elba,
+		   uint32_t chunk_nbytes, uint16_t qd);
+
+/**
+ * Retrieve the next chunk of the range, in LBA order, waiting for it when it
+ * is still being read
+ *
+ * @note The chunk is held by the caller until returned via xnvme_rstream_put()
+ *
+ * @param rs Handle as initialized with xnvme_rstream_init()
+ * @param chunk Pointer to the next chunk, NULL when the range is exhausted
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * -EIO when reading the chunk failed, and -ENOBUFS when all chunks of the ring
+ * are held by the caller.
+ */
+int
+xnvme_rstream_next(struct xnvme_rstream *rs,
+		   struct xnvme_rstream_chunk **chunk);
+
+/**
+ * Return a chunk obtained with xnvme_rstream_next() for re-use
+ *
+ * @param rs Handle as initialized with xnvme_rstream_init()
+ * @param chunk The chunk to return
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_rstream_put(struct xnvme_rstream *rs, struct xnvme_rstream_chunk *chunk);
+
+/**
+ * Wait for outstanding reads and release the given handle, including the
+ * buffers of chunks not returned
+ *
+ * @param rs Handle as initialized with xnvme_rstream_init()
+ */
+void
+xnvme_rstream_term(struct xnvme_rstream *rs);
+
+/**
+ * Options for write-aggregation, see xnvme_aggr_init()
+ *
+ * @enum xnvme_aggr_opts
+ */
+enum xnvme_aggr_opts {
+	XNVME_AGGR_WRITE = 0x0,		///< Flush via Write at a write-pointer
+	XNVME_AGGR_APPEND = 0x1,	///< Flush via Zone Append
+	XNVME_AGGR_FUA = 0x2,		///< Flush with Force-Unit-Access
+};
+
+/**
+ * Mapping of an aggregated record to its location on the device
+ *
+ * @struct xnvme_aggr_rec
+ */
+struct xnvme_aggr_rec {
+	uint64_t id;		///< Identifier as returned by xnvme_aggr_put()
+	uint64_t lba;		///< LBA at which the record starts
+	uint32_t ofz;		///< Offset, in bytes, of the record within 'lba'
+	uint32_t nbytes;	///< Size of the record in bytes
+};
+
+/**
+ * Opaque write-aggregation handle as provided by xnvme_aggr_init()
+ *
+ * Records are appended to a staging buffer, which is written, as a single
+ * command, when full or when explicitly flushed. Each handle is a stream
+ * with its own buffer, e.g. a handle per zone. Writes are padded to the
+ * preferred write granularity of the namespace, when reported.
+ *
+ * @struct xnvme_aggr
+ */
+struct xnvme_aggr;
+
+/**
+ * Signature of the function called when a buffer is flushed, providing the
+ * mapping of the records written by it
+ *
+ * @param recs Array of mappings, valid for the duration of the call only
+ * @param nrecs Number of mappings in 'recs'
+ * @param err 0 when the records are written, negative `errno` otherwise
+ * @param cb_arg User callback argument
+ */
+typedef void (*xnvme_aggr_cb)(const struct xnvme_aggr_rec *recs,
+			      uint32_t nrecs, int err, void *cb_arg);
+
+/**
+ * Setup write-aggregation for the given device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param aggr Pointer-pointer to the initialized handle
+ * @param nsid Namespace Identifier
+ * @param slba With XNVME_AGGR_WRITE the LBA to write from, which must be
+ * aligned to the preferred write alignment (npwa) when reported, with
+ * XNVME_AGGR_APPEND the first LBA of the Zone to append to
+ * @param buf_nbytes Size of the staging buffer in bytes, bounded by the
+ * maximum-data-transfer-size, 0 means the largest multiple of the optimal
+ * write size, or preferred write granularity, within the
+ * maximum-data-transfer-size
+ * @param opts Aggregation options, see ::xnvme_aggr_opts
+ * @param cb Function called when a buffer is flushed
+ * @param cb_arg User callback argument
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_aggr_init(struct xnvme_dev *dev, struct xnvme_aggr **aggr, uint32_t nsid,
+		uint64_t slba, uint32_t buf_nbytes, int opts, xnvme_aggr_cb cb,
+		void *cb_arg);
+
+/**
+ * Add a record to the staging buffer, flushing the buffer when the record
+ * does not fit, or when it is filled by the record
+ *
+ * @param aggr Handle as initialized with xnvme_aggr_init()
+ * @param rec Pointer to the record
+ * @param nbytes Size of the record in bytes, at most the buffer size
+ * @param id Pointer to store the record identifier, may be NULL
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_aggr_put(struct xnvme_aggr *aggr, const void *rec, uint32_t nbytes,
+	       uint64_t *id);
+
+/**
+ * Write the staging buffer, padded with zeros to a multiple of the LBA size
+ *
+ * @param aggr Handle as initialized with xnvme_aggr_init()
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_aggr_flush(struct xnvme_aggr *aggr);
+
+/**
+ * Flush and release the given handle
+ *
+ * @param aggr Handle as initialized with xnvme_aggr_init()
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_aggr_term(struct xnvme_aggr *aggr);
+
+/**
+ * Options for memory-mapped views, see xnvme_mmap()
+ *
+ * @enum xnvme_mmap_opts
+ */
+enum xnvme_mmap_opts {
+	XNVME_MMAP_RDWR = 0x0,		///< Map for reading and writing
+	XNVME_MMAP_RDONLY = 0x1,	///< Map for reading only
+};
+
+/**
+ * Opaque memory-mapped view of a range of LBAs, as provided by xnvme_mmap()
+ *
+ * Virtual address space is reserved for the range, and page faults on it are
+ * serviced via userfaultfd by a thread of the handle, reading the faulting
+ * block, that is, a page or an LBA when larger, via an asynchronous context.
+ * Sequential faults grow a read-ahead window, doubling on every continuation
+ * of the stream. The number of resident blocks is bounded, blocks are evicted
+ * in the order they became resident, with modified blocks written back via
+ * xnvme_cmd_write() on eviction and on xnvme_msync(). Modifications are
+ * tracked by installing blocks write-protected and releasing them on the
+ * first write.
+ *
+ * @note The view is private to the process, and only consistent with the
+ * device as long as the range is not written by other means
+ * @note Linux only, requires userfaultfd with write-protect support for
+ * ::XNVME_MMAP_RDWR
+ *
+ * @struct xnvme_mmap
+ */
+struct xnvme_mmap;
+
+/**
+ * Memory-mapped view statistics
+ *
+ * @struct xnvme_mmap_stats
+ */
+struct xnvme_mmap_stats {
+	uint64_t faults;	///< Faults on blocks neither resident nor read ahead
+	uint64_t hits;		///< Faults on blocks being read ahead
+	uint64_t prefetched;	///< Number of blocks read ahead
+	uint64_t evicted;	///< Number of blocks evicted
+	uint64_t written;	///< Number of blocks written back
+};
+
+/**
+ * Create a memory-mapped view of a range of LBAs of the given device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param map Pointer-pointer to the initialized handle
+ * @param slba The first LBA of the range
+ * @param nlb The number of LBAs in the range, 0 means through the last LBA.
+ * NOTE: nlb is NOT a zero-based value
+ * @param resident_nbytes Upper bound on the memory occupied by resident
+ * blocks, 0 means 64MiB
+ * @param opts Mapping options, see ::xnvme_mmap_opts
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_mmap(struct xnvme_dev *dev, struct xnvme_mmap **map, uint64_t slba,
+	   uint64_t nlb, uint64_t resident_nbytes, int opts);
+
+/**
+ * Retrieve the address at which the first LBA of the range is mapped
+ *
+ * @param map Handle as initialized with xnvme_mmap()
+ *
+ * @return On success, the start address of the view is returned.
+ */
+void *
+xnvme_mmap_get_addr(const struct xnvme_mmap *map);
+
+/**
+ * Retrieve the size of the view in bytes, that is, the range rounded up to a
+ * multiple of the block size
+ *
+ * @param map Handle as initialized with xnvme_mmap()
+ *
+ * @return On success, the size of the view in bytes is returned.
+ */
+uint64_t
+xnvme_mmap_get_nbytes(const struct xnvme_mmap *map);
+
+/**
+ * Write back the modified blocks of a part of the view, and wait for blocks
+ * written back on eviction, followed by a flush when the device has a
+ * volatile write cache
+ *
+ * @param map Handle as initialized with xnvme_mmap()
+ * @param ofz Offset, in bytes, of the part within the view
+ * @param nbytes Size of the part in bytes, 0 means through the end of the view
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * this includes errors of write-back on eviction since the previous call.
+ */
+int
+xnvme_msync(struct xnvme_mmap *map, uint64_t ofz, uint64_t nbytes);
+
+/**
+ * Retrieve the statistics of the given view
+ *
+ * @note The statistics are updated by the fault-handler without
+ * synchronization, values read while the view is in use are approximate
+ *
+ * @param map Handle as initialized with xnvme_mmap()
+ *
+ * @return On success, pointer to statistics is returned.
+ */
+const struct xnvme_mmap_stats *
+xnvme_mmap_get_stats(const struct xnvme_mmap *map);
+
+/**
+ * Write back the modified blocks of the view, then unmap it and release the
+ * given handle; the handle is released regardless of the outcome
+ *
+ * @param map Handle as initialized with xnvme_mmap()
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_munmap(struct xnvme_mmap *map);
+
 #ifdef __cplusplus
 }
 #endif
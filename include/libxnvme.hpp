@@ -0,0 +1,454 @@
+/**
+ * Header-only C++20 coroutine binding for the xNVMe asynchronous interface
+ *
+ * Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Commands are submitted via an #xnvme_async_ctx with the #xnvme_req embedded
+ * in the awaitable, that is, in the frame of the awaiting coroutine, thus no
+ * heap-allocation is done per command. An xnvme::executor owns the context
+ * and drives completions via xnvme_async_poke(), resuming the awaiting
+ * coroutine from the completion-callback.
+ *
+ * Errors are not thrown, the awaitables produce an int, 0 on success and
+ * negative `errno` on error, as does the rest of the xNVMe API.
+ *
+ * Example:
+ *
+ *   xnvme::task scan(xnvme::device &dev, void *buf)
+ *   {
+ *           for (uint64_t slba = 0; slba < 1024; slba += 8) {
+ *                   int err = co_await dev.read(slba, 7, buf);
+ *                   if (err) {
+ *                           co_return;
+ *                   }
+ *           }
+ *   }
+ *
+ *   xnvme::executor exec;
+ *   exec.init(xdev, 16, 0);
+ *   xnvme::device dev(xdev, exec);
+ *   exec.spawn(scan(dev, buf));
+ *   exec.run();
+ *
+ * @file libxnvme.hpp
+ */
+#ifndef __LIBXNVME_HPP
+#define __LIBXNVME_HPP
+
+#if __cplusplus < 202002L
+#error "libxnvme.hpp requires C++20"
+#endif
+
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+#include <libxnvme.h>
+
+namespace xnvme {
+
+class executor;
+
+/**
+ * Coroutine return-type for tasks driven by an xnvme::executor
+ *
+ * A task is lazily started; either by handing it to executor::spawn() or by
+ * co_await'ing it from another task. When awaited, the awaiting coroutine is
+ * resumed via symmetric transfer once the task has finished.
+ */
+class task {
+public:
+	struct promise_type {
+		std::coroutine_handle<> continuation{};
+		executor *owner = nullptr;	///< Set for spawned tasks
+
+		task get_return_object() noexcept
+		{
+			return task{handle::from_promise(*this)};
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		struct final_awaiter {
+			bool await_ready() noexcept { return false; }
+
+			std::coroutine_handle<>
+			await_suspend(std::coroutine_handle<promise_type> h)
+			noexcept;
+
+			void await_resume() noexcept {}
+		};
+
+		final_awaiter final_suspend() noexcept { return {}; }
+
+		void return_void() noexcept {}
+
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+
+	using handle = std::coroutine_handle<promise_type>;
+
+	task(task &&other) noexcept : h(std::exchange(other.h, {})) {}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+
+	~task()
+	{
+		if (h) {
+			h.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept { return !h || h.done(); }
+
+	std::coroutine_handle<>
+	await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		h.promise().continuation = awaiting;
+		return h;
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	friend class executor;
+
+	explicit task(handle h) noexcept : h(h) {}
+
+	handle h;
+};
+
+/**
+ * Awaitable for a single command, the #xnvme_req lives in the awaitable and
+ * thus in the frame of the awaiting coroutine
+ */
+class io {
+public:
+	io(executor &exec, const struct xnvme_spec_cmd &cmd, void *dbuf,
+	   size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes) noexcept
+		: exec(exec), cmd(cmd), dbuf(dbuf), dbuf_nbytes(dbuf_nbytes),
+		  mbuf(mbuf), mbuf_nbytes(mbuf_nbytes)
+	{
+	}
+
+	io(const io &) = delete;
+	io &operator=(const io &) = delete;
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> h) noexcept;
+
+	/**
+	 * @return On success, 0 is returned. On error, negative `errno` is
+	 * returned; -EIO when the command completed with an error-status, in
+	 * which case the completion is available via req()
+	 */
+	int await_resume() const noexcept
+	{
+		if (err) {
+			return err;
+		}
+
+		return xnvme_req_cpl_status(const_cast<struct xnvme_req *>(&rq)) ? -EIO : 0;
+	}
+
+	const struct xnvme_req &req() const noexcept { return rq; }
+
+private:
+	friend class executor;
+
+	static void
+	cb(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+	{
+		auto self = static_cast<io *>(cb_arg);
+
+		self->awaiting.resume();
+	}
+
+	int submit() noexcept;
+
+	executor &exec;
+	struct xnvme_spec_cmd cmd;
+	void *dbuf;
+	size_t dbuf_nbytes;
+	void *mbuf;
+	size_t mbuf_nbytes;
+
+	struct xnvme_req rq = {};
+	std::coroutine_handle<> awaiting{};
+	io *next = nullptr;		///< Link for the executor backlog
+	int err = 0;
+};
+
+/**
+ * Owner of an #xnvme_async_ctx, drives completions and the tasks spawned on
+ * it; an executor must only be used from a single thread
+ */
+class executor {
+public:
+	executor() noexcept = default;
+	executor(const executor &) = delete;
+	executor &operator=(const executor &) = delete;
+
+	~executor()
+	{
+		term();
+	}
+
+	/**
+	 * Initialize the asynchronous context, see xnvme_async_init()
+	 *
+	 * @return On success, 0 is returned. On error, negative `errno` is
+	 * returned.
+	 */
+	int init(struct xnvme_dev *dev, uint16_t depth, int flags) noexcept
+	{
+		this->dev = dev;
+
+		return xnvme_async_init(dev, &ctx, depth, flags);
+	}
+
+	/**
+	 * Wait for outstanding commands and tear down the asynchronous context
+	 */
+	int term() noexcept
+	{
+		int err;
+
+		if (!ctx) {
+			return 0;
+		}
+
+		xnvme_async_wait(dev, ctx);
+		err = xnvme_async_term(dev, ctx);
+		ctx = nullptr;
+
+		return err;
+	}
+
+	/**
+	 * Start the given task, the executor takes ownership of it and
+	 * destroys it once it has run to completion
+	 */
+	void spawn(task &&t) noexcept
+	{
+		auto h = std::exchange(t.h, {});
+
+		h.promise().owner = this;
+		++nspawned;
+		h.resume();
+	}
+
+	/**
+	 * Process completions and resubmit backlogged commands
+	 *
+	 * @return On success, number of completions processed. On error,
+	 * negative `errno` is returned.
+	 */
+	int poke(uint32_t max = 0) noexcept
+	{
+		int ret = xnvme_async_poke(dev, ctx, max);
+
+		if (ret < 0) {
+			return ret;
+		}
+
+		drain_backlog();
+
+		return ret;
+	}
+
+	/**
+	 * Drive completions until all spawned tasks have finished
+	 *
+	 * @return On success, 0 is returned. On error, negative `errno` is
+	 * returned.
+	 */
+	int run() noexcept
+	{
+		while (nspawned) {
+			int err = poke();
+
+			if (err < 0) {
+				return err;
+			}
+		}
+
+		return 0;
+	}
+
+	struct xnvme_dev *get_dev() const noexcept { return dev; }
+
+	struct xnvme_async_ctx *get_ctx() const noexcept { return ctx; }
+
+	uint32_t get_outstanding() const noexcept
+	{
+		return xnvme_async_get_outstanding(ctx);
+	}
+
+private:
+	friend class io;
+	friend struct task::promise_type::final_awaiter;
+
+	// Commands which could not be submitted, due to a full queue, are
+	// queued here and resubmitted after completions are processed
+	void backlog(io *cmd) noexcept
+	{
+		cmd->next = nullptr;
+		if (backlog_tail) {
+			backlog_tail->next = cmd;
+		} else {
+			backlog_head = cmd;
+		}
+		backlog_tail = cmd;
+	}
+
+	void drain_backlog() noexcept
+	{
+		while (backlog_head) {
+			io *cmd = backlog_head;
+			int err = cmd->submit();
+
+			if ((err == -EBUSY) || (err == -EAGAIN)) {
+				return;
+			}
+
+			backlog_head = cmd->next;
+			if (!backlog_head) {
+				backlog_tail = nullptr;
+			}
+			if (err) {
+				cmd->err = err;
+				cmd->awaiting.resume();
+			}
+		}
+	}
+
+	struct xnvme_dev *dev = nullptr;
+	struct xnvme_async_ctx *ctx = nullptr;
+	io *backlog_head = nullptr;
+	io *backlog_tail = nullptr;
+	uint64_t nspawned = 0;
+};
+
+inline std::coroutine_handle<>
+task::promise_type::final_awaiter::await_suspend(
+	std::coroutine_handle<promise_type> h) noexcept
+{
+	auto &promise = h.promise();
+
+	if (promise.owner) {
+		promise.owner->nspawned -= 1;
+		h.destroy();
+		return std::noop_coroutine();
+	}
+	if (promise.continuation) {
+		return promise.continuation;
+	}
+
+	return std::noop_coroutine();
+}
+
+inline int
+io::submit() noexcept
+{
+	rq.async.ctx = exec.ctx;
+	rq.async.cb = cb;
+	rq.async.cb_arg = this;
+
+	return xnvme_cmd_pass(exec.dev, &cmd, dbuf, dbuf_nbytes, mbuf,
+			      mbuf_nbytes, XNVME_CMD_ASYNC, &rq);
+}
+
+inline bool
+io::await_suspend(std::coroutine_handle<> h) noexcept
+{
+	awaiting = h;
+
+	if (exec.backlog_head) {	// Preserve submission order
+		exec.backlog(this);
+		return true;
+	}
+
+	err = submit();
+	switch (err) {
+	case 0:
+		return true;
+
+	case -EBUSY:
+	case -EAGAIN:
+		err = 0;
+		exec.backlog(this);
+		return true;
+
+	default:
+		return false;		// Resume immediately, with error
+	}
+}
+
+/**
+ * Namespace bound to an executor, producing awaitable commands
+ */
+class device {
+public:
+	device(struct xnvme_dev *dev, executor &exec) noexcept
+		: dev(dev), exec(exec), nsid(xnvme_dev_get_nsid(dev)),
+		  lba_nbytes(xnvme_dev_get_geo(dev)->lba_nbytes)
+	{
+	}
+
+	/**
+	 * Read 'nlb' + 1 LBAs starting at 'slba', NOTE: nlb is zero-based
+	 */
+	io read(uint64_t slba, uint16_t nlb, void *dbuf) noexcept
+	{
+		return rw(XNVME_SPEC_OPC_READ, slba, nlb, dbuf);
+	}
+
+	/**
+	 * Write 'nlb' + 1 LBAs starting at 'slba', NOTE: nlb is zero-based
+	 */
+	io write(uint64_t slba, uint16_t nlb, const void *dbuf) noexcept
+	{
+		return rw(XNVME_SPEC_OPC_WRITE, slba, nlb,
+			  const_cast<void *>(dbuf));
+	}
+
+	/**
+	 * Pass a user-defined command through the executor context
+	 */
+	io pass(const struct xnvme_spec_cmd &cmd, void *dbuf,
+		size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes) noexcept
+	{
+		return io(exec, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes);
+	}
+
+	struct xnvme_dev *get_dev() const noexcept { return dev; }
+
+	executor &get_executor() const noexcept { return exec; }
+
+private:
+	io rw(uint8_t opcode, uint64_t slba, uint16_t nlb, void *dbuf) noexcept
+	{
+		struct xnvme_spec_cmd cmd = {};
+
+		cmd.common.opcode = opcode;
+		cmd.common.nsid = nsid;
+		cmd.lblk.slba = slba;
+		cmd.lblk.nlb = nlb;
+
+		return io(exec, cmd, dbuf, lba_nbytes * ((size_t)nlb + 1),
+			  nullptr, 0);
+	}
+
+	struct xnvme_dev *dev;
+	executor &exec;
+	uint32_t nsid;
+	uint32_t lba_nbytes;
+};
+
+} // namespace xnvme
+
+#endif /* __LIBXNVME_HPP */
@@ -35,6 +35,17 @@ struct xnvme_spec_status {
 };
 XNVME_STATIC_ASSERT(sizeof(struct xnvme_spec_status) == 2, "Incorrect size")
 
+/**
+ * Generic Command Status values (Status Code Type 0x0) produced by xNVMe
+ *
+ * @enum xnvme_spec_sc
+ */
+enum xnvme_spec_sc {
+	XNVME_SPEC_SC_SUCCESS = 0x00,	///< XNVME_SPEC_SC_SUCCESS
+	XNVME_SPEC_SC_INTERNAL = 0x06,	///< XNVME_SPEC_SC_INTERNAL: Internal Error
+	XNVME_SPEC_SC_ABORT_REQ = 0x07,	///< XNVME_SPEC_SC_ABORT_REQ: Command Abort Requested
+};
+
 /**
  * Completion Queue Entry
  *
@@ -247,6 +258,7 @@ XNVME_STATIC_ASSERT(sizeof(struct xnvme_spec_lbaf) == 4, "Incorrect size")
  */
 enum xnvme_spec_csi {
 	XNVME_SPEC_CSI_LBLK	= 0x0,	///< XNVME_SPEC_CSI_LBLK
+	XNVME_SPEC_CSI_KV	= 0x1,	///< XNVME_SPEC_CSI_KV
 	XNVME_SPEC_CSI_ZONED	= 0x2,	///< XNVME_SPEC_CSI_ZONED
 
 	XNVME_SPEC_CSI_NOCHECK	= 0xFF,	///< XNVME_SPEC_CSI_NOCHECK
@@ -280,8 +292,9 @@ struct xnvme_spec_idfy_ns {
 		uint8_t	ns_atomic_write_unit : 1; ///< NAWUN, NAWUPF, and NACWU
 		uint8_t	dealloc_or_unwritten_error : 1;
 		uint8_t	guid_never_reused : 1; ////< Non-zero NGUID and EUI64
+		uint8_t	optperf : 1; ///< NPWG, NPWA, NPDG, NPDA, and NOWS
 
-		uint8_t	reserved1 : 4;
+		uint8_t	reserved1 : 3;
 	} nsfeat;
 
 	uint8_t		nlbaf; ///< number of lba formats
@@ -438,7 +451,13 @@ struct xnvme_spec_idfy_ns {
 
 	uint64_t nvmcap[2];	///< NVM Capacity
 
-	uint8_t reserved64[40];
+	uint16_t npwg;		///< Namespace Preferred Write Granularity
+	uint16_t npwa;		///< Namespace Preferred Write Alignment
+	uint16_t npdg;		///< Namespace Preferred Deallocate Granularity
+	uint16_t npda;		///< Namespace Preferred Deallocate Alignment
+	uint16_t nows;		///< Namespace Optimal Write Size
+
+	uint8_t reserved74[30];
 
 	/** namespace globally unique identifier */
 	uint8_t nguid[16];
@@ -961,6 +980,17 @@ xnvme_spec_idfy_cs_fpr(FILE *stream, const struct xnvme_spec_idfy_cs *idfy,
 int
 xnvme_spec_idfy_cs_pr(const struct xnvme_spec_idfy_cs *idfy, int opts);
 
+/**
+ * Representation of the Active Namespace ID list, that is, the namespace
+ * identifiers in increasing order, terminated by 0 when less than 1024
+ *
+ * @struct xnvme_spec_idfy_nslist
+ */
+struct xnvme_spec_idfy_nslist {
+	uint32_t nsid[1024];
+};
+XNVME_STATIC_ASSERT(sizeof(struct xnvme_spec_idfy_nslist) == 4096, "Incorrect size")
+
 /**
  * NVMe completion result accessor
  *
@@ -973,6 +1003,7 @@ struct xnvme_spec_idfy {
 		struct xnvme_spec_idfy_ctrlr ctrlr;
 		struct xnvme_spec_idfy_ns ns;
 		struct xnvme_spec_idfy_cs cs;
+		struct xnvme_spec_idfy_nslist nslist;
 	};
 };
 XNVME_STATIC_ASSERT(sizeof(struct xnvme_spec_idfy) == 4096, "Incorrect size")
@@ -990,6 +1021,7 @@ enum xnvme_spec_opcodes {
 	XNVME_SPEC_OPC_SFEAT = 0x09, ///< XNVME_SPEC_OPC_SFEAT
 	XNVME_SPEC_OPC_GFEAT = 0x0A, ///< XNVME_SPEC_OPC_GFEAT
 
+	XNVME_SPEC_OPC_FLUSH = 0x00, ///< XNVME_SPEC_OPC_FLUSH
 	XNVME_SPEC_OPC_WRITE = 0x01, ///< XNVME_SPEC_OPC_WRITE
 	XNVME_SPEC_OPC_READ = 0x02, ///< XNVME_SPEC_OPC_READ
 
@@ -99,6 +99,54 @@ xnvmec_cmd_from_file(struct xnvme_spec_cmd *cmd, const char *fpath);
 int
 xnvmec_cmd_to_file(const struct xnvme_spec_cmd *cmd, const char *fpath);
 
+/**
+ * Export 'nlb' + 1 logical blocks, starting at 'slba', to the file at 'path'
+ *
+ * The range is read in chunks of at most MDTS, rounded down to a multiple of
+ * the optimal write size, or else of the preferred write granularity, when
+ * reported, with up to 'qd' reads outstanding on an asynchronous context,
+ * while completed chunks are written to the file, opened with O_DIRECT when
+ * the file-system allows it.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param slba The LBA to start reading from
+ * @param nlb The number of LBAs to read, NOTE: zero-based value
+ * @param qd Maximum number of outstanding reads
+ * @param path Destination file, created or truncated
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvmec_dev_to_file(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		   uint64_t nlb, uint32_t qd, const char *path);
+
+/**
+ * Import the file at 'path' to the device, starting at 'slba'
+ *
+ * The file is read in chunks sized as for xnvmec_dev_to_file(), each
+ * submitted as a write on an asynchronous context with up to 'qd'
+ * outstanding, such that reading the next chunk from the file overlaps with
+ * the writes in flight. The last LBA is zero-padded when the file-size is not
+ * a multiple of the LBA size.
+ *
+ * @note On zoned devices, chunks are split at zone boundaries; use a 'qd' of
+ * one, as writes to a zone must arrive in order
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param slba The LBA to start writing at
+ * @param qd Maximum number of outstanding writes
+ * @param path Source file
+ * @param nbytes Set to the number of bytes written, including padding, ignored
+ * when NULL
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvmec_dev_from_file(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		     uint32_t qd, const char *path, size_t *nbytes);
+
 /**
  * Options are stored in an instance of this structure
  *
@@ -167,10 +215,12 @@ struct xnvmec_args {
 
 	uint64_t count;
 	uint64_t offset;
+	uint64_t interval;
 
 	uint64_t opcode;
 	uint64_t flags;
 	uint64_t all;
+	uint32_t pr;	///< Printer format, one of ::xnvme_pr
 
 	uint32_t status;
 	uint32_t save;
@@ -269,14 +319,14 @@ enum xnvmec_opt {
 
 	XNVMEC_OPT_COUNT = 'z', ///< XNVMEC_OPT_COUNT
 	XNVMEC_OPT_OFFSET = '{', ///< XNVMEC_OPT_OFFSET
+	XNVMEC_OPT_INTERVAL = '}', ///< XNVMEC_OPT_INTERVAL
 
 	XNVMEC_OPT_OPCODE = '#', ///< XNVMEC_OPT_OPCODE
 	XNVMEC_OPT_FLAGS = '*', ///< XNVMEC_OPT_FLAGS
 
 	XNVMEC_OPT_ALL = '.', ///< XNVMEC_OPT_ALL
+	XNVMEC_OPT_PR = '~', ///< XNVMEC_OPT_PR
 
-	XNVMEC_OPT_UNUSED01 = '}',
-	XNVMEC_OPT_UNUSED02 = '~',
 	XNVMEC_OPT_UNUSED03 = '!',
 	XNVMEC_OPT_UNUSED04 = '"',
 	XNVMEC_OPT_UNUSED05 = '$',
@@ -692,9 +692,12 @@ XNVME_STATIC_ASSERT(sizeof(struct znd_report) == 64, "Incorrect size")
 /**
  * Prints the given ::znd_report to the given stream
  *
+ * With ::XNVME_PR_CSV, ::XNVME_PR_JSONL, and ::XNVME_PR_BIN only the entries
+ * are printed, for BIN including descriptor extensions, as retrieved
+ *
  * @param stream output stream used for printing
  * @param report pointer to the the ::znd_report to print
- * @param flags
+ * @param flags printer options, see ::xnvme_pr
  *
  * @return On success, the number of characters printed is returned.
  */
@@ -705,7 +708,7 @@ znd_report_fpr(FILE *stream, const struct znd_report *report, int flags);
  * Prints the given ::znd_report to stdout
  *
  * @param report
- * @param flags
+ * @param flags printer options, see ::xnvme_pr
  *
  * @return On success, the number of characters printed is returned.
  */
@@ -748,6 +751,66 @@ znd_report_pr(const struct znd_report *report, int flags);
 struct znd_report *
 znd_report_from_dev(struct xnvme_dev *dev, uint64_t slba, size_t limit, uint8_t extended);
 
+/**
+ * Opaque iterator over the Zone Descriptors of a namespace, see
+ * znd_report_iter_init()
+ *
+ * @struct znd_report_iter
+ */
+struct znd_report_iter;
+
+/**
+ * Initialize an iterator over the Zone Descriptors reported by the namespace
+ * associated with the given `dev`, starting at the given `slba`
+ *
+ * In contrast to znd_report_from_dev(), the report is not materialized in
+ * memory. Descriptors are received in chunks of at most MDTS into two
+ * buffers; while the caller consumes one, the following chunk is received
+ * into the other. Memory use is thus bounded regardless of the number of
+ * zones.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param slba LBA of the first zone to report
+ * @param sf Report only zones in the state given by ::znd_recv_action_sf
+ * @param extended When 0, the "regular" report is provided. When 1, then the
+ * Extended Report is provided, if supported by device.
+ * @param chunk_limit Maximum number of descriptors in a chunk, 0 means as many
+ * as fit in MDTS
+ * @param iter Pointer to the iterator to initialize
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+znd_report_iter_init(struct xnvme_dev *dev, uint64_t slba,
+		     enum znd_recv_action_sf sf, uint8_t extended,
+		     size_t chunk_limit, struct znd_report_iter **iter);
+
+/**
+ * Retrieve the next Zone Descriptor from the given iterator
+ *
+ * @note
+ * The descriptor, and extension, are valid until the next call to
+ * znd_report_iter_next() or znd_report_iter_term()
+ *
+ * @param iter Iterator obtained with znd_report_iter_init()
+ * @param descr Pointer to the next descriptor, NULL when there are no more
+ * @param dext Optional pointer to the Zone Descriptor Extension, NULL unless
+ * the iterator provides the Extended Report
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+znd_report_iter_next(struct znd_report_iter *iter,
+		     const struct znd_descr **descr, const void **dext);
+
+/**
+ * Tear down the given iterator, waiting for any outstanding prefetch
+ *
+ * @param iter Iterator obtained with znd_report_iter_init()
+ */
+void
+znd_report_iter_term(struct znd_report_iter *iter);
+
 /**
  * Scan the 'report' for a zone in the given 'state' and store it in 'zlba'
  *
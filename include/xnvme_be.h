@@ -20,8 +20,8 @@
 
 #define XNVME_BE_ACTX_NBYTES 192
 
-#define XNVME_BE_FUNC_NBYTES 104
-#define XNVME_BE_ATTR_NBYTES 24
+#define XNVME_BE_FUNC_NBYTES 120
+#define XNVME_BE_ATTR_NBYTES 32
 #define XNVME_BE_STATE_NBYTES 128
 #define XNVME_BE_NBYTES \
 	( XNVME_BE_FUNC_NBYTES + XNVME_BE_ATTR_NBYTES + XNVME_BE_STATE_NBYTES )
@@ -87,6 +87,17 @@ struct xnvme_be_func {
 	 */
 	void (*buf_free)(const struct xnvme_dev *, void *);
 
+	/**
+	 * Provide buffers ['bid', 'bid' + 'nbufs') of the given buffer-group for
+	 * the backend to select from when reads complete
+	 */
+	int (*bufgrp_provide)(struct xnvme_bufgrp *, uint32_t, uint32_t);
+
+	/**
+	 * Remove the buffers of the given buffer-group from the backend
+	 */
+	int (*bufgrp_remove)(struct xnvme_bufgrp *);
+
 	/**
 	 * Enumerate devices on/at the given 'sys_uri' when NULL local devices
 	 */
@@ -0,0 +1,56 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_CMPR_H
+#define __INTERNAL_XNVME_BE_CMPR_H
+#include <pthread.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_CMPR_CHUNK_DEF 2	///< Chunks of 4KiB << 'chunk', 16KiB
+#define XNVME_BE_CMPR_CHUNK_MAX 5	///< Max. value of the 'chunk' option
+#define XNVME_BE_CMPR_RATIO_DEF 2	///< Capacity exposed, times the physical
+#define XNVME_BE_CMPR_NWORK_DEF 4	///< Threads compressing/decompressing
+#define XNVME_BE_CMPR_NWORK_MAX 9	///< Max. value of the 'nwork' option
+#define XNVME_BE_CMPR_SEG_NBYTES (1024 * 1024)	///< Unit of space reclaim
+#define XNVME_BE_CMPR_OP_PCT 7		///< Over-provisioning, in % of segments
+
+struct xnvme_cmpr;
+struct cmpr_cmd;
+
+/**
+ * Commands are carried out by the workers of the device, each taking a chunk
+ * at a time; completions are queued on the context by the worker finishing
+ * the last chunk, until reaped via poke/wait
+ */
+struct xnvme_async_ctx_cmpr {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Submitted and not yet reaped
+
+	struct cmpr_cmd *cmds;	///< 'depth' commands, for submission
+	struct cmpr_cmd *free;
+	struct cmpr_cmd *head;	///< Completed commands
+	struct cmpr_cmd *tail;
+
+	pthread_mutex_t lock;	///< Protects 'head' and 'tail'
+	pthread_cond_t cond;	///< Signalled on completion
+
+	uint8_t rsvd[192 - 40 - sizeof(pthread_mutex_t) - sizeof(pthread_cond_t)];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_cmpr) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_CMPR state
+ */
+struct xnvme_be_cmpr_state {
+	struct xnvme_cmpr *cmpr;	///< Compression layer on the lower dev.
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_cmpr_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_CMPR_H */
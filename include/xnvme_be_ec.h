@@ -0,0 +1,47 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_EC_H
+#define __INTERNAL_XNVME_BE_EC_H
+#include <xnvme_dev.h>
+
+#define XNVME_BE_EC_NMEMBERS_MAX 16	///< Max. number of member devices
+#define XNVME_BE_EC_PARITY_DEF 2	///< Parity units per stripe, m
+#define XNVME_BE_EC_UNIT_DEF 2		///< Stripe units of 4KiB << 'unit', 16KiB
+#define XNVME_BE_EC_UNIT_MAX 6		///< Max. value of the 'unit' option
+#define XNVME_BE_EC_NSOPS 16		///< Stripes in flight per context
+#define XNVME_BE_EC_NSYNC 4		///< Contexts shared by sync. commands
+
+struct xnvme_ec;
+struct ec_ctx;
+
+/**
+ * Each context has an async. context on every member, commands are carried
+ * out a stripe at a time, driven by poke/wait on the context
+ */
+struct xnvme_async_ctx_ec {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Outstanding IO on the context
+
+	struct ec_ctx *ectx;	///< Stripes in flight and member contexts
+
+	uint8_t rsvd[176];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_ec) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_EC state
+ */
+struct xnvme_be_ec_state {
+	struct xnvme_ec *ec;	///< Members and coding parameters
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_ec_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_EC_H */
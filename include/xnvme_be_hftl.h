@@ -0,0 +1,44 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_HFTL_H
+#define __INTERNAL_XNVME_BE_HFTL_H
+#include <xnvme_dev.h>
+
+#define XNVME_BE_HFTL_OZONES_DEF 4	///< Zones open for host writes
+#define XNVME_BE_HFTL_OZONES_MAX 9	///< Max. value of the 'ozones' option
+#define XNVME_BE_HFTL_OP_PCT 7		///< Over-provisioning, in % of zones
+
+struct xnvme_hftl;
+
+/**
+ * Commands are carried out at submission, their completions are queued on the
+ * context, linked via 'req->async.be_rsvd', until reaped via poke/wait
+ */
+struct xnvme_async_ctx_hftl {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Completions queued on the context
+
+	struct xnvme_req *head;
+	struct xnvme_req *tail;
+
+	uint8_t rsvd[168];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_hftl) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_HFTL state
+ */
+struct xnvme_be_hftl_state {
+	struct xnvme_hftl *ftl;		///< Translation layer on the lower dev.
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_hftl_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_HFTL_H */
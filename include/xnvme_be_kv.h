@@ -0,0 +1,54 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_KV_H
+#define __INTERNAL_XNVME_BE_KV_H
+#include <pthread.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_KV_NWORK_DEF 2		///< Threads carrying out store/retrieve
+#define XNVME_BE_KV_NWORK_MAX 9		///< Max. value of the 'nwork' option
+#define XNVME_BE_KV_UNIT_NBYTES 4096	///< Min. unit of value allocation
+#define XNVME_BE_KV_VML (1024 * 1024)	///< Max. Value Length, in bytes
+#define XNVME_BE_KV_MNK (1 << 22)	///< Max. Number of Keys, upper bound
+
+struct xnvme_kv;
+struct kv_cmd;
+
+/**
+ * Store and retrieve are carried out by the workers of the device, other
+ * commands on submission; completions are queued on the context until reaped
+ * via poke/wait
+ */
+struct xnvme_async_ctx_kv {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Submitted and not yet reaped
+
+	struct kv_cmd *cmds;	///< 'depth' commands, for submission
+	struct kv_cmd *free;
+	struct kv_cmd *head;	///< Completed commands
+	struct kv_cmd *tail;
+
+	pthread_mutex_t lock;	///< Protects 'head' and 'tail'
+	pthread_cond_t cond;	///< Signalled on completion
+
+	uint8_t rsvd[192 - 40 - sizeof(pthread_mutex_t) - sizeof(pthread_cond_t)];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_kv) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_KV state
+ */
+struct xnvme_be_kv_state {
+	struct xnvme_kv *kv;	///< Key-Value store on the lower device
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_kv_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_KV_H */
@@ -3,16 +3,23 @@
 #ifndef __INTERNAL_XNVME_BE_LIOU_H
 #define __INTERNAL_XNVME_BE_LIOU_H
 
+#define XNVME_BE_LIOU_SYNC_DEPTH 1
+
+// Completions of commands issued by the backend itself, e.g. for providing
+// buffers, carry this as 'user_data' instead of a request
+#define XNVME_BE_LIOU_UDATA_INTERNAL 0x1
+
 struct xnvme_async_ctx_liou {
 	uint32_t depth;		///< IO depth
 	uint32_t outstanding;	///< Outstanding IO on the context/ring/queue
 
 	struct io_uring ring;
+	struct io_uring_sqe *link_tail;	///< Last command of an open chain
 
 	uint8_t poll_io;
 	uint8_t poll_sq;
 
-	uint8_t _rsvd[14];
+	uint8_t _rsvd[6];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_async_ctx_liou) == XNVME_BE_ACTX_NBYTES,
@@ -29,8 +36,9 @@ struct xnvme_be_liou_state {
 
 	uint8_t poll_io;
 	uint8_t poll_sq;
+	uint8_t poll_sync;	///< Busy-poll for completion of sync. commands
 
-	uint8_t rsvd[121];
+	uint8_t rsvd[120];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_be_liou_state) == XNVME_BE_STATE_NBYTES,
@@ -31,6 +31,13 @@ xnvme_be_nosys_buf_realloc(const struct xnvme_dev *dev, void *buf,
 void
 xnvme_be_nosys_buf_free(const struct xnvme_dev *dev, void *buf);
 
+int
+xnvme_be_nosys_bufgrp_provide(struct xnvme_bufgrp *grp, uint32_t bid,
+			      uint32_t nbufs);
+
+int
+xnvme_be_nosys_bufgrp_remove(struct xnvme_bufgrp *grp);
+
 int
 xnvme_be_nosys_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
 			  uint16_t depth, int flags);
@@ -70,6 +77,9 @@ xnvme_be_nosys_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 	.buf_realloc = xnvme_be_nosys_buf_realloc,		\
 	.buf_free = xnvme_be_nosys_buf_free,			\
 								\
+	.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,	\
+	.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,		\
+								\
 	.enumerate = xnvme_be_nosys_enumerate,			\
 								\
 	.dev_from_ident = xnvme_be_nosys_dev_from_ident,	\
@@ -4,6 +4,12 @@ static struct xnvme_be *xnvme_be_registry[] = {
 	&xnvme_be_laio,
 	&xnvme_be_lioc,
 	&xnvme_be_fioc,
+	&xnvme_be_hftl,
+	&xnvme_be_tcp,
+	&xnvme_be_cmpr,
+	&xnvme_be_ec,
+	&xnvme_be_kv,
+	&xnvme_be_sim,
 	NULL
 };
 
@@ -8,5 +8,11 @@ extern struct xnvme_be xnvme_be_fioc;
 extern struct xnvme_be xnvme_be_lioc;
 extern struct xnvme_be xnvme_be_liou;
 extern struct xnvme_be xnvme_be_laio;
+extern struct xnvme_be xnvme_be_hftl;
+extern struct xnvme_be xnvme_be_tcp;
+extern struct xnvme_be xnvme_be_cmpr;
+extern struct xnvme_be xnvme_be_ec;
+extern struct xnvme_be xnvme_be_kv;
+extern struct xnvme_be xnvme_be_sim;
 
 #endif /* __INTERNAL_XNVME_BE_REGISTRY_H */
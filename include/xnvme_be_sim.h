@@ -0,0 +1,44 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_SIM_H
+#define __INTERNAL_XNVME_BE_SIM_H
+#include <xnvme_dev.h>
+
+#define XNVME_BE_SIM_MODEL_DEF "default"	///< Built-in model
+#define XNVME_BE_SIM_NCHAN_MAX 1024		///< Max. number of channels
+#define XNVME_BE_SIM_SEG_NBYTES (1 << 20)	///< Unit of data retention
+
+struct xnvme_sim;
+struct sim_cmd;
+
+/**
+ * Commands are timed on submission and kept on the context, in a min-heap
+ * ordered by completion time, until the virtual clock reaches them
+ */
+struct xnvme_async_ctx_sim {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Submitted and not yet reaped, heap size
+
+	struct sim_cmd *heap;	///< 'depth' entries
+
+	uint8_t rsvd[176];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_sim) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_SIM state
+ */
+struct xnvme_be_sim_state {
+	struct xnvme_sim *sim;	///< Device model and virtual clock
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_sim_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_SIM_H */
@@ -9,6 +9,39 @@
 
 #define XNVME_BE_SPDK_QPAIR_MAX 64
 #define XNVME_BE_SPDK_ALIGN 0x1000
+#define XNVME_BE_SPDK_BOUNCE_NSLOTS 16
+
+struct xnvme_be_spdk_bounce_pool;
+
+/**
+ * Slot of a bounce-buffer pool, staging the payload of a command whose
+ * data-buffer is not DMA-able, e.g. allocated on the heap
+ */
+struct xnvme_be_spdk_bounce {
+	struct xnvme_be_spdk_bounce_pool *pool;
+	uint8_t *buf;			///< DMA-able staging memory
+	void *ubuf;			///< Buffer provided by the user
+	size_t nbytes;			///< Payload size
+	int c2h;			///< Copy to 'ubuf' on completion
+
+	spdk_nvme_cmd_cb cb;		///< Completion-callback of the command
+	void *cb_arg;			///< Argument of 'cb'
+};
+
+/**
+ * Pool of bounce-buffers, allocated from hugepage memory on the first use of
+ * the qpair with a non DMA-able buffer, and thereafter re-used
+ */
+struct xnvme_be_spdk_bounce_pool {
+	uint8_t *bufs;			///< DMA-able memory backing the slots
+	size_t buf_nbytes;		///< Size of the buffer of each slot
+
+	struct xnvme_be_spdk_bounce *slots;
+	uint32_t nslots;
+
+	uint32_t nfree;
+	struct xnvme_be_spdk_bounce **free;
+};
 
 struct xnvme_async_ctx_spdk {
 	uint32_t depth;		///< IO depth
@@ -16,7 +49,9 @@ struct xnvme_async_ctx_spdk {
 
 	struct spdk_nvme_qpair *qpair;
 
-	uint8_t rsvd[176];
+	struct xnvme_be_spdk_bounce_pool *bounce;	///< Allocated on use
+
+	uint8_t rsvd[168];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_async_ctx_spdk) == XNVME_BE_ACTX_NBYTES,
@@ -51,13 +86,16 @@ struct xnvme_be_spdk_state {
 	struct spdk_nvme_ctrlr *ctrlr;	///< Pointer to attached controller
 	struct spdk_nvme_ns *ns;	///< Pointer to associated namespace
 
+	struct xnvme_be_spdk_bounce_pool *bounce;	///< For SYNC IO commands
+
 	uint8_t attached;
+	uint8_t bounce_check;		///< Bounce non DMA-able buffers
 
 	// Options
 	uint8_t cmb_sqs;
 	uint8_t css;
 
-	uint8_t _rsvd[37];
+	uint8_t _rsvd[28];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_be_spdk_state) == XNVME_BE_STATE_NBYTES,
@@ -0,0 +1,47 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_TCP_H
+#define __INTERNAL_XNVME_BE_TCP_H
+#include <xnvme_dev.h>
+
+#define XNVME_BE_TCP_PORT "4420"	///< Default transport service id
+#define XNVME_BE_TCP_NCONN_MAX 8	///< Max. value of the 'nconn' option
+#define XNVME_BE_TCP_AQ_DEPTH 32	///< Admin queue depth
+#define XNVME_BE_TCP_SQ_DEPTH 32	///< Depth of the queue for sync. IO
+#define XNVME_BE_TCP_TIMEOUT_MS 30000	///< Sync. command timeout
+
+struct xnvme_tcp_ctrlr;
+struct xnvme_tcp_qpair;
+
+/**
+ * Each context has its own I/O queues, each on a TCP connection of its own;
+ * one by default, or 'nconn' with commands spread over the least busy
+ */
+struct xnvme_async_ctx_tcp {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Outstanding IO on the context/ring/queue
+
+	struct xnvme_tcp_qpair *qpairs[XNVME_BE_TCP_NCONN_MAX];
+	uint32_t nqpairs;
+
+	uint8_t rsvd[116];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_tcp) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * Internal representation of XNVME_BE_TCP state
+ */
+struct xnvme_be_tcp_state {
+	struct xnvme_tcp_ctrlr *ctrlr;	///< Connection to the controller
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_tcp_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_TCP_H */
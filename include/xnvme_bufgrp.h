@@ -0,0 +1,24 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BUFGRP_H
+#define __INTERNAL_XNVME_BUFGRP_H
+
+/**
+ * Internal representation of a buffer-group, see xnvme_bufgrp_init()
+ */
+struct xnvme_bufgrp {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;
+
+	uint8_t *bufs;		///< 'nbufs' consecutive buffers
+	uint32_t nbufs;
+	uint32_t buf_nbytes;
+
+	uint16_t bgid;		///< Group identifier, for use by the backend
+	int native;		///< Buffers are selected by the backend
+
+	uint32_t nfree;		///< Library-managed: amount of free buffers
+	uint32_t *free;		///< Library-managed: stack of free buffer ids
+};
+
+#endif /* __INTERNAL_XNVME_BUFGRP_H */
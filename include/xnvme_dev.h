@@ -12,6 +12,8 @@ enum xnvme_dev_type {
 	XNVME_DEV_TYPE_BLOCK_DEVICE,
 };
 
+struct xnvme_gcommit;
+
 struct xnvme_dev {
 	struct xnvme_geo geo;		///< Device geometry
 	struct xnvme_be be;		///< Backend interface
@@ -23,7 +25,10 @@ struct xnvme_dev {
 
 	enum xnvme_dev_type dtype;	///< Device type
 
-	uint8_t _pad[36];
+	uint8_t _pad[20];
+
+	struct xnvme_gcommit *gcommit;	///< Group commit of SYNC commands
+	uint64_t nbounced;		///< # cmds. staged via bounce-buffers
 
 	struct {
 		struct xnvme_spec_idfy_ctrlr ctrlr;	///< NVMe id-ctrlr
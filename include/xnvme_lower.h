@@ -0,0 +1,128 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_LOWER_H
+#define __INTERNAL_XNVME_LOWER_H
+#include <libxnvme.h>
+
+#define XNVME_LOWER_CSUM_INIT 0xcbf29ce484222325ULL	///< FNV-1a offset basis
+#define XNVME_CKPT_HDR_NBYTES_MAX 512
+
+/**
+ * The device a stacked backend, e.g. hftl, is opened on
+ */
+struct xnvme_lower {
+	struct xnvme_dev *dev;
+	uint32_t nsid;			///< Namespace of the lower device
+	uint32_t lba_nbytes;
+	uint32_t io_nlb;		///< Max. LBAs per read/write
+};
+
+/**
+ * Synchronous read/write of 'nlb' LBAs, split into commands of at most
+ * 'io_nlb' LBAs
+ */
+int
+xnvme_lower_rw(const struct xnvme_lower *lower, uint8_t opcode, uint64_t slba,
+	       uint64_t nlb, void *dbuf);
+
+/**
+ * Synchronous flush, when the lower device has a volatile write cache
+ */
+int
+xnvme_lower_flush(const struct xnvme_lower *lower);
+
+/**
+ * FNV-1a over the 64bit words of 'buf', continuing from 'csum', start with
+ * XNVME_LOWER_CSUM_INIT; 'nbytes' must be a multiple of eight
+ */
+uint64_t
+xnvme_lower_csum(uint64_t csum, const void *buf, uint64_t nbytes);
+
+/**
+ * Common prefix of the header of a checkpoint, followed by fields of the
+ * backend
+ */
+struct xnvme_ckpt_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t lba_nbytes;
+	uint64_t seq;
+	uint64_t tbl_nbytes;	///< Size of the table following the header
+	uint64_t csum;		///< xnvme_lower_csum() of the table
+};
+
+/**
+ * Produce, when writing, or consume, when reading, 'nbytes' of the table at
+ * offset 'ofz'; the table is traversed in order, starting from offset zero
+ */
+typedef int (*xnvme_ckpt_tbl_cb)(void *cb_arg, uint64_t ofz, uint8_t *buf,
+				 uint64_t nbytes);
+
+/**
+ * Verify the fields, following the common prefix, of a checkpoint header
+ */
+typedef int (*xnvme_ckpt_hdr_cb)(void *cb_arg,
+				 const struct xnvme_ckpt_hdr *hdr);
+
+/**
+ * Read/write 'nlb' LBAs at the linear offset 'lin' of the given area
+ */
+typedef int (*xnvme_ckpt_area_cb)(void *cb_arg, uint8_t opcode, uint32_t area,
+				  uint64_t lin, uint64_t nlb, void *buf);
+
+/**
+ * Checkpoints of the state of a stacked backend, written in turn to one of two
+ * areas of the lower device such that the latest remains intact until the
+ * next is complete
+ *
+ * An area holds the header in its first LBA, the table from its second, and a
+ * copy of the header at 'tbl_nlb' + 1. The header is written first, as zoned
+ * areas must be written sequentially, thus a checkpoint with a header and a
+ * copy which differ is incomplete.
+ */
+struct xnvme_ckpt {
+	const struct xnvme_lower *lower;
+
+	uint64_t magic;
+	uint32_t version;
+	uint32_t hdr_nbytes;		///< Size of the header of the backend
+	uint64_t area_nlb;		///< Area 'i' starts at LBA 'i * area_nlb'
+	uint64_t tbl_nlb;		///< LBAs of an area for the table
+
+	xnvme_ckpt_tbl_cb get;		///< Produces the table to write
+	xnvme_ckpt_tbl_cb put;		///< Consumes the table read
+	xnvme_ckpt_hdr_cb check;	///< Verifies the header, or NULL
+	xnvme_ckpt_area_cb area_rw;	///< Maps areas to LBAs, or NULL
+	void *cb_arg;
+
+	uint8_t *iobuf;			///< 'io_nlb' LBAs, from the lower device
+
+	uint64_t seq;			///< Sequence number of the latest
+	uint32_t area;			///< Area holding the latest
+};
+
+/**
+ * Write a checkpoint, with the given header, to the area not holding the
+ * latest. The common fields of the header are set, except for 'tbl_nbytes',
+ * which the caller provides.
+ */
+int
+xnvme_ckpt_write(struct xnvme_ckpt *ckpt, struct xnvme_ckpt_hdr *hdr);
+
+/**
+ * Load the latest valid checkpoint, its header is stored in 'hdr'
+ *
+ * @return On success, 0 is returned. When no checkpoint is found, -ENOENT is
+ * returned, and -EIO when one is found but none is valid.
+ */
+int
+xnvme_ckpt_load(struct xnvme_ckpt *ckpt, struct xnvme_ckpt_hdr *hdr);
+
+/**
+ * Setup for writing the first checkpoint of an empty state; when written to
+ * both areas, a checkpoint left from before cannot be taken as the latest
+ */
+void
+xnvme_ckpt_format(struct xnvme_ckpt *ckpt);
+
+#endif /* __INTERNAL_XNVME_LOWER_H */
@@ -0,0 +1,53 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_PR_H
+#define __INTERNAL_XNVME_PR_H
+#include <stdio.h>
+#include <libxnvme.h>
+
+#define XNVME_PR_BUF_NBYTES 16384
+
+/**
+ * Buffered writer for printers emitting many entries, that is, the ::xnvme_pr
+ * formats CSV, JSONL, and BIN, such that output is written in large chunks
+ * instead of one or more stdio calls per field
+ */
+struct xnvme_pr_buf {
+	FILE *stream;
+	size_t len;		///< Bytes in 'buf' not yet written
+	int wrtn;		///< Bytes accepted, written or in 'buf'
+	int err;		///< First write-error, as negative errno
+	char buf[XNVME_PR_BUF_NBYTES];
+};
+
+void
+xnvme_pr_buf_init(struct xnvme_pr_buf *pb, FILE *stream);
+
+int
+xnvme_pr_buf_printf(struct xnvme_pr_buf *pb, const char *fmt, ...)
+__attribute__((format(printf, 2, 3)));
+
+int
+xnvme_pr_buf_write(struct xnvme_pr_buf *pb, const void *data, size_t nbytes);
+
+/**
+ * Write 'str' as a CSV field, quoted when containing separators or quotes
+ */
+int
+xnvme_pr_buf_csv_str(struct xnvme_pr_buf *pb, const char *str);
+
+/**
+ * Write 'str' as a quoted and escaped JSON string
+ */
+int
+xnvme_pr_buf_json_str(struct xnvme_pr_buf *pb, const char *str);
+
+/**
+ * Write what remains buffered
+ *
+ * @return On success, the number of bytes written, on error, negative errno
+ */
+int
+xnvme_pr_buf_flush(struct xnvme_pr_buf *pb);
+
+#endif /* __INTERNAL_XNVME_PR_H */
@@ -8,7 +8,7 @@ def main():
 
     arg = POINTER(xnvme.Enumeration)()
 
-    capi.xnvme_enumerate(byref(arg), 0x0)
+    capi.xnvme_enumerate(byref(arg), None, 0x0)
 
     capi.xnvme_enumeration_pr(arg, 0x0)
 
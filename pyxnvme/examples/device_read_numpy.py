@@ -0,0 +1,24 @@
+#!/usr/bin/env python3
+import numpy
+import xnvme
+
+def main():
+    """Read a batch of LBAs into a NumPy array without copying"""
+
+    with xnvme.Device("/dev/nvme0n1") as dev:
+        nlb = 7
+        slbas = numpy.arange(0, 1024, nlb + 1, dtype=numpy.uint64)
+
+        buf = dev.buf_alloc(len(slbas) * (nlb + 1) * dev.geo.lba_nbytes)
+
+        with xnvme.AsyncContext(dev, 16) as ctx:
+            nerr = ctx.read_batch(slbas, nlb, buf)
+            print("errors: %d" % nerr)
+
+        data = buf.numpy()
+        print(data[:16])
+
+        buf.free()
+
+if __name__ == "__main__":
+    main()
@@ -2,6 +2,14 @@
     xNVMe libraries for Python
 
     Wrapping the shared version of xNVMe
+
+    Raw access to the C API is available via ``CAPI``, with argument and
+    return-types declared for the functions wrapped by the classes below:
+
+    * ``Device``, a handle obtained with ``xnvme_dev_open()``
+    * ``Buffer``, memory from ``xnvme_buf_alloc()`` exposed, without copying,
+      via the buffer protocol and the NumPy array interface
+    * ``AsyncContext``, submitting batches of reads/writes in a single call
 """
 import ctypes
 import time
@@ -12,46 +20,317 @@ XNVME_SHARED_LIB_FN = "libxnvme-shared.so"
 
 CAPI = None
 if CAPI is None:
-    CAPI = ctypes.cdll.LoadLibrary(XNVME_SHARED_LIB_FN)
+    CAPI = ctypes.CDLL(XNVME_SHARED_LIB_FN, use_errno=True)
 
 VERSION_MAJOR = CAPI.xnvme_ver_major()
 VERSION_MINOR = CAPI.xnvme_ver_minor()
 VERSION_PATCH = CAPI.xnvme_ver_patch()
 VERSION = "%d.%d.%d" % (VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH)
 
+XNVME_IDENT_URI_LEN = 384
+XNVME_IDENT_SCHM_LEN = 5
+XNVME_IDENT_TRGT_LEN = 155
+XNVME_IDENT_OPTS_LEN = 160
+
+XNVME_SPEC_OPC_WRITE = 0x01
+XNVME_SPEC_OPC_READ = 0x02
+
 class BackendAttributes(ctypes.Structure):
+    """Mirror of 'struct xnvme_be_attr'"""
 
     _fields_ = [
-        ("name", ctypes.c_char * 8),
-        ("scheme", ctypes.c_char * 7),
-        ("enabled", ctypes.c_uint8)
+        ("name", ctypes.c_char_p),
+        ("schemes", ctypes.POINTER(ctypes.c_char_p)),
+        ("nschemes", ctypes.c_int),
+        ("enabled", ctypes.c_int),
+        ("caps", ctypes.c_int),
+        ("_rsvd", ctypes.c_int),
     ]
 
 class BackendListing(ctypes.Structure):
+    """Mirror of 'struct xnvme_be_attr_list', 'item' is a flexible array"""
 
     _fields_ = [
         ("capacity", ctypes.c_uint32),
         ("count", ctypes.c_int32),
-        ("item", ctypes.POINTER(BackendAttributes)),
+        ("item", BackendAttributes * 0),
     ]
 
+    def items(self):
+        """Returns the used entries of the flexible array 'item'"""
+
+        return (BackendAttributes * self.count).from_address(
+            ctypes.addressof(self) + BackendListing.item.offset
+        )
+
 class Ident(ctypes.Structure):
+    """Mirror of 'struct xnvme_ident'"""
 
     _fields_ = [
-        ("nsid", ctypes.c_uint32),
-        ("nst", ctypes.c_uint8),
-        ("type", ctypes.c_uint8),
-        ("_pad0", ctypes.c_uint8),
-        ("be_attr", BackendAttributes),
-        ("_pad", ctypes.c_uint8 * 38),
-        ("uri", ctypes.c_char * 320),
-        ("be_uri", ctypes.c_char * 320)
+        ("uri", ctypes.c_char * XNVME_IDENT_URI_LEN),
+        ("schm", ctypes.c_char * XNVME_IDENT_SCHM_LEN),
+        ("trgt", ctypes.c_char * XNVME_IDENT_TRGT_LEN),
+        ("opts", ctypes.c_char * XNVME_IDENT_OPTS_LEN),
     ]
 
 class Enumeration(ctypes.Structure):
+    """Mirror of 'struct xnvme_enumeration', 'entries' is a flexible array"""
 
     _fields_ = [
         ("capacity", ctypes.c_uint32),
         ("nentries", ctypes.c_uint32),
-        ("entries", ctypes.POINTER(Ident)),
+        ("entries", Ident * 0),
     ]
+
+    def items(self):
+        """Returns the used entries of the flexible array 'entries'"""
+
+        return (Ident * self.nentries).from_address(
+            ctypes.addressof(self) + Enumeration.entries.offset
+        )
+
+class Geometry(ctypes.Structure):
+    """Mirror of 'struct xnvme_geo'"""
+
+    _fields_ = [
+        ("type", ctypes.c_int),
+        ("npugrp", ctypes.c_uint32),
+        ("npunit", ctypes.c_uint32),
+        ("nzone", ctypes.c_uint32),
+        ("nsect", ctypes.c_uint64),
+        ("nbytes", ctypes.c_uint32),
+        ("nbytes_oob", ctypes.c_uint32),
+        ("tbytes", ctypes.c_uint64),
+        ("mdts_nbytes", ctypes.c_uint32),
+        ("lba_nbytes", ctypes.c_uint32),
+        ("lba_extended", ctypes.c_uint8),
+        ("_pad", ctypes.c_uint8),
+        ("npwg", ctypes.c_uint16),
+        ("npwa", ctypes.c_uint16),
+        ("npdg", ctypes.c_uint16),
+        ("nows", ctypes.c_uint16),
+        ("_rsvd", ctypes.c_uint8 * 6),
+    ]
+
+class Completion(ctypes.Structure):
+    """Mirror of 'struct xnvme_spec_cpl', status is kept as the raw value"""
+
+    _fields_ = [
+        ("cdw0", ctypes.c_uint32),
+        ("rsvd1", ctypes.c_uint32),
+        ("sqhd", ctypes.c_uint16),
+        ("sqid", ctypes.c_uint16),
+        ("cid", ctypes.c_uint16),
+        ("status", ctypes.c_uint16),
+    ]
+
+    @property
+    def sc(self):
+        """Status Code"""
+
+        return (self.status >> 1) & 0xFF
+
+    @property
+    def sct(self):
+        """Status Code Type"""
+
+        return (self.status >> 9) & 0x7
+
+for _STRUCT, _NBYTES in [(Ident, 704), (Geometry, 64), (Completion, 16)]:
+    assert ctypes.sizeof(_STRUCT) == _NBYTES, "Incorrect size"
+
+def _declare(name, restype, argtypes):
+    """Declare return and argument-types, pointers are truncated otherwise"""
+
+    func = getattr(CAPI, name)
+    func.restype = restype
+    func.argtypes = argtypes
+
+_declare("xnvme_enumerate", ctypes.c_int, [
+    ctypes.POINTER(ctypes.POINTER(Enumeration)), ctypes.c_char_p, ctypes.c_int
+])
+_declare("xnvme_enumeration_pr", ctypes.c_int, [
+    ctypes.POINTER(Enumeration), ctypes.c_int
+])
+_declare("xnvme_dev_open", ctypes.c_void_p, [ctypes.c_char_p])
+_declare("xnvme_dev_close", None, [ctypes.c_void_p])
+_declare("xnvme_dev_pr", ctypes.c_int, [ctypes.c_void_p, ctypes.c_int])
+_declare("xnvme_dev_get_geo", ctypes.POINTER(Geometry), [ctypes.c_void_p])
+_declare("xnvme_dev_get_nsid", ctypes.c_uint32, [ctypes.c_void_p])
+_declare("xnvme_geo_pr", ctypes.c_int, [
+    ctypes.POINTER(Geometry), ctypes.c_int
+])
+_declare("xnvme_buf_alloc", ctypes.c_void_p, [
+    ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint64)
+])
+_declare("xnvme_buf_free", None, [ctypes.c_void_p, ctypes.c_void_p])
+_declare("xnvme_async_init", ctypes.c_int, [
+    ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p), ctypes.c_uint16,
+    ctypes.c_int
+])
+_declare("xnvme_async_term", ctypes.c_int, [ctypes.c_void_p, ctypes.c_void_p])
+_declare("xnvme_async_batch_rw", ctypes.c_int, [
+    ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint32,
+    ctypes.c_void_p, ctypes.c_uint16, ctypes.c_void_p, ctypes.c_uint32,
+    ctypes.POINTER(Completion)
+])
+
+def ver_pr():
+    """Print the library version"""
+
+    CAPI.xnvme_ver_pr(0x0)
+
+def _errno_error(err, func):
+    """Produce an OSError from a negative errno as returned by the C API"""
+
+    return OSError(-err, "%s: %s" % (func, os.strerror(-err)))
+
+class Device(object):
+    """Device handle, see xnvme_dev_open()"""
+
+    def __init__(self, uri):
+        self.handle = CAPI.xnvme_dev_open(uri.encode())
+        if not self.handle:
+            raise OSError(ctypes.get_errno(), "xnvme_dev_open(%s)" % uri)
+
+        self.geo = CAPI.xnvme_dev_get_geo(self.handle).contents
+        self.nsid = CAPI.xnvme_dev_get_nsid(self.handle)
+
+    def close(self):
+        """Close the device handle, buffers allocated must be freed first"""
+
+        if self.handle:
+            CAPI.xnvme_dev_close(self.handle)
+        self.handle = None
+
+    def buf_alloc(self, nbytes):
+        """Allocate a buffer suitable for IO with the device"""
+
+        return Buffer(self, nbytes)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+class Buffer(object):
+    """
+    Memory allocated with xnvme_buf_alloc(), exposed without copying
+
+    Use ``memoryview(buf.view)``, ``numpy.asarray(buf)``, or
+    ``buf.numpy(dtype)`` to access the memory
+    """
+
+    def __init__(self, dev, nbytes):
+        self.dev = dev
+        self.nbytes = nbytes
+        self.ptr = CAPI.xnvme_buf_alloc(dev.handle, nbytes, None)
+        if not self.ptr:
+            raise OSError(ctypes.get_errno(), "xnvme_buf_alloc()")
+
+        self.view = (ctypes.c_uint8 * nbytes).from_address(self.ptr)
+
+    @property
+    def __array_interface__(self):
+        return {
+            "shape": (self.nbytes,),
+            "typestr": "|u1",
+            "data": (self.ptr, False),
+            "version": 3,
+        }
+
+    def numpy(self, dtype="uint8"):
+        """Returns a NumPy array backed by the buffer, no data is copied"""
+
+        import numpy
+
+        return numpy.frombuffer(self.view, dtype=dtype)
+
+    def free(self):
+        """Free the buffer, views of the buffer must no longer be used"""
+
+        if self.ptr:
+            CAPI.xnvme_buf_free(self.dev.handle, self.ptr)
+        self.ptr = None
+        self.view = None
+
+    def __len__(self):
+        return self.nbytes
+
+class AsyncContext(object):
+    """Asynchronous context, see xnvme_async_init()"""
+
+    def __init__(self, dev, depth, flags=0x0):
+        self.dev = dev
+        self.handle = ctypes.c_void_p()
+
+        err = CAPI.xnvme_async_init(dev.handle, ctypes.byref(self.handle),
+                                    depth, flags)
+        if err:
+            raise _errno_error(err, "xnvme_async_init()")
+
+    def term(self):
+        """Tear down the context"""
+
+        if self.handle:
+            CAPI.xnvme_async_term(self.dev.handle, self.handle)
+        self.handle = None
+
+    def _batch(self, opcode, slbas, nlb, buf, cpl):
+        """
+        Submit the commands and wait for their completion in a single call,
+        'slbas' can be a uint64 NumPy array, used without copying, or any
+        sequence of integers
+        """
+
+        nentries = len(slbas)
+        iface = getattr(slbas, "__array_interface__", None)
+        if iface and iface["typestr"][1:] == "u8" and not iface.get("strides"):
+            slbas_ptr = iface["data"][0]
+        else:
+            slbas_arr = (ctypes.c_uint64 * nentries)(*slbas)
+            slbas_ptr = ctypes.addressof(slbas_arr)
+
+        cmd_nbytes = (nlb + 1) * self.dev.geo.lba_nbytes
+        if nentries * cmd_nbytes > buf.nbytes:
+            raise ValueError("buffer too small for batch")
+
+        cpls = (Completion * nentries)() if cpl else None
+
+        err = CAPI.xnvme_async_batch_rw(
+            self.dev.handle, self.handle, opcode, self.dev.nsid,
+            slbas_ptr, nlb, buf.ptr, nentries, cpls
+        )
+        if err < 0:
+            raise _errno_error(err, "xnvme_async_batch_rw()")
+
+        return (err, cpls) if cpl else err
+
+    def read_batch(self, slbas, nlb, buf, cpl=False):
+        """
+        Read 'nlb' + 1 LBAs at each of 'slbas' into consecutive regions of
+        'buf', NOTE: nlb is a zero-based value
+
+        Returns the number of commands completing with error-status, and when
+        'cpl' is True, along with the array of completions
+        """
+
+        return self._batch(XNVME_SPEC_OPC_READ, slbas, nlb, buf, cpl)
+
+    def write_batch(self, slbas, nlb, buf, cpl=False):
+        """
+        Write 'nlb' + 1 LBAs at each of 'slbas' from consecutive regions of
+        'buf', NOTE: nlb is a zero-based value
+
+        Returns the number of commands completing with error-status, and when
+        'cpl' is True, along with the array of completions
+        """
+
+        return self._batch(XNVME_SPEC_OPC_WRITE, slbas, nlb, buf, cpl)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.term()
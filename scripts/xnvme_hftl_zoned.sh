@@ -0,0 +1,163 @@
+#!/usr/bin/env bash
+#
+# This script sets up a Zoned Namespace on a memory-backed, zoned, 'null_blk'
+# device, exported via a Linux 'nvmet' loop target, and runs the lblk tests
+# against 'be:hftl' stacked upon it. The overwrite tests exhaust the free
+# space, thus exercising the garbage-collector, and re-open the device,
+# thus restoring the mapping from the checkpoints. Everything is torn down on
+# exit.
+#
+# It must be run as root, from the xNVMe repos-root, with the tests built and
+# 'nvme-cli' installed, e.g.:
+#
+# make && sudo ./scripts/xnvme_hftl_zoned.sh
+#
+# The following environment variables are used when set:
+#
+# TESTS     - Directory of the test binaries, defaults to 'build/tests'
+# NZONES    - Number of zones, defaults to 32
+# ZONE_MB   - Size of a zone in MB, defaults to 8
+#
+TESTS=${TESTS:-build/tests}
+NZONES=${NZONES:-32}
+ZONE_MB=${ZONE_MB:-8}
+
+SUBNQN="nqn.2021-01.io.xnvme:hftl"
+NULLB="/sys/kernel/config/nullb/xnvme_hftl"
+CFS="/sys/kernel/config/nvmet"
+PORTID=2
+NSID=1
+
+teardown() {
+  nvme disconnect -n "${SUBNQN}" &> /dev/null
+  rm -f "${CFS}/ports/${PORTID}/subsystems/${SUBNQN}" &> /dev/null
+  rmdir "${CFS}/ports/${PORTID}" &> /dev/null
+  if [[ -d "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}" ]]; then
+    echo 0 > "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/enable"
+    rmdir "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}"
+  fi
+  rmdir "${CFS}/subsystems/${SUBNQN}" &> /dev/null
+  if [[ -d "${NULLB}" ]]; then
+    echo 0 > "${NULLB}/power"
+    rmdir "${NULLB}"
+  fi
+}
+
+setup() {
+  if ! modprobe null_blk nr_devices=0; then
+    echo "# FAILED: modprobe null_blk"
+    return 1
+  fi
+  if ! modprobe nvme-loop; then
+    echo "# FAILED: modprobe nvme-loop"
+    return 1
+  fi
+  if [[ ! -d "${CFS}" ]]; then
+    mount -t configfs none /sys/kernel/config &> /dev/null
+  fi
+  if [[ ! -d "${CFS}" ]]; then
+    echo "# FAILED: could not find dir(${CFS})"
+    return 1
+  fi
+  if [[ -d "${CFS}/ports/${PORTID}" ]]; then
+    echo "# FAILED: nvmet port(${PORTID}) is in use"
+    return 1
+  fi
+
+  # The zoned null_blk, without conventional zones, which nvmet cannot export
+  mkdir "${NULLB}" || return 1
+  echo 4096 > "${NULLB}/blocksize"
+  echo $((NZONES * ZONE_MB)) > "${NULLB}/size"
+  echo 1 > "${NULLB}/zoned"
+  echo "${ZONE_MB}" > "${NULLB}/zone_size"
+  echo 0 > "${NULLB}/zone_nr_conv"
+  echo 1 > "${NULLB}/memory_backed"
+  echo 1 > "${NULLB}/power" || return 1
+
+  mkdir "${CFS}/subsystems/${SUBNQN}" || return 1
+  echo 1 > "${CFS}/subsystems/${SUBNQN}/attr_allow_any_host"
+
+  mkdir "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}" || return 1
+  echo "/dev/nullb$(cat "${NULLB}/index")" > \
+    "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/device_path"
+  echo 1 > "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/enable" || return 1
+
+  mkdir "${CFS}/ports/${PORTID}" || return 1
+  echo "loop" > "${CFS}/ports/${PORTID}/addr_trtype"
+  ln -s "${CFS}/subsystems/${SUBNQN}" \
+    "${CFS}/ports/${PORTID}/subsystems/${SUBNQN}" || return 1
+
+  nvme connect -t loop -n "${SUBNQN}" || return 1
+
+  return 0
+}
+
+# Prints the block device of the namespace exported by the loop target
+find_dev() {
+  for TRY in $(seq 10); do
+    for BDEV in /sys/block/nvme*; do
+      if [[ "$(cat "${BDEV}/device/subsysnqn" 2> /dev/null)" == "${SUBNQN}" ]]
+      then
+        echo "/dev/$(basename "${BDEV}")"
+        return 0
+      fi
+    done
+    sleep 1
+  done
+
+  return 1
+}
+
+# Check that the script is run from xNVMe repos-root with the tests built
+if [[ ! -x "${TESTS}/xnvme_tests_lblk" ]]; then
+  echo "# FAILED: could not find test(${TESTS}/xnvme_tests_lblk)"
+  exit 1
+fi
+if ! nvme version &> /dev/null; then
+  echo "# This script uses 'nvme-cli', please install it"
+  exit 1
+fi
+
+trap teardown EXIT
+
+if ! setup; then
+  echo "# FAILED: setting up the zoned nvmet loop target"
+  exit 1
+fi
+
+DEV=$(find_dev)
+if [[ -z "${DEV}" ]]; then
+  echo "# FAILED: could not find the namespace of subnqn(${SUBNQN})"
+  exit 1
+fi
+echo "# Using DEV: ${DEV}"
+
+# The URIs contain glob characters
+set -f
+
+# The first open formats, discarding whatever the device held; the others
+# must find the mapping of the one before
+CMDS=(
+  "xnvme_tests_lblk io hftl:${DEV}?format=1 --slba 0x0 --elba 0x3ff"
+  "xnvme_tests_lblk reopen hftl:${DEV}"
+  "xnvme_tests_lblk overwrite hftl:${DEV} --count 3"
+  "xnvme_tests_lblk overwrite hftl:${DEV}?scopy=0&ozones=2 --count 3"
+  "xnvme_tests_lblk overwrite hftl:${DEV} --count 1"
+)
+
+NFAILED=0
+for CMD in "${CMDS[@]}"; do
+  echo "# ${CMD}"
+  if ! ${TESTS}/${CMD}; then
+    echo "# FAILED: ${CMD}"
+    NFAILED=$((NFAILED + 1))
+  fi
+done
+
+if [[ $NFAILED -ne 0 ]]; then
+  echo "# FAILED: ${NFAILED} test(s)"
+  exit 1
+fi
+
+echo "# PASSED"
+exit 0
@@ -0,0 +1,126 @@
+#!/usr/bin/env bash
+#
+# This script sets up a Linux 'nvmet' NVMe/TCP target on the loopback
+# interface, backed by a regular file, and runs the lblk and async_intf tests
+# against it via 'be:tcp'. The target is torn down on exit.
+#
+# It must be run as root, from the xNVMe repos-root, with the tests built, e.g.:
+#
+# make && sudo ./scripts/xnvme_tcp_loopback.sh
+#
+# The following environment variables are used when set:
+#
+# TESTS   - Directory of the test binaries, defaults to 'build/tests'
+# ADDR    - Address to listen on, defaults to '127.0.0.1'
+# PORT    - Port to listen on, defaults to '4420'
+# NBYTES  - Size of the backing file, defaults to 1GB
+#
+TESTS=${TESTS:-build/tests}
+ADDR=${ADDR:-127.0.0.1}
+PORT=${PORT:-4420}
+NBYTES=${NBYTES:-1073741824}
+
+SUBNQN="nqn.2021-01.io.xnvme:loopback"
+CFS="/sys/kernel/config/nvmet"
+PORTID=1
+NSID=1
+
+IMG=$(mktemp /tmp/xnvme_tcp_loopback.XXXXXX.img)
+
+teardown() {
+  rm -f "${CFS}/ports/${PORTID}/subsystems/${SUBNQN}" &> /dev/null
+  rmdir "${CFS}/ports/${PORTID}" &> /dev/null
+  if [[ -d "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}" ]]; then
+    echo 0 > "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/enable"
+    rmdir "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}"
+  fi
+  rmdir "${CFS}/subsystems/${SUBNQN}" &> /dev/null
+  rm -f "${IMG}"
+}
+
+setup() {
+  if ! modprobe nvmet-tcp; then
+    echo "# FAILED: modprobe nvmet-tcp"
+    return 1
+  fi
+  if [[ ! -d "${CFS}" ]]; then
+    mount -t configfs none /sys/kernel/config &> /dev/null
+  fi
+  if [[ ! -d "${CFS}" ]]; then
+    echo "# FAILED: could not find dir(${CFS})"
+    return 1
+  fi
+  if [[ -d "${CFS}/ports/${PORTID}" ]]; then
+    echo "# FAILED: nvmet port(${PORTID}) is in use"
+    return 1
+  fi
+
+  truncate -s "${NBYTES}" "${IMG}" || return 1
+
+  mkdir "${CFS}/subsystems/${SUBNQN}" || return 1
+  echo 1 > "${CFS}/subsystems/${SUBNQN}/attr_allow_any_host"
+
+  mkdir "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}" || return 1
+  echo "${IMG}" > "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/device_path"
+  echo 1 > "${CFS}/subsystems/${SUBNQN}/namespaces/${NSID}/enable" || return 1
+
+  mkdir "${CFS}/ports/${PORTID}" || return 1
+  echo "tcp" > "${CFS}/ports/${PORTID}/addr_trtype"
+  echo "ipv4" > "${CFS}/ports/${PORTID}/addr_adrfam"
+  echo "${ADDR}" > "${CFS}/ports/${PORTID}/addr_traddr"
+  echo "${PORT}" > "${CFS}/ports/${PORTID}/addr_trsvcid"
+  ln -s "${CFS}/subsystems/${SUBNQN}" \
+    "${CFS}/ports/${PORTID}/subsystems/${SUBNQN}" || return 1
+
+  return 0
+}
+
+# Check that the script is run from xNVMe repos-root with the tests built
+for TNAME in lblk async_intf; do
+  if [[ ! -x "${TESTS}/xnvme_tests_${TNAME}" ]]; then
+    echo "# FAILED: could not find test(${TESTS}/xnvme_tests_${TNAME})"
+    exit 1
+  fi
+done
+
+trap teardown EXIT
+
+if ! setup; then
+  echo "# FAILED: setting up the nvmet loopback target"
+  exit 1
+fi
+
+# Once via discovery, and once with the subsystem given, to cover both paths
+URIS="tcp:${ADDR}:${PORT}?nsid=${NSID}"
+URIS="${URIS} tcp:${ADDR}:${PORT}?nsid=${NSID}&subnqn=${SUBNQN}"
+
+# The URIs contain glob characters
+set -f
+
+NFAILED=0
+for URI in $URIS; do
+  CMDS=(
+    "xnvme_tests_lblk io ${URI} --slba 0x0 --elba 0x3ff"
+    "xnvme_tests_lblk reopen ${URI}"
+    "xnvme_tests_async_intf init_term ${URI} --count 4 --qdepth 64"
+    "xnvme_tests_async_intf chain ${URI} --slba 0x10 --qdepth 16"
+    "xnvme_tests_async_intf bufgrp ${URI} --slba 0x10 --qdepth 16"
+    "xnvme_tests_async_intf mget ${URI} --slba 0x10 --qdepth 16"
+    "xnvme_tests_async_intf rstream ${URI} --slba 0x10 --qdepth 16"
+  )
+  for CMD in "${CMDS[@]}"; do
+    echo "# ${CMD}"
+    if ! ${TESTS}/${CMD}; then
+      echo "# FAILED: ${CMD}"
+      NFAILED=$((NFAILED + 1))
+    fi
+  done
+done
+
+if [[ $NFAILED -ne 0 ]]; then
+  echo "# FAILED: ${NFAILED} test(s)"
+  exit 1
+fi
+
+echo "# PASSED"
+exit 0
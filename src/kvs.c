@@ -0,0 +1,228 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <libkvs.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_spec.h>
+
+const char *
+kvs_cmd_opc_str(enum kvs_cmd_opc opc)
+{
+	switch (opc) {
+	case KVS_CMD_OPC_STORE:
+		return "KVS_CMD_OPC_STORE";
+	case KVS_CMD_OPC_RETRIEVE:
+		return "KVS_CMD_OPC_RETRIEVE";
+	case KVS_CMD_OPC_LIST:
+		return "KVS_CMD_OPC_LIST";
+	case KVS_CMD_OPC_DELETE:
+		return "KVS_CMD_OPC_DELETE";
+	case KVS_CMD_OPC_EXIST:
+		return "KVS_CMD_OPC_EXIST";
+	}
+
+	return "KVS_CMD_OPC_ENOSYS";
+}
+
+const char *
+kvs_status_code_str(enum kvs_status_code sc)
+{
+	switch (sc) {
+	case KVS_SC_INVALID_VALUE_SIZE:
+		return "KVS_SC_INVALID_VALUE_SIZE";
+	case KVS_SC_INVALID_KEY_SIZE:
+		return "KVS_SC_INVALID_KEY_SIZE";
+	case KVS_SC_KEY_NOT_EXISTS:
+		return "KVS_SC_KEY_NOT_EXISTS";
+	case KVS_SC_UNRECOVERED:
+		return "KVS_SC_UNRECOVERED";
+	case KVS_SC_KEY_EXISTS:
+		return "KVS_SC_KEY_EXISTS";
+	}
+
+	return "KVS_SC_ENOSYS";
+}
+
+void
+kvs_cmd_set_key(struct kvs_cmd *cmd, const void *key, uint8_t klen)
+{
+	uint8_t buf[KVS_KEY_NBYTES_MAX] = { 0 };
+
+	klen = klen > KVS_KEY_NBYTES_MAX ? KVS_KEY_NBYTES_MAX : klen;
+	if (klen) {
+		memcpy(buf, key, klen);
+	}
+
+	memcpy(&cmd->kv.key_lo, buf, sizeof(cmd->kv.key_lo));
+	memcpy(&cmd->kv.key_hi, buf + 8, sizeof(cmd->kv.key_hi));
+	cmd->kv.kl = klen;
+}
+
+uint8_t
+kvs_cmd_get_key(const struct kvs_cmd *cmd, void *key)
+{
+	uint8_t buf[KVS_KEY_NBYTES_MAX];
+	uint8_t klen = cmd->kv.kl;
+
+	klen = klen > KVS_KEY_NBYTES_MAX ? KVS_KEY_NBYTES_MAX : klen;
+
+	memcpy(buf, &cmd->kv.key_lo, sizeof(cmd->kv.key_lo));
+	memcpy(buf + 8, &cmd->kv.key_hi, sizeof(cmd->kv.key_hi));
+	memcpy(key, buf, klen);
+
+	return klen;
+}
+
+int
+kvs_idfy_ns_fpr(FILE *stream, const struct kvs_idfy_ns *idfy, int opts)
+{
+	int wrtn = 0;
+
+	switch (opts) {
+	case XNVME_PR_DEF:
+	case XNVME_PR_YAML:
+		break;
+
+	case XNVME_PR_TERSE:
+		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
+		return wrtn;
+	}
+
+	wrtn += fprintf(stream, "kvs_idfy_ns:");
+	if (!idfy) {
+		wrtn += fprintf(stream, " ~\n");
+		return wrtn;
+	}
+
+	wrtn += fprintf(stream, "\n");
+	wrtn += fprintf(stream, "  nsze: %zu\n", idfy->nsze);
+	wrtn += fprintf(stream, "  nuse: %zu\n", idfy->nuse);
+	wrtn += fprintf(stream, "  nkvf: %d\n", idfy->nkvf);
+	wrtn += fprintf(stream, "  novg: %u\n", idfy->novg);
+
+	wrtn += fprintf(stream, "  kvf:\n");
+	for (int i = 0; i <= idfy->nkvf && i < KVS_NKVF; ++i) {
+		const struct kvs_kvf *kvf = &idfy->kvf[i];
+
+		wrtn += fprintf(stream, "  - { kml: %u, mvl: %u, mnk: %u }\n",
+				kvf->kml, kvf->mvl, kvf->mnk);
+	}
+
+	return wrtn;
+}
+
+int
+kvs_idfy_ns_pr(const struct kvs_idfy_ns *idfy, int opts)
+{
+	return kvs_idfy_ns_fpr(stdout, idfy, opts);
+}
+
+int
+kvs_list_next(const void *buf, uint32_t buf_nbytes, uint32_t *ofz, void *key)
+{
+	const uint8_t *data = buf;
+	uint16_t klen;
+
+	if (*ofz == 0) {
+		*ofz = sizeof(struct kvs_list_hdr);
+	}
+	if (*ofz + sizeof(klen) > buf_nbytes) {
+		return 0;
+	}
+
+	memcpy(&klen, data + *ofz, sizeof(klen));
+	if (!klen) {
+		return 0;
+	}
+	if ((klen > KVS_KEY_NBYTES_MAX) || \
+	    (*ofz + sizeof(klen) + klen > buf_nbytes)) {
+		XNVME_DEBUG("FAILED: invalid list entry, klen: %u", klen);
+		return -EINVAL;
+	}
+
+	memcpy(key, data + *ofz + sizeof(klen), klen);
+	*ofz += (sizeof(klen) + klen + 3) & ~3U;
+
+	return klen;
+}
+
+int
+kvs_cmd_store(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	      uint8_t klen, const void *vbuf, uint32_t vlen, uint8_t sopts,
+	      int opts, struct xnvme_req *ret)
+{
+	struct kvs_cmd cmd = { 0 };
+
+	cmd.common.opcode = KVS_CMD_OPC_STORE;
+	cmd.common.nsid = nsid;
+	cmd.kv.vsz = vlen;
+	cmd.kv.so = sopts;
+	kvs_cmd_set_key(&cmd, key, klen);
+
+	return dev->be.func.cmd_pass(dev, &cmd.base, (void *)vbuf, vlen,
+				     NULL, 0, opts, ret);
+}
+
+int
+kvs_cmd_retrieve(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+		 uint8_t klen, void *vbuf, uint32_t vbuf_nbytes, int opts,
+		 struct xnvme_req *ret)
+{
+	struct kvs_cmd cmd = { 0 };
+
+	cmd.common.opcode = KVS_CMD_OPC_RETRIEVE;
+	cmd.common.nsid = nsid;
+	cmd.kv.vsz = vbuf_nbytes;
+	kvs_cmd_set_key(&cmd, key, klen);
+
+	return dev->be.func.cmd_pass(dev, &cmd.base, vbuf, vbuf_nbytes,
+				     NULL, 0, opts, ret);
+}
+
+int
+kvs_cmd_delete(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	       uint8_t klen, int opts, struct xnvme_req *ret)
+{
+	struct kvs_cmd cmd = { 0 };
+
+	cmd.common.opcode = KVS_CMD_OPC_DELETE;
+	cmd.common.nsid = nsid;
+	kvs_cmd_set_key(&cmd, key, klen);
+
+	return dev->be.func.cmd_pass(dev, &cmd.base, NULL, 0, NULL, 0, opts,
+				     ret);
+}
+
+int
+kvs_cmd_exist(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	      uint8_t klen, int opts, struct xnvme_req *ret)
+{
+	struct kvs_cmd cmd = { 0 };
+
+	cmd.common.opcode = KVS_CMD_OPC_EXIST;
+	cmd.common.nsid = nsid;
+	kvs_cmd_set_key(&cmd, key, klen);
+
+	return dev->be.func.cmd_pass(dev, &cmd.base, NULL, 0, NULL, 0, opts,
+				     ret);
+}
+
+int
+kvs_cmd_list(struct xnvme_dev *dev, uint32_t nsid, const void *key,
+	     uint8_t klen, void *buf, uint32_t buf_nbytes, int opts,
+	     struct xnvme_req *ret)
+{
+	struct kvs_cmd cmd = { 0 };
+
+	cmd.common.opcode = KVS_CMD_OPC_LIST;
+	cmd.common.nsid = nsid;
+	cmd.kv.vsz = buf_nbytes;
+	kvs_cmd_set_key(&cmd, key, klen);
+
+	return dev->be.func.cmd_pass(dev, &cmd.base, buf, buf_nbytes, NULL, 0,
+				     opts, ret);
+}
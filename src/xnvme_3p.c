@@ -34,6 +34,9 @@ xnvme_3p_ver_fpr(FILE *stream, const char *ver[], enum xnvme_pr opts)
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
 		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
 		return wrtn;
 
@@ -0,0 +1,248 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <libznd.h>
+#include <xnvme_dev.h>
+
+struct xnvme_aggr {
+	struct xnvme_dev *dev;
+	uint32_t nsid;
+	int opts;
+
+	uint64_t slba;		///< Write-pointer or Zone start LBA
+	uint64_t id;		///< Identifier of the next record
+
+	xnvme_aggr_cb cb;
+	void *cb_arg;
+
+	uint8_t *buf;
+	uint32_t buf_nbytes;
+	uint32_t used_nbytes;
+	uint32_t pwg_nlb;	///< Preferred write granularity, NOT zero-based
+
+	struct xnvme_aggr_rec *recs;
+	uint32_t nrecs;
+	uint32_t recs_capacity;
+};
+
+int
+xnvme_aggr_flush(struct xnvme_aggr *aggr)
+{
+	const uint32_t lba_nbytes = aggr->dev->geo.lba_nbytes;
+	const uint32_t buf_nlb = aggr->buf_nbytes / lba_nbytes;
+	uint32_t nlb = (aggr->used_nbytes + lba_nbytes - 1) / lba_nbytes;
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	uint64_t slba;
+	int err;
+
+	if (!aggr->used_nbytes) {
+		return 0;
+	}
+
+	// Pad to the preferred write granularity, within the buffer
+	nlb = XNVME_MIN(((nlb + aggr->pwg_nlb - 1) / aggr->pwg_nlb) *
+			aggr->pwg_nlb, buf_nlb);
+
+	memset(aggr->buf + aggr->used_nbytes, 0,
+	       nlb * lba_nbytes - aggr->used_nbytes);
+
+	cmd.common.nsid = aggr->nsid;
+	cmd.common.opcode = (aggr->opts & XNVME_AGGR_APPEND) ?
+			    ZND_CMD_OPC_APPEND : XNVME_SPEC_OPC_WRITE;
+	cmd.lblk.slba = aggr->slba;
+	cmd.lblk.nlb = nlb - 1;
+	cmd.lblk.fua = (aggr->opts & XNVME_AGGR_FUA) ? 1 : 0;
+
+	err = xnvme_cmd_pass(aggr->dev, &cmd, aggr->buf, nlb * lba_nbytes, NULL,
+			     0, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_pass(), err: %d", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	if (aggr->opts & XNVME_AGGR_APPEND) {
+		slba = req.cpl.result;
+	} else {
+		slba = aggr->slba;
+		aggr->slba += nlb;
+	}
+
+	for (uint32_t i = 0; i < aggr->nrecs; ++i) {
+		struct xnvme_aggr_rec *rec = &aggr->recs[i];
+
+		// NOTE: 'lba' holds the byte-offset within the buffer until now
+		rec->ofz = rec->lba % lba_nbytes;
+		rec->lba = slba + rec->lba / lba_nbytes;
+	}
+
+exit:
+	if (aggr->cb) {
+		aggr->cb(aggr->recs, aggr->nrecs, err, aggr->cb_arg);
+	}
+
+	aggr->used_nbytes = 0;
+	aggr->nrecs = 0;
+
+	return err;
+}
+
+int
+xnvme_aggr_put(struct xnvme_aggr *aggr, const void *rec, uint32_t nbytes,
+	       uint64_t *id)
+{
+	int err;
+
+	if ((!nbytes) || (nbytes > aggr->buf_nbytes)) {
+		XNVME_DEBUG("FAILED: invalid nbytes: %u", nbytes);
+		return -EINVAL;
+	}
+
+	if (aggr->used_nbytes + nbytes > aggr->buf_nbytes) {
+		err = xnvme_aggr_flush(aggr);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_aggr_flush(), err: %d", err);
+			return err;
+		}
+	}
+
+	if (aggr->nrecs == aggr->recs_capacity) {
+		uint32_t capacity = aggr->recs_capacity * 2;
+		struct xnvme_aggr_rec *recs;
+
+		recs = realloc(aggr->recs, capacity * sizeof(*recs));
+		if (!recs) {
+			XNVME_DEBUG("FAILED: realloc(), errno: %d", errno);
+			return -errno;
+		}
+		aggr->recs = recs;
+		aggr->recs_capacity = capacity;
+	}
+
+	aggr->recs[aggr->nrecs].id = aggr->id;
+	aggr->recs[aggr->nrecs].lba = aggr->used_nbytes;
+	aggr->recs[aggr->nrecs].nbytes = nbytes;
+	aggr->nrecs += 1;
+
+	memcpy(aggr->buf + aggr->used_nbytes, rec, nbytes);
+	aggr->used_nbytes += nbytes;
+
+	if (id) {
+		*id = aggr->id;
+	}
+	aggr->id += 1;
+
+	if (aggr->used_nbytes == aggr->buf_nbytes) {
+		return xnvme_aggr_flush(aggr);
+	}
+
+	return 0;
+}
+
+int
+xnvme_aggr_term(struct xnvme_aggr *aggr)
+{
+	int err;
+
+	if (!aggr) {
+		return 0;
+	}
+
+	err = xnvme_aggr_flush(aggr);
+
+	xnvme_buf_free(aggr->dev, aggr->buf);
+	free(aggr->recs);
+	free(aggr);
+
+	return err;
+}
+
+/**
+ * Default buffer size; the largest multiple of the optimal write size, or
+ * else of the preferred write granularity, which is within MDTS
+ */
+static uint32_t
+aggr_buf_nbytes(const struct xnvme_geo *geo)
+{
+	uint32_t unit_nbytes = (geo->nows + 1) * geo->lba_nbytes;
+
+	if ((!geo->nows) || (unit_nbytes > geo->mdts_nbytes)) {
+		unit_nbytes = (geo->npwg + 1) * geo->lba_nbytes;
+	}
+	if ((!unit_nbytes) || (unit_nbytes > geo->mdts_nbytes)) {
+		return geo->mdts_nbytes;
+	}
+
+	return (geo->mdts_nbytes / unit_nbytes) * unit_nbytes;
+}
+
+int
+xnvme_aggr_init(struct xnvme_dev *dev, struct xnvme_aggr **aggr, uint32_t nsid,
+		uint64_t slba, uint32_t buf_nbytes, int opts, xnvme_aggr_cb cb,
+		void *cb_arg)
+{
+	const struct xnvme_geo *geo = &dev->geo;
+	int err;
+
+	if (!buf_nbytes) {
+		buf_nbytes = aggr_buf_nbytes(geo);
+	}
+	if ((!geo->lba_nbytes) || (buf_nbytes < geo->lba_nbytes) ||
+	    (buf_nbytes % geo->lba_nbytes) ||
+	    (buf_nbytes > geo->mdts_nbytes)) {
+		XNVME_DEBUG("FAILED: invalid buf_nbytes: %u", buf_nbytes);
+		return -EINVAL;
+	}
+	if ((opts & XNVME_AGGR_APPEND) && (geo->type != XNVME_GEO_ZONED)) {
+		XNVME_DEBUG("FAILED: XNVME_AGGR_APPEND on non-zoned device");
+		return -EINVAL;
+	}
+	// Padding to the write granularity is pointless from an unaligned start
+	if ((!(opts & XNVME_AGGR_APPEND)) && (slba % (geo->npwa + 1))) {
+		XNVME_DEBUG("FAILED: slba: 0x%016"PRIx64" unaligned to npwa: %u",
+			    slba, geo->npwa);
+		return -EINVAL;
+	}
+
+	(*aggr) = calloc(1, sizeof(**aggr));
+	if (!(*aggr)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*aggr)->dev = dev;
+	(*aggr)->nsid = nsid;
+	(*aggr)->opts = opts;
+	(*aggr)->slba = slba;
+	(*aggr)->cb = cb;
+	(*aggr)->cb_arg = cb_arg;
+	(*aggr)->buf_nbytes = buf_nbytes;
+	(*aggr)->pwg_nlb = geo->npwg + 1;
+
+	(*aggr)->buf = xnvme_buf_alloc(dev, buf_nbytes, NULL);
+	if (!(*aggr)->buf) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+		goto failed;
+	}
+
+	(*aggr)->recs_capacity = XNVME_MAX(buf_nbytes / geo->lba_nbytes, 1);
+	(*aggr)->recs = calloc((*aggr)->recs_capacity, sizeof(*(*aggr)->recs));
+	if (!(*aggr)->recs) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	xnvme_buf_free(dev, (*aggr)->buf);
+	free(*aggr);
+	*aggr = NULL;
+
+	return err;
+}
@@ -50,3 +50,239 @@ xnvme_async_get_outstanding(struct xnvme_async_ctx *ctx)
 {
 	return ctx->outstanding;
 }
+
+struct batch_cb_args {
+	struct xnvme_req *reqs;
+	struct xnvme_spec_cpl *cpl;
+	uint32_t ecount;
+};
+
+static void
+batch_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct batch_cb_args *args = cb_arg;
+
+	if (args->cpl) {
+		args->cpl[req - args->reqs] = req->cpl;
+	}
+	if (xnvme_req_cpl_status(req)) {
+		args->ecount += 1;
+	}
+}
+
+int
+xnvme_async_batch_rw(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		     uint8_t opcode, uint32_t nsid, const uint64_t *slbas,
+		     uint16_t nlb, void *buf, uint32_t nentries,
+		     struct xnvme_spec_cpl *cpl)
+{
+	const size_t cmd_nbytes = (size_t)dev->geo.lba_nbytes * (nlb + 1);
+	struct batch_cb_args args = { 0 };
+	struct xnvme_cmd_prep prep;
+	uint8_t *payload = buf;
+	int err = 0;
+
+	switch (opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x", opcode);
+		return -EINVAL;
+	}
+	if (!(ctx && slbas && buf)) {
+		XNVME_DEBUG("FAILED: !ctx || !slbas || !buf");
+		return -EINVAL;
+	}
+
+	err = xnvme_cmd_prep_init(&prep, dev, opcode, nsid, XNVME_CMD_ASYNC);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_prep_init(), err: %d", err);
+		return err;
+	}
+
+	args.reqs = calloc(nentries, sizeof(*args.reqs));
+	if (!args.reqs) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	args.cpl = cpl;
+
+	for (uint32_t i = 0; i < nentries; ++i) {
+		struct xnvme_req *req = &args.reqs[i];
+
+		req->async.ctx = ctx;
+		req->async.cb = batch_cb;
+		req->async.cb_arg = &args;
+
+submit:
+		err = xnvme_cmd_prep_pass(&prep, slbas[i], nlb, payload, NULL,
+					  req);
+		switch (err) {
+		case 0:
+			break;
+
+		case -EBUSY:
+		case -EAGAIN:
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err < 0) {
+				XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d",
+					    err);
+				goto exit;
+			}
+			goto submit;
+
+		default:
+			XNVME_DEBUG("FAILED: submission, i: %u, err: %d", i,
+				    err);
+			goto exit;
+		}
+
+		payload += cmd_nbytes;
+	}
+
+exit:
+	{
+		int err_wait = xnvme_async_wait(dev, ctx);
+
+		if (err_wait < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d",
+				    err_wait);
+			err = err ? err : err_wait;
+		}
+	}
+	free(args.reqs);
+
+	return err < 0 ? err : (int)args.ecount;
+}
+
+static void
+chain_complete(struct xnvme_async_link *link, uint8_t sc)
+{
+	struct xnvme_req *req = &link->req;
+
+	req->async.cb = link->sched.cb;
+	req->async.cb_arg = link->sched.cb_arg;
+	if (sc) {
+		req->cpl.status.sct = 0x0;
+		req->cpl.status.sc = sc;
+	}
+
+	req->async.cb(req, req->async.cb_arg);
+}
+
+static void
+chain_abort(struct xnvme_async_link *link)
+{
+	for (; link; link = link->sched.next) {
+		chain_complete(link, XNVME_SPEC_SC_ABORT_REQ);
+	}
+}
+
+static inline int
+chain_submit(struct xnvme_async_link *link, int opts)
+{
+	return xnvme_cmd_pass(link->sched.dev, &link->cmd, link->dbuf,
+			      link->dbuf_nbytes, link->mbuf, link->mbuf_nbytes,
+			      XNVME_CMD_ASYNC | opts, &link->req);
+}
+
+// Library-side scheduling: the successor is submitted from the callback of
+// its predecessor, thus without returning to the caller in between
+static void
+chain_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_async_link *link = cb_arg;
+	struct xnvme_async_link *next = link->sched.next;
+	int failed = xnvme_req_cpl_status(req);
+	int err;
+
+	chain_complete(link, XNVME_SPEC_SC_SUCCESS);
+
+	if (!next) {
+		return;
+	}
+	if (failed) {
+		chain_abort(next);
+		return;
+	}
+
+	err = chain_submit(next, 0x0);
+	if (err) {
+		XNVME_DEBUG("FAILED: chain_submit(), err: %d", err);
+		chain_abort(next);
+	}
+}
+
+int
+xnvme_async_chain(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		  struct xnvme_async_link *links, uint32_t nlinks)
+{
+	int err = 0;
+
+	if (!(ctx && links && nlinks)) {
+		XNVME_DEBUG("FAILED: !ctx || !links || !nlinks");
+		return -EINVAL;
+	}
+	if (ctx->outstanding + nlinks > ctx->depth) {
+		XNVME_DEBUG("FAILED: chain does not fit, nlinks: %u", nlinks);
+		return -EBUSY;
+	}
+
+	for (uint32_t i = 0; i < nlinks; ++i) {
+		struct xnvme_async_link *link = &links[i];
+
+		link->req.async.ctx = ctx;
+		link->sched.dev = dev;
+		link->sched.next = (i + 1 < nlinks) ? &links[i + 1] : NULL;
+		link->sched.cb = link->req.async.cb;
+		link->sched.cb_arg = link->req.async.cb_arg;
+	}
+
+	// Native linking is opt-in, as a backend unaware of XNVME_CMD_LINK
+	// would execute the commands in any order
+	if (dev->be.attr.caps & XNVME_BE_CAP_LINK) {
+		for (uint32_t i = 0; i < nlinks; ++i) {
+			struct xnvme_async_link *link = &links[i];
+			int opts = link->sched.next ? XNVME_CMD_LINK : 0x0;
+
+			err = chain_submit(link, opts);
+			if (!err) {
+				continue;
+			}
+			if (!i) {
+				XNVME_DEBUG("FAILED: chain_submit(), err: %d",
+					    err);
+				return err;
+			}
+
+			// NOTE: the backend terminates the chain at the
+			// command preceding 'link', the commands from 'link'
+			// and onwards are thus not executed
+			XNVME_DEBUG("FAILED: chain_submit(), i: %u, err: %d", i,
+				    err);
+			chain_abort(link);
+			return 0;
+		}
+
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < nlinks; ++i) {
+		links[i].req.async.cb = chain_cb;
+		links[i].req.async.cb_arg = &links[i];
+	}
+
+	err = chain_submit(&links[0], 0x0);
+	if (err) {
+		XNVME_DEBUG("FAILED: chain_submit(), err: %d", err);
+		for (uint32_t i = 0; i < nlinks; ++i) {
+			links[i].req.async.cb = links[i].sched.cb;
+			links[i].req.async.cb_arg = links[i].sched.cb_arg;
+		}
+		return err;
+	}
+
+	return 0;
+}
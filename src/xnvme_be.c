@@ -7,8 +7,10 @@
 #include <errno.h>
 #include <libxnvme.h>
 #include <libznd.h>
+#include <libkvs.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
+#include <xnvme_pr.h>
 #include <xnvme_be_registry.c>
 
 bool
@@ -65,6 +67,9 @@ xnvme_lba_fpr(FILE *stream, uint64_t lba, enum xnvme_pr opts)
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
 		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
 		return wrtn;
 
@@ -75,6 +80,9 @@ xnvme_lba_fpr(FILE *stream, uint64_t lba, enum xnvme_pr opts)
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
 		wrtn += fprintf(stream, "0x%016lx", lba);
 		break;
 
@@ -101,6 +109,9 @@ xnvme_lba_fprn(FILE *stream, const uint64_t *lba, uint16_t nlb,
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
 		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
 		return wrtn;
 
@@ -282,11 +293,9 @@ _zoned_geometry(struct xnvme_dev *dev)
 
 // TODO: select LBAF correctly, instead of the first
 static inline int
-_conventional_geometry(struct xnvme_dev *dev)
+_ns_geometry(const struct xnvme_spec_idfy_ns *nvm, struct xnvme_geo *geo)
 {
-	const struct xnvme_spec_idfy_ns *nvm = (void *)xnvme_dev_get_ns(dev);
 	const struct xnvme_spec_lbaf *lbaf = &nvm->lbaf[nvm->flbas.format];
-	struct xnvme_geo *geo = &dev->geo;
 
 	geo->type = XNVME_GEO_CONVENTIONAL;
 
@@ -294,7 +303,7 @@ _conventional_geometry(struct xnvme_dev *dev)
 	geo->npunit = 1;
 	geo->nzone = 1;
 
-	geo->nsect = dev->id.ns.nsze;
+	geo->nsect = nvm->nsze;
 	geo->nbytes = 2 << (lbaf->ds - 1);
 	geo->nbytes_oob = lbaf->ms;
 
@@ -307,6 +316,60 @@ _conventional_geometry(struct xnvme_dev *dev)
 	return 0;
 }
 
+static inline int
+_conventional_geometry(struct xnvme_dev *dev)
+{
+	return _ns_geometry(xnvme_dev_get_ns(dev), &dev->geo);
+}
+
+/**
+ * Key-Value namespaces are not addressed by LBA, the geometry thus describes
+ * the capacity in bytes, with a "sector" of a single byte
+ */
+static inline int
+_kv_geometry(struct xnvme_dev *dev)
+{
+	struct kvs_idfy_ns *kvs = (void *)xnvme_dev_get_ns_css(dev);
+	struct xnvme_geo *geo = &dev->geo;
+
+	if (!kvs->nsze) {
+		XNVME_DEBUG("FAILED: !kvs.nsze");
+		return -EINVAL;
+	}
+
+	geo->type = XNVME_GEO_KV;
+
+	geo->npugrp = 1;
+	geo->npunit = 1;
+	geo->nzone = 1;
+	geo->nsect = kvs->nsze;
+
+	geo->nbytes = 1;
+	geo->nbytes_oob = 0;
+
+	geo->lba_nbytes = geo->nbytes;
+	geo->lba_extended = 0;
+
+	return 0;
+}
+
+/**
+ * Optimal IO boundaries, these are only valid when reported via 'optperf'
+ */
+static inline void
+_optimal_boundaries(const struct xnvme_spec_idfy_ns *nvm,
+		    struct xnvme_geo *geo)
+{
+	if (!nvm->nsfeat.optperf) {
+		return;
+	}
+
+	geo->npwg = nvm->npwg;
+	geo->npwa = nvm->npwa;
+	geo->npdg = nvm->npdg;
+	geo->nows = nvm->nows;
+}
+
 // TODO: extract basename from ident->trgt
 static inline int
 _blockdevice_geometry(struct xnvme_dev *dev)
@@ -352,6 +415,14 @@ _blockdevice_geometry(struct xnvme_dev *dev)
 	}
 	geo->mdts_nbytes = val * 1024;
 
+	// Optional, thus errors are ignored
+	sprintf(sysfs_path, "/sys/block/%s/queue/optimal_io_size", dev_fname);
+	if ((!path_to_ll(sysfs_path, &val)) && (val >= geo->nbytes)) {
+		uint64_t nlb = val / geo->nbytes;
+
+		geo->nows = (nlb > UINT16_MAX ? UINT16_MAX + 1 : nlb) - 1;
+	}
+
 	dev->ssw = XNVME_ILOG2(geo->nbytes);
 
 	geo->lba_extended = 0;
@@ -360,7 +431,6 @@ _blockdevice_geometry(struct xnvme_dev *dev)
 	return 0;
 }
 
-// TODO: add proper handling of NVMe controllers
 int
 xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 {
@@ -374,8 +444,11 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 		}
 		break;
 
+	// The namespaces of a controller handle each have their own geometry,
+	// see xnvme_dev_get_ns_geo()
 	case XNVME_DEV_TYPE_NVME_CONTROLLER:
-		return -ENOSYS;
+		geo->type = XNVME_GEO_UNKNOWN;
+		goto mdts;
 
 	case XNVME_DEV_TYPE_NVME_NAMESPACE:
 		switch (dev->csi) {
@@ -386,6 +459,13 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 			}
 			break;
 
+		case XNVME_SPEC_CSI_KV:
+			if (_kv_geometry(dev)) {
+				XNVME_DEBUG("FAILED: _kv_geometry");
+				return -EINVAL;
+			}
+			break;
+
 		case XNVME_SPEC_CSI_NOCHECK:
 		case XNVME_SPEC_CSI_LBLK:
 			if (_conventional_geometry(dev)) {
@@ -394,6 +474,7 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 			}
 			break;
 		}
+		_optimal_boundaries(xnvme_dev_get_ns(dev), &dev->geo);
 		break;
 	}
 
@@ -403,6 +484,7 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 	/* Derive the sector-shift-width for LBA mapping */
 	dev->ssw = XNVME_ILOG2(dev->geo.nbytes);
 
+mdts:
 	//
 	// If the controller reports that MDTS is unbounded, that is, it can be
 	// infinitely large then we cap it here to something that just might
@@ -433,6 +515,56 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 	return 0;
 }
 
+int
+xnvme_dev_get_ns_geo(struct xnvme_dev *dev, uint32_t nsid,
+		     struct xnvme_geo *geo)
+{
+	struct xnvme_spec_idfy *idfy = NULL;
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	int err;
+
+	idfy = xnvme_buf_alloc(dev, sizeof(*idfy), NULL);
+	if (!idfy) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		return -errno;
+	}
+	memset(idfy, 0, sizeof(*idfy));
+
+	cmd.common.opcode = XNVME_SPEC_OPC_IDFY;
+	cmd.common.nsid = nsid;
+	cmd.idfy.cns = XNVME_SPEC_IDFY_NS;
+
+	err = xnvme_cmd_pass_admin(dev, &cmd, idfy, sizeof(*idfy), NULL, 0x0,
+				   0x0, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify namespace, err: %d", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	if (!idfy->ns.nsze) {
+		XNVME_DEBUG("FAILED: inactive nsid: 0x%x", nsid);
+		err = -ENXIO;
+		goto exit;
+	}
+
+	memset(geo, 0, sizeof(*geo));
+	err = _ns_geometry(&idfy->ns, geo);
+	if (err) {
+		XNVME_DEBUG("FAILED: _ns_geometry(), err: %d", err);
+		goto exit;
+	}
+	_optimal_boundaries(&idfy->ns, geo);
+
+	geo->tbytes = geo->nsect * geo->nbytes;
+	geo->mdts_nbytes = dev->geo.mdts_nbytes;
+
+exit:
+	xnvme_buf_free(dev, idfy);
+
+	return err;
+}
+
 int
 xnvme_ident_yaml(FILE *stream, const struct xnvme_ident *ident, int indent,
 		 const char *sep, int head)
@@ -494,6 +626,59 @@ xnvme_ident_pr(const struct xnvme_ident *ident, int opts)
 	return xnvme_ident_fpr(stdout, ident, opts);
 }
 
+/**
+ * Emit the entries of the enumeration as CSV rows, JSON objects, or as stored
+ */
+static int
+xnvme_enumeration_fpr_entries(FILE *stream, struct xnvme_enumeration *list,
+			      int opts)
+{
+	struct xnvme_pr_buf pb;
+
+	if (!list) {
+		return 0;
+	}
+
+	xnvme_pr_buf_init(&pb, stream);
+
+	if (opts == XNVME_PR_BIN) {
+		xnvme_pr_buf_write(&pb, list->entries,
+				   list->nentries * sizeof(*list->entries));
+		return xnvme_pr_buf_flush(&pb);
+	}
+
+	if (opts == XNVME_PR_CSV) {
+		xnvme_pr_buf_printf(&pb, "uri,schm,trgt,opts\n");
+	}
+	for (uint32_t idx = 0; idx < list->nentries; ++idx) {
+		const struct xnvme_ident *entry = &list->entries[idx];
+
+		if (opts == XNVME_PR_CSV) {
+			xnvme_pr_buf_csv_str(&pb, entry->uri);
+			xnvme_pr_buf_write(&pb, ",", 1);
+			xnvme_pr_buf_csv_str(&pb, entry->schm);
+			xnvme_pr_buf_write(&pb, ",", 1);
+			xnvme_pr_buf_csv_str(&pb, entry->trgt);
+			xnvme_pr_buf_write(&pb, ",", 1);
+			xnvme_pr_buf_csv_str(&pb, entry->opts);
+			xnvme_pr_buf_write(&pb, "\n", 1);
+			continue;
+		}
+
+		xnvme_pr_buf_printf(&pb, "{\"uri\":");
+		xnvme_pr_buf_json_str(&pb, entry->uri);
+		xnvme_pr_buf_printf(&pb, ",\"schm\":");
+		xnvme_pr_buf_json_str(&pb, entry->schm);
+		xnvme_pr_buf_printf(&pb, ",\"trgt\":");
+		xnvme_pr_buf_json_str(&pb, entry->trgt);
+		xnvme_pr_buf_printf(&pb, ",\"opts\":");
+		xnvme_pr_buf_json_str(&pb, entry->opts);
+		xnvme_pr_buf_printf(&pb, "}\n");
+	}
+
+	return xnvme_pr_buf_flush(&pb);
+}
+
 int
 xnvme_enumeration_fpr(FILE *stream, struct xnvme_enumeration *list, int opts)
 {
@@ -504,6 +689,11 @@ xnvme_enumeration_fpr(FILE *stream, struct xnvme_enumeration *list, int opts)
 		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
+		return xnvme_enumeration_fpr_entries(stream, list, opts);
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
@@ -0,0 +1,1991 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_CMPR_NAME "cmpr"
+
+#ifdef XNVME_BE_CMPR_ENABLED
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xnvme_async.h>
+#include <xnvme_be_cmpr.h>
+#include <xnvme_dev.h>
+#include <xnvme_lower.h>
+
+/**
+ * Inline compression on top of a conventional namespace
+ *
+ * The exposed LBAs are grouped into fixed-size chunks, each compressed, by a
+ * pool of worker threads, into a variable-size record. Records are packed, at
+ * byte granularity, into segments which are filled in host memory and written
+ * in full to the lower device, via its async. interface, when sealed. A table
+ * in memory maps each chunk to its record: segment, offset, and length.
+ *
+ * Writes smaller than a chunk read, modify, and write the chunk. Reads of a
+ * record still in memory are served from there, others read the LBAs holding
+ * the record and decompress it directly into the buffer of the command.
+ *
+ * Space held by overwritten records is reclaimed by a garbage collector, on a
+ * thread of its own, moving the valid records of the segment with the fewest
+ * valid bytes, without decompressing them. The mapping table is persisted as
+ * a checkpoint, as done by be:hftl, on flush, on close, and when reclaimed
+ * segments are to be reused; data written since the last flush is lost on
+ * power-loss, as with a volatile write cache.
+ *
+ * Records are compressed in the LZ4 block format; a record not shrinking is
+ * stored as is.
+ */
+
+#define CMPR_UNMAPPED UINT32_MAX
+#define CMPR_CKPT_MAGIC 0x52504d43454d564eULL	///< "NVMECMPR"
+#define CMPR_CKPT_VERSION 1
+#define CMPR_GC_RESERVE 2	///< Free segments only usable by the collector
+#define CMPR_GC_STALE_MAX 4	///< Stale segments before forcing a checkpoint
+#define CMPR_NSTRIPES 64	///< Locks serializing writes to the same chunk
+#define CMPR_WB_QD 8		///< Queue-depth of segment write-back
+
+#define CMPR_LZ4_HASH_LOG 12
+#define CMPR_LZ4_MINMATCH 4
+#define CMPR_LZ4_LASTLITERALS 5
+#define CMPR_LZ4_MFLIMIT 12
+#define CMPR_LZ4_DISTANCE_MAX 65535
+
+enum cmpr_open {
+	CMPR_OPEN_HOST = 0,
+	CMPR_OPEN_GC = 1,
+};
+
+enum cmpr_sstate {
+	CMPR_SEG_FREE = 0,
+	CMPR_SEG_OPEN,		///< Receiving records, in memory
+	CMPR_SEG_SEALED,	///< Full, being written to the device
+	CMPR_SEG_CLOSED,	///< On the device
+	CMPR_SEG_STALE,		///< No valid records, freed by the next checkpoint
+};
+
+/**
+ * Location of the record of a chunk
+ */
+struct cmpr_map {
+	uint32_t seg;		///< Segment, CMPR_UNMAPPED when never written
+	uint32_t ofz;		///< Offset, in bytes, of the record in the segment
+	uint32_t clen;		///< Length of the payload, chunk_nbytes when raw
+	uint32_t gen;		///< Generation of the segment
+};
+XNVME_STATIC_ASSERT(sizeof(struct cmpr_map) == 16, "Incorrect size")
+
+/**
+ * Header of a record, the payload follows; records are 16 byte aligned. The
+ * generation tells records of the current use of a segment from stale ones.
+ */
+struct cmpr_rec {
+	uint64_t lchunk;
+	uint32_t clen;
+	uint32_t gen;
+};
+XNVME_STATIC_ASSERT(sizeof(struct cmpr_rec) == 16, "Incorrect size")
+
+struct cmpr_sbuf {
+	uint8_t *buf;		///< Segment in memory, allocated via lower
+	struct cmpr_sbuf *next;
+};
+
+struct cmpr_seg {
+	enum cmpr_sstate state;
+	uint32_t gen;
+	uint32_t used;		///< Bytes filled with records
+	uint32_t nvalid;	///< Bytes of records referenced by the mapping
+	uint32_t nreaders;	///< Reading records from the device
+	struct cmpr_sbuf *sbuf;	///< When OPEN or SEALED
+};
+
+/**
+ * Header of a checkpoint, the table is the mapping
+ */
+struct cmpr_ckpt {
+	struct xnvme_ckpt_hdr hdr;
+	uint64_t nchunks;
+	uint32_t chunk_nbytes;
+	uint32_t seg_nbytes;
+	uint32_t nsegs;
+	uint32_t gen;		///< Latest segment generation
+};
+
+/**
+ * State of a worker, also used by the garbage collector
+ */
+struct cmpr_worker {
+	struct xnvme_cmpr *cmpr;
+	pthread_t thread;
+	int started;
+
+	uint8_t *raw;			///< A chunk, uncompressed
+	uint8_t *cbuf;			///< A chunk, compressed
+	uint8_t *rbuf;			///< Record read from the device
+	uint32_t *htbl;			///< LZ4 hash-table
+
+	struct xnvme_async_ctx *actx;	///< Write-back on the lower device
+	struct xnvme_req reqs[CMPR_WB_QD];
+	int wb_err;
+};
+
+/**
+ * A command split into chunks, each carried out by a worker
+ */
+struct cmpr_cmd {
+	struct xnvme_req *req;
+	struct xnvme_async_ctx_cmpr *actx;	///< NULL when sync.
+
+	uint8_t opcode;
+	uint64_t slba;
+	uint64_t nlb;
+	uint8_t *dbuf;
+
+	uint64_t npieces;
+	uint64_t next;		///< Piece to be taken by a worker
+	uint64_t ndone;
+	int err;
+	int done;
+
+	struct cmpr_cmd *link;
+};
+
+struct xnvme_cmpr {
+	struct xnvme_lower lower;
+
+	pthread_mutex_t lock;		///< Mapping, segments, and buffers
+	pthread_cond_t cond;
+	pthread_mutex_t stripes[CMPR_NSTRIPES];
+	int err;			///< Write-back failed, data is lost
+
+	pthread_mutex_t wq_lock;	///< Work-queue and command progress
+	pthread_cond_t wq_cond;
+	struct cmpr_cmd *wq_head;
+	struct cmpr_cmd *wq_tail;
+	int wq_stop;
+	struct cmpr_worker *workers;
+	uint32_t nwork;
+
+	pthread_t gc_thread;
+	int gc_started;
+	int gc_stop;
+	int gc_err;			///< Error causing the collector to stop
+	int gc_nospc;			///< No segment is worth reclaiming
+	uint32_t gc_thresh;		///< Collect when fewer segments are free
+	struct cmpr_worker gcw;
+	uint8_t *gcbuf;			///< Segment being reclaimed
+
+	uint32_t chunk_nbytes;
+	uint32_t chunk_nlb;
+	uint64_t nchunks;
+	uint64_t nlpages;		///< LBAs exposed
+
+	uint32_t seg_nbytes;
+	uint32_t seg_nlb;
+	uint32_t nsegs;
+	uint64_t data_slba;		///< First LBA of the first segment
+
+	struct cmpr_map *l2p;
+	struct cmpr_seg *segs;
+	uint32_t nfree;
+	uint32_t nstale;
+	uint32_t nsealed;
+	uint32_t seg_next;		///< Allocation cursor
+	uint32_t gen;
+	uint32_t open[2];		///< See enum cmpr_open, nsegs when none
+
+	struct cmpr_sbuf *sbufs;
+	uint32_t nsbufs;
+	struct cmpr_sbuf *sbuf_free;
+
+	struct xnvme_ckpt ckpt;		///< Of the mapping
+};
+
+static inline uint64_t
+cmpr_min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline uint32_t
+cmpr_rec_nbytes(uint32_t clen)
+{
+	return (sizeof(struct cmpr_rec) + clen + 15) & ~15U;
+}
+
+static inline uint32_t
+cmpr_lz4_read32(const uint8_t *ptr)
+{
+	uint32_t val;
+
+	memcpy(&val, ptr, sizeof(val));
+
+	return val;
+}
+
+static inline uint32_t
+cmpr_lz4_hash(uint32_t seq)
+{
+	return (seq * 2654435761U) >> (32 - CMPR_LZ4_HASH_LOG);
+}
+
+static inline uint8_t *
+cmpr_lz4_len(uint8_t *op, const uint8_t *oend, uint64_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op == oend) {
+			return NULL;
+		}
+		*op++ = 255;
+	}
+	if (op == oend) {
+		return NULL;
+	}
+	*op++ = len;
+
+	return op;
+}
+
+/**
+ * Compress 'src' into 'dst' as a LZ4 block; returns the compressed length, or
+ * zero when it does not fit in 'cap' bytes
+ */
+static uint32_t
+cmpr_lz4_compress(const uint8_t *src, uint32_t nbytes, uint8_t *dst,
+		  uint32_t cap, uint32_t *htbl)
+{
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *iend = src + nbytes;
+	const uint8_t *mflimit = iend - CMPR_LZ4_MFLIMIT;
+	const uint8_t *mlimit = iend - CMPR_LZ4_LASTLITERALS;
+	uint8_t *op = dst, *oend = dst + cap;
+	uint64_t litlen;
+
+	memset(htbl, 0, sizeof(*htbl) << CMPR_LZ4_HASH_LOG);
+
+	while ((nbytes > CMPR_LZ4_MFLIMIT) && (ip < mflimit)) {
+		const uint32_t seq = cmpr_lz4_read32(ip);
+		const uint32_t hash = cmpr_lz4_hash(seq);
+		const uint8_t *ref = src + htbl[hash];
+		const uint8_t *mp;
+		uint64_t mlen;
+		uint8_t *token;
+
+		htbl[hash] = ip - src;
+		if ((ref >= ip) || (ip - ref > CMPR_LZ4_DISTANCE_MAX) ||
+		    (cmpr_lz4_read32(ref) != seq)) {
+			ip += 1;
+			continue;
+		}
+
+		while ((ip > anchor) && (ref > src) && (ip[-1] == ref[-1])) {
+			ip -= 1;
+			ref -= 1;
+		}
+		mp = ip + CMPR_LZ4_MINMATCH;
+		for (ref += CMPR_LZ4_MINMATCH; (mp < mlimit) && (*mp == *ref);
+		     ++mp, ++ref) {
+			;
+		}
+		litlen = ip - anchor;
+		mlen = mp - ip - CMPR_LZ4_MINMATCH;
+
+		if (op + 1 + litlen + 2 > oend) {
+			return 0;
+		}
+		token = op++;
+		*token = (litlen < 15 ? litlen : 15) << 4;
+		if ((litlen >= 15) && !(op = cmpr_lz4_len(op, oend, litlen - 15))) {
+			return 0;
+		}
+		if (op + litlen + 2 > oend) {
+			return 0;
+		}
+		memcpy(op, anchor, litlen);
+		op += litlen;
+		*op++ = (mp - ref) & 0xFF;
+		*op++ = (mp - ref) >> 8;
+
+		*token |= mlen < 15 ? mlen : 15;
+		if ((mlen >= 15) && !(op = cmpr_lz4_len(op, oend, mlen - 15))) {
+			return 0;
+		}
+
+		ip = mp;
+		anchor = ip;
+	}
+
+	litlen = iend - anchor;
+	if (op + 1 > oend) {
+		return 0;
+	}
+	*op++ = (litlen < 15 ? litlen : 15) << 4;
+	if ((litlen >= 15) && !(op = cmpr_lz4_len(op, oend, litlen - 15))) {
+		return 0;
+	}
+	if (op + litlen > oend) {
+		return 0;
+	}
+	memcpy(op, anchor, litlen);
+	op += litlen;
+
+	return op - dst;
+}
+
+static inline int
+cmpr_lz4_len_read(const uint8_t **ip, const uint8_t *iend, uint64_t *len)
+{
+	uint8_t val;
+
+	do {
+		if (*ip == iend) {
+			return -EIO;
+		}
+		val = *(*ip)++;
+		*len += val;
+	} while (val == 255);
+
+	return 0;
+}
+
+/**
+ * Decompress the LZ4 block 'src' into 'dst'; returns the decompressed length,
+ * or -EIO when the block is malformed or exceeds 'cap' bytes
+ */
+static int64_t
+cmpr_lz4_decompress(const uint8_t *src, uint32_t nbytes, uint8_t *dst,
+		    uint32_t cap)
+{
+	const uint8_t *ip = src, *iend = src + nbytes;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	for (;;) {
+		uint64_t litlen, mlen, ofz;
+		uint8_t token;
+
+		if (ip == iend) {
+			return -EIO;
+		}
+		token = *ip++;
+
+		litlen = token >> 4;
+		if ((litlen == 15) && cmpr_lz4_len_read(&ip, iend, &litlen)) {
+			return -EIO;
+		}
+		if ((litlen > (uint64_t)(iend - ip)) ||
+		    (litlen > (uint64_t)(oend - op))) {
+			return -EIO;
+		}
+		memcpy(op, ip, litlen);
+		op += litlen;
+		ip += litlen;
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -EIO;
+		}
+		ofz = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if ((!ofz) || (ofz > (uint64_t)(op - dst))) {
+			return -EIO;
+		}
+
+		mlen = token & 15;
+		if ((mlen == 15) && cmpr_lz4_len_read(&ip, iend, &mlen)) {
+			return -EIO;
+		}
+		mlen += CMPR_LZ4_MINMATCH;
+		if (mlen > (uint64_t)(oend - op)) {
+			return -EIO;
+		}
+
+		if (ofz >= mlen) {
+			memcpy(op, op - ofz, mlen);
+			op += mlen;
+		} else {
+			for (; mlen; --mlen, ++op) {
+				*op = *(op - ofz);
+			}
+		}
+	}
+
+	return op - dst;
+}
+
+static void
+cmpr_wb_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct cmpr_worker *w = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		w->wb_err = -EIO;
+	}
+}
+
+/**
+ * Write the first 'nbytes' of the given segment; via the async. interface of
+ * the lower device, when it has one
+ */
+static int
+cmpr_seg_write(struct xnvme_cmpr *cmpr, struct cmpr_worker *w, uint32_t sidx,
+	       uint8_t *buf, uint32_t nbytes)
+{
+	const uint32_t lba_nbytes = cmpr->lower.lba_nbytes;
+	const uint64_t slba = cmpr->data_slba + (uint64_t)sidx * cmpr->seg_nlb;
+	const uint64_t nlb = (nbytes + lba_nbytes - 1) / lba_nbytes;
+	int err;
+
+	if (!w->actx) {
+		return xnvme_lower_rw(&cmpr->lower, XNVME_SPEC_OPC_WRITE, slba,
+				      nlb, buf);
+	}
+
+	w->wb_err = 0;
+	for (uint64_t ofz = 0; ofz < nlb;) {
+		for (int i = 0; (i < CMPR_WB_QD) && (ofz < nlb); ++i) {
+			struct xnvme_req *req = &w->reqs[i];
+			uint64_t n = cmpr_min(nlb - ofz, cmpr->lower.io_nlb);
+
+			memset(req, 0, sizeof(*req));
+			req->async.ctx = w->actx;
+			req->async.cb = cmpr_wb_cb;
+			req->async.cb_arg = w;
+
+			err = xnvme_cmd_write(cmpr->lower.dev, cmpr->lower.nsid,
+					      slba + ofz, n - 1,
+					      buf + ofz * lba_nbytes, NULL,
+					      XNVME_CMD_ASYNC, req);
+			if (err == -EBUSY || err == -EAGAIN) {
+				xnvme_async_poke(cmpr->lower.dev, w->actx, 0);
+				--i;
+				continue;
+			}
+			if (err) {
+				XNVME_DEBUG("FAILED: xnvme_cmd_write(), err: %d",
+					    err);
+				w->wb_err = err;
+				break;
+			}
+			ofz += n;
+		}
+
+		err = xnvme_async_wait(cmpr->lower.dev, w->actx);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d", err);
+			return err;
+		}
+		if (w->wb_err) {
+			return w->wb_err;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Map 'lchunk' to 'map', the record previously mapped, if any, becomes invalid
+ */
+static void
+cmpr_map_set(struct xnvme_cmpr *cmpr, uint64_t lchunk,
+	     const struct cmpr_map *map)
+{
+	const struct cmpr_map *old = &cmpr->l2p[lchunk];
+
+	if (old->seg != CMPR_UNMAPPED) {
+		struct cmpr_seg *seg = &cmpr->segs[old->seg];
+
+		seg->nvalid -= cmpr_rec_nbytes(old->clen);
+		if (seg->state == CMPR_SEG_CLOSED) {
+			cmpr->gc_nospc = 0;
+		}
+		if ((seg->state == CMPR_SEG_CLOSED) && (!seg->nvalid)) {
+			seg->state = CMPR_SEG_STALE;
+			cmpr->nstale += 1;
+		}
+	}
+
+	cmpr->l2p[lchunk] = *map;
+	if (map->seg != CMPR_UNMAPPED) {
+		cmpr->segs[map->seg].nvalid += cmpr_rec_nbytes(map->clen);
+	}
+}
+
+/**
+ * Open a free segment for records of 'which', waiting for the garbage
+ * collector when none is. Called with the lock held.
+ */
+static int
+cmpr_seg_open(struct xnvme_cmpr *cmpr, enum cmpr_open which)
+{
+	const uint32_t reserve = which == CMPR_OPEN_GC ? 0 : CMPR_GC_RESERVE;
+	struct cmpr_seg *seg = NULL;
+
+	for (;;) {
+		if (cmpr->err) {
+			return cmpr->err;
+		}
+		if (cmpr->sbuf_free && (cmpr->nfree > reserve)) {
+			break;
+		}
+		if (which == CMPR_OPEN_GC) {
+			if (!cmpr->nfree) {
+				XNVME_DEBUG("FAILED: no segment for relocation");
+				return -ENOSPC;
+			}
+		} else {
+			if (cmpr->gc_err) {
+				return cmpr->gc_err;
+			}
+			if ((!cmpr->gc_started) || cmpr->gc_stop ||
+			    (cmpr->gc_nospc && (!cmpr->nstale) &&
+			     (cmpr->nfree <= reserve))) {
+				XNVME_DEBUG("FAILED: no segment to reclaim");
+				return -ENOSPC;
+			}
+		}
+
+		pthread_cond_broadcast(&cmpr->cond);
+		pthread_cond_wait(&cmpr->cond, &cmpr->lock);
+	}
+
+	for (uint32_t i = 0; i < cmpr->nsegs; ++i) {
+		uint32_t sidx = (cmpr->seg_next + i) % cmpr->nsegs;
+
+		if (cmpr->segs[sidx].state != CMPR_SEG_FREE) {
+			continue;
+		}
+
+		seg = &cmpr->segs[sidx];
+		cmpr->seg_next = (sidx + 1) % cmpr->nsegs;
+		cmpr->open[which] = sidx;
+		break;
+	}
+	if (!seg) {
+		XNVME_DEBUG("FAILED: nfree: %u, but none found", cmpr->nfree);
+		return -EIO;
+	}
+
+	memset(seg, 0, sizeof(*seg));
+	seg->state = CMPR_SEG_OPEN;
+	seg->gen = ++cmpr->gen;
+	seg->sbuf = cmpr->sbuf_free;
+	cmpr->sbuf_free = seg->sbuf->next;
+	memset(seg->sbuf->buf, 0, cmpr->seg_nbytes);
+
+	cmpr->nfree -= 1;
+	if (cmpr->nfree < cmpr->gc_thresh) {
+		pthread_cond_broadcast(&cmpr->cond);
+	}
+
+	return 0;
+}
+
+/**
+ * The segment sealed for write-back is on the device, or failed to be written.
+ * Called with the lock held.
+ */
+static void
+cmpr_seg_written(struct xnvme_cmpr *cmpr, uint32_t sidx, int err)
+{
+	struct cmpr_seg *seg = &cmpr->segs[sidx];
+
+	seg->sbuf->next = cmpr->sbuf_free;
+	cmpr->sbuf_free = seg->sbuf;
+	seg->sbuf = NULL;
+
+	seg->state = CMPR_SEG_CLOSED;
+	if (!seg->nvalid) {
+		seg->state = CMPR_SEG_STALE;
+		cmpr->nstale += 1;
+	}
+	cmpr->nsealed -= 1;
+
+	if (err) {
+		XNVME_DEBUG("FAILED: write-back of segment: %u, err: %d", sidx,
+			    err);
+		cmpr->err = err;
+	}
+	pthread_cond_broadcast(&cmpr->cond);
+}
+
+/**
+ * Append a record to the open segment of 'which' and map 'lchunk' to it. A
+ * full segment is sealed and written back by the caller. With 'expect', the
+ * record is only appended when 'lchunk' is still mapped as expected.
+ */
+static int
+cmpr_append(struct xnvme_cmpr *cmpr, struct cmpr_worker *w,
+	    enum cmpr_open which, uint64_t lchunk, const uint8_t *payload,
+	    uint32_t clen, const struct cmpr_map *expect)
+{
+	const uint32_t nbytes = cmpr_rec_nbytes(clen);
+	struct cmpr_rec rec = { 0 };
+	struct cmpr_map map = { 0 };
+	struct cmpr_seg *seg;
+	int err = 0;
+
+	pthread_mutex_lock(&cmpr->lock);
+	for (;;) {
+		uint32_t sidx = cmpr->open[which];
+
+		if (sidx == cmpr->nsegs) {
+			err = cmpr_seg_open(cmpr, which);
+			if (err) {
+				goto exit;
+			}
+			continue;
+		}
+		seg = &cmpr->segs[sidx];
+		if (seg->used + nbytes <= cmpr->seg_nbytes) {
+			break;
+		}
+
+		seg->state = CMPR_SEG_SEALED;
+		cmpr->open[which] = cmpr->nsegs;
+		cmpr->nsealed += 1;
+
+		pthread_mutex_unlock(&cmpr->lock);
+		err = cmpr_seg_write(cmpr, w, sidx, seg->sbuf->buf, seg->used);
+		pthread_mutex_lock(&cmpr->lock);
+
+		cmpr_seg_written(cmpr, sidx, err);
+		if (err) {
+			goto exit;
+		}
+	}
+
+	// Overwritten by the host while being relocated
+	if (expect && memcmp(&cmpr->l2p[lchunk], expect, sizeof(*expect))) {
+		goto exit;
+	}
+
+	rec.lchunk = lchunk;
+	rec.clen = clen;
+	rec.gen = seg->gen;
+	memcpy(seg->sbuf->buf + seg->used, &rec, sizeof(rec));
+	memcpy(seg->sbuf->buf + seg->used + sizeof(rec), payload, clen);
+
+	map.seg = seg - cmpr->segs;
+	map.ofz = seg->used;
+	map.clen = clen;
+	map.gen = seg->gen;
+	cmpr_map_set(cmpr, lchunk, &map);
+
+	seg->used += nbytes;
+
+exit:
+	pthread_mutex_unlock(&cmpr->lock);
+
+	return err;
+}
+
+/**
+ * Read and decompress the chunk 'lchunk' into 'dst' of chunk_nbytes
+ */
+static int
+cmpr_chunk_load(struct xnvme_cmpr *cmpr, struct cmpr_worker *w,
+		uint64_t lchunk, uint8_t *dst)
+{
+	const struct cmpr_rec *rec;
+	struct cmpr_map map;
+	struct cmpr_seg *seg;
+	int64_t res;
+	int err = 0;
+
+	pthread_mutex_lock(&cmpr->lock);
+	map = cmpr->l2p[lchunk];
+	if (map.seg == CMPR_UNMAPPED) {
+		pthread_mutex_unlock(&cmpr->lock);
+		memset(dst, 0, cmpr->chunk_nbytes);
+		return 0;
+	}
+
+	seg = &cmpr->segs[map.seg];
+	if (seg->sbuf) {
+		memcpy(w->rbuf, seg->sbuf->buf + map.ofz, sizeof(*rec) + map.clen);
+		rec = (void *)w->rbuf;
+	} else {
+		const uint32_t lba_nbytes = cmpr->lower.lba_nbytes;
+		const uint64_t ofz = (uint64_t)map.seg * cmpr->seg_nbytes + map.ofz;
+		const uint64_t skip = ofz % lba_nbytes;
+		const uint64_t nlb = (skip + sizeof(*rec) + map.clen + \
+				      lba_nbytes - 1) / lba_nbytes;
+
+		// Keeps the segment from being reused until read
+		seg->nreaders += 1;
+		pthread_mutex_unlock(&cmpr->lock);
+		err = xnvme_lower_rw(&cmpr->lower, XNVME_SPEC_OPC_READ,
+				     cmpr->data_slba + ofz / lba_nbytes, nlb,
+				     w->rbuf);
+		pthread_mutex_lock(&cmpr->lock);
+		seg->nreaders -= 1;
+
+		rec = (void *)(w->rbuf + skip);
+	}
+	pthread_mutex_unlock(&cmpr->lock);
+	if (err) {
+		return err;
+	}
+
+	if ((rec->lchunk != lchunk) || (rec->clen != map.clen) ||
+	    (rec->gen != map.gen)) {
+		XNVME_DEBUG("FAILED: invalid record of chunk: %lu", lchunk);
+		return -EIO;
+	}
+
+	if (map.clen == cmpr->chunk_nbytes) {
+		memcpy(dst, rec + 1, map.clen);
+		return 0;
+	}
+
+	res = cmpr_lz4_decompress((const uint8_t *)(rec + 1), map.clen, dst,
+				  cmpr->chunk_nbytes);
+	if (res != cmpr->chunk_nbytes) {
+		XNVME_DEBUG("FAILED: decompress chunk: %lu, res: %ld", lchunk,
+			    res);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Compress 'src' of chunk_nbytes and append it as the record of 'lchunk'
+ */
+static int
+cmpr_chunk_store(struct xnvme_cmpr *cmpr, struct cmpr_worker *w,
+		 uint64_t lchunk, const uint8_t *src)
+{
+	uint32_t clen;
+
+	clen = cmpr_lz4_compress(src, cmpr->chunk_nbytes, w->cbuf,
+				 cmpr->chunk_nbytes - 1, w->htbl);
+	if (!clen) {
+		return cmpr_append(cmpr, w, CMPR_OPEN_HOST, lchunk, src,
+				   cmpr->chunk_nbytes, NULL);
+	}
+
+	return cmpr_append(cmpr, w, CMPR_OPEN_HOST, lchunk, w->cbuf, clen, NULL);
+}
+
+/**
+ * Carry out the part of 'cmd' within its i'th chunk
+ */
+static int
+cmpr_piece(struct xnvme_cmpr *cmpr, struct cmpr_worker *w,
+	   struct cmpr_cmd *cmd, uint64_t i)
+{
+	const uint64_t lchunk = cmd->slba / cmpr->chunk_nlb + i;
+	const uint64_t cslba = lchunk * cmpr->chunk_nlb;
+	const uint64_t slba = cmd->slba > cslba ? cmd->slba : cslba;
+	const uint64_t elba = cmpr_min(cmd->slba + cmd->nlb,
+				       cslba + cmpr->chunk_nlb);
+	const uint64_t ofz = (slba - cslba) * cmpr->lower.lba_nbytes;
+	const uint64_t nbytes = (elba - slba) * cmpr->lower.lba_nbytes;
+	uint8_t *buf = cmd->dbuf + (slba - cmd->slba) * cmpr->lower.lba_nbytes;
+	pthread_mutex_t *stripe = &cmpr->stripes[lchunk % CMPR_NSTRIPES];
+	int err;
+
+	if (cmd->opcode == XNVME_SPEC_OPC_READ) {
+		if (nbytes == cmpr->chunk_nbytes) {
+			return cmpr_chunk_load(cmpr, w, lchunk, buf);
+		}
+
+		err = cmpr_chunk_load(cmpr, w, lchunk, w->raw);
+		if (!err) {
+			memcpy(buf, w->raw + ofz, nbytes);
+		}
+
+		return err;
+	}
+
+	pthread_mutex_lock(stripe);
+	if (nbytes == cmpr->chunk_nbytes) {
+		err = cmpr_chunk_store(cmpr, w, lchunk, buf);
+	} else {
+		err = cmpr_chunk_load(cmpr, w, lchunk, w->raw);
+		if (!err) {
+			memcpy(w->raw + ofz, buf, nbytes);
+			err = cmpr_chunk_store(cmpr, w, lchunk, w->raw);
+		}
+	}
+	pthread_mutex_unlock(stripe);
+
+	return err;
+}
+
+/**
+ * Hand the completed command to its submitter. Called with 'wq_lock' held.
+ */
+static void
+cmpr_cmd_complete(struct xnvme_cmpr *cmpr, struct cmpr_cmd *cmd)
+{
+	struct xnvme_async_ctx_cmpr *actx = cmd->actx;
+
+	if (!actx) {
+		cmd->done = 1;
+		pthread_cond_broadcast(&cmpr->wq_cond);
+		return;
+	}
+
+	memset(&cmd->req->cpl, 0, sizeof(cmd->req->cpl));
+	if (cmd->err) {
+		cmd->req->cpl.status.sc = XNVME_SPEC_SC_INTERNAL;
+	}
+
+	pthread_mutex_lock(&actx->lock);
+	cmd->link = NULL;
+	if (actx->tail) {
+		actx->tail->link = cmd;
+	} else {
+		actx->head = cmd;
+	}
+	actx->tail = cmd;
+	pthread_cond_signal(&actx->cond);
+	pthread_mutex_unlock(&actx->lock);
+}
+
+static void *
+cmpr_worker_main(void *arg)
+{
+	struct cmpr_worker *w = arg;
+	struct xnvme_cmpr *cmpr = w->cmpr;
+
+	pthread_mutex_lock(&cmpr->wq_lock);
+	while (!cmpr->wq_stop) {
+		struct cmpr_cmd *cmd = cmpr->wq_head;
+		uint64_t i;
+		int err;
+
+		if (!cmd) {
+			pthread_cond_wait(&cmpr->wq_cond, &cmpr->wq_lock);
+			continue;
+		}
+
+		i = cmd->next++;
+		if (cmd->next == cmd->npieces) {
+			cmpr->wq_head = cmd->link;
+			if (!cmpr->wq_head) {
+				cmpr->wq_tail = NULL;
+			}
+		}
+		pthread_mutex_unlock(&cmpr->wq_lock);
+
+		err = cmpr_piece(cmpr, w, cmd, i);
+
+		pthread_mutex_lock(&cmpr->wq_lock);
+		if (err && (!cmd->err)) {
+			cmd->err = err;
+		}
+		cmd->ndone += 1;
+		if (cmd->ndone == cmd->npieces) {
+			cmpr_cmd_complete(cmpr, cmd);
+		}
+	}
+	pthread_mutex_unlock(&cmpr->wq_lock);
+
+	return NULL;
+}
+
+static void
+cmpr_cmd_submit(struct xnvme_cmpr *cmpr, struct cmpr_cmd *cmd)
+{
+	cmd->npieces = (cmd->slba + cmd->nlb - 1) / cmpr->chunk_nlb - \
+		       cmd->slba / cmpr->chunk_nlb + 1;
+	cmd->next = 0;
+	cmd->ndone = 0;
+	cmd->err = 0;
+	cmd->done = 0;
+	cmd->link = NULL;
+
+	pthread_mutex_lock(&cmpr->wq_lock);
+	if (cmpr->wq_tail) {
+		cmpr->wq_tail->link = cmd;
+	} else {
+		cmpr->wq_head = cmd;
+	}
+	cmpr->wq_tail = cmd;
+	pthread_cond_broadcast(&cmpr->wq_cond);
+	pthread_mutex_unlock(&cmpr->wq_lock);
+}
+
+/**
+ * Produce the mapping table of a checkpoint, see xnvme_ckpt_tbl_cb
+ */
+static int
+cmpr_ckpt_get(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_cmpr *cmpr = cb_arg;
+
+	memcpy(buf, ((uint8_t *)cmpr->l2p) + ofz, nbytes);
+
+	return 0;
+}
+
+/**
+ * Consume the mapping table of a checkpoint, see xnvme_ckpt_tbl_cb
+ */
+static int
+cmpr_ckpt_put(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_cmpr *cmpr = cb_arg;
+
+	memcpy(((uint8_t *)cmpr->l2p) + ofz, buf, nbytes);
+
+	return 0;
+}
+
+static int
+cmpr_ckpt_check(void *cb_arg, const struct xnvme_ckpt_hdr *hdr)
+{
+	const struct cmpr_ckpt *ckpt = (const void *)hdr;
+	struct xnvme_cmpr *cmpr = cb_arg;
+
+	return (ckpt->nchunks != cmpr->nchunks) ||
+	       (ckpt->chunk_nbytes != cmpr->chunk_nbytes) ||
+	       (ckpt->seg_nbytes != cmpr->seg_nbytes) ||
+	       (ckpt->nsegs != cmpr->nsegs) ||
+	       (hdr->tbl_nbytes != cmpr->nchunks * sizeof(*cmpr->l2p));
+}
+
+/**
+ * Write a checkpoint to the area not holding the latest, then free the stale
+ * segments. Called with the lock held and no segments sealed.
+ */
+static int
+cmpr_ckpt_write(struct xnvme_cmpr *cmpr)
+{
+	struct cmpr_ckpt ckpt = { 0 };
+	int err;
+
+	// Records of the open segments are referenced by the mapping
+	for (int which = 0; which < 2; ++which) {
+		uint32_t sidx = cmpr->open[which];
+		struct cmpr_seg *seg = &cmpr->segs[sidx];
+		uint32_t lba_nbytes = cmpr->lower.lba_nbytes;
+
+		if ((sidx == cmpr->nsegs) || (!seg->used)) {
+			continue;
+		}
+
+		err = xnvme_lower_rw(&cmpr->lower, XNVME_SPEC_OPC_WRITE,
+				     cmpr->data_slba +
+				     (uint64_t)sidx * cmpr->seg_nlb,
+				     (seg->used + lba_nbytes - 1) / lba_nbytes,
+				     seg->sbuf->buf);
+		if (err) {
+			return err;
+		}
+	}
+
+	ckpt.hdr.tbl_nbytes = cmpr->nchunks * sizeof(*cmpr->l2p);
+	ckpt.nchunks = cmpr->nchunks;
+	ckpt.chunk_nbytes = cmpr->chunk_nbytes;
+	ckpt.seg_nbytes = cmpr->seg_nbytes;
+	ckpt.nsegs = cmpr->nsegs;
+	ckpt.gen = cmpr->gen;
+
+	err = xnvme_ckpt_write(&cmpr->ckpt, &ckpt.hdr);
+	if (err) {
+		return err;
+	}
+
+	for (uint32_t sidx = 0; cmpr->nstale && (sidx < cmpr->nsegs); ++sidx) {
+		struct cmpr_seg *seg = &cmpr->segs[sidx];
+
+		if ((seg->state != CMPR_SEG_STALE) || seg->nreaders) {
+			continue;
+		}
+
+		memset(seg, 0, sizeof(*seg));
+		seg->state = CMPR_SEG_FREE;
+		cmpr->nstale -= 1;
+		cmpr->nfree += 1;
+	}
+	pthread_cond_broadcast(&cmpr->cond);
+
+	return 0;
+}
+
+/**
+ * Write a checkpoint once the sealed segments are written. Called with the
+ * lock held.
+ */
+static int
+cmpr_ckpt(struct xnvme_cmpr *cmpr)
+{
+	int err;
+
+	while (cmpr->nsealed) {
+		pthread_cond_wait(&cmpr->cond, &cmpr->lock);
+	}
+	if (cmpr->err) {
+		return cmpr->err;
+	}
+
+	err = cmpr_ckpt_write(cmpr);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmpr_ckpt_write(), err: %d", err);
+	}
+
+	return err;
+}
+
+/**
+ * Load the latest valid checkpoint and derive the state of the segments from
+ * it. When no checkpoint is found, or when asked to via 'format', then an
+ * empty one is written.
+ */
+static int
+cmpr_ckpt_load(struct xnvme_cmpr *cmpr, int format)
+{
+	struct cmpr_ckpt ckpt = { 0 };
+	int err = -ENOENT;
+
+	if (!format) {
+		err = xnvme_ckpt_load(&cmpr->ckpt, &ckpt.hdr);
+		if (err && (err != -ENOENT)) {
+			return err;
+		}
+	}
+	if (err) {
+		for (uint64_t i = 0; i < cmpr->nchunks; ++i) {
+			cmpr->l2p[i].seg = CMPR_UNMAPPED;
+		}
+		xnvme_ckpt_format(&cmpr->ckpt);
+	} else {
+		cmpr->gen = ckpt.gen;
+	}
+
+	for (uint64_t lchunk = 0; lchunk < cmpr->nchunks; ++lchunk) {
+		const struct cmpr_map *map = &cmpr->l2p[lchunk];
+		struct cmpr_seg *seg;
+
+		if (map->seg == CMPR_UNMAPPED) {
+			continue;
+		}
+		if ((map->seg >= cmpr->nsegs) || (!map->clen) ||
+		    (map->clen > cmpr->chunk_nbytes) ||
+		    (map->ofz + cmpr_rec_nbytes(map->clen) > cmpr->seg_nbytes)) {
+			XNVME_DEBUG("FAILED: invalid mapping: %lu", lchunk);
+			return -EIO;
+		}
+
+		seg = &cmpr->segs[map->seg];
+		seg->state = CMPR_SEG_CLOSED;
+		seg->gen = map->gen;
+		seg->used = cmpr->seg_nbytes;
+		seg->nvalid += cmpr_rec_nbytes(map->clen);
+	}
+	for (uint32_t sidx = 0; sidx < cmpr->nsegs; ++sidx) {
+		cmpr->nfree += cmpr->segs[sidx].state == CMPR_SEG_FREE;
+	}
+
+	if (!err) {
+		return 0;
+	}
+
+	// Both areas, as an older one may carry a higher sequence number
+	for (int i = 0; i < 2; ++i) {
+		err = cmpr_ckpt_write(cmpr);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * The closed segment with the fewest valid bytes, or nsegs when none is worth
+ * reclaiming. When down to the reserve, any segment reclaiming space for a
+ * chunk is, as the host is otherwise out of space.
+ */
+static uint32_t
+cmpr_gc_victim(struct xnvme_cmpr *cmpr)
+{
+	uint32_t victim = cmpr->nsegs;
+	uint32_t nvalid = cmpr->seg_nbytes - cmpr->seg_nbytes / 16;
+
+	if (cmpr->nfree <= CMPR_GC_RESERVE) {
+		nvalid = cmpr->seg_nbytes - cmpr_rec_nbytes(cmpr->chunk_nbytes) + 1;
+	}
+
+	for (uint32_t sidx = 0; sidx < cmpr->nsegs; ++sidx) {
+		const struct cmpr_seg *seg = &cmpr->segs[sidx];
+
+		if ((seg->state == CMPR_SEG_CLOSED) && (seg->nvalid < nvalid)) {
+			victim = sidx;
+			nvalid = seg->nvalid;
+		}
+	}
+
+	return victim;
+}
+
+/**
+ * Move the valid records of 'victim', which is then stale. Called with the
+ * lock held, which is released during IO.
+ */
+static int
+cmpr_gc_relocate(struct xnvme_cmpr *cmpr, uint32_t victim)
+{
+	struct cmpr_seg *seg = &cmpr->segs[victim];
+	const uint32_t gen = seg->gen;
+	uint32_t ofz = 0;
+	int err;
+
+	seg->nreaders += 1;
+	pthread_mutex_unlock(&cmpr->lock);
+
+	err = xnvme_lower_rw(&cmpr->lower, XNVME_SPEC_OPC_READ,
+			     cmpr->data_slba + (uint64_t)victim * cmpr->seg_nlb,
+			     cmpr->seg_nlb, cmpr->gcbuf);
+
+	while ((!err) && (ofz + sizeof(struct cmpr_rec) <= cmpr->seg_nbytes)) {
+		const struct cmpr_rec *rec = (void *)(cmpr->gcbuf + ofz);
+		struct cmpr_map expect = { 0 };
+
+		// Beyond the last record of this generation
+		if ((rec->gen != gen) || (!rec->clen) ||
+		    (rec->clen > cmpr->chunk_nbytes) ||
+		    (rec->lchunk >= cmpr->nchunks) ||
+		    (ofz + cmpr_rec_nbytes(rec->clen) > cmpr->seg_nbytes)) {
+			break;
+		}
+
+		expect.seg = victim;
+		expect.ofz = ofz;
+		expect.clen = rec->clen;
+		expect.gen = gen;
+
+		err = cmpr_append(cmpr, &cmpr->gcw, CMPR_OPEN_GC, rec->lchunk,
+				  (const uint8_t *)(rec + 1), rec->clen, &expect);
+
+		ofz += cmpr_rec_nbytes(rec->clen);
+	}
+
+	pthread_mutex_lock(&cmpr->lock);
+	seg->nreaders -= 1;
+	if (err) {
+		return err;
+	}
+
+	if (seg->state != CMPR_SEG_STALE) {
+		XNVME_DEBUG("FAILED: segment: %u, nvalid: %u after relocation",
+			    victim, seg->nvalid);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void *
+cmpr_gc_main(void *arg)
+{
+	struct xnvme_cmpr *cmpr = arg;
+
+	pthread_mutex_lock(&cmpr->lock);
+	while (!cmpr->gc_stop) {
+		uint32_t victim;
+		int err = 0;
+
+		if (cmpr->gc_err || cmpr->err || (cmpr->nfree >= cmpr->gc_thresh)) {
+			pthread_cond_wait(&cmpr->cond, &cmpr->lock);
+			continue;
+		}
+
+		victim = cmpr_gc_victim(cmpr);
+		if (victim < cmpr->nsegs) {
+			err = cmpr_gc_relocate(cmpr, victim);
+		}
+		if (err && (err != -ENOSPC)) {
+			XNVME_DEBUG("FAILED: cmpr_gc_relocate(), err: %d", err);
+			cmpr->gc_err = err;
+			pthread_cond_broadcast(&cmpr->cond);
+			continue;
+		}
+
+		if (cmpr->nstale && (err || (victim == cmpr->nsegs) ||
+				     (cmpr->nstale >= CMPR_GC_STALE_MAX) ||
+				     (cmpr->nfree <= CMPR_GC_RESERVE))) {
+			err = cmpr_ckpt(cmpr);
+			if (err) {
+				cmpr->gc_err = err;
+			}
+			pthread_cond_broadcast(&cmpr->cond);
+			continue;
+		}
+
+		if (err || (victim == cmpr->nsegs)) {
+			cmpr->gc_nospc = 1;
+			pthread_cond_broadcast(&cmpr->cond);
+			pthread_cond_wait(&cmpr->cond, &cmpr->lock);
+		}
+	}
+	pthread_mutex_unlock(&cmpr->lock);
+
+	return NULL;
+}
+
+static void
+cmpr_worker_term(struct xnvme_cmpr *cmpr, struct cmpr_worker *w)
+{
+	if (w->actx) {
+		xnvme_async_term(cmpr->lower.dev, w->actx);
+	}
+	xnvme_buf_free(cmpr->lower.dev, w->rbuf);
+	free(w->htbl);
+	free(w->cbuf);
+	free(w->raw);
+	memset(w, 0, sizeof(*w));
+}
+
+static int
+cmpr_worker_init(struct xnvme_cmpr *cmpr, struct cmpr_worker *w)
+{
+	const uint32_t lba_nbytes = cmpr->lower.lba_nbytes;
+	const size_t rbuf_nbytes = ((sizeof(struct cmpr_rec) + \
+				     cmpr->chunk_nbytes) / lba_nbytes + 2) * \
+				   lba_nbytes;
+	int err;
+
+	w->cmpr = cmpr;
+	w->raw = malloc(cmpr->chunk_nbytes);
+	w->cbuf = malloc(cmpr->chunk_nbytes);
+	w->htbl = malloc(sizeof(*w->htbl) << CMPR_LZ4_HASH_LOG);
+	w->rbuf = xnvme_buf_alloc(cmpr->lower.dev, rbuf_nbytes, NULL);
+	if (!(w->raw && w->cbuf && w->htbl && w->rbuf)) {
+		XNVME_DEBUG("FAILED: allocating worker buffers");
+		cmpr_worker_term(cmpr, w);
+		return -ENOMEM;
+	}
+
+	err = xnvme_async_init(cmpr->lower.dev, &w->actx, CMPR_WB_QD, 0);
+	if (err) {
+		XNVME_DEBUG("INFO: sync. write-back, err: %d", err);
+		w->actx = NULL;
+	}
+
+	return 0;
+}
+
+/**
+ * Tear down the compression layer, the lower device is left open
+ */
+static void
+cmpr_term(struct xnvme_cmpr *cmpr)
+{
+	if (!cmpr) {
+		return;
+	}
+
+	pthread_mutex_lock(&cmpr->wq_lock);
+	cmpr->wq_stop = 1;
+	pthread_cond_broadcast(&cmpr->wq_cond);
+	pthread_mutex_unlock(&cmpr->wq_lock);
+	for (uint32_t i = 0; cmpr->workers && (i < cmpr->nwork); ++i) {
+		if (cmpr->workers[i].started) {
+			pthread_join(cmpr->workers[i].thread, NULL);
+		}
+	}
+
+	if (cmpr->gc_started) {
+		pthread_mutex_lock(&cmpr->lock);
+		cmpr->gc_stop = 1;
+		pthread_cond_broadcast(&cmpr->cond);
+		pthread_mutex_unlock(&cmpr->lock);
+
+		pthread_join(cmpr->gc_thread, NULL);
+
+		pthread_mutex_lock(&cmpr->lock);
+		if (cmpr_ckpt(cmpr)) {
+			XNVME_DEBUG("FAILED: checkpoint on close");
+		}
+		pthread_mutex_unlock(&cmpr->lock);
+	}
+
+	for (uint32_t i = 0; cmpr->workers && (i < cmpr->nwork); ++i) {
+		cmpr_worker_term(cmpr, &cmpr->workers[i]);
+	}
+	cmpr_worker_term(cmpr, &cmpr->gcw);
+
+	for (uint32_t i = 0; cmpr->sbufs && (i < cmpr->nsbufs); ++i) {
+		xnvme_buf_free(cmpr->lower.dev, cmpr->sbufs[i].buf);
+	}
+
+	for (int i = 0; i < CMPR_NSTRIPES; ++i) {
+		pthread_mutex_destroy(&cmpr->stripes[i]);
+	}
+	pthread_cond_destroy(&cmpr->wq_cond);
+	pthread_mutex_destroy(&cmpr->wq_lock);
+	pthread_cond_destroy(&cmpr->cond);
+	pthread_mutex_destroy(&cmpr->lock);
+
+	xnvme_buf_free(cmpr->lower.dev, cmpr->gcbuf);
+	xnvme_buf_free(cmpr->lower.dev, cmpr->ckpt.iobuf);
+	free(cmpr->sbufs);
+	free(cmpr->workers);
+	free(cmpr->segs);
+	free(cmpr->l2p);
+	free(cmpr);
+}
+
+static int
+cmpr_init(struct xnvme_dev *lower, const struct xnvme_ident *ident,
+	  struct xnvme_cmpr **cmpr)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(lower);
+	uint32_t chunk = XNVME_BE_CMPR_CHUNK_DEF;
+	uint32_t ratio = XNVME_BE_CMPR_RATIO_DEF;
+	uint32_t nwork = XNVME_BE_CMPR_NWORK_DEF;
+	uint32_t format = 0;
+	uint64_t lower_nlb, nchunks_max, nop;
+	int err;
+
+	if (geo->type != XNVME_GEO_CONVENTIONAL) {
+		XNVME_DEBUG("FAILED: lower device is not conventional");
+		return -EINVAL;
+	}
+	if (geo->lba_extended || geo->nbytes_oob) {
+		XNVME_DEBUG("FAILED: metadata is not supported");
+		return -EINVAL;
+	}
+	xnvme_ident_opt_to_val(ident, "chunk", &chunk);
+	xnvme_ident_opt_to_val(ident, "ratio", &ratio);
+	xnvme_ident_opt_to_val(ident, "nwork", &nwork);
+	xnvme_ident_opt_to_val(ident, "format", &format);
+	if ((chunk > XNVME_BE_CMPR_CHUNK_MAX) || (!ratio) || (!nwork) ||
+	    (nwork > XNVME_BE_CMPR_NWORK_MAX)) {
+		XNVME_DEBUG("FAILED: chunk: %u, ratio: %u, nwork: %u", chunk,
+			    ratio, nwork);
+		return -EINVAL;
+	}
+	if (((4096U << chunk) % geo->lba_nbytes) ||
+	    (XNVME_BE_CMPR_SEG_NBYTES % geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: lba_nbytes: %u", geo->lba_nbytes);
+		return -EINVAL;
+	}
+
+	(*cmpr) = calloc(1, sizeof(**cmpr));
+	if (!(*cmpr)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*cmpr)->lower.dev = lower;
+	(*cmpr)->lower.nsid = xnvme_dev_get_nsid(lower);
+	pthread_mutex_init(&(*cmpr)->lock, NULL);
+	pthread_cond_init(&(*cmpr)->cond, NULL);
+	pthread_mutex_init(&(*cmpr)->wq_lock, NULL);
+	pthread_cond_init(&(*cmpr)->wq_cond, NULL);
+	for (int i = 0; i < CMPR_NSTRIPES; ++i) {
+		pthread_mutex_init(&(*cmpr)->stripes[i], NULL);
+	}
+
+	(*cmpr)->lower.lba_nbytes = geo->lba_nbytes;
+	(*cmpr)->lower.io_nlb = cmpr_min(geo->mdts_nbytes / geo->lba_nbytes,
+					 UINT16_MAX + 1);
+	if (!(*cmpr)->lower.io_nlb) {
+		XNVME_DEBUG("FAILED: mdts < lba_nbytes");
+		err = -EINVAL;
+		goto failed;
+	}
+	(*cmpr)->chunk_nbytes = 4096U << chunk;
+	(*cmpr)->chunk_nlb = (*cmpr)->chunk_nbytes / geo->lba_nbytes;
+	(*cmpr)->seg_nbytes = XNVME_BE_CMPR_SEG_NBYTES;
+	(*cmpr)->seg_nlb = (*cmpr)->seg_nbytes / geo->lba_nbytes;
+	(*cmpr)->nwork = nwork;
+	(*cmpr)->nsbufs = 2 + nwork + 1;
+	(*cmpr)->gc_thresh = CMPR_GC_RESERVE + 2;
+
+	// Checkpoint areas are sized for the chunks of the entire namespace
+	lower_nlb = geo->tbytes / geo->lba_nbytes;
+	nchunks_max = (geo->tbytes / (*cmpr)->chunk_nbytes) * ratio;
+	(*cmpr)->ckpt.area_nlb = 2 + (nchunks_max * sizeof(struct cmpr_map) + \
+				      geo->lba_nbytes - 1) / geo->lba_nbytes;
+	(*cmpr)->data_slba = ((2 * (*cmpr)->ckpt.area_nlb + \
+			       (*cmpr)->seg_nlb - 1) / \
+			      (*cmpr)->seg_nlb) * (*cmpr)->seg_nlb;
+	if (lower_nlb <= (*cmpr)->data_slba) {
+		XNVME_DEBUG("FAILED: too small, nlb: %lu", lower_nlb);
+		err = -EINVAL;
+		goto failed;
+	}
+	(*cmpr)->nsegs = (lower_nlb - (*cmpr)->data_slba) / (*cmpr)->seg_nlb;
+
+	nop = ((uint64_t)(*cmpr)->nsegs * XNVME_BE_CMPR_OP_PCT + 99) / 100;
+	nop = XNVME_MAX(nop, CMPR_GC_RESERVE + (*cmpr)->nsbufs + 2);
+	if ((*cmpr)->nsegs <= nop + 1) {
+		XNVME_DEBUG("FAILED: too few segments, nsegs: %u, nop: %lu",
+			    (*cmpr)->nsegs, nop);
+		err = -EINVAL;
+		goto failed;
+	}
+	(*cmpr)->nchunks = (((*cmpr)->nsegs - nop) * (uint64_t)(*cmpr)->seg_nbytes / \
+			    (*cmpr)->chunk_nbytes) * ratio;
+	(*cmpr)->nlpages = (*cmpr)->nchunks * (*cmpr)->chunk_nlb;
+	(*cmpr)->ckpt.tbl_nlb = ((*cmpr)->nchunks * sizeof(struct cmpr_map) + \
+				 geo->lba_nbytes - 1) / geo->lba_nbytes;
+	(*cmpr)->ckpt.lower = &(*cmpr)->lower;
+	(*cmpr)->ckpt.magic = CMPR_CKPT_MAGIC;
+	(*cmpr)->ckpt.version = CMPR_CKPT_VERSION;
+	(*cmpr)->ckpt.hdr_nbytes = sizeof(struct cmpr_ckpt);
+	(*cmpr)->ckpt.get = cmpr_ckpt_get;
+	(*cmpr)->ckpt.put = cmpr_ckpt_put;
+	(*cmpr)->ckpt.check = cmpr_ckpt_check;
+	(*cmpr)->ckpt.cb_arg = *cmpr;
+	(*cmpr)->open[CMPR_OPEN_HOST] = (*cmpr)->nsegs;
+	(*cmpr)->open[CMPR_OPEN_GC] = (*cmpr)->nsegs;
+
+	(*cmpr)->l2p = malloc((*cmpr)->nchunks * sizeof(*(*cmpr)->l2p));
+	(*cmpr)->segs = calloc((*cmpr)->nsegs, sizeof(*(*cmpr)->segs));
+	(*cmpr)->workers = calloc(nwork, sizeof(*(*cmpr)->workers));
+	(*cmpr)->sbufs = calloc((*cmpr)->nsbufs, sizeof(*(*cmpr)->sbufs));
+	if (!((*cmpr)->l2p && (*cmpr)->segs && (*cmpr)->workers &&
+	      (*cmpr)->sbufs)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: allocating mapping tables");
+		goto failed;
+	}
+
+	(*cmpr)->ckpt.iobuf = xnvme_buf_alloc(lower,
+					      (size_t)(*cmpr)->lower.io_nlb *
+					      geo->lba_nbytes, NULL);
+	(*cmpr)->gcbuf = xnvme_buf_alloc(lower, (*cmpr)->seg_nbytes, NULL);
+	if (!((*cmpr)->ckpt.iobuf && (*cmpr)->gcbuf)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		goto failed;
+	}
+	for (uint32_t i = 0; i < (*cmpr)->nsbufs; ++i) {
+		struct cmpr_sbuf *sbuf = &(*cmpr)->sbufs[i];
+
+		sbuf->buf = xnvme_buf_alloc(lower, (*cmpr)->seg_nbytes, NULL);
+		if (!sbuf->buf) {
+			err = -ENOMEM;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+			goto failed;
+		}
+		sbuf->next = (*cmpr)->sbuf_free;
+		(*cmpr)->sbuf_free = sbuf;
+	}
+
+	err = cmpr_ckpt_load(*cmpr, format);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmpr_ckpt_load(), err: %d", err);
+		goto failed;
+	}
+
+	err = cmpr_worker_init(*cmpr, &(*cmpr)->gcw);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmpr_worker_init(), err: %d", err);
+		goto failed;
+	}
+	for (uint32_t i = 0; i < nwork; ++i) {
+		struct cmpr_worker *w = &(*cmpr)->workers[i];
+
+		err = cmpr_worker_init(*cmpr, w);
+		if (err) {
+			XNVME_DEBUG("FAILED: cmpr_worker_init(), err: %d", err);
+			goto failed;
+		}
+		err = pthread_create(&w->thread, NULL, cmpr_worker_main, w);
+		if (err) {
+			XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+			err = -err;
+			goto failed;
+		}
+		w->started = 1;
+	}
+
+	err = pthread_create(&(*cmpr)->gc_thread, NULL, cmpr_gc_main, *cmpr);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+		err = -err;
+		goto failed;
+	}
+	(*cmpr)->gc_started = 1;
+
+	return 0;
+
+failed:
+	cmpr_term(*cmpr);
+	*cmpr = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_cmpr_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		       void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		       size_t XNVME_UNUSED(mbuf_nbytes), int opts,
+		       struct xnvme_req *req)
+{
+	struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+	struct xnvme_cmpr *cmpr = state->cmpr;
+	struct xnvme_async_ctx_cmpr *actx = NULL;
+	struct cmpr_cmd scmd = { 0 };
+	struct cmpr_cmd *ccmd = &scmd;
+	uint64_t slba = cmd->lblk.slba;
+	uint64_t nlb = cmd->lblk.nlb + 1;
+	int err;
+
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		actx = (void *)req->async.ctx;
+		if ((actx->outstanding == actx->depth) || (!actx->free)) {
+			return -EBUSY;
+		}
+	}
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		if (mbuf || (slba >= cmpr->nlpages) ||
+		    (nlb > cmpr->nlpages - slba) ||
+		    (dbuf_nbytes < nlb * cmpr->lower.lba_nbytes)) {
+			XNVME_DEBUG("FAILED: invalid slba: 0x%lx, nlb: %lu",
+				    slba, nlb);
+			return -EINVAL;
+		}
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		pthread_mutex_lock(&cmpr->lock);
+		err = cmpr_ckpt(cmpr);
+		pthread_mutex_unlock(&cmpr->lock);
+		if (err) {
+			return err;
+		}
+
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		if (actx) {
+			ccmd = actx->free;
+			actx->free = ccmd->link;
+			actx->outstanding += 1;
+
+			ccmd->req = req;
+			ccmd->actx = actx;
+			pthread_mutex_lock(&cmpr->wq_lock);
+			cmpr_cmd_complete(cmpr, ccmd);
+			pthread_mutex_unlock(&cmpr->wq_lock);
+		}
+		return 0;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (actx) {
+		ccmd = actx->free;
+		actx->free = ccmd->link;
+		actx->outstanding += 1;
+	}
+	ccmd->req = req;
+	ccmd->actx = actx;
+	ccmd->opcode = cmd->common.opcode;
+	ccmd->slba = slba;
+	ccmd->nlb = nlb;
+	ccmd->dbuf = dbuf;
+
+	cmpr_cmd_submit(cmpr, ccmd);
+	if (actx) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&cmpr->wq_lock);
+	while (!scmd.done) {
+		pthread_cond_wait(&cmpr->wq_cond, &cmpr->wq_lock);
+	}
+	pthread_mutex_unlock(&cmpr->wq_lock);
+	if (scmd.err) {
+		return scmd.err;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+
+	return 0;
+}
+
+int
+xnvme_be_cmpr_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t mbuf_nbytes, int opts,
+			     struct xnvme_req *req)
+{
+	struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+	struct xnvme_spec_cmd lcmd = *cmd;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		if ((!dbuf) || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			return -EINVAL;
+		}
+		memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_NS:
+			memcpy(dbuf, &dev->id.ns, sizeof(dev->id.ns));
+			break;
+		case XNVME_SPEC_IDFY_CTRLR:
+			memcpy(dbuf, &dev->id.ctrlr, sizeof(dev->id.ctrlr));
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: unsupported cns: 0x%x",
+				    cmd->idfy.cns);
+			return -ENOSYS;
+		}
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		return 0;
+
+	// These would pull the rug from under the compression layer
+	case XNVME_SPEC_OPC_FMT_NVM:
+	case XNVME_SPEC_OPC_SANITIZE:
+		XNVME_DEBUG("FAILED: opcode: 0x%x, use format=1",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (lcmd.common.nsid == dev->nsid) {
+		lcmd.common.nsid = state->cmpr->lower.nsid;
+	}
+
+	return xnvme_cmd_pass_admin(state->cmpr->lower.dev, &lcmd, dbuf,
+				    dbuf_nbytes, mbuf, mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_be_cmpr_async_init(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx **ctx, uint16_t depth,
+			 int XNVME_UNUSED(flags))
+{
+	struct xnvme_async_ctx_cmpr *actx;
+
+	if (!depth) {
+		XNVME_DEBUG("FAILED: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	actx = (void *)(*ctx);
+	actx->depth = depth;
+
+	actx->cmds = calloc(depth, sizeof(*actx->cmds));
+	if (!actx->cmds) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		free(*ctx);
+		*ctx = NULL;
+		return -ENOMEM;
+	}
+	for (uint32_t i = 0; i < depth; ++i) {
+		actx->cmds[i].link = actx->free;
+		actx->free = &actx->cmds[i];
+	}
+	pthread_mutex_init(&actx->lock, NULL);
+	pthread_cond_init(&actx->cond, NULL);
+
+	return 0;
+}
+
+int
+xnvme_be_cmpr_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_cmpr *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	pthread_cond_destroy(&actx->cond);
+	pthread_mutex_destroy(&actx->lock);
+	free(actx->cmds);
+	free(ctx);
+
+	return 0;
+}
+
+int
+xnvme_be_cmpr_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_cmpr *actx = (void *)ctx;
+	struct cmpr_cmd *head = NULL, *tail = NULL;
+	uint32_t completed = 0;
+
+	max = max ? max : actx->outstanding;
+
+	pthread_mutex_lock(&actx->lock);
+	while (actx->head && (completed < max)) {
+		struct cmpr_cmd *cmd = actx->head;
+
+		actx->head = cmd->link;
+		if (!actx->head) {
+			actx->tail = NULL;
+		}
+
+		cmd->link = NULL;
+		if (tail) {
+			tail->link = cmd;
+		} else {
+			head = cmd;
+		}
+		tail = cmd;
+		completed += 1;
+	}
+	pthread_mutex_unlock(&actx->lock);
+
+	while (head) {
+		struct cmpr_cmd *cmd = head;
+		struct xnvme_req *req = cmd->req;
+
+		head = cmd->link;
+		cmd->link = actx->free;
+		actx->free = cmd;
+		actx->outstanding -= 1;
+
+		req->async.cb(req, req->async.cb_arg);
+	}
+
+	return completed;
+}
+
+int
+xnvme_be_cmpr_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_cmpr *actx = (void *)ctx;
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		int res;
+
+		pthread_mutex_lock(&actx->lock);
+		while (!actx->head) {
+			pthread_cond_wait(&actx->cond, &actx->lock);
+		}
+		pthread_mutex_unlock(&actx->lock);
+
+		res = xnvme_be_cmpr_async_poke(dev, ctx, 0);
+		if (res < 0) {
+			XNVME_DEBUG("FAILED: xnvme_be_cmpr_async_poke(), err: %d",
+				    res);
+			return res;
+		}
+		acc += res;
+	}
+
+	return acc;
+}
+
+void *
+xnvme_be_cmpr_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+			uint64_t *phys)
+{
+	const struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_alloc(state->cmpr->lower.dev, nbytes, phys);
+}
+
+void *
+xnvme_be_cmpr_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			  size_t nbytes, uint64_t *phys)
+{
+	const struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_realloc(state->cmpr->lower.dev, buf, nbytes, phys);
+}
+
+void
+xnvme_be_cmpr_buf_free(const struct xnvme_dev *dev, void *buf)
+{
+	const struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+
+	xnvme_buf_free(state->cmpr->lower.dev, buf);
+}
+
+int
+xnvme_be_cmpr_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			  uint64_t *phys)
+{
+	const struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_vtophys(state->cmpr->lower.dev, buf, phys);
+}
+
+/**
+ * The compression layer is stacked on a device opened by uri, thus there is
+ * nothing to enumerate
+ */
+int
+xnvme_be_cmpr_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+			const char *XNVME_UNUSED(sys_uri),
+			int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void
+xnvme_be_cmpr_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_cmpr_state *state;
+	struct xnvme_dev *lower;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+	lower = state->cmpr->lower.dev;
+
+	cmpr_term(state->cmpr);
+	xnvme_dev_close(lower);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * The device is presented as a single conventional namespace, of the capacity
+ * given by the expected compression ratio, with the controller identity of
+ * the lower device
+ */
+static void
+xnvme_be_cmpr_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_cmpr_state *state = (void *)dev->be.state;
+	struct xnvme_cmpr *cmpr = state->cmpr;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	memcpy(&dev->id.ctrlr, xnvme_dev_get_ctrlr(cmpr->lower.dev),
+	       sizeof(dev->id.ctrlr));
+	dev->id.ctrlr.nn = 1;
+	dev->id.ctrlr.oncs.val = 0;
+	dev->id.ctrlr.vwc.val = 0;
+	dev->id.ctrlr.vwc.present = 1;	// Flush persists the mapping
+
+	memcpy(&dev->id.ns, xnvme_dev_get_ns(cmpr->lower.dev),
+	       sizeof(dev->id.ns));
+	dev->id.ns.nsze = cmpr->nlpages;
+	dev->id.ns.ncap = cmpr->nlpages;
+	dev->id.ns.nuse = cmpr->nlpages;
+	memset(&dev->id.ns.nsfeat, 0, sizeof(dev->id.ns.nsfeat));
+
+	memset(&dev->idcss, 0, sizeof(dev->idcss));
+}
+
+int
+xnvme_be_cmpr_dev_from_ident(const struct xnvme_ident *ident,
+			     struct xnvme_dev **dev)
+{
+	char uri[XNVME_IDENT_URI_LEN] = { 0 };
+	struct xnvme_be_cmpr_state *state;
+	struct xnvme_dev *lower;
+	int err;
+
+	// The target is the uri of the lower device, options apply to both
+	snprintf(uri, sizeof(uri), "%s%s", ident->trgt, ident->opts);
+
+	lower = xnvme_dev_open(uri);
+	if (!lower) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_dev_open(%s), err: %d", uri, err);
+		return err;
+	}
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		xnvme_dev_close(lower);
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_cmpr;
+	state = (void *)(*dev)->be.state;
+
+	err = cmpr_init(lower, ident, &state->cmpr);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmpr_init(), err: %d", err);
+		xnvme_dev_close(lower);
+		free(*dev);
+		return err;
+	}
+
+	xnvme_be_cmpr_dev_idfy(*dev);
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_cmpr_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	XNVME_BE_CMPR_NAME,
+};
+
+struct xnvme_be xnvme_be_cmpr = {
+#ifdef XNVME_BE_CMPR_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_cmpr_cmd_pass,
+		.cmd_pass_admin = xnvme_be_cmpr_cmd_pass_admin,
+
+		.async_init = xnvme_be_cmpr_async_init,
+		.async_term = xnvme_be_cmpr_async_term,
+		.async_poke = xnvme_be_cmpr_async_poke,
+		.async_wait = xnvme_be_cmpr_async_wait,
+
+		.buf_alloc = xnvme_be_cmpr_buf_alloc,
+		.buf_realloc = xnvme_be_cmpr_buf_realloc,
+		.buf_free = xnvme_be_cmpr_buf_free,
+		.buf_vtophys = xnvme_be_cmpr_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_cmpr_enumerate,
+
+		.dev_from_ident = xnvme_be_cmpr_dev_from_ident,
+		.dev_close = xnvme_be_cmpr_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_CMPR_NAME,
+#ifdef XNVME_BE_CMPR_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
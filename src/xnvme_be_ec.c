@@ -0,0 +1,1779 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_EC_NAME "ec"
+
+#ifdef XNVME_BE_EC_ENABLED
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xnvme_async.h>
+#include <xnvme_be_ec.h>
+#include <xnvme_dev.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define EC_X86_SIMD
+#endif
+
+/**
+ * Erasure-coded composite device
+ *
+ * Data is striped over k+m member devices, each stripe consists of k data
+ * units and m parity units, computed by systematic Reed-Solomon coding over
+ * GF(2^8) with a Cauchy generator matrix, thus, any k units of a stripe
+ * recover the stripe. The placement of units rotates with the stripe, such
+ * that parity is spread over all members.
+ *
+ * Commands are carried out a stripe at a time, up to XNVME_BE_EC_NSOPS
+ * stripes in flight per context, as IO on the async. contexts of the members.
+ * That is, there are no threads, progress is made by poke/wait on the context,
+ * and synchronous commands are carried out on contexts shared among threads.
+ *
+ * Writes covering a stripe encode parity from the command payload, smaller
+ * writes first read the data units not covered, then encode and write the
+ * units modified along with the parity. Writes, and reads in need of
+ * reconstruction, hold a lock on the stripe.
+ *
+ * A member failing IO is marked failed, and commands in flight on its stripes
+ * are redone without it; reads reconstruct units of failed members, writes
+ * skip them. With more than m failed members, IO fails.
+ *
+ * The first unit of every member holds a header with an epoch, which is
+ * advanced on the members in use at every open, and when a member fails. A
+ * member with an epoch behind the others has missed writes, and is thus
+ * treated as failed.
+ */
+
+#define EC_NLOCKS 256		///< Stripe locks, hashed by stripe
+#define EC_SLICE 4096		///< Bytes encoded at a time, to stay in cache
+#define EC_HDR_MAGIC 0x44484345454d564eULL	///< "NVMEECHD"
+#define EC_HDR_VERSION 1
+
+enum ec_phase {
+	EC_SOP_FREE = 0,
+	EC_SOP_PLAN,		///< Waiting for the stripe lock, or to be planned
+	EC_SOP_LOAD,		///< Reading units needed for decode or parity
+	EC_SOP_IO,		///< Reading or writing the payload
+};
+
+typedef void (*ec_mad_fn)(uint8_t *dst, const uint8_t *src, uint8_t c,
+			  size_t nbytes);
+
+/**
+ * Header of a member, in its first LBA
+ */
+struct ec_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t n;
+	uint32_t m;
+	uint32_t unit_nbytes;
+	uint32_t index;		///< Position of the member in the composite
+	uint32_t rsvd;
+	uint64_t epoch;
+};
+
+struct ec_member {
+	struct xnvme_dev *dev;	///< NULL when failing to open, or stale
+	uint32_t nsid;
+};
+
+struct xnvme_ec {
+	struct ec_member members[XNVME_BE_EC_NMEMBERS_MAX];
+	struct xnvme_dev *bufdev;	///< Member allocating buffers
+	uint32_t n;			///< Number of members, k + m
+	uint32_t k;
+	uint32_t m;
+	uint8_t coef[XNVME_BE_EC_NMEMBERS_MAX][XNVME_BE_EC_NMEMBERS_MAX];
+
+	uint32_t lba_nbytes;
+	uint32_t unit_nbytes;
+	uint32_t unit_nlb;
+	uint64_t stripe_nlb;		///< LBAs of data in a stripe
+	uint64_t nstripes;
+	uint64_t nlpages;
+
+	pthread_mutex_t lock;		///< Protects 'failed', 'epoch', and 'held'
+	uint32_t failed;		///< Mask of failed members
+	uint64_t epoch;			///< Epoch of the members in use
+	uint8_t held[EC_NLOCKS];
+
+	pthread_mutex_t sync_lock;	///< Protects the sync. contexts
+	pthread_cond_t sync_cond;
+	struct ec_ctx *sync[XNVME_BE_EC_NSYNC];
+	uint32_t sync_busy;
+};
+
+struct ec_cmd {
+	struct xnvme_req *req;
+	uint8_t opcode;
+	uint64_t slba;
+	uint64_t nlb;
+	uint8_t *dbuf;
+
+	uint64_t next;		///< LBAs handed to stripe operations
+	uint32_t nsops;		///< Stripe operations in flight
+	int err;
+	int sync;
+	int done;
+
+	struct ec_cmd *link;
+};
+
+/**
+ * Operation on a single stripe, carrying out a part of a command
+ */
+struct ec_sop {
+	struct ec_ctx *ectx;
+	struct ec_cmd *cmd;
+	enum ec_phase phase;
+
+	uint64_t stripe;
+	uint64_t ofz;		///< First LBA, relative to the stripe
+	uint64_t nlb;
+	uint8_t *ubuf;		///< Payload in the command buffer
+
+	uint32_t touched;	///< Data units covered by the command
+	uint32_t full;		///< Data units entirely covered
+	uint32_t have;		///< Units read into 'stage'
+	uint32_t want;		///< Data units to reconstruct
+	int locked;
+	int err;
+
+	uint32_t npending;	///< Member IO in flight
+	uint32_t errmask;	///< Members failing IO
+	struct xnvme_req reqs[XNVME_BE_EC_NMEMBERS_MAX];	///< By member
+
+	uint8_t *stage;		///< A unit for every member
+
+	struct ec_sop *link;
+};
+
+struct ec_ctx {
+	struct xnvme_ec *ec;
+	struct xnvme_async_ctx *ctx;	///< NULL for sync. contexts
+	struct xnvme_async_ctx *mctx[XNVME_BE_EC_NMEMBERS_MAX];
+
+	struct ec_cmd *cmds;		///< 'depth' commands, for submission
+	struct ec_cmd *free_cmds;
+	struct ec_cmd *head;		///< With stripes not yet started
+	struct ec_cmd *tail;
+
+	struct ec_sop sops[XNVME_BE_EC_NSOPS];
+	struct ec_sop *free;
+	uint8_t *stage;
+};
+
+static uint8_t g_ec_exp[512];
+static uint8_t g_ec_log[256];
+static uint8_t g_ec_mul[256][256];
+static ec_mad_fn g_ec_mad;
+static pthread_once_t g_ec_once = PTHREAD_ONCE_INIT;
+
+static inline uint8_t
+ec_gf_inv(uint8_t val)
+{
+	return g_ec_exp[255 - g_ec_log[val]];
+}
+
+/**
+ * dst ^= c * src, one byte at a time
+ */
+static void
+ec_mad_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t nbytes)
+{
+	const uint8_t *row = g_ec_mul[c];
+
+	for (size_t i = 0; i < nbytes; ++i) {
+		dst[i] ^= row[src[i]];
+	}
+}
+
+#ifdef EC_X86_SIMD
+/**
+ * dst ^= c * src, via lookup of the products of the low and high nibbles
+ */
+__attribute__((target("avx2")))
+static void
+ec_mad_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t nbytes)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	uint8_t tlo[16], thi[16];
+	__m256i lo, hi;
+	size_t i = 0;
+
+	for (int j = 0; j < 16; ++j) {
+		tlo[j] = g_ec_mul[c][j];
+		thi[j] = g_ec_mul[c][j << 4];
+	}
+	lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((void *)tlo));
+	hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((void *)thi));
+
+	for (; i + 32 <= nbytes; i += 32) {
+		__m256i x = _mm256_loadu_si256((const void *)(src + i));
+		__m256i d = _mm256_loadu_si256((const void *)(dst + i));
+		__m256i l = _mm256_and_si256(x, mask);
+		__m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+
+		d = _mm256_xor_si256(d, _mm256_shuffle_epi8(lo, l));
+		d = _mm256_xor_si256(d, _mm256_shuffle_epi8(hi, h));
+		_mm256_storeu_si256((void *)(dst + i), d);
+	}
+
+	ec_mad_scalar(dst + i, src + i, c, nbytes - i);
+}
+
+/**
+ * Multiplication by 'c' as the bit-matrix of a GF2P8AFFINEQB, where byte 7-i
+ * of the matrix yields bit i of the product
+ */
+static uint64_t
+ec_gf_affine(uint8_t c)
+{
+	uint64_t mat = 0;
+
+	for (int i = 0; i < 8; ++i) {
+		uint64_t row = 0;
+
+		for (int j = 0; j < 8; ++j) {
+			row |= ((g_ec_mul[c][1 << j] >> i) & 1) << j;
+		}
+		mat |= row << (8 * (7 - i));
+	}
+
+	return mat;
+}
+
+/**
+ * dst ^= c * src, via the Galois Field New Instructions
+ */
+__attribute__((target("gfni,avx2")))
+static void
+ec_mad_gfni(uint8_t *dst, const uint8_t *src, uint8_t c, size_t nbytes)
+{
+	const __m256i mat = _mm256_set1_epi64x(ec_gf_affine(c));
+	size_t i = 0;
+
+	for (; i + 32 <= nbytes; i += 32) {
+		__m256i x = _mm256_loadu_si256((const void *)(src + i));
+		__m256i d = _mm256_loadu_si256((const void *)(dst + i));
+
+		d = _mm256_xor_si256(d, _mm256_gf2p8affine_epi64_epi8(x, mat, 0));
+		_mm256_storeu_si256((void *)(dst + i), d);
+	}
+
+	ec_mad_scalar(dst + i, src + i, c, nbytes - i);
+}
+#endif
+
+/**
+ * Setup the tables of GF(2^8), with the polynomial 0x11d, and pick the
+ * fastest multiply-add supported by the CPU
+ */
+static void
+ec_gf_init(void)
+{
+	uint32_t val = 1;
+
+	for (int i = 0; i < 255; ++i) {
+		g_ec_exp[i] = val;
+		g_ec_exp[i + 255] = val;
+		g_ec_log[val] = i;
+
+		val <<= 1;
+		if (val & 0x100) {
+			val ^= 0x11d;
+		}
+	}
+	for (int a = 1; a < 256; ++a) {
+		for (int b = 1; b < 256; ++b) {
+			g_ec_mul[a][b] = g_ec_exp[g_ec_log[a] + g_ec_log[b]];
+		}
+	}
+
+	g_ec_mad = ec_mad_scalar;
+#ifdef EC_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		g_ec_mad = ec_mad_avx2;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("gfni")) {
+		g_ec_mad = ec_mad_gfni;
+	}
+#endif
+}
+
+/**
+ * Invert the k x k matrix 'mat', in place, by Gauss-Jordan elimination
+ */
+static int
+ec_gf_invert(uint8_t *mat, uint8_t *inv, uint32_t k)
+{
+	memset(inv, 0, k * k);
+	for (uint32_t i = 0; i < k; ++i) {
+		inv[i * k + i] = 1;
+	}
+
+	for (uint32_t col = 0; col < k; ++col) {
+		uint32_t piv = col;
+		uint8_t scale;
+
+		while ((piv < k) && (!mat[piv * k + col])) {
+			++piv;
+		}
+		if (piv == k) {
+			return -EINVAL;
+		}
+		for (uint32_t j = 0; (piv != col) && (j < k); ++j) {
+			uint8_t tmp = mat[col * k + j];
+
+			mat[col * k + j] = mat[piv * k + j];
+			mat[piv * k + j] = tmp;
+			tmp = inv[col * k + j];
+			inv[col * k + j] = inv[piv * k + j];
+			inv[piv * k + j] = tmp;
+		}
+
+		scale = ec_gf_inv(mat[col * k + col]);
+		for (uint32_t j = 0; j < k; ++j) {
+			mat[col * k + j] = g_ec_mul[scale][mat[col * k + j]];
+			inv[col * k + j] = g_ec_mul[scale][inv[col * k + j]];
+		}
+
+		for (uint32_t row = 0; row < k; ++row) {
+			uint8_t fac = mat[row * k + col];
+
+			if ((row == col) || (!fac)) {
+				continue;
+			}
+			for (uint32_t j = 0; j < k; ++j) {
+				mat[row * k + j] ^= g_ec_mul[fac][mat[col * k + j]];
+				inv[row * k + j] ^= g_ec_mul[fac][inv[col * k + j]];
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Compute the parity units from the data units
+ */
+static void
+ec_encode(struct xnvme_ec *ec, uint8_t **data, uint8_t **parity)
+{
+	for (uint32_t ofz = 0; ofz < ec->unit_nbytes; ofz += EC_SLICE) {
+		const size_t nbytes = ec->unit_nbytes - ofz < EC_SLICE ? \
+				      ec->unit_nbytes - ofz : EC_SLICE;
+
+		for (uint32_t i = 0; i < ec->m; ++i) {
+			memset(parity[i] + ofz, 0, nbytes);
+			for (uint32_t j = 0; j < ec->k; ++j) {
+				g_ec_mad(parity[i] + ofz, data[j] + ofz,
+					 ec->coef[i][j], nbytes);
+			}
+		}
+	}
+}
+
+/**
+ * Reconstruct the data units in 'want' from the first k units in 'have'
+ */
+static int
+ec_decode(struct xnvme_ec *ec, uint8_t **units, uint32_t have, uint32_t want)
+{
+	uint8_t mat[XNVME_BE_EC_NMEMBERS_MAX * XNVME_BE_EC_NMEMBERS_MAX];
+	uint8_t inv[XNVME_BE_EC_NMEMBERS_MAX * XNVME_BE_EC_NMEMBERS_MAX];
+	uint32_t rows[XNVME_BE_EC_NMEMBERS_MAX];
+	uint32_t nrows = 0;
+	int err;
+
+	for (uint32_t u = 0; (u < ec->n) && (nrows < ec->k); ++u) {
+		if (have & (1U << u)) {
+			rows[nrows++] = u;
+		}
+	}
+	if (nrows < ec->k) {
+		XNVME_DEBUG("FAILED: have: 0x%x, too few units", have);
+		return -EIO;
+	}
+
+	for (uint32_t r = 0; r < ec->k; ++r) {
+		for (uint32_t c = 0; c < ec->k; ++c) {
+			mat[r * ec->k + c] = rows[r] < ec->k ? rows[r] == c : \
+					     ec->coef[rows[r] - ec->k][c];
+		}
+	}
+	err = ec_gf_invert(mat, inv, ec->k);
+	if (err) {
+		XNVME_DEBUG("FAILED: ec_gf_invert(), err: %d", err);
+		return err;
+	}
+
+	for (uint32_t j = 0; j < ec->k; ++j) {
+		if (!(want & (1U << j))) {
+			continue;
+		}
+
+		memset(units[j], 0, ec->unit_nbytes);
+		for (uint32_t r = 0; r < ec->k; ++r) {
+			if (inv[j * ec->k + r]) {
+				g_ec_mad(units[j], units[rows[r]],
+					 inv[j * ec->k + r], ec->unit_nbytes);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static inline uint32_t
+ec_member_of(struct xnvme_ec *ec, uint64_t stripe, uint32_t unit)
+{
+	return (unit + stripe) % ec->n;
+}
+
+static inline uint8_t *
+ec_unit_buf(struct ec_sop *sop, uint32_t unit)
+{
+	return sop->stage + (size_t)unit * sop->ectx->ec->unit_nbytes;
+}
+
+static int
+ec_popcount(uint32_t mask)
+{
+	return __builtin_popcount(mask);
+}
+
+/**
+ * Write the header of the given member, with the current epoch
+ */
+static int
+ec_hdr_write(struct xnvme_ec *ec, uint32_t mi)
+{
+	struct ec_member *member = &ec->members[mi];
+	struct xnvme_req req = { 0 };
+	struct ec_hdr *hdr;
+	int err;
+
+	hdr = xnvme_buf_alloc(member->dev, ec->lba_nbytes, NULL);
+	if (!hdr) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+		return -errno;
+	}
+	memset(hdr, 0, ec->lba_nbytes);
+	hdr->magic = EC_HDR_MAGIC;
+	hdr->version = EC_HDR_VERSION;
+	hdr->n = ec->n;
+	hdr->m = ec->m;
+	hdr->unit_nbytes = ec->unit_nbytes;
+	hdr->index = mi;
+	hdr->epoch = ec->epoch;
+
+	err = xnvme_cmd_write(member->dev, member->nsid, 0, 0, hdr, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_write(), member: %u, err: %d", mi,
+			    err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	if (xnvme_dev_get_ctrlr(member->dev)->vwc.present) {
+		struct xnvme_spec_cmd cmd = { 0 };
+
+		cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+		cmd.common.nsid = member->nsid;
+		err = xnvme_cmd_pass(member->dev, &cmd, NULL, 0, NULL, 0,
+				     XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: flush, member: %u, err: %d", mi, err);
+			err = err ? err : -EIO;
+		}
+	}
+
+exit:
+	xnvme_buf_free(member->dev, hdr);
+
+	return err;
+}
+
+/**
+ * Advance the epoch on the members not failed, the members failing to take
+ * it are marked failed. Called with 'lock' held.
+ */
+static void
+ec_epoch_advance(struct xnvme_ec *ec)
+{
+	ec->epoch += 1;
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if ((ec->failed & (1U << mi)) || (!ec_hdr_write(ec, mi))) {
+			continue;
+		}
+		ec->failed |= 1U << mi;
+	}
+}
+
+/**
+ * Mark the given members failed, returns the number of failed members
+ */
+static int
+ec_fail(struct xnvme_ec *ec, uint32_t members)
+{
+	int nfailed;
+
+	pthread_mutex_lock(&ec->lock);
+	if (members & ~ec->failed) {
+		ec->failed |= members;
+		ec_epoch_advance(ec);
+	}
+	nfailed = ec_popcount(ec->failed);
+	pthread_mutex_unlock(&ec->lock);
+
+	XNVME_DEBUG("INFO: members: 0x%x failed, nfailed: %d", members, nfailed);
+
+	return nfailed;
+}
+
+static void
+ec_member_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct ec_sop *sop = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		sop->errmask |= 1U << (req - sop->reqs);
+	}
+	sop->npending -= 1;
+}
+
+/**
+ * Submit IO on the given unit of the stripe, the LBA range is relative to the
+ * unit
+ */
+static void
+ec_sop_submit(struct ec_sop *sop, uint32_t unit, uint8_t opcode, uint64_t ofz,
+	      uint64_t nlb, uint8_t *buf)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	const uint32_t mi = ec_member_of(ec, sop->stripe, unit);
+	struct ec_member *member = &ec->members[mi];
+	struct xnvme_async_ctx *mctx = sop->ectx->mctx[mi];
+	struct xnvme_req *req = &sop->reqs[mi];
+	const uint64_t slba = (sop->stripe + 1) * ec->unit_nlb + ofz;
+	int err;
+
+	memset(req, 0, sizeof(*req));
+	req->async.ctx = mctx;
+	req->async.cb = ec_member_cb;
+	req->async.cb_arg = sop;
+
+	sop->npending += 1;
+	for (;;) {
+		struct xnvme_spec_cmd cmd = { 0 };
+
+		switch (opcode) {
+		case XNVME_SPEC_OPC_READ:
+			err = xnvme_cmd_read(member->dev, member->nsid, slba,
+					     nlb - 1, buf, NULL, XNVME_CMD_ASYNC,
+					     req);
+			break;
+		case XNVME_SPEC_OPC_WRITE:
+			err = xnvme_cmd_write(member->dev, member->nsid, slba,
+					      nlb - 1, buf, NULL, XNVME_CMD_ASYNC,
+					      req);
+			break;
+
+		default:
+			cmd.common.opcode = opcode;
+			cmd.common.nsid = member->nsid;
+			err = xnvme_cmd_pass(member->dev, &cmd, NULL, 0, NULL, 0,
+					     XNVME_CMD_ASYNC, req);
+			break;
+		}
+		if ((err != -EBUSY) && (err != -EAGAIN)) {
+			break;
+		}
+
+		xnvme_async_poke(member->dev, mctx, 0);
+	}
+	if (err) {
+		XNVME_DEBUG("FAILED: member: %u, opcode: 0x%x, err: %d", mi,
+			    opcode, err);
+		sop->errmask |= 1U << mi;
+		sop->npending -= 1;
+	}
+}
+
+/**
+ * LBA range of the command within the given data unit
+ */
+static inline void
+ec_sop_range(struct ec_sop *sop, uint32_t unit, uint64_t *ofz, uint64_t *nlb,
+	     uint8_t **ubuf)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	const uint64_t uslba = (uint64_t)unit * ec->unit_nlb;
+	const uint64_t slba = sop->ofz > uslba ? sop->ofz : uslba;
+	const uint64_t elba = sop->ofz + sop->nlb < uslba + ec->unit_nlb ? \
+			      sop->ofz + sop->nlb : uslba + ec->unit_nlb;
+
+	*ofz = slba - uslba;
+	*nlb = elba - slba;
+	*ubuf = sop->ubuf + (slba - sop->ofz) * ec->lba_nbytes;
+}
+
+/**
+ * Encode parity, with the payload of the command over the loaded data units,
+ * and write the units modified along with the parity
+ */
+static void
+ec_sop_write(struct ec_sop *sop, uint32_t lost)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	uint8_t *data[XNVME_BE_EC_NMEMBERS_MAX];
+	uint8_t *parity[XNVME_BE_EC_NMEMBERS_MAX];
+
+	for (uint32_t j = 0; j < ec->k; ++j) {
+		uint64_t ofz, nlb;
+		uint8_t *ubuf;
+
+		data[j] = ec_unit_buf(sop, j);
+		if (!(sop->touched & (1U << j))) {
+			continue;
+		}
+
+		ec_sop_range(sop, j, &ofz, &nlb, &ubuf);
+		if (sop->full & (1U << j)) {
+			data[j] = ubuf;
+			continue;
+		}
+		memcpy(data[j] + ofz * ec->lba_nbytes, ubuf, nlb * ec->lba_nbytes);
+	}
+	for (uint32_t i = 0; i < ec->m; ++i) {
+		parity[i] = ec_unit_buf(sop, ec->k + i);
+	}
+	ec_encode(ec, data, parity);
+
+	sop->phase = EC_SOP_IO;
+	for (uint32_t j = 0; j < ec->k; ++j) {
+		uint64_t ofz, nlb;
+		uint8_t *ubuf;
+
+		if ((!(sop->touched & (1U << j))) || (lost & (1U << j))) {
+			continue;
+		}
+
+		ec_sop_range(sop, j, &ofz, &nlb, &ubuf);
+		ec_sop_submit(sop, j, XNVME_SPEC_OPC_WRITE, ofz, nlb, ubuf);
+	}
+	for (uint32_t i = 0; i < ec->m; ++i) {
+		if (lost & (1U << (ec->k + i))) {
+			continue;
+		}
+
+		ec_sop_submit(sop, ec->k + i, XNVME_SPEC_OPC_WRITE, 0,
+			      ec->unit_nlb, parity[i]);
+	}
+}
+
+/**
+ * Units of the stripe on failed members
+ */
+static uint32_t
+ec_sop_lost(struct ec_sop *sop, uint32_t failed)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	uint32_t lost = 0;
+
+	for (uint32_t u = 0; u < ec->n; ++u) {
+		if (failed & (1U << ec_member_of(ec, sop->stripe, u))) {
+			lost |= 1U << u;
+		}
+	}
+
+	return lost;
+}
+
+/**
+ * The first k units not lost, data units first
+ */
+static uint32_t
+ec_sop_choose(struct ec_sop *sop, uint32_t lost)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	uint32_t need = 0, count = 0;
+
+	for (uint32_t u = 0; (u < ec->n) && (count < ec->k); ++u) {
+		if (!(lost & (1U << u))) {
+			need |= 1U << u;
+			count += 1;
+		}
+	}
+
+	return need;
+}
+
+/**
+ * Submit the IO of a stripe operation; this never completes the operation,
+ * errors are recorded and handled by the next step
+ */
+static void
+ec_sop_plan(struct ec_sop *sop)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	const uint32_t data_mask = (1U << ec->k) - 1;
+	uint32_t failed, lost, need;
+
+	sop->have = 0;
+	sop->want = 0;
+
+	pthread_mutex_lock(&ec->lock);
+	failed = ec->failed;
+	if (ec_popcount(failed) > (int)ec->m) {
+		pthread_mutex_unlock(&ec->lock);
+		sop->err = -EIO;
+		sop->phase = EC_SOP_IO;
+		return;
+	}
+
+	if (sop->cmd->opcode == XNVME_SPEC_OPC_FLUSH) {
+		pthread_mutex_unlock(&ec->lock);
+		sop->phase = EC_SOP_IO;
+		for (uint32_t mi = 0; mi < ec->n; ++mi) {
+			if (!(failed & (1U << mi))) {
+				ec_sop_submit(sop, (mi + ec->n - sop->stripe % ec->n) % ec->n,
+					      XNVME_SPEC_OPC_FLUSH, 0, 0, NULL);
+			}
+		}
+		return;
+	}
+
+	lost = ec_sop_lost(sop, failed);
+	if ((sop->cmd->opcode == XNVME_SPEC_OPC_READ) && (!(sop->touched & lost))) {
+		pthread_mutex_unlock(&ec->lock);
+		sop->phase = EC_SOP_IO;
+		for (uint32_t j = 0; j < ec->k; ++j) {
+			uint64_t ofz, nlb;
+			uint8_t *ubuf;
+
+			if (sop->touched & (1U << j)) {
+				ec_sop_range(sop, j, &ofz, &nlb, &ubuf);
+				ec_sop_submit(sop, j, XNVME_SPEC_OPC_READ, ofz,
+					      nlb, ubuf);
+			}
+		}
+		return;
+	}
+
+	if (!sop->locked) {
+		if (ec->held[sop->stripe % EC_NLOCKS]) {
+			pthread_mutex_unlock(&ec->lock);
+			sop->phase = EC_SOP_PLAN;
+			return;
+		}
+		ec->held[sop->stripe % EC_NLOCKS] = 1;
+		sop->locked = 1;
+	}
+	pthread_mutex_unlock(&ec->lock);
+
+	if (sop->cmd->opcode == XNVME_SPEC_OPC_READ) {
+		need = ec_sop_choose(sop, lost);
+		sop->want = sop->touched & lost;
+	} else {
+		need = data_mask & ~sop->full;
+		if (need & lost) {
+			sop->want = need & lost;
+			need = ec_sop_choose(sop, lost);
+		}
+	}
+
+	if (!need) {
+		ec_sop_write(sop, lost);
+		return;
+	}
+
+	sop->phase = EC_SOP_LOAD;
+	sop->have = need;
+	for (uint32_t u = 0; u < ec->n; ++u) {
+		if (need & (1U << u)) {
+			ec_sop_submit(sop, u, XNVME_SPEC_OPC_READ, 0, ec->unit_nlb,
+				      ec_unit_buf(sop, u));
+		}
+	}
+}
+
+static int
+ec_cmd_complete(struct ec_ctx *ectx, struct ec_cmd *cmd)
+{
+	struct xnvme_req *req = cmd->req;
+
+	if (cmd->sync) {
+		cmd->done = 1;
+		return 1;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+	if (cmd->err) {
+		req->cpl.status.sc = XNVME_SPEC_SC_INTERNAL;
+	}
+
+	cmd->link = ectx->free_cmds;
+	ectx->free_cmds = cmd;
+	ectx->ctx->outstanding -= 1;
+
+	req->async.cb(req, req->async.cb_arg);
+
+	return 1;
+}
+
+static int
+ec_sop_finish(struct ec_sop *sop, int err)
+{
+	struct ec_ctx *ectx = sop->ectx;
+	struct xnvme_ec *ec = ectx->ec;
+	struct ec_cmd *cmd = sop->cmd;
+
+	if (sop->locked) {
+		pthread_mutex_lock(&ec->lock);
+		ec->held[sop->stripe % EC_NLOCKS] = 0;
+		pthread_mutex_unlock(&ec->lock);
+	}
+	if (err && (!cmd->err)) {
+		cmd->err = err;
+	}
+
+	sop->phase = EC_SOP_FREE;
+	sop->link = ectx->free;
+	ectx->free = sop;
+
+	cmd->nsops -= 1;
+	if (cmd->nsops || (cmd->next < cmd->nlb)) {
+		return 0;
+	}
+
+	return ec_cmd_complete(ectx, cmd);
+}
+
+/**
+ * Advance a stripe operation with no IO in flight; returns the number of
+ * commands completed
+ */
+static int
+ec_sop_step(struct ec_sop *sop)
+{
+	struct xnvme_ec *ec = sop->ectx->ec;
+	uint32_t lost;
+	int err;
+
+	if (sop->errmask) {
+		if (ec_fail(ec, sop->errmask) > (int)ec->m) {
+			return ec_sop_finish(sop, -EIO);
+		}
+
+		// Redo the operation without the failed members
+		sop->errmask = 0;
+		sop->phase = EC_SOP_PLAN;
+		if (sop->cmd->opcode == XNVME_SPEC_OPC_FLUSH) {
+			return ec_sop_finish(sop, 0);
+		}
+	}
+
+	switch (sop->phase) {
+	case EC_SOP_PLAN:
+		ec_sop_plan(sop);
+		return 0;
+
+	case EC_SOP_LOAD:
+		break;
+
+	default:
+		return ec_sop_finish(sop, sop->err);
+	}
+
+	if (sop->want) {
+		uint8_t *units[XNVME_BE_EC_NMEMBERS_MAX];
+
+		for (uint32_t u = 0; u < ec->n; ++u) {
+			units[u] = ec_unit_buf(sop, u);
+		}
+		err = ec_decode(ec, units, sop->have, sop->want);
+		if (err) {
+			return ec_sop_finish(sop, err);
+		}
+	}
+
+	if (sop->cmd->opcode == XNVME_SPEC_OPC_READ) {
+		for (uint32_t j = 0; j < ec->k; ++j) {
+			uint64_t ofz, nlb;
+			uint8_t *ubuf;
+
+			if (sop->touched & (1U << j)) {
+				ec_sop_range(sop, j, &ofz, &nlb, &ubuf);
+				memcpy(ubuf, ec_unit_buf(sop, j) + ofz * ec->lba_nbytes,
+				       nlb * ec->lba_nbytes);
+			}
+		}
+
+		return ec_sop_finish(sop, 0);
+	}
+
+	pthread_mutex_lock(&ec->lock);
+	lost = ec_sop_lost(sop, ec->failed);
+	pthread_mutex_unlock(&ec->lock);
+
+	ec_sop_write(sop, lost);
+
+	return 0;
+}
+
+/**
+ * Start stripe operations for the queued commands, as long as there are
+ * operations available
+ */
+static void
+ec_ctx_start(struct ec_ctx *ectx)
+{
+	struct xnvme_ec *ec = ectx->ec;
+
+	while (ectx->free && ectx->head) {
+		struct ec_cmd *cmd = ectx->head;
+		struct ec_sop *sop = ectx->free;
+		const uint64_t lba = cmd->slba + cmd->next;
+
+		ectx->free = sop->link;
+
+		sop->cmd = cmd;
+		sop->stripe = lba / ec->stripe_nlb;
+		sop->ofz = lba % ec->stripe_nlb;
+		sop->nlb = cmd->nlb - cmd->next;
+		if (sop->nlb > ec->stripe_nlb - sop->ofz) {
+			sop->nlb = ec->stripe_nlb - sop->ofz;
+		}
+		sop->ubuf = cmd->dbuf + cmd->next * ec->lba_nbytes;
+		sop->locked = 0;
+		sop->err = 0;
+		sop->errmask = 0;
+		sop->npending = 0;
+
+		sop->touched = 0;
+		sop->full = 0;
+		for (uint32_t j = 0; (cmd->opcode != XNVME_SPEC_OPC_FLUSH) &&
+		     (j < ec->k); ++j) {
+			const uint64_t uslba = (uint64_t)j * ec->unit_nlb;
+
+			if ((sop->ofz >= uslba + ec->unit_nlb) ||
+			    (sop->ofz + sop->nlb <= uslba)) {
+				continue;
+			}
+			sop->touched |= 1U << j;
+			if ((sop->ofz <= uslba) &&
+			    (sop->ofz + sop->nlb >= uslba + ec->unit_nlb)) {
+				sop->full |= 1U << j;
+			}
+		}
+
+		cmd->next += sop->nlb;
+		cmd->nsops += 1;
+		if (cmd->next == cmd->nlb) {
+			ectx->head = cmd->link;
+			if (!ectx->head) {
+				ectx->tail = NULL;
+			}
+		}
+
+		sop->phase = EC_SOP_PLAN;
+		ec_sop_plan(sop);
+	}
+}
+
+static void
+ec_ctx_enqueue(struct ec_ctx *ectx, struct ec_cmd *cmd)
+{
+	cmd->next = 0;
+	cmd->nsops = 0;
+	cmd->err = 0;
+	cmd->done = 0;
+	cmd->link = NULL;
+
+	if (ectx->tail) {
+		ectx->tail->link = cmd;
+	} else {
+		ectx->head = cmd;
+	}
+	ectx->tail = cmd;
+
+	ec_ctx_start(ectx);
+}
+
+/**
+ * Reap member completions, advance the stripe operations with no IO in
+ * flight, and start new ones; returns the number of commands completed
+ */
+static int
+ec_ctx_progress(struct ec_ctx *ectx)
+{
+	struct xnvme_ec *ec = ectx->ec;
+	int completed = 0;
+
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if (ectx->mctx[mi]) {
+			xnvme_async_poke(ec->members[mi].dev, ectx->mctx[mi], 0);
+		}
+	}
+
+	for (uint32_t i = 0; i < XNVME_BE_EC_NSOPS; ++i) {
+		struct ec_sop *sop = &ectx->sops[i];
+
+		if ((sop->phase == EC_SOP_FREE) || sop->npending) {
+			continue;
+		}
+
+		completed += ec_sop_step(sop);
+	}
+
+	ec_ctx_start(ectx);
+
+	return completed;
+}
+
+static void
+ec_ctx_term(struct xnvme_ec *ec, struct ec_ctx *ectx)
+{
+	if (!ectx) {
+		return;
+	}
+
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if (ectx->mctx[mi]) {
+			xnvme_async_term(ec->members[mi].dev, ectx->mctx[mi]);
+		}
+	}
+	xnvme_buf_free(ec->bufdev, ectx->stage);
+	free(ectx->cmds);
+	free(ectx);
+}
+
+static int
+ec_ctx_init(struct xnvme_ec *ec, uint32_t depth, struct ec_ctx **ectx)
+{
+	const size_t stripe_nbytes = (size_t)ec->n * ec->unit_nbytes;
+	int err;
+
+	(*ectx) = calloc(1, sizeof(**ectx));
+	if (!(*ectx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*ectx)->ec = ec;
+
+	(*ectx)->cmds = calloc(depth, sizeof(*(*ectx)->cmds));
+	(*ectx)->stage = xnvme_buf_alloc(ec->bufdev,
+					 stripe_nbytes * XNVME_BE_EC_NSOPS, NULL);
+	if (!((*ectx)->cmds && (*ectx)->stage)) {
+		XNVME_DEBUG("FAILED: allocating context buffers");
+		err = -ENOMEM;
+		goto failed;
+	}
+	for (uint32_t i = 0; i < depth; ++i) {
+		(*ectx)->cmds[i].link = (*ectx)->free_cmds;
+		(*ectx)->free_cmds = &(*ectx)->cmds[i];
+	}
+	for (uint32_t i = 0; i < XNVME_BE_EC_NSOPS; ++i) {
+		struct ec_sop *sop = &(*ectx)->sops[i];
+
+		sop->ectx = *ectx;
+		sop->stage = (*ectx)->stage + i * stripe_nbytes;
+		sop->link = (*ectx)->free;
+		(*ectx)->free = sop;
+	}
+
+	// Each stripe operation has at most one command on a member
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if (!ec->members[mi].dev) {
+			continue;
+		}
+
+		err = xnvme_async_init(ec->members[mi].dev, &(*ectx)->mctx[mi],
+				       XNVME_BE_EC_NSOPS, 0);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_async_init(), member: %u, err: %d",
+				    mi, err);
+			(*ectx)->mctx[mi] = NULL;
+			goto failed;
+		}
+	}
+
+	return 0;
+
+failed:
+	ec_ctx_term(ec, *ectx);
+	*ectx = NULL;
+
+	return err;
+}
+
+static void
+ec_term(struct xnvme_ec *ec)
+{
+	if (!ec) {
+		return;
+	}
+
+	for (int i = 0; i < XNVME_BE_EC_NSYNC; ++i) {
+		ec_ctx_term(ec, ec->sync[i]);
+	}
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if (ec->members[mi].dev) {
+			xnvme_dev_close(ec->members[mi].dev);
+		}
+	}
+
+	pthread_cond_destroy(&ec->sync_cond);
+	pthread_mutex_destroy(&ec->sync_lock);
+	pthread_mutex_destroy(&ec->lock);
+	free(ec);
+}
+
+static int
+ec_hdr_read(struct xnvme_ec *ec, uint32_t mi, struct ec_hdr *hdr)
+{
+	struct ec_member *member = &ec->members[mi];
+	struct xnvme_req req = { 0 };
+	void *buf;
+	int err;
+
+	buf = xnvme_buf_alloc(member->dev, ec->lba_nbytes, NULL);
+	if (!buf) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+		return -errno;
+	}
+
+	err = xnvme_cmd_read(member->dev, member->nsid, 0, 0, buf, NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_read(), member: %u, err: %d", mi,
+			    err);
+		err = err ? err : -EIO;
+	}
+	memcpy(hdr, buf, sizeof(*hdr));
+	xnvme_buf_free(member->dev, buf);
+
+	return err;
+}
+
+/**
+ * Read the headers of the members, and take those at the latest epoch into
+ * use; members without a header, or behind on the epoch, are closed and
+ * marked failed. When no member has a header, or when asked to via 'format',
+ * then all members are taken into use. The epoch is then advanced, such that
+ * members not in use at this open are behind at the next.
+ */
+static int
+ec_hdr_load(struct xnvme_ec *ec, int format)
+{
+	struct ec_hdr hdrs[XNVME_BE_EC_NMEMBERS_MAX] = { 0 };
+	uint32_t valid = 0;
+	uint64_t epoch = 0;
+
+	for (uint32_t mi = 0; (!format) && (mi < ec->n); ++mi) {
+		struct ec_hdr *hdr = &hdrs[mi];
+
+		if ((!ec->members[mi].dev) || ec_hdr_read(ec, mi, hdr) ||
+		    (hdr->magic != EC_HDR_MAGIC)) {
+			continue;
+		}
+		if ((hdr->version != EC_HDR_VERSION) || (hdr->n != ec->n) ||
+		    (hdr->m != ec->m) || (hdr->unit_nbytes != ec->unit_nbytes) ||
+		    (hdr->index != mi)) {
+			XNVME_DEBUG("FAILED: member: %u, mismatch, use format=1",
+				    mi);
+			return -EINVAL;
+		}
+
+		valid |= 1U << mi;
+		epoch = hdr->epoch > epoch ? hdr->epoch : epoch;
+	}
+	if (!valid) {
+		XNVME_DEBUG("INFO: formatting");
+	}
+
+	ec->bufdev = NULL;
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		struct ec_member *member = &ec->members[mi];
+
+		if (!member->dev) {
+			continue;
+		}
+		if (valid && ((!(valid & (1U << mi))) ||
+			      (hdrs[mi].epoch != epoch))) {
+			XNVME_DEBUG("INFO: member: %u, stale, epoch: %lu/%lu", mi,
+				    hdrs[mi].epoch, epoch);
+			xnvme_dev_close(member->dev);
+			member->dev = NULL;
+			ec->failed |= 1U << mi;
+			continue;
+		}
+		ec->bufdev = ec->bufdev ? ec->bufdev : member->dev;
+	}
+
+	pthread_mutex_lock(&ec->lock);
+	ec->epoch = epoch;
+	ec_epoch_advance(ec);
+	pthread_mutex_unlock(&ec->lock);
+
+	return 0;
+}
+
+/**
+ * Open the members, given as a comma-separated list of uris, and derive the
+ * layout of stripes from the smallest member
+ */
+static int
+ec_init(const struct xnvme_ident *ident, struct xnvme_ec **ec)
+{
+	char trgt[XNVME_IDENT_TRGT_LEN] = { 0 };
+	uint32_t m = XNVME_BE_EC_PARITY_DEF;
+	uint32_t unit = XNVME_BE_EC_UNIT_DEF;
+	uint64_t member_nlb = 0;
+	char *saveptr = NULL;
+	uint32_t nfailed = 0;
+	uint32_t format = 0;
+	int err;
+
+	xnvme_ident_opt_to_val(ident, "parity", &m);
+	xnvme_ident_opt_to_val(ident, "format", &format);
+	xnvme_ident_opt_to_val(ident, "unit", &unit);
+	if (unit > XNVME_BE_EC_UNIT_MAX) {
+		XNVME_DEBUG("FAILED: unit: %u", unit);
+		return -EINVAL;
+	}
+
+	(*ec) = calloc(1, sizeof(**ec));
+	if (!(*ec)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	pthread_mutex_init(&(*ec)->lock, NULL);
+	pthread_mutex_init(&(*ec)->sync_lock, NULL);
+	pthread_cond_init(&(*ec)->sync_cond, NULL);
+
+	strncpy(trgt, ident->trgt, sizeof(trgt) - 1);
+	for (char *tok = strtok_r(trgt, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		char uri[XNVME_IDENT_URI_LEN] = { 0 };
+		struct ec_member *member;
+
+		if ((*ec)->n == XNVME_BE_EC_NMEMBERS_MAX) {
+			XNVME_DEBUG("FAILED: more than %d members",
+				    XNVME_BE_EC_NMEMBERS_MAX);
+			err = -EINVAL;
+			goto failed;
+		}
+		member = &(*ec)->members[(*ec)->n++];
+
+		// Options apply to the composite and the members alike
+		snprintf(uri, sizeof(uri), "%s%s", tok, ident->opts);
+		member->dev = xnvme_dev_open(uri);
+		if (!member->dev) {
+			XNVME_DEBUG("INFO: xnvme_dev_open(%s), failed", uri);
+			(*ec)->failed |= 1U << ((*ec)->n - 1);
+			nfailed += 1;
+			continue;
+		}
+		member->nsid = xnvme_dev_get_nsid(member->dev);
+	}
+	if ((m >= (*ec)->n) || (nfailed > m)) {
+		XNVME_DEBUG("FAILED: n: %u, m: %u, nfailed: %u", (*ec)->n, m,
+			    nfailed);
+		err = -EINVAL;
+		goto failed;
+	}
+	(*ec)->m = m;
+	(*ec)->k = (*ec)->n - m;
+
+	for (uint32_t mi = 0; mi < (*ec)->n; ++mi) {
+		const struct xnvme_geo *geo;
+		uint64_t nlb;
+
+		if (!(*ec)->members[mi].dev) {
+			continue;
+		}
+		geo = xnvme_dev_get_geo((*ec)->members[mi].dev);
+		nlb = geo->tbytes / geo->lba_nbytes;
+
+		if (!(*ec)->bufdev) {
+			(*ec)->bufdev = (*ec)->members[mi].dev;
+			(*ec)->lba_nbytes = geo->lba_nbytes;
+			(*ec)->unit_nbytes = 4096U << unit;
+			member_nlb = nlb;
+		}
+		if ((geo->type != XNVME_GEO_CONVENTIONAL) || geo->lba_extended ||
+		    geo->nbytes_oob || (geo->lba_nbytes != (*ec)->lba_nbytes) ||
+		    ((*ec)->unit_nbytes % geo->lba_nbytes) ||
+		    ((*ec)->unit_nbytes > geo->mdts_nbytes)) {
+			XNVME_DEBUG("FAILED: member: %u, unsupported geometry", mi);
+			err = -EINVAL;
+			goto failed;
+		}
+		member_nlb = nlb < member_nlb ? nlb : member_nlb;
+	}
+
+	// The first unit of a member holds its header
+	(*ec)->unit_nlb = (*ec)->unit_nbytes / (*ec)->lba_nbytes;
+	(*ec)->stripe_nlb = (uint64_t)(*ec)->k * (*ec)->unit_nlb;
+	(*ec)->nstripes = member_nlb / (*ec)->unit_nlb;
+	(*ec)->nstripes = (*ec)->nstripes ? (*ec)->nstripes - 1 : 0;
+	(*ec)->nlpages = (*ec)->nstripes * (*ec)->stripe_nlb;
+	if (!(*ec)->nstripes) {
+		XNVME_DEBUG("FAILED: members too small, nlb: %lu", member_nlb);
+		err = -EINVAL;
+		goto failed;
+	}
+
+	err = ec_hdr_load(*ec, format);
+	if (err) {
+		XNVME_DEBUG("FAILED: ec_hdr_load(), err: %d", err);
+		goto failed;
+	}
+	if (ec_popcount((*ec)->failed) > (int)(*ec)->m) {
+		XNVME_DEBUG("FAILED: failed: 0x%x", (*ec)->failed);
+		err = -EIO;
+		goto failed;
+	}
+
+	// Cauchy matrix, x_i = k + i and y_j = j, below the identity matrix
+	pthread_once(&g_ec_once, ec_gf_init);
+	for (uint32_t i = 0; i < (*ec)->m; ++i) {
+		for (uint32_t j = 0; j < (*ec)->k; ++j) {
+			(*ec)->coef[i][j] = ec_gf_inv(((*ec)->k + i) ^ j);
+		}
+	}
+
+	return 0;
+
+failed:
+	ec_term(*ec);
+	*ec = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_ec_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		     size_t XNVME_UNUSED(mbuf_nbytes), int opts,
+		     struct xnvme_req *req)
+{
+	struct xnvme_be_ec_state *state = (void *)dev->be.state;
+	struct xnvme_ec *ec = state->ec;
+	struct ec_cmd scmd = { 0 };
+	struct ec_cmd *ecmd = &scmd;
+	struct ec_ctx *ectx;
+	int slot = 0;
+	int err;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		if (mbuf || (cmd->lblk.slba >= ec->nlpages) ||
+		    (cmd->lblk.nlb + 1ULL > ec->nlpages - cmd->lblk.slba) ||
+		    (dbuf_nbytes < (cmd->lblk.nlb + 1ULL) * ec->lba_nbytes)) {
+			XNVME_DEBUG("FAILED: invalid slba: 0x%lx, nlb: %u",
+				    cmd->lblk.slba, cmd->lblk.nlb);
+			return -EINVAL;
+		}
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		struct xnvme_async_ctx_ec *actx = (void *)req->async.ctx;
+
+		ectx = actx->ectx;
+		if (!ectx->free_cmds) {
+			return -EBUSY;
+		}
+		ecmd = ectx->free_cmds;
+		ectx->free_cmds = ecmd->link;
+		actx->outstanding += 1;
+	} else {
+		pthread_mutex_lock(&ec->sync_lock);
+		while (ec->sync_busy == (1U << XNVME_BE_EC_NSYNC) - 1) {
+			pthread_cond_wait(&ec->sync_cond, &ec->sync_lock);
+		}
+		while (ec->sync_busy & (1U << slot)) {
+			++slot;
+		}
+		if (!ec->sync[slot]) {
+			err = ec_ctx_init(ec, 1, &ec->sync[slot]);
+			if (err) {
+				pthread_mutex_unlock(&ec->sync_lock);
+				XNVME_DEBUG("FAILED: ec_ctx_init(), err: %d", err);
+				return err;
+			}
+		}
+		ec->sync_busy |= 1U << slot;
+		pthread_mutex_unlock(&ec->sync_lock);
+
+		ectx = ec->sync[slot];
+		ecmd->sync = 1;
+	}
+
+	ecmd->req = req;
+	ecmd->opcode = cmd->common.opcode;
+	ecmd->slba = cmd->lblk.slba;
+	ecmd->nlb = cmd->lblk.nlb + 1ULL;
+	ecmd->dbuf = dbuf;
+	if (ecmd->opcode == XNVME_SPEC_OPC_FLUSH) {
+		ecmd->slba = 0;
+		ecmd->nlb = 1;
+	}
+	ec_ctx_enqueue(ectx, ecmd);
+
+	if (opts & XNVME_CMD_ASYNC) {
+		return 0;
+	}
+
+	// The members are poked, and the thread yields while their IO is in
+	// flight, rather than spinning on it
+	for (ec_ctx_progress(ectx); !scmd.done; ec_ctx_progress(ectx)) {
+		sched_yield();
+	}
+
+	pthread_mutex_lock(&ec->sync_lock);
+	ec->sync_busy &= ~(1U << slot);
+	pthread_cond_signal(&ec->sync_cond);
+	pthread_mutex_unlock(&ec->sync_lock);
+
+	if (scmd.err) {
+		return scmd.err;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+
+	return 0;
+}
+
+int
+xnvme_be_ec_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			   void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			   size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_be_ec_state *state = (void *)dev->be.state;
+	struct xnvme_spec_cmd lcmd = *cmd;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		if ((!dbuf) || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			return -EINVAL;
+		}
+		memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_NS:
+			memcpy(dbuf, &dev->id.ns, sizeof(dev->id.ns));
+			break;
+		case XNVME_SPEC_IDFY_CTRLR:
+			memcpy(dbuf, &dev->id.ctrlr, sizeof(dev->id.ctrlr));
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: unsupported cns: 0x%x",
+				    cmd->idfy.cns);
+			return -ENOSYS;
+		}
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		return 0;
+
+	// These would only apply to a single member
+	case XNVME_SPEC_OPC_FMT_NVM:
+	case XNVME_SPEC_OPC_SANITIZE:
+		XNVME_DEBUG("FAILED: opcode: 0x%x", cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (lcmd.common.nsid == dev->nsid) {
+		lcmd.common.nsid = xnvme_dev_get_nsid(state->ec->bufdev);
+	}
+
+	return xnvme_cmd_pass_admin(state->ec->bufdev, &lcmd, dbuf, dbuf_nbytes,
+				    mbuf, mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_be_ec_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+		       uint16_t depth, int XNVME_UNUSED(flags))
+{
+	struct xnvme_be_ec_state *state = (void *)dev->be.state;
+	struct xnvme_async_ctx_ec *actx;
+	int err;
+
+	if (!depth) {
+		XNVME_DEBUG("FAILED: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	actx = (void *)(*ctx);
+	actx->depth = depth;
+
+	err = ec_ctx_init(state->ec, depth, &actx->ectx);
+	if (err) {
+		XNVME_DEBUG("FAILED: ec_ctx_init(), err: %d", err);
+		free(*ctx);
+		*ctx = NULL;
+		return err;
+	}
+	actx->ectx->ctx = *ctx;
+
+	return 0;
+}
+
+int
+xnvme_be_ec_async_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_be_ec_state *state = (void *)dev->be.state;
+	struct xnvme_async_ctx_ec *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	ec_ctx_term(state->ec, actx->ectx);
+	free(ctx);
+
+	return 0;
+}
+
+int
+xnvme_be_ec_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_async_ctx *ctx, uint32_t XNVME_UNUSED(max))
+{
+	struct xnvme_async_ctx_ec *actx = (void *)ctx;
+
+	return ec_ctx_progress(actx->ectx);
+}
+
+int
+xnvme_be_ec_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		acc += xnvme_be_ec_async_poke(dev, ctx, 0);
+	}
+
+	return acc;
+}
+
+void *
+xnvme_be_ec_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+		      uint64_t *phys)
+{
+	const struct xnvme_be_ec_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_alloc(state->ec->bufdev, nbytes, phys);
+}
+
+void *
+xnvme_be_ec_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			size_t nbytes, uint64_t *phys)
+{
+	const struct xnvme_be_ec_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_realloc(state->ec->bufdev, buf, nbytes, phys);
+}
+
+void
+xnvme_be_ec_buf_free(const struct xnvme_dev *dev, void *buf)
+{
+	const struct xnvme_be_ec_state *state = (void *)dev->be.state;
+
+	xnvme_buf_free(state->ec->bufdev, buf);
+}
+
+int
+xnvme_be_ec_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			uint64_t *phys)
+{
+	const struct xnvme_be_ec_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_vtophys(state->ec->bufdev, buf, phys);
+}
+
+/**
+ * The composite is made of devices opened by uri, thus there is nothing to
+ * enumerate
+ */
+int
+xnvme_be_ec_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+		      const char *XNVME_UNUSED(sys_uri),
+		      int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void
+xnvme_be_ec_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_ec_state *state;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+
+	ec_term(state->ec);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * The composite is presented as a single conventional namespace with the
+ * controller identity of the first member, a stripe is the optimal write size
+ */
+static void
+xnvme_be_ec_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_ec_state *state = (void *)dev->be.state;
+	struct xnvme_ec *ec = state->ec;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	memcpy(&dev->id.ctrlr, xnvme_dev_get_ctrlr(ec->bufdev),
+	       sizeof(dev->id.ctrlr));
+	dev->id.ctrlr.nn = 1;
+	dev->id.ctrlr.oncs.val = 0;
+	dev->id.ctrlr.vwc.val = 0;
+	for (uint32_t mi = 0; mi < ec->n; ++mi) {
+		if (ec->members[mi].dev &&
+		    xnvme_dev_get_ctrlr(ec->members[mi].dev)->vwc.present) {
+			dev->id.ctrlr.vwc.present = 1;
+		}
+	}
+
+	memcpy(&dev->id.ns, xnvme_dev_get_ns(ec->bufdev), sizeof(dev->id.ns));
+	dev->id.ns.nsze = ec->nlpages;
+	dev->id.ns.ncap = ec->nlpages;
+	dev->id.ns.nuse = ec->nlpages;
+	memset(&dev->id.ns.nsfeat, 0, sizeof(dev->id.ns.nsfeat));
+	if (ec->stripe_nlb <= UINT16_MAX + 1) {
+		dev->id.ns.nsfeat.optperf = 1;
+		dev->id.ns.npwg = ec->stripe_nlb - 1;
+		dev->id.ns.npwa = ec->stripe_nlb - 1;
+		dev->id.ns.nows = ec->stripe_nlb - 1;
+		dev->id.ns.npdg = 0;
+		dev->id.ns.npda = 0;
+	}
+
+	memset(&dev->idcss, 0, sizeof(dev->idcss));
+}
+
+int
+xnvme_be_ec_dev_from_ident(const struct xnvme_ident *ident,
+			   struct xnvme_dev **dev)
+{
+	struct xnvme_be_ec_state *state;
+	struct xnvme_ec *ec;
+	int err;
+
+	err = ec_init(ident, &ec);
+	if (err) {
+		XNVME_DEBUG("FAILED: ec_init(), err: %d", err);
+		return err;
+	}
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		ec_term(ec);
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_ec;
+	state = (void *)(*dev)->be.state;
+	state->ec = ec;
+
+	xnvme_be_ec_dev_idfy(*dev);
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_ec_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	XNVME_BE_EC_NAME,
+};
+
+struct xnvme_be xnvme_be_ec = {
+#ifdef XNVME_BE_EC_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_ec_cmd_pass,
+		.cmd_pass_admin = xnvme_be_ec_cmd_pass_admin,
+
+		.async_init = xnvme_be_ec_async_init,
+		.async_term = xnvme_be_ec_async_term,
+		.async_poke = xnvme_be_ec_async_poke,
+		.async_wait = xnvme_be_ec_async_wait,
+
+		.buf_alloc = xnvme_be_ec_buf_alloc,
+		.buf_realloc = xnvme_be_ec_buf_realloc,
+		.buf_free = xnvme_be_ec_buf_free,
+		.buf_vtophys = xnvme_be_ec_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_ec_enumerate,
+
+		.dev_from_ident = xnvme_be_ec_dev_from_ident,
+		.dev_close = xnvme_be_ec_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_EC_NAME,
+#ifdef XNVME_BE_EC_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
@@ -285,6 +285,9 @@ struct xnvme_be xnvme_be_fioc = {
 		.buf_free = xnvme_be_fioc_buf_free,
 		.buf_vtophys = xnvme_be_fioc_buf_vtophys,
 
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
 		.enumerate = xnvme_be_fioc_enumerate,
 
 		.dev_from_ident = xnvme_be_fioc_dev_from_ident,
@@ -0,0 +1,1500 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_HFTL_NAME "hftl"
+
+#ifdef XNVME_BE_HFTL_ENABLED
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <liblblk.h>
+#include <libznd.h>
+#include <xnvme_async.h>
+#include <xnvme_be_hftl.h>
+#include <xnvme_dev.h>
+#include <xnvme_lower.h>
+
+/**
+ * Host-side FTL presenting a conventional namespace on top of a zoned one
+ *
+ * Host writes are appended, round-robin, to a set of open zones and mapped at
+ * LBA granularity by a table kept in memory. Overwritten LBAs are reclaimed by
+ * a garbage collector, running on its own thread, relocating the valid LBAs of
+ * the zone with the fewest, via Simple Copy when supported by the device or
+ * else via read and append.
+ *
+ * The mapping table is persisted on the device as a checkpoint; written on
+ * flush, on close, and by the garbage collector. Two areas, of dedicated zones
+ * at the start of the namespace, are written in turn such that the previous
+ * checkpoint remains intact until the current one is complete. A zone emptied
+ * by the garbage collector is "stale" until the next checkpoint, as the one on
+ * the device might still reference it, and reset once that is written.
+ *
+ * Thus, data written since the last flush is lost on power-loss, as with a
+ * volatile write cache.
+ */
+
+#define HFTL_UNMAPPED UINT64_MAX
+#define HFTL_CKPT_MAGIC 0x4c544648454d564eULL	///< "NVMEHFTL"
+#define HFTL_CKPT_VERSION 1
+#define HFTL_GC_RESERVE 2	///< Free zones only usable by the collector
+#define HFTL_GC_STALE_MAX 4	///< Stale zones before forcing a checkpoint
+
+enum hftl_zstate {
+	HFTL_ZONE_FREE = 0,
+	HFTL_ZONE_OPEN,		///< Receiving host writes
+	HFTL_ZONE_GC,		///< Receiving relocated LBAs
+	HFTL_ZONE_FULL,
+	HFTL_ZONE_STALE,	///< Relocated, reset by the next checkpoint
+	HFTL_ZONE_CKPT,		///< Part of a checkpoint area
+	HFTL_ZONE_BAD,		///< Offline or read-only
+};
+
+struct hftl_zone {
+	enum hftl_zstate state;
+	uint64_t wp;		///< LBAs written, relative to the zslba
+	uint64_t reserved;	///< LBAs reserved, including in-flight appends
+	uint64_t nvalid;	///< LBAs referenced by the mapping table
+};
+
+/**
+ * Header of a checkpoint, the table is the mapping
+ */
+struct hftl_ckpt {
+	struct xnvme_ckpt_hdr hdr;
+	uint64_t nlpages;
+	uint64_t zcap;
+	uint32_t nzones;
+	uint32_t ckpt_nzones;
+};
+
+struct xnvme_hftl {
+	struct xnvme_lower lower;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t gc_thread;
+	int gc_started;
+	int gc_stop;
+	int gc_err;			///< Error causing the collector to stop
+	uint32_t gc_thresh;		///< Collect when fewer zones are free
+
+	uint32_t ninflight;		///< Commands doing IO without the lock
+	int quiesce;			///< Checkpoint waiting for the above
+
+	uint64_t zsze;
+	uint64_t zcap;			///< Capacity used, the least of all zones
+	uint32_t nzones;
+	uint32_t ckpt_nzones;		///< Zones per checkpoint area
+	uint64_t nlpages;		///< LBAs exposed
+
+	uint64_t *l2p;			///< Logical to physical page
+	uint64_t *p2l;			///< Physical to logical page
+	struct hftl_zone *zones;
+	uint32_t nfree;
+	uint32_t nstale;
+
+	uint32_t open[XNVME_BE_HFTL_OZONES_MAX];
+	uint32_t nopen;
+	uint32_t open_next;
+	uint32_t gc_zone;		///< Receiving relocated LBAs, or nzones
+
+	struct xnvme_ckpt ckpt;		///< Of the mapping
+
+	int scopy;			///< Relocate via Simple Copy
+	uint32_t scopy_nr;		///< Max. source ranges
+	uint32_t scopy_mssrl;		///< Max. LBAs in a source range
+	uint32_t scopy_mcl;		///< Max. LBAs copied
+
+	uint8_t *iobuf;			///< Checkpoint and relocation staging
+	struct lblk_source_range *ranges;
+	uint64_t *gc_ppa;
+	uint64_t *gc_lpa;
+};
+
+static inline uint64_t
+hftl_ppa2lba(const struct xnvme_hftl *ftl, uint64_t ppa)
+{
+	return (ppa / ftl->zcap) * ftl->zsze + (ppa % ftl->zcap);
+}
+
+static inline uint64_t
+hftl_min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+/**
+ * Commands doing IO without holding the lock must be bracketed by these, such
+ * that a checkpoint, which resets zones, can wait for them
+ */
+static void
+hftl_enter(struct xnvme_hftl *ftl)
+{
+	while (ftl->quiesce) {
+		pthread_cond_wait(&ftl->cond, &ftl->lock);
+	}
+	ftl->ninflight += 1;
+}
+
+static void
+hftl_leave(struct xnvme_hftl *ftl)
+{
+	ftl->ninflight -= 1;
+	if (!ftl->ninflight) {
+		pthread_cond_broadcast(&ftl->cond);
+	}
+}
+
+static int
+hftl_zone_mgmt(struct xnvme_hftl *ftl, uint32_t zidx,
+	       enum znd_send_action action)
+{
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = znd_cmd_mgmt_send(ftl->lower.dev, ftl->lower.nsid,
+				zidx * ftl->zsze, action, 0x0, NULL,
+				XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: zidx: %u, action: 0x%x, err: %d", zidx,
+			    action, err);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Read/write 'nlb' LBAs, at most 'io_nlb', at the linear offset 'lin' of the
+ * given checkpoint area, the area spanning the capacity of its zones, see
+ * xnvme_ckpt_area_cb
+ */
+static int
+hftl_area_rw(void *cb_arg, uint8_t opcode, uint32_t area, uint64_t lin,
+	     uint64_t nlb, void *dbuf)
+{
+	struct xnvme_hftl *ftl = cb_arg;
+	uint8_t *buf = dbuf;
+
+	while (nlb) {
+		uint32_t zidx = area * ftl->ckpt_nzones + lin / ftl->zcap;
+		uint64_t ofz = lin % ftl->zcap;
+		uint64_t n = hftl_min(nlb, ftl->zcap - ofz);
+		int err;
+
+		err = xnvme_lower_rw(&ftl->lower, opcode,
+				     zidx * ftl->zsze + ofz, n, buf);
+		if (err) {
+			return err;
+		}
+
+		buf += n * ftl->lower.lba_nbytes;
+		lin += n;
+		nlb -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * Produce the mapping table of a checkpoint, see xnvme_ckpt_tbl_cb
+ */
+static int
+hftl_ckpt_get(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_hftl *ftl = cb_arg;
+
+	memcpy(buf, ((uint8_t *)ftl->l2p) + ofz, nbytes);
+
+	return 0;
+}
+
+/**
+ * Consume the mapping table of a checkpoint, see xnvme_ckpt_tbl_cb
+ */
+static int
+hftl_ckpt_put(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_hftl *ftl = cb_arg;
+
+	memcpy(((uint8_t *)ftl->l2p) + ofz, buf, nbytes);
+
+	return 0;
+}
+
+static int
+hftl_ckpt_check(void *cb_arg, const struct xnvme_ckpt_hdr *hdr)
+{
+	const struct hftl_ckpt *ckpt = (const void *)hdr;
+	struct xnvme_hftl *ftl = cb_arg;
+
+	return (ckpt->nlpages != ftl->nlpages) || (ckpt->zcap != ftl->zcap) ||
+	       (ckpt->nzones != ftl->nzones) ||
+	       (ckpt->ckpt_nzones != ftl->ckpt_nzones) ||
+	       (hdr->tbl_nbytes != ftl->nlpages * sizeof(*ftl->l2p));
+}
+
+/**
+ * Write a checkpoint to the area not holding the latest, then reset the stale
+ * zones. Called with the lock held and no commands in-flight.
+ */
+static int
+hftl_ckpt_write(struct xnvme_hftl *ftl)
+{
+	const uint32_t area = !ftl->ckpt.area;
+	struct hftl_ckpt ckpt = { 0 };
+	int err;
+
+	for (uint32_t i = 0; i < ftl->ckpt_nzones; ++i) {
+		err = hftl_zone_mgmt(ftl, area * ftl->ckpt_nzones + i,
+				     ZND_SEND_RESET);
+		if (err) {
+			return err;
+		}
+	}
+
+	ckpt.hdr.tbl_nbytes = ftl->nlpages * sizeof(*ftl->l2p);
+	ckpt.nlpages = ftl->nlpages;
+	ckpt.zcap = ftl->zcap;
+	ckpt.nzones = ftl->nzones;
+	ckpt.ckpt_nzones = ftl->ckpt_nzones;
+
+	err = xnvme_ckpt_write(&ftl->ckpt, &ckpt.hdr);
+	if (err) {
+		return err;
+	}
+
+	for (uint32_t zidx = 0; ftl->nstale && (zidx < ftl->nzones); ++zidx) {
+		struct hftl_zone *zone = &ftl->zones[zidx];
+
+		if (zone->state != HFTL_ZONE_STALE) {
+			continue;
+		}
+
+		err = hftl_zone_mgmt(ftl, zidx, ZND_SEND_RESET);
+		if (err) {
+			return err;
+		}
+
+		memset(zone, 0, sizeof(*zone));
+		zone->state = HFTL_ZONE_FREE;
+		ftl->nstale -= 1;
+		ftl->nfree += 1;
+	}
+	pthread_cond_broadcast(&ftl->cond);
+
+	return 0;
+}
+
+/**
+ * Write a checkpoint once the commands in-flight have completed, new commands
+ * are held back meanwhile. Called with the lock held.
+ */
+static int
+hftl_ckpt(struct xnvme_hftl *ftl)
+{
+	int err;
+
+	while (ftl->quiesce) {
+		pthread_cond_wait(&ftl->cond, &ftl->lock);
+	}
+	ftl->quiesce = 1;
+	while (ftl->ninflight) {
+		pthread_cond_wait(&ftl->cond, &ftl->lock);
+	}
+
+	err = hftl_ckpt_write(ftl);
+	if (err) {
+		XNVME_DEBUG("FAILED: hftl_ckpt_write(), err: %d", err);
+	}
+
+	ftl->quiesce = 0;
+	pthread_cond_broadcast(&ftl->cond);
+
+	return err;
+}
+
+/**
+ * Load the latest valid checkpoint. When no checkpoint is found, or when asked
+ * to via 'format', then all zones are reset and an empty one is written.
+ */
+static int
+hftl_ckpt_load(struct xnvme_hftl *ftl, int format)
+{
+	struct hftl_ckpt ckpt = { 0 };
+	struct xnvme_req req = { 0 };
+	int err;
+
+	if (!format) {
+		err = xnvme_ckpt_load(&ftl->ckpt, &ckpt.hdr);
+		if (err != -ENOENT) {
+			return err;
+		}
+	}
+
+	err = znd_cmd_mgmt_send(ftl->lower.dev, ftl->lower.nsid, 0x0,
+				ZND_SEND_RESET, ZND_SEND_SF_SALL, NULL,
+				XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: reset all zones, err: %d", err);
+		return err ? err : -EIO;
+	}
+	for (uint32_t zidx = 2 * ftl->ckpt_nzones; zidx < ftl->nzones; ++zidx) {
+		if (ftl->zones[zidx].state != HFTL_ZONE_BAD) {
+			ftl->zones[zidx].state = HFTL_ZONE_FREE;
+		}
+	}
+
+	memset(ftl->l2p, 0xFF, ftl->nlpages * sizeof(*ftl->l2p));
+	xnvme_ckpt_format(&ftl->ckpt);
+
+	return hftl_ckpt_write(ftl);
+}
+
+/**
+ * Retrieve zone states and capacity of the lower device
+ */
+static int
+hftl_zones_load(struct xnvme_hftl *ftl)
+{
+	struct znd_report_iter *iter = NULL;
+	const struct znd_descr *descr;
+	int err;
+
+	err = znd_report_iter_init(ftl->lower.dev, 0x0, ZND_RECV_SF_ALL, 0, 0,
+				   &iter);
+	if (err) {
+		XNVME_DEBUG("FAILED: znd_report_iter_init(), err: %d", err);
+		return err;
+	}
+
+	ftl->zcap = ftl->zsze;
+	for (;;) {
+		struct hftl_zone *zone;
+		uint64_t zidx;
+
+		err = znd_report_iter_next(iter, &descr, NULL);
+		if (err || (!descr)) {
+			break;
+		}
+
+		zidx = descr->zslba / ftl->zsze;
+		if (zidx >= ftl->nzones) {
+			continue;
+		}
+		zone = &ftl->zones[zidx];
+
+		switch (descr->zs) {
+		case ZND_STATE_RONLY:
+		case ZND_STATE_OFFLINE:
+			zone->state = HFTL_ZONE_BAD;
+			continue;
+
+		case ZND_STATE_EMPTY:
+			zone->state = HFTL_ZONE_FREE;
+			break;
+
+		case ZND_STATE_FULL:
+			zone->state = HFTL_ZONE_FULL;
+			break;
+
+		default:	// Written since the checkpoint, finished below
+			zone->state = HFTL_ZONE_OPEN;
+			break;
+		}
+
+		ftl->zcap = hftl_min(ftl->zcap, descr->zcap);
+	}
+
+	znd_report_iter_term(iter);
+
+	return err;
+}
+
+/**
+ * Map 'lpa' to 'ppa', the LBA previously mapped, if any, becomes invalid
+ */
+static void
+hftl_map(struct xnvme_hftl *ftl, uint64_t lpa, uint64_t ppa)
+{
+	uint64_t old = ftl->l2p[lpa];
+
+	if (old != HFTL_UNMAPPED) {
+		ftl->zones[old / ftl->zcap].nvalid -= 1;
+		ftl->p2l[old] = HFTL_UNMAPPED;
+	}
+
+	ftl->l2p[lpa] = ppa;
+	ftl->p2l[ppa] = lpa;
+	ftl->zones[ppa / ftl->zcap].nvalid += 1;
+}
+
+static uint32_t
+hftl_zone_alloc(struct xnvme_hftl *ftl, enum hftl_zstate state,
+		uint32_t reserve)
+{
+	if (ftl->nfree <= reserve) {
+		return ftl->nzones;
+	}
+
+	for (uint32_t zidx = 2 * ftl->ckpt_nzones; zidx < ftl->nzones; ++zidx) {
+		struct hftl_zone *zone = &ftl->zones[zidx];
+
+		if (zone->state != HFTL_ZONE_FREE) {
+			continue;
+		}
+
+		memset(zone, 0, sizeof(*zone));
+		zone->state = state;
+		ftl->nfree -= 1;
+		if (ftl->nfree < ftl->gc_thresh) {
+			pthread_cond_broadcast(&ftl->cond);
+		}
+
+		return zidx;
+	}
+
+	return ftl->nzones;
+}
+
+/**
+ * The full zone with the fewest valid LBAs, or nzones when none are invalid
+ */
+static uint32_t
+hftl_gc_victim(struct xnvme_hftl *ftl)
+{
+	uint32_t victim = ftl->nzones;
+	uint64_t nvalid = ftl->zcap;
+
+	for (uint32_t zidx = 2 * ftl->ckpt_nzones; zidx < ftl->nzones; ++zidx) {
+		const struct hftl_zone *zone = &ftl->zones[zidx];
+
+		if ((zone->state == HFTL_ZONE_FULL) && (zone->nvalid < nvalid)) {
+			victim = zidx;
+			nvalid = zone->nvalid;
+		}
+	}
+
+	return victim;
+}
+
+/**
+ * Reserve room for up to 'nlb' LBAs in one of the open zones. When none has
+ * room and no zone is free, then wait for the garbage collector.
+ */
+static int
+hftl_open_reserve(struct xnvme_hftl *ftl, uint64_t nlb, uint32_t *zidx,
+		  uint64_t *n)
+{
+	for (;;) {
+		for (uint32_t i = 0; i < ftl->nopen; ++i) {
+			uint32_t slot = (ftl->open_next + i) % ftl->nopen;
+			struct hftl_zone *zone;
+
+			if (ftl->open[slot] == ftl->nzones) {
+				ftl->open[slot] = hftl_zone_alloc(ftl,
+								  HFTL_ZONE_OPEN,
+								  HFTL_GC_RESERVE);
+				if (ftl->open[slot] == ftl->nzones) {
+					continue;
+				}
+			}
+			*zidx = ftl->open[slot];
+			zone = &ftl->zones[*zidx];
+
+			*n = hftl_min(hftl_min(nlb, ftl->lower.io_nlb),
+				      ftl->zcap - zone->reserved);
+			zone->reserved += *n;
+			if (zone->reserved == ftl->zcap) {
+				ftl->open[slot] = ftl->nzones;
+			}
+			ftl->open_next = (slot + 1) % ftl->nopen;
+
+			return 0;
+		}
+
+		if (ftl->gc_err) {
+			return ftl->gc_err;
+		}
+		if ((!ftl->gc_started) || ftl->gc_stop ||
+		    ((hftl_gc_victim(ftl) == ftl->nzones) && (!ftl->nstale))) {
+			XNVME_DEBUG("FAILED: no zone to reclaim");
+			return -ENOSPC;
+		}
+
+		hftl_leave(ftl);
+		pthread_cond_broadcast(&ftl->cond);
+		pthread_cond_wait(&ftl->cond, &ftl->lock);
+		hftl_enter(ftl);
+	}
+}
+
+static int
+hftl_write(struct xnvme_hftl *ftl, uint64_t slba, uint64_t nlb,
+	   const uint8_t *dbuf)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&ftl->lock);
+	hftl_enter(ftl);
+
+	while (nlb) {
+		struct xnvme_req req = { 0 };
+		struct hftl_zone *zone;
+		uint64_t zslba, n;
+		uint32_t zidx;
+
+		err = hftl_open_reserve(ftl, nlb, &zidx, &n);
+		if (err) {
+			break;
+		}
+		zslba = zidx * ftl->zsze;
+
+		pthread_mutex_unlock(&ftl->lock);
+		err = znd_cmd_append(ftl->lower.dev, ftl->lower.nsid, zslba,
+				     n - 1, dbuf, NULL, XNVME_CMD_SYNC, &req);
+		if ((!err) && xnvme_req_cpl_status(&req)) {
+			err = -EIO;
+		}
+		if ((!err) && ((req.cpl.result < zslba) ||
+			       (req.cpl.result + n > zslba + ftl->zcap))) {
+			XNVME_DEBUG("FAILED: invalid append lba: 0x%lx",
+				    req.cpl.result);
+			err = -EIO;
+		}
+		pthread_mutex_lock(&ftl->lock);
+
+		// On error, the reserved LBAs are left unmapped
+		for (uint64_t i = 0; (!err) && (i < n); ++i) {
+			uint64_t ppa = zidx * ftl->zcap + \
+				       (req.cpl.result - zslba) + i;
+
+			hftl_map(ftl, slba + i, ppa);
+		}
+
+		zone = &ftl->zones[zidx];
+		zone->wp += n;
+		if (zone->wp == ftl->zcap) {
+			zone->state = HFTL_ZONE_FULL;
+		}
+		if (err) {
+			XNVME_DEBUG("FAILED: znd_cmd_append(), err: %d", err);
+			break;
+		}
+
+		slba += n;
+		nlb -= n;
+		dbuf += n * ftl->lower.lba_nbytes;
+	}
+
+	hftl_leave(ftl);
+	pthread_mutex_unlock(&ftl->lock);
+
+	return err;
+}
+
+static int
+hftl_read(struct xnvme_hftl *ftl, uint64_t slba, uint64_t nlb, uint8_t *dbuf)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&ftl->lock);
+	hftl_enter(ftl);
+
+	while (nlb) {
+		uint64_t ppa = ftl->l2p[slba];
+		uint64_t n = 1;
+
+		// Coalesce into a single read, within a zone, or a single fill
+		if (ppa == HFTL_UNMAPPED) {
+			while ((n < nlb) && (ftl->l2p[slba + n] == ppa)) {
+				++n;
+			}
+		} else {
+			while ((n < nlb) && (n < ftl->lower.io_nlb) &&
+			       ((ppa + n) % ftl->zcap) &&
+			       (ftl->l2p[slba + n] == ppa + n)) {
+				++n;
+			}
+		}
+
+		pthread_mutex_unlock(&ftl->lock);
+		if (ppa == HFTL_UNMAPPED) {
+			memset(dbuf, 0, n * ftl->lower.lba_nbytes);
+		} else {
+			err = xnvme_lower_rw(&ftl->lower, XNVME_SPEC_OPC_READ,
+					     hftl_ppa2lba(ftl, ppa), n, dbuf);
+		}
+		pthread_mutex_lock(&ftl->lock);
+		if (err) {
+			break;
+		}
+
+		slba += n;
+		nlb -= n;
+		dbuf += n * ftl->lower.lba_nbytes;
+	}
+
+	hftl_leave(ftl);
+	pthread_mutex_unlock(&ftl->lock);
+
+	return err;
+}
+
+static int
+hftl_gc_scopy(struct xnvme_hftl *ftl, uint64_t sdlba, uint64_t count)
+{
+	struct lblk_source_range_entry *entry = ftl->ranges->entry;
+	struct xnvme_req req = { 0 };
+	uint32_t nr = 0;
+	int err;
+
+	memset(ftl->ranges, 0, sizeof(*ftl->ranges));
+	for (uint64_t i = 0; i < count; ++i) {
+		if (i && (ftl->gc_ppa[i] == ftl->gc_ppa[i - 1] + 1) &&
+		    (entry[nr - 1].nlb + 1u < ftl->scopy_mssrl)) {
+			entry[nr - 1].nlb += 1;
+			continue;
+		}
+
+		entry[nr].slba = hftl_ppa2lba(ftl, ftl->gc_ppa[i]);
+		entry[nr].nlb = 0;
+		nr += 1;
+	}
+
+	err = lblk_cmd_scopy(ftl->lower.dev, ftl->lower.nsid, sdlba, entry,
+			     nr - 1, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: lblk_cmd_scopy(), err: %d", err);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+static int
+hftl_gc_hcopy(struct xnvme_hftl *ftl, uint64_t sdlba, uint64_t count)
+{
+	struct xnvme_req req = { 0 };
+	int err;
+
+	for (uint64_t i = 0; i < count;) {
+		uint64_t n = 1;
+
+		while ((i + n < count) &&
+		       (ftl->gc_ppa[i + n] == ftl->gc_ppa[i] + n)) {
+			++n;
+		}
+
+		err = xnvme_lower_rw(&ftl->lower, XNVME_SPEC_OPC_READ,
+				     hftl_ppa2lba(ftl, ftl->gc_ppa[i]), n,
+				     ftl->iobuf + i * ftl->lower.lba_nbytes);
+		if (err) {
+			return err;
+		}
+
+		i += n;
+	}
+
+	err = znd_cmd_append(ftl->lower.dev, ftl->lower.nsid,
+			     (sdlba / ftl->zsze) * ftl->zsze, count - 1,
+			     ftl->iobuf, NULL, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: znd_cmd_append(), err: %d", err);
+		return err ? err : -EIO;
+	}
+	if (req.cpl.result != sdlba) {
+		XNVME_DEBUG("FAILED: append lba: 0x%lx != 0x%lx",
+			    req.cpl.result, sdlba);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Relocate the valid LBAs of 'victim', which is then stale. Called with the
+ * lock held, which is released during IO.
+ */
+static int
+hftl_gc_relocate(struct xnvme_hftl *ftl, uint32_t victim)
+{
+	const uint64_t base = (uint64_t)victim * ftl->zcap;
+	uint64_t ofz = 0;
+
+	while (ofz < ftl->zcap) {
+		uint32_t gidx = ftl->gc_zone;
+		struct hftl_zone *gzone;
+		uint64_t count = 0, nr = 0, run = 0, max, sdlba;
+		int err;
+
+		if (gidx == ftl->nzones) {
+			gidx = hftl_zone_alloc(ftl, HFTL_ZONE_GC, 0);
+			if (gidx == ftl->nzones) {
+				return -ENOSPC;
+			}
+			ftl->gc_zone = gidx;
+		}
+		gzone = &ftl->zones[gidx];
+
+		max = hftl_min(ftl->zcap - gzone->wp, ftl->lower.io_nlb);
+		if (ftl->scopy) {
+			max = hftl_min(max, ftl->scopy_mcl);
+		}
+
+		for (; (ofz < ftl->zcap) && (count < max); ++ofz) {
+			uint64_t lpa = ftl->p2l[base + ofz];
+
+			if (lpa == HFTL_UNMAPPED) {
+				continue;
+			}
+			// Source ranges as formed by hftl_gc_scopy()
+			if (ftl->scopy && ((!count) || (run == ftl->scopy_mssrl) ||
+					   (ftl->gc_ppa[count - 1] + 1 !=
+					    base + ofz))) {
+				if (nr == ftl->scopy_nr) {
+					break;
+				}
+				nr += 1;
+				run = 0;
+			}
+			run += 1;
+
+			ftl->gc_ppa[count] = base + ofz;
+			ftl->gc_lpa[count] = lpa;
+			count += 1;
+		}
+		if (!count) {
+			continue;
+		}
+
+		sdlba = gidx * ftl->zsze + gzone->wp;
+
+		hftl_enter(ftl);
+		pthread_mutex_unlock(&ftl->lock);
+		if (ftl->scopy) {
+			err = hftl_gc_scopy(ftl, sdlba, count);
+			if (err) {
+				XNVME_DEBUG("INFO: disabling simple copy");
+				ftl->scopy = 0;
+			}
+		}
+		if (!ftl->scopy) {
+			err = hftl_gc_hcopy(ftl, sdlba, count);
+		}
+		pthread_mutex_lock(&ftl->lock);
+		hftl_leave(ftl);
+		if (err) {
+			return err;
+		}
+
+		// Skip LBAs overwritten by the host during relocation
+		for (uint64_t i = 0; i < count; ++i) {
+			if (ftl->l2p[ftl->gc_lpa[i]] != ftl->gc_ppa[i]) {
+				continue;
+			}
+			hftl_map(ftl, ftl->gc_lpa[i],
+				 gidx * ftl->zcap + gzone->wp + i);
+		}
+
+		gzone->wp += count;
+		gzone->reserved = gzone->wp;
+		if (gzone->wp == ftl->zcap) {
+			gzone->state = HFTL_ZONE_FULL;
+			ftl->gc_zone = ftl->nzones;
+		}
+	}
+
+	ftl->zones[victim].state = HFTL_ZONE_STALE;
+	ftl->nstale += 1;
+
+	return 0;
+}
+
+static void *
+hftl_gc_main(void *arg)
+{
+	struct xnvme_hftl *ftl = arg;
+
+	pthread_mutex_lock(&ftl->lock);
+	while (!ftl->gc_stop) {
+		uint32_t victim;
+		int err = 0;
+
+		if (ftl->gc_err || (ftl->nfree >= ftl->gc_thresh)) {
+			pthread_cond_wait(&ftl->cond, &ftl->lock);
+			continue;
+		}
+
+		victim = hftl_gc_victim(ftl);
+		if (victim < ftl->nzones) {
+			err = hftl_gc_relocate(ftl, victim);
+		}
+		if (err && (err != -ENOSPC)) {
+			XNVME_DEBUG("FAILED: hftl_gc_relocate(), err: %d", err);
+			ftl->gc_err = err;
+			pthread_cond_broadcast(&ftl->cond);
+			continue;
+		}
+
+		if (ftl->nstale && (err || (victim == ftl->nzones) ||
+				    (ftl->nstale >= HFTL_GC_STALE_MAX) ||
+				    (ftl->nfree <= HFTL_GC_RESERVE))) {
+			err = hftl_ckpt(ftl);
+			if (err) {
+				ftl->gc_err = err;
+			}
+			pthread_cond_broadcast(&ftl->cond);
+			continue;
+		}
+
+		if (err || (victim == ftl->nzones)) {
+			pthread_cond_broadcast(&ftl->cond);
+			pthread_cond_wait(&ftl->cond, &ftl->lock);
+		}
+	}
+	pthread_mutex_unlock(&ftl->lock);
+
+	return NULL;
+}
+
+/**
+ * Tear down the translation layer, the lower device is left open
+ */
+static void
+hftl_term(struct xnvme_hftl *ftl)
+{
+	if (!ftl) {
+		return;
+	}
+
+	if (ftl->gc_started) {
+		pthread_mutex_lock(&ftl->lock);
+		ftl->gc_stop = 1;
+		pthread_cond_broadcast(&ftl->cond);
+		pthread_mutex_unlock(&ftl->lock);
+
+		pthread_join(ftl->gc_thread, NULL);
+
+		pthread_mutex_lock(&ftl->lock);
+		if (hftl_ckpt(ftl)) {
+			XNVME_DEBUG("FAILED: checkpoint on close");
+		}
+		pthread_mutex_unlock(&ftl->lock);
+	}
+
+	pthread_cond_destroy(&ftl->cond);
+	pthread_mutex_destroy(&ftl->lock);
+
+	xnvme_buf_free(ftl->lower.dev, ftl->ranges);
+	xnvme_buf_free(ftl->lower.dev, ftl->iobuf);
+	free(ftl->gc_lpa);
+	free(ftl->gc_ppa);
+	free(ftl->zones);
+	free(ftl->p2l);
+	free(ftl->l2p);
+	free(ftl);
+}
+
+static int
+hftl_init(struct xnvme_dev *lower, const struct xnvme_ident *ident,
+	  struct xnvme_hftl **ftl)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(lower);
+	const struct znd_idfy_ctrlr *zctrlr = (void *)xnvme_dev_get_ctrlr_css(lower);
+	const struct lblk_idfy_ctrlr *lctrlr = (void *)xnvme_dev_get_ctrlr(lower);
+	const struct lblk_idfy_ns *lns = (void *)xnvme_dev_get_ns(lower);
+	uint32_t ozones = XNVME_BE_HFTL_OZONES_DEF;
+	uint32_t scopy = 1, format = 0;
+	uint64_t ckpt_nlb, ndata = 0, nop;
+	int err;
+
+	if (geo->type != XNVME_GEO_ZONED) {
+		XNVME_DEBUG("FAILED: lower device is not zoned");
+		return -EINVAL;
+	}
+	if (geo->lba_extended || geo->nbytes_oob) {
+		XNVME_DEBUG("FAILED: metadata is not supported");
+		return -EINVAL;
+	}
+	xnvme_ident_opt_to_val(ident, "ozones", &ozones);
+	xnvme_ident_opt_to_val(ident, "scopy", &scopy);
+	xnvme_ident_opt_to_val(ident, "format", &format);
+	if ((!ozones) || (ozones > XNVME_BE_HFTL_OZONES_MAX)) {
+		XNVME_DEBUG("FAILED: invalid ozones: %u", ozones);
+		return -EINVAL;
+	}
+
+	(*ftl) = calloc(1, sizeof(**ftl));
+	if (!(*ftl)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*ftl)->lower.dev = lower;
+	(*ftl)->lower.nsid = xnvme_dev_get_nsid(lower);
+	pthread_mutex_init(&(*ftl)->lock, NULL);
+	pthread_cond_init(&(*ftl)->cond, NULL);
+
+	(*ftl)->lower.lba_nbytes = geo->lba_nbytes;
+	(*ftl)->zsze = geo->nsect;
+	(*ftl)->nzones = geo->nzone;
+	(*ftl)->nopen = ozones;
+	(*ftl)->gc_thresh = ozones + HFTL_GC_RESERVE + 1;
+
+	// Bound by MDTS, by the Zone Append Size Limit, and by 'nlb'
+	(*ftl)->lower.io_nlb = geo->mdts_nbytes / geo->lba_nbytes;
+	if (zctrlr->zasl) {
+		uint64_t zasl_nlb = ((1ULL << zctrlr->zasl) * 4096) /
+				    geo->lba_nbytes;
+
+		(*ftl)->lower.io_nlb = hftl_min((*ftl)->lower.io_nlb, zasl_nlb);
+	}
+	(*ftl)->lower.io_nlb = hftl_min((*ftl)->lower.io_nlb, UINT16_MAX + 1);
+	if (!(*ftl)->lower.io_nlb) {
+		XNVME_DEBUG("FAILED: mdts < lba_nbytes");
+		err = -EINVAL;
+		goto failed;
+	}
+
+	(*ftl)->zones = calloc((*ftl)->nzones, sizeof(*(*ftl)->zones));
+	if (!(*ftl)->zones) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+	err = hftl_zones_load(*ftl);
+	if (err) {
+		XNVME_DEBUG("FAILED: hftl_zones_load(), err: %d", err);
+		goto failed;
+	}
+
+	// Checkpoint areas are sized for mapping the entire namespace
+	ckpt_nlb = 2 + ((uint64_t)(*ftl)->nzones * (*ftl)->zcap * \
+			sizeof(uint64_t) + geo->lba_nbytes - 1) / geo->lba_nbytes;
+	(*ftl)->ckpt_nzones = (ckpt_nlb + (*ftl)->zcap - 1) / (*ftl)->zcap;
+
+	for (uint32_t zidx = 0; zidx < (*ftl)->nzones; ++zidx) {
+		struct hftl_zone *zone = &(*ftl)->zones[zidx];
+
+		if (zidx >= 2 * (*ftl)->ckpt_nzones) {
+			ndata += zone->state != HFTL_ZONE_BAD;
+			continue;
+		}
+		if (zone->state == HFTL_ZONE_BAD) {
+			XNVME_DEBUG("FAILED: checkpoint zone: %u is bad", zidx);
+			err = -EIO;
+			goto failed;
+		}
+		zone->state = HFTL_ZONE_CKPT;
+	}
+
+	nop = (ndata * XNVME_BE_HFTL_OP_PCT + 99) / 100;
+	nop = XNVME_MAX(nop, ozones + HFTL_GC_RESERVE + 2);
+	if (ndata <= nop + ozones + 1) {
+		XNVME_DEBUG("FAILED: too few zones, ndata: %lu, nop: %lu",
+			    ndata, nop);
+		err = -EINVAL;
+		goto failed;
+	}
+	(*ftl)->nlpages = (ndata - nop) * (*ftl)->zcap;
+	(*ftl)->ckpt.tbl_nlb = ((*ftl)->nlpages * sizeof(uint64_t) + \
+				geo->lba_nbytes - 1) / geo->lba_nbytes;
+	(*ftl)->ckpt.lower = &(*ftl)->lower;
+	(*ftl)->ckpt.magic = HFTL_CKPT_MAGIC;
+	(*ftl)->ckpt.version = HFTL_CKPT_VERSION;
+	(*ftl)->ckpt.hdr_nbytes = sizeof(struct hftl_ckpt);
+	(*ftl)->ckpt.get = hftl_ckpt_get;
+	(*ftl)->ckpt.put = hftl_ckpt_put;
+	(*ftl)->ckpt.check = hftl_ckpt_check;
+	(*ftl)->ckpt.area_rw = hftl_area_rw;
+	(*ftl)->ckpt.cb_arg = *ftl;
+
+	(*ftl)->l2p = malloc((*ftl)->nlpages * sizeof(*(*ftl)->l2p));
+	(*ftl)->p2l = malloc((uint64_t)(*ftl)->nzones * (*ftl)->zcap * \
+			     sizeof(*(*ftl)->p2l));
+	(*ftl)->gc_ppa = calloc((*ftl)->lower.io_nlb, sizeof(*(*ftl)->gc_ppa));
+	(*ftl)->gc_lpa = calloc((*ftl)->lower.io_nlb, sizeof(*(*ftl)->gc_lpa));
+	if (!((*ftl)->l2p && (*ftl)->p2l && (*ftl)->gc_ppa && (*ftl)->gc_lpa)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: allocating mapping tables");
+		goto failed;
+	}
+	memset((*ftl)->p2l, 0xFF,
+	       (uint64_t)(*ftl)->nzones * (*ftl)->zcap * sizeof(*(*ftl)->p2l));
+
+	(*ftl)->iobuf = xnvme_buf_alloc(lower, (size_t)(*ftl)->lower.io_nlb *
+					geo->lba_nbytes, NULL);
+	(*ftl)->ranges = xnvme_buf_alloc(lower, sizeof(*(*ftl)->ranges), NULL);
+	if (!((*ftl)->iobuf && (*ftl)->ranges)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		goto failed;
+	}
+	(*ftl)->ckpt.iobuf = (*ftl)->iobuf;
+
+	(*ftl)->scopy = scopy && lctrlr->oncs.copy && lns->mssrl && lns->mcl;
+	(*ftl)->scopy_nr = hftl_min(lns->msrc + 1, LBLK_SCOPY_NENTRY_MAX);
+	(*ftl)->scopy_mssrl = lns->mssrl;
+	(*ftl)->scopy_mcl = lns->mcl;
+
+	err = hftl_ckpt_load(*ftl, format);
+	if (err) {
+		XNVME_DEBUG("FAILED: hftl_ckpt_load(), err: %d", err);
+		goto failed;
+	}
+
+	// Rebuild the reverse-mapping and the valid-counts
+	for (uint64_t lpa = 0; lpa < (*ftl)->nlpages; ++lpa) {
+		uint64_t ppa = (*ftl)->l2p[lpa];
+
+		if (ppa == HFTL_UNMAPPED) {
+			continue;
+		}
+		if ((ppa >= (uint64_t)(*ftl)->nzones * (*ftl)->zcap) ||
+		    ((*ftl)->zones[ppa / (*ftl)->zcap].state == HFTL_ZONE_CKPT)) {
+			XNVME_DEBUG("FAILED: invalid mapping: %lu", lpa);
+			err = -EIO;
+			goto failed;
+		}
+		(*ftl)->p2l[ppa] = lpa;
+		(*ftl)->zones[ppa / (*ftl)->zcap].nvalid += 1;
+	}
+
+	// Zones written since the checkpoint are finished, leaving them for
+	// the garbage collector
+	for (uint32_t zidx = 2 * (*ftl)->ckpt_nzones; zidx < (*ftl)->nzones;
+	     ++zidx) {
+		struct hftl_zone *zone = &(*ftl)->zones[zidx];
+
+		switch (zone->state) {
+		case HFTL_ZONE_OPEN:
+			err = hftl_zone_mgmt(*ftl, zidx, ZND_SEND_FINISH);
+			if (err) {
+				goto failed;
+			}
+			zone->state = HFTL_ZONE_FULL;
+		// fall through
+		case HFTL_ZONE_FULL:
+			zone->wp = (*ftl)->zcap;
+			zone->reserved = (*ftl)->zcap;
+			break;
+
+		case HFTL_ZONE_FREE:
+			(*ftl)->nfree += 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	(*ftl)->gc_zone = (*ftl)->nzones;
+	for (uint32_t i = 0; i < XNVME_BE_HFTL_OZONES_MAX; ++i) {
+		(*ftl)->open[i] = (*ftl)->nzones;
+	}
+
+	err = pthread_create(&(*ftl)->gc_thread, NULL, hftl_gc_main, *ftl);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+		err = -err;
+		goto failed;
+	}
+	(*ftl)->gc_started = 1;
+
+	return 0;
+
+failed:
+	hftl_term(*ftl);
+	*ftl = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_hftl_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		       void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		       size_t XNVME_UNUSED(mbuf_nbytes), int opts,
+		       struct xnvme_req *req)
+{
+	struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+	struct xnvme_hftl *ftl = state->ftl;
+	struct xnvme_async_ctx_hftl *actx = NULL;
+	uint64_t slba = cmd->lblk.slba;
+	uint64_t nlb = cmd->lblk.nlb + 1;
+	int err;
+
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		actx = (void *)req->async.ctx;
+		if (actx->outstanding == actx->depth) {
+			return -EBUSY;
+		}
+	}
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		if (mbuf || (slba >= ftl->nlpages) ||
+		    (nlb > ftl->nlpages - slba) ||
+		    (dbuf_nbytes < nlb * ftl->lower.lba_nbytes)) {
+			XNVME_DEBUG("FAILED: invalid slba: 0x%lx, nlb: %lu",
+				    slba, nlb);
+			return -EINVAL;
+		}
+
+		if (cmd->common.opcode == XNVME_SPEC_OPC_READ) {
+			err = hftl_read(ftl, slba, nlb, dbuf);
+		} else {
+			err = hftl_write(ftl, slba, nlb, dbuf);
+		}
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		pthread_mutex_lock(&ftl->lock);
+		err = hftl_ckpt(ftl);
+		pthread_mutex_unlock(&ftl->lock);
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+	if (err) {
+		return err;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+
+	if (actx) {
+		memset(req->async.be_rsvd, 0, sizeof(req->async.be_rsvd));
+		if (actx->tail) {
+			memcpy(actx->tail->async.be_rsvd, &req, sizeof(req));
+		} else {
+			actx->head = req;
+		}
+		actx->tail = req;
+		actx->outstanding += 1;
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_hftl_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t mbuf_nbytes, int opts,
+			     struct xnvme_req *req)
+{
+	struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+	struct xnvme_spec_cmd lcmd = *cmd;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		if ((!dbuf) || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			return -EINVAL;
+		}
+		memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_NS:
+			memcpy(dbuf, &dev->id.ns, sizeof(dev->id.ns));
+			break;
+		case XNVME_SPEC_IDFY_CTRLR:
+			memcpy(dbuf, &dev->id.ctrlr, sizeof(dev->id.ctrlr));
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: unsupported cns: 0x%x",
+				    cmd->idfy.cns);
+			return -ENOSYS;
+		}
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		return 0;
+
+	// These would pull the rug from under the translation layer
+	case XNVME_SPEC_OPC_FMT_NVM:
+	case XNVME_SPEC_OPC_SANITIZE:
+		XNVME_DEBUG("FAILED: opcode: 0x%x, use format=1",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (lcmd.common.nsid == dev->nsid) {
+		lcmd.common.nsid = state->ftl->lower.nsid;
+	}
+
+	return xnvme_cmd_pass_admin(state->ftl->lower.dev, &lcmd, dbuf,
+				    dbuf_nbytes, mbuf, mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_be_hftl_async_init(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx **ctx, uint16_t depth,
+			 int XNVME_UNUSED(flags))
+{
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*ctx)->depth = depth;
+
+	return 0;
+}
+
+int
+xnvme_be_hftl_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx *ctx)
+{
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	free(ctx);
+
+	return 0;
+}
+
+int
+xnvme_be_hftl_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_hftl *actx = (void *)ctx;
+	uint32_t completed = 0;
+
+	// Bounded by those queued on entry, as callbacks might submit more
+	max = max ? max : actx->outstanding;
+	max = max > actx->outstanding ? actx->outstanding : max;
+
+	while (completed < max) {
+		struct xnvme_req *req = actx->head;
+
+		memcpy(&actx->head, req->async.be_rsvd, sizeof(actx->head));
+		if (!actx->head) {
+			actx->tail = NULL;
+		}
+		actx->outstanding -= 1;
+		completed += 1;
+
+		req->async.cb(req, req->async.cb_arg);
+	}
+
+	return completed;
+}
+
+int
+xnvme_be_hftl_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		acc += xnvme_be_hftl_async_poke(dev, ctx, 0);
+	}
+
+	return acc;
+}
+
+void *
+xnvme_be_hftl_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+			uint64_t *phys)
+{
+	const struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_alloc(state->ftl->lower.dev, nbytes, phys);
+}
+
+void *
+xnvme_be_hftl_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			  size_t nbytes, uint64_t *phys)
+{
+	const struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_realloc(state->ftl->lower.dev, buf, nbytes, phys);
+}
+
+void
+xnvme_be_hftl_buf_free(const struct xnvme_dev *dev, void *buf)
+{
+	const struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+
+	xnvme_buf_free(state->ftl->lower.dev, buf);
+}
+
+int
+xnvme_be_hftl_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			  uint64_t *phys)
+{
+	const struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_vtophys(state->ftl->lower.dev, buf, phys);
+}
+
+/**
+ * The translation layer is stacked on a device opened by uri, thus there is
+ * nothing to enumerate
+ */
+int
+xnvme_be_hftl_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+			const char *XNVME_UNUSED(sys_uri),
+			int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void
+xnvme_be_hftl_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_hftl_state *state;
+	struct xnvme_dev *lower;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+	lower = state->ftl->lower.dev;
+
+	hftl_term(state->ftl);
+	xnvme_dev_close(lower);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * The device is presented as a single conventional namespace, with the
+ * controller identity of the lower device
+ */
+static void
+xnvme_be_hftl_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_hftl_state *state = (void *)dev->be.state;
+	struct xnvme_hftl *ftl = state->ftl;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	memcpy(&dev->id.ctrlr, xnvme_dev_get_ctrlr(ftl->lower.dev),
+	       sizeof(dev->id.ctrlr));
+	dev->id.ctrlr.nn = 1;
+	dev->id.ctrlr.oncs.val = 0;
+	dev->id.ctrlr.vwc.val = 0;
+	dev->id.ctrlr.vwc.present = 1;	// Flush persists the mapping
+
+	memcpy(&dev->id.ns, xnvme_dev_get_ns(ftl->lower.dev),
+	       sizeof(dev->id.ns));
+	dev->id.ns.nsze = ftl->nlpages;
+	dev->id.ns.ncap = ftl->nlpages;
+	dev->id.ns.nuse = ftl->nlpages;
+	memset(&dev->id.ns.nsfeat, 0, sizeof(dev->id.ns.nsfeat));
+
+	memset(&dev->idcss, 0, sizeof(dev->idcss));
+}
+
+int
+xnvme_be_hftl_dev_from_ident(const struct xnvme_ident *ident,
+			     struct xnvme_dev **dev)
+{
+	char uri[XNVME_IDENT_URI_LEN] = { 0 };
+	struct xnvme_be_hftl_state *state;
+	struct xnvme_dev *lower;
+	int err;
+
+	// The target is the uri of the lower device, options apply to both
+	snprintf(uri, sizeof(uri), "%s%s", ident->trgt, ident->opts);
+
+	lower = xnvme_dev_open(uri);
+	if (!lower) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_dev_open(%s), err: %d", uri, err);
+		return err;
+	}
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		xnvme_dev_close(lower);
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_hftl;
+	state = (void *)(*dev)->be.state;
+
+	err = hftl_init(lower, ident, &state->ftl);
+	if (err) {
+		XNVME_DEBUG("FAILED: hftl_init(), err: %d", err);
+		xnvme_dev_close(lower);
+		free(*dev);
+		return err;
+	}
+
+	xnvme_be_hftl_dev_idfy(*dev);
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_hftl_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	XNVME_BE_HFTL_NAME,
+};
+
+struct xnvme_be xnvme_be_hftl = {
+#ifdef XNVME_BE_HFTL_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_hftl_cmd_pass,
+		.cmd_pass_admin = xnvme_be_hftl_cmd_pass_admin,
+
+		.async_init = xnvme_be_hftl_async_init,
+		.async_term = xnvme_be_hftl_async_term,
+		.async_poke = xnvme_be_hftl_async_poke,
+		.async_wait = xnvme_be_hftl_async_wait,
+
+		.buf_alloc = xnvme_be_hftl_buf_alloc,
+		.buf_realloc = xnvme_be_hftl_buf_realloc,
+		.buf_free = xnvme_be_hftl_buf_free,
+		.buf_vtophys = xnvme_be_hftl_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_hftl_enumerate,
+
+		.dev_from_ident = xnvme_be_hftl_dev_from_ident,
+		.dev_close = xnvme_be_hftl_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_HFTL_NAME,
+#ifdef XNVME_BE_HFTL_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
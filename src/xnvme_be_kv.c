@@ -0,0 +1,1626 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_KV_NAME "kv"
+
+#ifdef XNVME_BE_KV_ENABLED
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libkvs.h>
+#include <xnvme_async.h>
+#include <xnvme_be_kv.h>
+#include <xnvme_dev.h>
+#include <xnvme_lower.h>
+
+/**
+ * Emulation of a Key-Value namespace on top of a conventional namespace
+ *
+ * Values are stored in runs of contiguous units, allocated next-fit from a
+ * bitmap, a value is always written to a fresh run, thus a store never
+ * overwrites the value it replaces. The keys are held in memory, in an
+ * ordered index, mapping each key to its run; ordered to serve List.
+ *
+ * Store and retrieve are carried out by a pool of worker threads, doing
+ * synchronous IO on the lower device, the index is updated when the value is
+ * written. Delete and exist only touch the index.
+ *
+ * The index is persisted as a checkpoint, alternating between two areas, as
+ * done by be:cmpr, on flush and on close. Runs released since the latest
+ * checkpoint are not reused until the next one, thus the value of every key
+ * in a checkpoint is intact; stores since the last flush are lost on
+ * power-loss, as with a volatile write cache.
+ */
+
+#define KV_CKPT_MAGIC 0x5453564b454d564eULL	///< "NVMEKVST"
+#define KV_CKPT_VERSION 1
+#define KV_SC_CAPACITY_EXCEEDED 0x81	///< Generic Command Status
+
+/**
+ * A key and the location of its value, as stored in a checkpoint
+ */
+struct kv_rec {
+	uint8_t key[KVS_KEY_NBYTES_MAX];
+	uint8_t klen;
+	uint8_t rsvd[3];
+	uint32_t vlen;
+	uint64_t unit;		///< First unit of the value
+};
+XNVME_STATIC_ASSERT(sizeof(struct kv_rec) == 32, "Incorrect size")
+
+/**
+ * Header of a checkpoint, the table holds its records in key order
+ */
+struct kv_ckpt {
+	struct xnvme_ckpt_hdr hdr;
+	uint32_t unit_nbytes;
+	uint32_t rsvd;
+	uint64_t ndata;		///< Units available for values
+	uint64_t mnk;		///< Records the area has room for
+};
+
+/**
+ * A key in the index, a treap ordered by key
+ */
+struct kv_entry {
+	struct kv_entry *left;
+	struct kv_entry *right;
+	uint32_t prio;
+
+	uint8_t key[KVS_KEY_NBYTES_MAX];
+	uint8_t klen;
+	uint32_t vlen;
+	uint64_t unit;
+	uint32_t nunits;
+
+	uint32_t nreaders;	///< Retrieves in flight
+	int stale;		///< Replaced or deleted, released by the last reader
+};
+
+struct kv_run {
+	uint64_t unit;
+	uint32_t nunits;
+};
+
+struct kv_worker {
+	struct xnvme_kv *kv;
+	pthread_t thread;
+	int started;
+
+	uint8_t *bounce;	///< A unit, for the tail of a value
+};
+
+/**
+ * A command and its completion, carried out by a worker or on submission
+ */
+struct kv_cmd {
+	struct xnvme_req *req;
+	struct xnvme_async_ctx_kv *actx;	///< NULL when sync.
+
+	struct kvs_cmd cmd;
+	uint8_t *dbuf;
+	uint32_t dbuf_nbytes;
+
+	uint32_t cdw0;
+	uint8_t sct;
+	uint8_t sc;
+	int done;
+
+	struct kv_cmd *link;
+};
+
+struct xnvme_kv {
+	struct xnvme_lower lower;
+
+	pthread_mutex_t lock;		///< Index, allocation, and checkpoint
+	struct kv_entry *root;
+	uint64_t nkeys;
+	uint32_t prng;
+
+	uint64_t *bitmap;		///< Allocated units
+	uint64_t nfree;
+	uint64_t alloc_next;		///< Allocation cursor
+	struct kv_run *pend;		///< Released since the latest checkpoint
+	uint64_t npend;
+	uint64_t pend_cap;
+
+	pthread_mutex_t wq_lock;	///< Work-queue and command completion
+	pthread_cond_t wq_cond;
+	struct kv_cmd *wq_head;
+	struct kv_cmd *wq_tail;
+	int wq_stop;
+	struct kv_worker *workers;
+	uint32_t nwork;
+
+	uint32_t unit_nbytes;
+	uint32_t unit_nlb;
+	uint64_t ndata;			///< Units available for values
+	uint64_t data_slba;		///< First LBA of the first unit
+	uint64_t mnk;			///< Max. Number of Keys
+
+	struct xnvme_ckpt ckpt;		///< Of the index
+	struct kv_entry *ckpt_next;	///< Next key of the checkpoint written
+};
+
+static inline uint64_t
+kv_min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline int
+kv_key_cmp(const uint8_t *a, uint8_t alen, const uint8_t *b, uint8_t blen)
+{
+	int res = memcmp(a, b, XNVME_MIN(alen, blen));
+
+	return res ? res : (int)alen - (int)blen;
+}
+
+static inline uint32_t
+kv_nunits(struct xnvme_kv *kv, uint32_t vlen)
+{
+	return (vlen + kv->unit_nbytes - 1) / kv->unit_nbytes;
+}
+
+static inline void
+kv_cmd_status(struct kv_cmd *cmd, uint8_t sct, uint8_t sc)
+{
+	cmd->sct = sct;
+	cmd->sc = sc;
+}
+
+static struct kv_entry *
+kv_idx_rotate_right(struct kv_entry *node)
+{
+	struct kv_entry *left = node->left;
+
+	node->left = left->right;
+	left->right = node;
+
+	return left;
+}
+
+static struct kv_entry *
+kv_idx_rotate_left(struct kv_entry *node)
+{
+	struct kv_entry *right = node->right;
+
+	node->right = right->left;
+	right->left = node;
+
+	return right;
+}
+
+static struct kv_entry *
+kv_idx_insert(struct kv_entry *node, struct kv_entry *entry)
+{
+	if (!node) {
+		return entry;
+	}
+
+	if (kv_key_cmp(entry->key, entry->klen, node->key, node->klen) < 0) {
+		node->left = kv_idx_insert(node->left, entry);
+		if (node->left->prio > node->prio) {
+			node = kv_idx_rotate_right(node);
+		}
+	} else {
+		node->right = kv_idx_insert(node->right, entry);
+		if (node->right->prio > node->prio) {
+			node = kv_idx_rotate_left(node);
+		}
+	}
+
+	return node;
+}
+
+static struct kv_entry *
+kv_idx_merge(struct kv_entry *left, struct kv_entry *right)
+{
+	if (!left) {
+		return right;
+	}
+	if (!right) {
+		return left;
+	}
+
+	if (left->prio > right->prio) {
+		left->right = kv_idx_merge(left->right, right);
+		return left;
+	}
+
+	right->left = kv_idx_merge(left, right->left);
+
+	return right;
+}
+
+static struct kv_entry *
+kv_idx_remove(struct kv_entry *node, const uint8_t *key, uint8_t klen,
+	      struct kv_entry **removed)
+{
+	int cmp;
+
+	if (!node) {
+		return NULL;
+	}
+
+	cmp = kv_key_cmp(key, klen, node->key, node->klen);
+	if (cmp < 0) {
+		node->left = kv_idx_remove(node->left, key, klen, removed);
+	} else if (cmp > 0) {
+		node->right = kv_idx_remove(node->right, key, klen, removed);
+	} else {
+		*removed = node;
+		return kv_idx_merge(node->left, node->right);
+	}
+
+	return node;
+}
+
+static struct kv_entry *
+kv_idx_find(struct xnvme_kv *kv, const uint8_t *key, uint8_t klen)
+{
+	struct kv_entry *node = kv->root;
+
+	while (node) {
+		int cmp = kv_key_cmp(key, klen, node->key, node->klen);
+
+		if (!cmp) {
+			return node;
+		}
+		node = cmp < 0 ? node->left : node->right;
+	}
+
+	return NULL;
+}
+
+/**
+ * The first entry with a key greater than, or when not 'strict' equal to,
+ * the given key; the first entry of the index when 'klen' is zero
+ */
+static struct kv_entry *
+kv_idx_ceil(struct xnvme_kv *kv, const uint8_t *key, uint8_t klen, int strict)
+{
+	struct kv_entry *node = kv->root, *ceil = NULL;
+
+	while (node) {
+		int cmp = klen ? kv_key_cmp(key, klen, node->key, node->klen) : -1;
+
+		if ((cmp < 0) || ((!cmp) && (!strict))) {
+			ceil = node;
+			if (!cmp) {
+				break;
+			}
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	return ceil;
+}
+
+static void
+kv_idx_clear(struct kv_entry *node)
+{
+	while (node) {
+		struct kv_entry *right = node->right;
+
+		kv_idx_clear(node->left);
+		free(node);
+		node = right;
+	}
+}
+
+static inline int
+kv_bm_test(const uint64_t *bitmap, uint64_t unit)
+{
+	return (bitmap[unit >> 6] >> (unit & 63)) & 1;
+}
+
+static void
+kv_bm_set(struct xnvme_kv *kv, uint64_t unit, uint32_t nunits, int val)
+{
+	for (uint64_t u = unit; u < unit + nunits; ++u) {
+		if (val) {
+			kv->bitmap[u >> 6] |= 1ULL << (u & 63);
+		} else {
+			kv->bitmap[u >> 6] &= ~(1ULL << (u & 63));
+		}
+	}
+
+	if (val) {
+		kv->nfree -= nunits;
+	} else {
+		kv->nfree += nunits;
+	}
+}
+
+/**
+ * The first of 'nunits' free units in [from, to), UINT64_MAX when none
+ */
+static uint64_t
+kv_bm_find(const uint64_t *bitmap, uint64_t from, uint64_t to, uint32_t nunits)
+{
+	uint64_t run = 0;
+
+	for (uint64_t u = from; u < to; ++u) {
+		if ((!(u & 63)) && (u + 64 <= to) && (bitmap[u >> 6] == ~0ULL)) {
+			run = 0;
+			u += 63;
+			continue;
+		}
+		if (kv_bm_test(bitmap, u)) {
+			run = 0;
+			continue;
+		}
+
+		run += 1;
+		if (run == nunits) {
+			return u + 1 - nunits;
+		}
+	}
+
+	return UINT64_MAX;
+}
+
+/**
+ * Allocate a run of 'nunits', next-fit. Called with the lock held.
+ */
+static int
+kv_alloc(struct xnvme_kv *kv, uint32_t nunits, uint64_t *unit)
+{
+	uint64_t found;
+
+	*unit = 0;
+	if (!nunits) {
+		return 0;
+	}
+	if (nunits > kv->nfree) {
+		return -ENOSPC;
+	}
+
+	found = kv_bm_find(kv->bitmap, kv->alloc_next, kv->ndata, nunits);
+	if (found == UINT64_MAX) {
+		found = kv_bm_find(kv->bitmap, 0,
+				   kv_min(kv->alloc_next + nunits, kv->ndata),
+				   nunits);
+	}
+	if (found == UINT64_MAX) {
+		return -ENOSPC;
+	}
+
+	kv_bm_set(kv, found, nunits, 1);
+	kv->alloc_next = found + nunits;
+	*unit = found;
+
+	return 0;
+}
+
+/**
+ * Release the run of an entry no longer in the index, the run is reused once
+ * a checkpoint not referencing it is written. Called with the lock held.
+ */
+static void
+kv_entry_release(struct xnvme_kv *kv, struct kv_entry *entry)
+{
+	if (entry->nreaders) {
+		entry->stale = 1;
+		return;
+	}
+
+	if (entry->nunits && (kv->npend == kv->pend_cap)) {
+		uint64_t cap = kv->pend_cap ? kv->pend_cap * 2 : 64;
+		struct kv_run *pend = realloc(kv->pend, cap * sizeof(*pend));
+
+		if (pend) {
+			kv->pend = pend;
+			kv->pend_cap = cap;
+		}
+	}
+	if (entry->nunits && (kv->npend < kv->pend_cap)) {
+		kv->pend[kv->npend].unit = entry->unit;
+		kv->pend[kv->npend].nunits = entry->nunits;
+		kv->npend += 1;
+	} else if (entry->nunits) {
+		// The run is recovered when the checkpoint is next loaded
+		XNVME_DEBUG("FAILED: realloc(), leaking unit: %lu", entry->unit);
+	}
+
+	free(entry);
+}
+
+/**
+ * Read or write the first 'nbytes' of the run starting at 'unit', whole units
+ * directly from/to 'dbuf', the remainder via the bounce-buffer of the worker
+ */
+static int
+kv_value_rw(struct xnvme_kv *kv, struct kv_worker *w, uint8_t opcode,
+	    uint64_t unit, uint8_t *dbuf, uint32_t nbytes)
+{
+	const uint32_t nfull = nbytes / kv->unit_nbytes;
+	const uint32_t tail = nbytes % kv->unit_nbytes;
+	const uint64_t slba = kv->data_slba + unit * kv->unit_nlb;
+	int err;
+
+	if (nfull) {
+		err = xnvme_lower_rw(&kv->lower, opcode, slba,
+				     (uint64_t)nfull * kv->unit_nlb, dbuf);
+		if (err) {
+			return err;
+		}
+	}
+	if (!tail) {
+		return 0;
+	}
+
+	dbuf += (uint64_t)nfull * kv->unit_nbytes;
+	if (opcode == XNVME_SPEC_OPC_WRITE) {
+		memcpy(w->bounce, dbuf, tail);
+		memset(w->bounce + tail, 0, kv->unit_nbytes - tail);
+	}
+	err = xnvme_lower_rw(&kv->lower, opcode,
+			     slba + (uint64_t)nfull * kv->unit_nlb,
+			     kv->unit_nlb, w->bounce);
+	if (err) {
+		return err;
+	}
+	if (opcode == XNVME_SPEC_OPC_READ) {
+		memcpy(dbuf, w->bounce, tail);
+	}
+
+	return 0;
+}
+
+/**
+ * Clear the index and the allocation bitmap
+ */
+static void
+kv_idx_reset(struct xnvme_kv *kv)
+{
+	kv_idx_clear(kv->root);
+	kv->root = NULL;
+	kv->nkeys = 0;
+	memset(kv->bitmap, 0, ((kv->ndata + 63) / 64) * sizeof(*kv->bitmap));
+	kv->nfree = kv->ndata;
+}
+
+/**
+ * Produce the records of a checkpoint from the index, see xnvme_ckpt_tbl_cb
+ */
+static int
+kv_ckpt_get(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_kv *kv = cb_arg;
+	struct kv_rec *recs = (void *)buf;
+
+	if (!ofz) {
+		kv->ckpt_next = kv_idx_ceil(kv, NULL, 0, 0);
+	}
+
+	for (uint64_t i = 0; i < nbytes / sizeof(*recs); ++i) {
+		struct kv_entry *entry = kv->ckpt_next;
+		struct kv_rec *rec = &recs[i];
+
+		if (!entry) {
+			XNVME_DEBUG("FAILED: index has fewer keys than nkeys");
+			return -EIO;
+		}
+
+		memset(rec, 0, sizeof(*rec));
+		memcpy(rec->key, entry->key, entry->klen);
+		rec->klen = entry->klen;
+		rec->vlen = entry->vlen;
+		rec->unit = entry->unit;
+
+		kv->ckpt_next = kv_idx_ceil(kv, entry->key, entry->klen, 1);
+	}
+
+	return 0;
+}
+
+/**
+ * Rebuild the index and the allocation bitmap from the records of a
+ * checkpoint, see xnvme_ckpt_tbl_cb
+ */
+static int
+kv_ckpt_put(void *cb_arg, uint64_t ofz, uint8_t *buf, uint64_t nbytes)
+{
+	struct xnvme_kv *kv = cb_arg;
+	const struct kv_rec *recs = (void *)buf;
+
+	// A table read before, from the other area, was invalid
+	if (!ofz) {
+		kv_idx_reset(kv);
+	}
+
+	for (uint64_t i = 0; i < nbytes / sizeof(*recs); ++i) {
+		const struct kv_rec *rec = &recs[i];
+		struct kv_entry *entry;
+
+		if ((!rec->klen) || (rec->klen > KVS_KEY_NBYTES_MAX) ||
+		    (rec->vlen > XNVME_BE_KV_VML) || (rec->unit > kv->ndata) ||
+		    (kv_nunits(kv, rec->vlen) > kv->ndata - rec->unit) ||
+		    kv_idx_find(kv, rec->key, rec->klen)) {
+			XNVME_DEBUG("FAILED: invalid record");
+			return -EIO;
+		}
+
+		entry = calloc(1, sizeof(*entry));
+		if (!entry) {
+			return -ENOMEM;
+		}
+		memcpy(entry->key, rec->key, rec->klen);
+		entry->klen = rec->klen;
+		entry->vlen = rec->vlen;
+		entry->unit = rec->unit;
+		entry->nunits = kv_nunits(kv, rec->vlen);
+		kv->prng = kv->prng * 1103515245 + 12345;
+		entry->prio = kv->prng;
+
+		for (uint32_t u = 0; u < entry->nunits; ++u) {
+			if (kv_bm_test(kv->bitmap, entry->unit + u)) {
+				XNVME_DEBUG("FAILED: overlapping records");
+				free(entry);
+				return -EIO;
+			}
+		}
+		kv_bm_set(kv, entry->unit, entry->nunits, 1);
+
+		kv->root = kv_idx_insert(kv->root, entry);
+		kv->nkeys += 1;
+	}
+
+	return 0;
+}
+
+static int
+kv_ckpt_check(void *cb_arg, const struct xnvme_ckpt_hdr *hdr)
+{
+	const struct kv_ckpt *ckpt = (const void *)hdr;
+	struct xnvme_kv *kv = cb_arg;
+
+	return (ckpt->unit_nbytes != kv->unit_nbytes) ||
+	       (ckpt->ndata != kv->ndata) || (ckpt->mnk != kv->mnk) ||
+	       (hdr->tbl_nbytes % sizeof(struct kv_rec)) ||
+	       (hdr->tbl_nbytes / sizeof(struct kv_rec) > kv->mnk);
+}
+
+/**
+ * Write a checkpoint of the index, then release the runs pending on it.
+ * Called with the lock held.
+ */
+static int
+kv_ckpt_write(struct xnvme_kv *kv)
+{
+	struct kv_ckpt ckpt = { 0 };
+	int err;
+
+	ckpt.hdr.tbl_nbytes = kv->nkeys * sizeof(struct kv_rec);
+	ckpt.unit_nbytes = kv->unit_nbytes;
+	ckpt.ndata = kv->ndata;
+	ckpt.mnk = kv->mnk;
+
+	err = xnvme_ckpt_write(&kv->ckpt, &ckpt.hdr);
+	if (err) {
+		return err;
+	}
+
+	for (uint64_t i = 0; i < kv->npend; ++i) {
+		kv_bm_set(kv, kv->pend[i].unit, kv->pend[i].nunits, 0);
+	}
+	kv->npend = 0;
+
+	return 0;
+}
+
+/**
+ * Load the latest valid checkpoint. When no checkpoint is found, or when
+ * asked to via 'format', then an empty one is written.
+ */
+static int
+kv_ckpt_load(struct xnvme_kv *kv, int format)
+{
+	struct kv_ckpt ckpt = { 0 };
+	int err;
+
+	if (!format) {
+		err = xnvme_ckpt_load(&kv->ckpt, &ckpt.hdr);
+		if (err != -ENOENT) {
+			return err;
+		}
+	}
+
+	kv_idx_reset(kv);
+	xnvme_ckpt_format(&kv->ckpt);
+
+	// Both areas are written, a checkpoint left from before would be newer
+	for (int i = 0; i < 2; ++i) {
+		err = kv_ckpt_write(kv);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Hand the completed command to its submitter. Called with 'wq_lock' held.
+ */
+static void
+kv_cmd_complete(struct xnvme_kv *kv, struct kv_cmd *cmd)
+{
+	struct xnvme_async_ctx_kv *actx = cmd->actx;
+
+	if (!actx) {
+		cmd->done = 1;
+		pthread_cond_broadcast(&kv->wq_cond);
+		return;
+	}
+
+	memset(&cmd->req->cpl, 0, sizeof(cmd->req->cpl));
+	cmd->req->cpl.cdw0 = cmd->cdw0;
+	cmd->req->cpl.status.sct = cmd->sct;
+	cmd->req->cpl.status.sc = cmd->sc;
+
+	pthread_mutex_lock(&actx->lock);
+	cmd->link = NULL;
+	if (actx->tail) {
+		actx->tail->link = cmd;
+	} else {
+		actx->head = cmd;
+	}
+	actx->tail = cmd;
+	pthread_cond_signal(&actx->cond);
+	pthread_mutex_unlock(&actx->lock);
+}
+
+/**
+ * Check the store options against the index. Called with the lock held.
+ */
+static int
+kv_store_check(struct xnvme_kv *kv, struct kv_cmd *cmd, const uint8_t *key,
+	       uint8_t klen)
+{
+	struct kv_entry *entry = kv_idx_find(kv, key, klen);
+
+	if ((cmd->cmd.kv.so & KVS_STORE_OPT_MUST_EXIST) && (!entry)) {
+		kv_cmd_status(cmd, 0x1, KVS_SC_KEY_NOT_EXISTS);
+		return -ENOENT;
+	}
+	if ((cmd->cmd.kv.so & KVS_STORE_OPT_MUST_NOT_EXIST) && entry) {
+		kv_cmd_status(cmd, 0x1, KVS_SC_KEY_EXISTS);
+		return -EEXIST;
+	}
+	if ((!entry) && (kv->nkeys >= kv->mnk)) {
+		kv_cmd_status(cmd, 0x0, KV_SC_CAPACITY_EXCEEDED);
+		return -ENOSPC;
+	}
+
+	return 0;
+}
+
+static void
+kv_store(struct xnvme_kv *kv, struct kv_worker *w, struct kv_cmd *cmd)
+{
+	const uint32_t vlen = cmd->cmd.kv.vsz;
+	const uint32_t nunits = kv_nunits(kv, vlen);
+	uint8_t key[KVS_KEY_NBYTES_MAX];
+	struct kv_entry *entry, *old = NULL;
+	uint8_t klen;
+	uint64_t unit;
+	int err;
+
+	klen = kvs_cmd_get_key(&cmd->cmd, key);
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		kv_cmd_status(cmd, 0x0, XNVME_SPEC_SC_INTERNAL);
+		return;
+	}
+
+	pthread_mutex_lock(&kv->lock);
+	if (kv_store_check(kv, cmd, key, klen)) {
+		pthread_mutex_unlock(&kv->lock);
+		free(entry);
+		return;
+	}
+	err = kv_alloc(kv, nunits, &unit);
+	if (err && kv->npend) {
+		// Released runs become available with the next checkpoint
+		err = kv_ckpt_write(kv);
+		err = err ? err : kv_alloc(kv, nunits, &unit);
+	}
+	pthread_mutex_unlock(&kv->lock);
+	if (err) {
+		XNVME_DEBUG("FAILED: kv_alloc(%u), err: %d", nunits, err);
+		kv_cmd_status(cmd, 0x0, (err == -ENOSPC) ?
+			      KV_SC_CAPACITY_EXCEEDED : XNVME_SPEC_SC_INTERNAL);
+		free(entry);
+		return;
+	}
+
+	err = kv_value_rw(kv, w, XNVME_SPEC_OPC_WRITE, unit, cmd->dbuf, vlen);
+
+	pthread_mutex_lock(&kv->lock);
+	if (err) {
+		kv_cmd_status(cmd, 0x0, XNVME_SPEC_SC_INTERNAL);
+	}
+	// Re-checked, as other stores and deletes might have completed
+	if (err || kv_store_check(kv, cmd, key, klen)) {
+		kv_bm_set(kv, unit, nunits, 0);
+		pthread_mutex_unlock(&kv->lock);
+		free(entry);
+		return;
+	}
+
+	memcpy(entry->key, key, klen);
+	entry->klen = klen;
+	entry->vlen = vlen;
+	entry->unit = unit;
+	entry->nunits = nunits;
+	kv->prng = kv->prng * 1103515245 + 12345;
+	entry->prio = kv->prng;
+
+	kv->root = kv_idx_remove(kv->root, key, klen, &old);
+	kv->root = kv_idx_insert(kv->root, entry);
+	if (old) {
+		kv_entry_release(kv, old);
+	} else {
+		kv->nkeys += 1;
+	}
+	pthread_mutex_unlock(&kv->lock);
+}
+
+static void
+kv_retrieve(struct xnvme_kv *kv, struct kv_worker *w, struct kv_cmd *cmd)
+{
+	uint8_t key[KVS_KEY_NBYTES_MAX];
+	struct kv_entry *entry;
+	uint32_t nbytes;
+	uint8_t klen;
+	int err;
+
+	klen = kvs_cmd_get_key(&cmd->cmd, key);
+
+	pthread_mutex_lock(&kv->lock);
+	entry = kv_idx_find(kv, key, klen);
+	if (entry) {
+		entry->nreaders += 1;
+	}
+	pthread_mutex_unlock(&kv->lock);
+	if (!entry) {
+		kv_cmd_status(cmd, 0x1, KVS_SC_KEY_NOT_EXISTS);
+		return;
+	}
+
+	nbytes = kv_min(entry->vlen, kv_min(cmd->cmd.kv.vsz, cmd->dbuf_nbytes));
+	err = kv_value_rw(kv, w, XNVME_SPEC_OPC_READ, entry->unit, cmd->dbuf,
+			  nbytes);
+	if (err) {
+		kv_cmd_status(cmd, 0x1, KVS_SC_UNRECOVERED);
+	}
+	cmd->cdw0 = entry->vlen;
+
+	pthread_mutex_lock(&kv->lock);
+	entry->nreaders -= 1;
+	if ((!entry->nreaders) && entry->stale) {
+		kv_entry_release(kv, entry);
+	}
+	pthread_mutex_unlock(&kv->lock);
+}
+
+/**
+ * Commands only touching the index, carried out on submission
+ */
+static void
+kv_index_cmd(struct xnvme_kv *kv, struct kv_cmd *cmd)
+{
+	uint8_t key[KVS_KEY_NBYTES_MAX];
+	struct kv_entry *entry = NULL;
+	uint8_t klen;
+
+	klen = kvs_cmd_get_key(&cmd->cmd, key);
+
+	pthread_mutex_lock(&kv->lock);
+	switch (cmd->cmd.common.opcode) {
+	case KVS_CMD_OPC_DELETE:
+		kv->root = kv_idx_remove(kv->root, key, klen, &entry);
+		if (!entry) {
+			kv_cmd_status(cmd, 0x1, KVS_SC_KEY_NOT_EXISTS);
+			break;
+		}
+		kv->nkeys -= 1;
+		kv_entry_release(kv, entry);
+		break;
+
+	case KVS_CMD_OPC_EXIST:
+		if (!kv_idx_find(kv, key, klen)) {
+			kv_cmd_status(cmd, 0x1, KVS_SC_KEY_NOT_EXISTS);
+		}
+		break;
+
+	case KVS_CMD_OPC_LIST:
+	{
+		uint32_t nbytes = kv_min(cmd->cmd.kv.vsz, cmd->dbuf_nbytes);
+		struct kvs_list_hdr hdr = { 0 };
+		uint32_t ofz = sizeof(hdr);
+
+		if (nbytes < sizeof(hdr)) {
+			kv_cmd_status(cmd, 0x0, XNVME_SPEC_SC_INTERNAL);
+			break;
+		}
+		memset(cmd->dbuf, 0, nbytes);
+
+		entry = kv_idx_ceil(kv, key, klen, 0);
+		for (; entry; entry = kv_idx_ceil(kv, entry->key, entry->klen, 1)) {
+			uint16_t elen = entry->klen;
+
+			if (ofz + sizeof(elen) + elen > nbytes) {
+				break;
+			}
+			memcpy(cmd->dbuf + ofz, &elen, sizeof(elen));
+			memcpy(cmd->dbuf + ofz + sizeof(elen), entry->key, elen);
+
+			ofz += (sizeof(elen) + elen + 3) & ~3U;
+			hdr.nkeys += 1;
+		}
+		memcpy(cmd->dbuf, &hdr, sizeof(hdr));
+		cmd->cdw0 = hdr.nkeys;
+	}
+	break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		if (kv_ckpt_write(kv)) {
+			XNVME_DEBUG("FAILED: kv_ckpt_write()");
+			kv_cmd_status(cmd, 0x0, XNVME_SPEC_SC_INTERNAL);
+		}
+		break;
+	}
+	pthread_mutex_unlock(&kv->lock);
+}
+
+static void *
+kv_worker_main(void *arg)
+{
+	struct kv_worker *w = arg;
+	struct xnvme_kv *kv = w->kv;
+
+	pthread_mutex_lock(&kv->wq_lock);
+	while (!kv->wq_stop) {
+		struct kv_cmd *cmd = kv->wq_head;
+
+		if (!cmd) {
+			pthread_cond_wait(&kv->wq_cond, &kv->wq_lock);
+			continue;
+		}
+
+		kv->wq_head = cmd->link;
+		if (!kv->wq_head) {
+			kv->wq_tail = NULL;
+		}
+		pthread_mutex_unlock(&kv->wq_lock);
+
+		if (cmd->cmd.common.opcode == KVS_CMD_OPC_STORE) {
+			kv_store(kv, w, cmd);
+		} else {
+			kv_retrieve(kv, w, cmd);
+		}
+
+		pthread_mutex_lock(&kv->wq_lock);
+		kv_cmd_complete(kv, cmd);
+	}
+	pthread_mutex_unlock(&kv->wq_lock);
+
+	return NULL;
+}
+
+static void
+kv_cmd_submit(struct xnvme_kv *kv, struct kv_cmd *cmd)
+{
+	cmd->link = NULL;
+
+	pthread_mutex_lock(&kv->wq_lock);
+	if (kv->wq_tail) {
+		kv->wq_tail->link = cmd;
+	} else {
+		kv->wq_head = cmd;
+	}
+	kv->wq_tail = cmd;
+	pthread_cond_broadcast(&kv->wq_cond);
+	pthread_mutex_unlock(&kv->wq_lock);
+}
+
+/**
+ * Tear down the Key-Value layer, the lower device is left open
+ */
+static void
+kv_term(struct xnvme_kv *kv)
+{
+	if (!kv) {
+		return;
+	}
+
+	pthread_mutex_lock(&kv->wq_lock);
+	kv->wq_stop = 1;
+	pthread_cond_broadcast(&kv->wq_cond);
+	pthread_mutex_unlock(&kv->wq_lock);
+	for (uint32_t i = 0; kv->workers && (i < kv->nwork); ++i) {
+		struct kv_worker *w = &kv->workers[i];
+
+		if (w->started) {
+			pthread_join(w->thread, NULL);
+		}
+		xnvme_buf_free(kv->lower.dev, w->bounce);
+	}
+
+	pthread_cond_destroy(&kv->wq_cond);
+	pthread_mutex_destroy(&kv->wq_lock);
+	pthread_mutex_destroy(&kv->lock);
+
+	kv_idx_clear(kv->root);
+	xnvme_buf_free(kv->lower.dev, kv->ckpt.iobuf);
+	free(kv->workers);
+	free(kv->pend);
+	free(kv->bitmap);
+	free(kv);
+}
+
+static int
+kv_init(struct xnvme_dev *lower, const struct xnvme_ident *ident,
+	struct xnvme_kv **kv)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(lower);
+	uint32_t nwork = XNVME_BE_KV_NWORK_DEF;
+	uint32_t format = 0;
+	uint64_t nunits, mnk, tbl_units;
+	int err;
+
+	if (geo->type != XNVME_GEO_CONVENTIONAL) {
+		XNVME_DEBUG("FAILED: lower device is not conventional");
+		return -EINVAL;
+	}
+	if (geo->lba_extended || geo->nbytes_oob) {
+		XNVME_DEBUG("FAILED: metadata is not supported");
+		return -EINVAL;
+	}
+	xnvme_ident_opt_to_val(ident, "nwork", &nwork);
+	xnvme_ident_opt_to_val(ident, "format", &format);
+	if ((!nwork) || (nwork > XNVME_BE_KV_NWORK_MAX)) {
+		XNVME_DEBUG("FAILED: nwork: %u", nwork);
+		return -EINVAL;
+	}
+	if ((geo->lba_nbytes < sizeof(struct kv_ckpt)) ||
+	    ((XNVME_BE_KV_UNIT_NBYTES % geo->lba_nbytes) &&
+	     (geo->lba_nbytes % XNVME_BE_KV_UNIT_NBYTES))) {
+		XNVME_DEBUG("FAILED: lba_nbytes: %u", geo->lba_nbytes);
+		return -EINVAL;
+	}
+
+	(*kv) = calloc(1, sizeof(**kv));
+	if (!(*kv)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*kv)->lower.dev = lower;
+	(*kv)->lower.nsid = xnvme_dev_get_nsid(lower);
+	(*kv)->prng = 0x9e3779b9;
+	pthread_mutex_init(&(*kv)->lock, NULL);
+	pthread_mutex_init(&(*kv)->wq_lock, NULL);
+	pthread_cond_init(&(*kv)->wq_cond, NULL);
+
+	(*kv)->lower.lba_nbytes = geo->lba_nbytes;
+	(*kv)->lower.io_nlb = kv_min(geo->mdts_nbytes / geo->lba_nbytes,
+			       UINT16_MAX + 1);
+	if (!(*kv)->lower.io_nlb) {
+		XNVME_DEBUG("FAILED: mdts < lba_nbytes");
+		err = -EINVAL;
+		goto failed;
+	}
+	(*kv)->unit_nbytes = XNVME_MAX(XNVME_BE_KV_UNIT_NBYTES,
+				       (int)geo->lba_nbytes);
+	(*kv)->unit_nlb = (*kv)->unit_nbytes / geo->lba_nbytes;
+
+	// Each key takes at least a unit, less the units of two areas
+	nunits = geo->tbytes / (*kv)->unit_nbytes;
+	if (nunits <= 5) {
+		XNVME_DEBUG("FAILED: too small, tbytes: %lu", geo->tbytes);
+		err = -EINVAL;
+		goto failed;
+	}
+	mnk = (nunits - 4) * (*kv)->unit_nbytes / \
+	      ((*kv)->unit_nbytes + 2 * sizeof(struct kv_rec));
+	mnk = kv_min(mnk, XNVME_BE_KV_MNK);
+	tbl_units = (mnk * sizeof(struct kv_rec) + (*kv)->unit_nbytes - 1) / \
+		    (*kv)->unit_nbytes;
+
+	(*kv)->mnk = mnk;
+	(*kv)->ckpt.lower = &(*kv)->lower;
+	(*kv)->ckpt.magic = KV_CKPT_MAGIC;
+	(*kv)->ckpt.version = KV_CKPT_VERSION;
+	(*kv)->ckpt.hdr_nbytes = sizeof(struct kv_ckpt);
+	(*kv)->ckpt.get = kv_ckpt_get;
+	(*kv)->ckpt.put = kv_ckpt_put;
+	(*kv)->ckpt.check = kv_ckpt_check;
+	(*kv)->ckpt.cb_arg = *kv;
+	(*kv)->ckpt.tbl_nlb = tbl_units * (*kv)->unit_nlb;
+	(*kv)->ckpt.area_nlb = (2 + tbl_units) * (*kv)->unit_nlb;
+	(*kv)->data_slba = 2 * (*kv)->ckpt.area_nlb;
+	(*kv)->ndata = nunits - 2 * (2 + tbl_units);
+	(*kv)->nfree = (*kv)->ndata;
+
+	(*kv)->bitmap = calloc(((*kv)->ndata + 63) / 64, sizeof(uint64_t));
+	(*kv)->workers = calloc(nwork, sizeof(*(*kv)->workers));
+	(*kv)->ckpt.iobuf = xnvme_buf_alloc(lower, (size_t)(*kv)->lower.io_nlb *
+					    geo->lba_nbytes, NULL);
+	if (!((*kv)->bitmap && (*kv)->workers && (*kv)->ckpt.iobuf)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: allocating index and buffers");
+		goto failed;
+	}
+	(*kv)->nwork = nwork;
+
+	err = kv_ckpt_load(*kv, format);
+	if (err) {
+		XNVME_DEBUG("FAILED: kv_ckpt_load(), err: %d", err);
+		goto failed;
+	}
+
+	for (uint32_t i = 0; i < nwork; ++i) {
+		struct kv_worker *w = &(*kv)->workers[i];
+
+		w->kv = *kv;
+		w->bounce = xnvme_buf_alloc(lower, (*kv)->unit_nbytes, NULL);
+		if (!w->bounce) {
+			err = -ENOMEM;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+			goto failed;
+		}
+		err = pthread_create(&w->thread, NULL, kv_worker_main, w);
+		if (err) {
+			XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+			err = -err;
+			goto failed;
+		}
+		w->started = 1;
+	}
+
+	return 0;
+
+failed:
+	kv_term(*kv);
+	*kv = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_kv_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		     size_t XNVME_UNUSED(mbuf_nbytes), int opts,
+		     struct xnvme_req *req)
+{
+	struct xnvme_be_kv_state *state = (void *)dev->be.state;
+	struct xnvme_kv *kv = state->kv;
+	struct xnvme_async_ctx_kv *actx = NULL;
+	struct kv_cmd scmd = { 0 };
+	struct kv_cmd *kcmd = &scmd;
+	struct kvs_cmd *kvs = (void *)cmd;
+
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		actx = (void *)req->async.ctx;
+		if ((actx->outstanding == actx->depth) || (!actx->free)) {
+			return -EBUSY;
+		}
+	}
+	if (mbuf) {
+		XNVME_DEBUG("FAILED: metadata is not supported");
+		return -EINVAL;
+	}
+
+	switch (cmd->common.opcode) {
+	case KVS_CMD_OPC_STORE:
+	case KVS_CMD_OPC_RETRIEVE:
+	case KVS_CMD_OPC_LIST:
+		if ((kvs->kv.vsz && (!dbuf)) ||
+		    ((cmd->common.opcode == KVS_CMD_OPC_STORE) &&
+		     (dbuf_nbytes < kvs->kv.vsz))) {
+			XNVME_DEBUG("FAILED: vsz: %u, dbuf_nbytes: %zu",
+				    kvs->kv.vsz, dbuf_nbytes);
+			return -EINVAL;
+		}
+		break;
+
+	case KVS_CMD_OPC_DELETE:
+	case KVS_CMD_OPC_EXIST:
+	case XNVME_SPEC_OPC_FLUSH:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (actx) {
+		kcmd = actx->free;
+		actx->free = kcmd->link;
+		actx->outstanding += 1;
+		memset(kcmd, 0, sizeof(*kcmd));
+	}
+	kcmd->req = req;
+	kcmd->actx = actx;
+	kcmd->cmd.base = *cmd;
+	kcmd->dbuf = dbuf;
+	kcmd->dbuf_nbytes = kv_min(dbuf_nbytes, UINT32_MAX);
+
+	switch (cmd->common.opcode) {
+	case KVS_CMD_OPC_STORE:
+	case KVS_CMD_OPC_RETRIEVE:
+		if ((kvs->kv.kl < 1) || (kvs->kv.kl > KVS_KEY_NBYTES_MAX)) {
+			kv_cmd_status(kcmd, 0x1, KVS_SC_INVALID_KEY_SIZE);
+			break;
+		}
+		if ((cmd->common.opcode == KVS_CMD_OPC_STORE) &&
+		    (kvs->kv.vsz > XNVME_BE_KV_VML)) {
+			kv_cmd_status(kcmd, 0x1, KVS_SC_INVALID_VALUE_SIZE);
+			break;
+		}
+
+		kv_cmd_submit(kv, kcmd);
+		if (actx) {
+			return 0;
+		}
+
+		pthread_mutex_lock(&kv->wq_lock);
+		while (!scmd.done) {
+			pthread_cond_wait(&kv->wq_cond, &kv->wq_lock);
+		}
+		pthread_mutex_unlock(&kv->wq_lock);
+		break;
+
+	case KVS_CMD_OPC_LIST:
+		if (kvs->kv.kl > KVS_KEY_NBYTES_MAX) {
+			kv_cmd_status(kcmd, 0x1, KVS_SC_INVALID_KEY_SIZE);
+			break;
+		}
+		kv_index_cmd(kv, kcmd);
+		break;
+
+	case KVS_CMD_OPC_DELETE:
+	case KVS_CMD_OPC_EXIST:
+		if ((kvs->kv.kl < 1) || (kvs->kv.kl > KVS_KEY_NBYTES_MAX)) {
+			kv_cmd_status(kcmd, 0x1, KVS_SC_INVALID_KEY_SIZE);
+			break;
+		}
+		kv_index_cmd(kv, kcmd);
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		kv_index_cmd(kv, kcmd);
+		break;
+	}
+
+	if (actx) {
+		pthread_mutex_lock(&kv->wq_lock);
+		kv_cmd_complete(kv, kcmd);
+		pthread_mutex_unlock(&kv->wq_lock);
+		return 0;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+	req->cpl.cdw0 = scmd.cdw0;
+	req->cpl.status.sct = scmd.sct;
+	req->cpl.status.sc = scmd.sc;
+
+	return 0;
+}
+
+/**
+ * The I/O Command Set specific Identify Namespace, with the utilization of
+ * the value units as of now
+ */
+static void
+kv_idfy_ns_css(struct xnvme_dev *dev, struct kvs_idfy_ns *idfy)
+{
+	struct xnvme_be_kv_state *state = (void *)dev->be.state;
+	struct xnvme_kv *kv = state->kv;
+
+	memset(idfy, 0, sizeof(*idfy));
+
+	idfy->nsze = kv->ndata * kv->unit_nbytes;
+	idfy->nkvf = 0;
+	idfy->novg = kv->unit_nbytes;
+	idfy->kvf[0].kml = KVS_KEY_NBYTES_MAX;
+	idfy->kvf[0].mvl = XNVME_BE_KV_VML;
+	idfy->kvf[0].mnk = kv->mnk;
+
+	pthread_mutex_lock(&kv->lock);
+	idfy->nuse = (kv->ndata - kv->nfree) * kv->unit_nbytes;
+	pthread_mutex_unlock(&kv->lock);
+}
+
+int
+xnvme_be_kv_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			   void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			   size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_be_kv_state *state = (void *)dev->be.state;
+	struct xnvme_spec_cmd lcmd = *cmd;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		if ((!dbuf) || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			return -EINVAL;
+		}
+		memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_NS:
+			memcpy(dbuf, &dev->id.ns, sizeof(dev->id.ns));
+			break;
+		case XNVME_SPEC_IDFY_CTRLR:
+			memcpy(dbuf, &dev->id.ctrlr, sizeof(dev->id.ctrlr));
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+			if (cmd->idfy.csi == XNVME_SPEC_CSI_KV) {
+				kv_idfy_ns_css(dev, dbuf);
+			}
+			break;
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: unsupported cns: 0x%x",
+				    cmd->idfy.cns);
+			return -ENOSYS;
+		}
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		return 0;
+
+	// These would pull the rug from under the Key-Value layer
+	case XNVME_SPEC_OPC_FMT_NVM:
+	case XNVME_SPEC_OPC_SANITIZE:
+		XNVME_DEBUG("FAILED: opcode: 0x%x, use format=1",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	if (lcmd.common.nsid == dev->nsid) {
+		lcmd.common.nsid = state->kv->lower.nsid;
+	}
+
+	return xnvme_cmd_pass_admin(state->kv->lower.dev, &lcmd, dbuf,
+				    dbuf_nbytes, mbuf, mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_be_kv_async_init(struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_async_ctx **ctx, uint16_t depth,
+		       int XNVME_UNUSED(flags))
+{
+	struct xnvme_async_ctx_kv *actx;
+
+	if (!depth) {
+		XNVME_DEBUG("FAILED: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	actx = (void *)(*ctx);
+	actx->depth = depth;
+
+	actx->cmds = calloc(depth, sizeof(*actx->cmds));
+	if (!actx->cmds) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		free(*ctx);
+		*ctx = NULL;
+		return -ENOMEM;
+	}
+	for (uint32_t i = 0; i < depth; ++i) {
+		actx->cmds[i].link = actx->free;
+		actx->free = &actx->cmds[i];
+	}
+	pthread_mutex_init(&actx->lock, NULL);
+	pthread_cond_init(&actx->cond, NULL);
+
+	return 0;
+}
+
+int
+xnvme_be_kv_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_kv *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	pthread_cond_destroy(&actx->cond);
+	pthread_mutex_destroy(&actx->lock);
+	free(actx->cmds);
+	free(ctx);
+
+	return 0;
+}
+
+int
+xnvme_be_kv_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_kv *actx = (void *)ctx;
+	struct kv_cmd *head = NULL, *tail = NULL;
+	uint32_t completed = 0;
+
+	max = max ? max : actx->outstanding;
+
+	pthread_mutex_lock(&actx->lock);
+	while (actx->head && (completed < max)) {
+		struct kv_cmd *cmd = actx->head;
+
+		actx->head = cmd->link;
+		if (!actx->head) {
+			actx->tail = NULL;
+		}
+
+		cmd->link = NULL;
+		if (tail) {
+			tail->link = cmd;
+		} else {
+			head = cmd;
+		}
+		tail = cmd;
+		completed += 1;
+	}
+	pthread_mutex_unlock(&actx->lock);
+
+	while (head) {
+		struct kv_cmd *cmd = head;
+		struct xnvme_req *req = cmd->req;
+
+		head = cmd->link;
+		cmd->link = actx->free;
+		actx->free = cmd;
+		actx->outstanding -= 1;
+
+		req->async.cb(req, req->async.cb_arg);
+	}
+
+	return completed;
+}
+
+int
+xnvme_be_kv_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_kv *actx = (void *)ctx;
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		int res;
+
+		pthread_mutex_lock(&actx->lock);
+		while (!actx->head) {
+			pthread_cond_wait(&actx->cond, &actx->lock);
+		}
+		pthread_mutex_unlock(&actx->lock);
+
+		res = xnvme_be_kv_async_poke(dev, ctx, 0);
+		if (res < 0) {
+			XNVME_DEBUG("FAILED: xnvme_be_kv_async_poke(), err: %d",
+				    res);
+			return res;
+		}
+		acc += res;
+	}
+
+	return acc;
+}
+
+void *
+xnvme_be_kv_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+		      uint64_t *phys)
+{
+	const struct xnvme_be_kv_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_alloc(state->kv->lower.dev, nbytes, phys);
+}
+
+void *
+xnvme_be_kv_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			size_t nbytes, uint64_t *phys)
+{
+	const struct xnvme_be_kv_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_realloc(state->kv->lower.dev, buf, nbytes, phys);
+}
+
+void
+xnvme_be_kv_buf_free(const struct xnvme_dev *dev, void *buf)
+{
+	const struct xnvme_be_kv_state *state = (void *)dev->be.state;
+
+	xnvme_buf_free(state->kv->lower.dev, buf);
+}
+
+int
+xnvme_be_kv_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			uint64_t *phys)
+{
+	const struct xnvme_be_kv_state *state = (void *)dev->be.state;
+
+	return xnvme_buf_vtophys(state->kv->lower.dev, buf, phys);
+}
+
+/**
+ * The Key-Value layer is stacked on a device opened by uri, thus there is
+ * nothing to enumerate
+ */
+int
+xnvme_be_kv_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+		      const char *XNVME_UNUSED(sys_uri), int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void
+xnvme_be_kv_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_kv_state *state;
+	struct xnvme_dev *lower;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+	lower = state->kv->lower.dev;
+
+	pthread_mutex_lock(&state->kv->lock);
+	if (kv_ckpt_write(state->kv)) {
+		XNVME_DEBUG("FAILED: checkpoint on close");
+	}
+	pthread_mutex_unlock(&state->kv->lock);
+
+	kv_term(state->kv);
+	xnvme_dev_close(lower);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * The device is presented as a single Key-Value namespace, with the
+ * controller identity of the lower device
+ */
+static void
+xnvme_be_kv_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_kv_state *state = (void *)dev->be.state;
+	struct xnvme_kv *kv = state->kv;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_KV;
+	dev->nsid = 1;
+
+	memcpy(&dev->id.ctrlr, xnvme_dev_get_ctrlr(kv->lower.dev),
+	       sizeof(dev->id.ctrlr));
+	dev->id.ctrlr.nn = 1;
+	dev->id.ctrlr.oncs.val = 0;
+	dev->id.ctrlr.vwc.val = 0;
+	dev->id.ctrlr.vwc.present = 1;	// Flush persists the index
+
+	memset(&dev->id.ns, 0, sizeof(dev->id.ns));
+	dev->id.ns.nsze = kv->ndata * kv->unit_nbytes;
+	dev->id.ns.ncap = dev->id.ns.nsze;
+
+	memset(&dev->idcss, 0, sizeof(dev->idcss));
+	kv_idfy_ns_css(dev, (void *)&dev->idcss.ns);
+}
+
+int
+xnvme_be_kv_dev_from_ident(const struct xnvme_ident *ident,
+			   struct xnvme_dev **dev)
+{
+	char uri[XNVME_IDENT_URI_LEN] = { 0 };
+	struct xnvme_be_kv_state *state;
+	struct xnvme_dev *lower;
+	int err;
+
+	// The target is the uri of the lower device, options apply to both
+	snprintf(uri, sizeof(uri), "%s%s", ident->trgt, ident->opts);
+
+	lower = xnvme_dev_open(uri);
+	if (!lower) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_dev_open(%s), err: %d", uri, err);
+		return err;
+	}
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		xnvme_dev_close(lower);
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_kv;
+	state = (void *)(*dev)->be.state;
+
+	err = kv_init(lower, ident, &state->kv);
+	if (err) {
+		XNVME_DEBUG("FAILED: kv_init(), err: %d", err);
+		xnvme_dev_close(lower);
+		free(*dev);
+		return err;
+	}
+
+	xnvme_be_kv_dev_idfy(*dev);
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_kv_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	XNVME_BE_KV_NAME,
+};
+
+struct xnvme_be xnvme_be_kv = {
+#ifdef XNVME_BE_KV_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_kv_cmd_pass,
+		.cmd_pass_admin = xnvme_be_kv_cmd_pass_admin,
+
+		.async_init = xnvme_be_kv_async_init,
+		.async_term = xnvme_be_kv_async_term,
+		.async_poke = xnvme_be_kv_async_poke,
+		.async_wait = xnvme_be_kv_async_wait,
+
+		.buf_alloc = xnvme_be_kv_buf_alloc,
+		.buf_realloc = xnvme_be_kv_buf_realloc,
+		.buf_free = xnvme_be_kv_buf_free,
+		.buf_vtophys = xnvme_be_kv_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_kv_enumerate,
+
+		.dev_from_ident = xnvme_be_kv_dev_from_ident,
+		.dev_close = xnvme_be_kv_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_KV_NAME,
+#ifdef XNVME_BE_KV_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
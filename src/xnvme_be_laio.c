@@ -123,6 +123,10 @@ xnvme_be_laio_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 
 			// Map event-result to req-completion
 			req->cpl.status.sc = ev->res;
+
+			// NOTE: decremented before the callback, such that it
+			// can submit, e.g. the next command of a chain
+			lctx->outstanding -= 1;
 			req->async.cb(req, req->async.cb_arg);
 
 			++completed;
@@ -130,7 +134,6 @@ xnvme_be_laio_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 
 	} while (completed < max);
 
-	lctx->outstanding -= completed;
 	return completed;
 }
 
@@ -258,6 +261,10 @@ xnvme_be_laio_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 		XNVME_DEBUG("FAILED: missing req");
 		return -EINVAL;
 	}
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
 
 	return async_io(dev, cmd->common.opcode, cmd, dbuf, dbuf_nbytes,
 			mbuf, mbuf_nbytes, opts, req);
@@ -422,6 +429,9 @@ struct xnvme_be xnvme_be_laio = {
 		.buf_realloc = xnvme_be_lioc_buf_realloc,
 		.buf_free = xnvme_be_lioc_buf_free,
 
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
 		.enumerate = xnvme_be_laio_enumerate,
 
 		.dev_from_ident = xnvme_be_laio_dev_from_ident,
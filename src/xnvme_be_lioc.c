@@ -27,6 +27,7 @@
 #include <xnvme_be_lioc.h>
 #include <xnvme_dev.h>
 #include <libznd.h>
+#include <libkvs.h>
 
 /**
  * Encapsulation of NVMe command representation as sent via the Linux IOCTLs
@@ -455,6 +456,34 @@ not_zns:
 		XNVME_DEBUG("INFO: failed idfy with csi(ZNS)");
 	}
 
+	// Attempt to identify Key-Value Namespace
+	{
+		struct kvs_idfy_ns *kvs = (void *)idfy_ns;
+
+		memset(idfy_ns, 0, sizeof(*idfy_ns));
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_idfy_ns_csi(dev, dev->nsid, XNVME_SPEC_CSI_KV,
+					    idfy_ns, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("INFO: !id-ns-kv");
+			goto not_kv;
+		}
+
+		if ((!kvs->nsze) || (!kvs->kvf[0].kml)) {
+			goto not_kv;
+		}
+
+		memset(&dev->idcss.ctrlr, 0, sizeof(dev->idcss.ctrlr));
+		memcpy(&dev->idcss.ns, idfy_ns, sizeof(*idfy_ns));
+		dev->csi = XNVME_SPEC_CSI_KV;
+
+		XNVME_DEBUG("INFO: looks like csi(KV)");
+		goto exit;
+
+not_kv:
+		XNVME_DEBUG("INFO: failed idfy with csi(KV)");
+	}
+
 	// Attempt to identify LBLK Namespace
 	memset(idfy_ns, 0, sizeof(*idfy_ns));
 	memset(&req, 0, sizeof(req));
@@ -636,6 +665,9 @@ struct xnvme_be xnvme_be_lioc = {
 		.buf_free = xnvme_be_lioc_buf_free,
 		.buf_vtophys = xnvme_be_lioc_buf_vtophys,
 
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
 		.enumerate = xnvme_be_lioc_enumerate,
 
 		.dev_from_ident = xnvme_be_lioc_dev_from_ident,
@@ -22,9 +22,11 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <paths.h>
+#include <pthread.h>
 #include <liburing.h>
 
 #include <xnvme_async.h>
+#include <xnvme_bufgrp.h>
 #include <xnvme_be_lioc.h>
 #include <xnvme_be_liou.h>
 #include <xnvme_dev.h>
@@ -36,6 +38,7 @@ static int g_opcodes[] = {
 	IORING_OP_WRITE_FIXED,
 	IORING_OP_READ,
 	IORING_OP_WRITE,
+	IORING_OP_FSYNC,
 };
 int g_nopcodes = sizeof g_opcodes / sizeof(*g_opcodes);
 
@@ -175,6 +178,15 @@ xnvme_be_liou_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 		}
 		cqe = &ring->cqes[head & cq_ring_mask];
 
+		if (cqe->user_data == XNVME_BE_LIOU_UDATA_INTERNAL) {
+			if (cqe->res < 0) {
+				XNVME_DEBUG("FAILED: internal cmd, res: %d",
+					    cqe->res);
+			}
+			++head;
+			continue;
+		}
+
 		req = (struct xnvme_req *)(uintptr_t) cqe->user_data;
 		if (!req) {
 			XNVME_DEBUG("-{[THIS SHOULD NOT HAPPEN]}-");
@@ -189,15 +201,30 @@ xnvme_be_liou_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 		}
 
 		// Map cqe-result to req-completion
-		req->cpl.status.sc = cqe->res;
+		if (cqe->res == -ECANCELED) {	// Link broken by predecessor
+			req->cpl.status.sct = 0x0;
+			req->cpl.status.sc = XNVME_SPEC_SC_ABORT_REQ;
+		} else {
+			req->cpl.status.sc = cqe->res;
+		}
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			struct xnvme_bufgrp *grp;
+			uint32_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
 
+			memcpy(&grp, req->async.be_rsvd, sizeof(grp));
+			req->async.dbuf = grp->bufs +
+					  (size_t)bid * grp->buf_nbytes;
+		}
+
+		// NOTE: decremented before the callback, such that it can
+		// submit, e.g. the next command of a chain
+		lctx->outstanding -= 1;
 		req->async.cb(req, req->async.cb_arg);
 
 		++completed;
 		++head;
 	} while (completed < max);
 
-	lctx->outstanding -= completed;
 	*ring->khead = head;
 	io_uring_barrier();
 
@@ -255,10 +282,27 @@ xnvme_be_liou_buf_free(const struct xnvme_dev *XNVME_UNUSED(dev), void *buf)
 	xnvme_buf_virt_free(buf);
 }
 
+/**
+ * Terminate a chain of linked, and not yet submitted, commands at the last
+ * command prepared and submit them
+ */
+static inline void
+async_link_term(struct xnvme_async_ctx_liou *lctx)
+{
+	if (!lctx->link_tail) {
+		return;
+	}
+
+	lctx->link_tail->flags &= ~IOSQE_IO_LINK;
+	lctx->link_tail = NULL;
+
+	io_uring_submit(&lctx->ring);
+}
+
 static inline int
 async_io(struct xnvme_dev *dev, int opcode, struct xnvme_spec_cmd *cmd,
 	 void *dbuf, size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes,
-	 int XNVME_UNUSED(opts), struct xnvme_req *req)
+	 int opts, struct xnvme_req *req)
 {
 	struct xnvme_be_liou_state *state = (void *)dev->be.state;
 	struct xnvme_async_ctx_liou *lctx = (void *)req->async.ctx;
@@ -292,6 +336,25 @@ async_io(struct xnvme_dev *dev, int opcode, struct xnvme_spec_cmd *cmd,
 	sqe->user_data = (unsigned long)req;
 	sqe->__pad2[0] = sqe->__pad2[1] = sqe->__pad2[2] = 0;
 
+	// The buffer is selected by the kernel from the group given as 'dbuf'
+	if (opts & XNVME_CMD_BUFSEL) {
+		struct xnvme_bufgrp *grp = dbuf;
+
+		sqe->addr = 0;
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = grp->bgid;
+		memcpy(req->async.be_rsvd, &grp, sizeof(grp));
+	}
+
+	// Linked commands are submitted along with the end of the chain
+	if (opts & XNVME_CMD_LINK) {
+		sqe->flags |= IOSQE_IO_LINK;
+		lctx->link_tail = sqe;
+		lctx->outstanding += 1;
+		return 0;
+	}
+	lctx->link_tail = NULL;
+
 	err = io_uring_submit(&lctx->ring);
 	if (err < 0) {
 		XNVME_DEBUG("io_uring_submit(%d), err: %d", opcode, err);
@@ -303,11 +366,154 @@ async_io(struct xnvme_dev *dev, int opcode, struct xnvme_spec_cmd *cmd,
 	return 0;
 }
 
+// Synchronous commands are submitted via a ring owned by the calling thread,
+// it is created on first use and torn down by the key-destructor on thread
+// exit. No files are registered, thus the ring serves any device
+static pthread_key_t g_sync_key;
+static pthread_once_t g_sync_once = PTHREAD_ONCE_INIT;
+static int g_sync_key_err;
+
+static void
+sync_ring_term(void *arg)
+{
+	struct io_uring *ring = arg;
+
+	io_uring_queue_exit(ring);
+	free(ring);
+}
+
+static void
+sync_key_init(void)
+{
+	g_sync_key_err = -pthread_key_create(&g_sync_key, sync_ring_term);
+}
+
+static int
+sync_ring_get(struct io_uring **ring)
+{
+	int err;
+
+	pthread_once(&g_sync_once, sync_key_init);
+	if (g_sync_key_err) {
+		XNVME_DEBUG("FAILED: pthread_key_create(), err: %d",
+			    g_sync_key_err);
+		return g_sync_key_err;
+	}
+
+	*ring = pthread_getspecific(g_sync_key);
+	if (*ring) {
+		return 0;
+	}
+
+	*ring = calloc(1, sizeof(**ring));
+	if (!*ring) {
+		XNVME_DEBUG("FAILED: calloc(ring), err: %s", strerror(errno));
+		return -errno;
+	}
+	err = io_uring_queue_init(XNVME_BE_LIOU_SYNC_DEPTH, *ring, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: io_uring_queue_init(), err: %d", err);
+		free(*ring);
+		*ring = NULL;
+		return err;
+	}
+	err = -pthread_setspecific(g_sync_key, *ring);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_setspecific(), err: %d", err);
+		sync_ring_term(*ring);
+		*ring = NULL;
+		return err;
+	}
+
+	return 0;
+}
+
+static inline int
+sync_io(struct xnvme_dev *dev, int opcode, struct xnvme_spec_cmd *cmd,
+	void *dbuf, size_t dbuf_nbytes, struct xnvme_req *req)
+{
+	struct xnvme_be_liou_state *state = (void *)dev->be.state;
+	struct io_uring_cqe *cqe = NULL;
+	struct io_uring_sqe *sqe = NULL;
+	struct io_uring *ring = NULL;
+	int res;
+	int err;
+
+	err = sync_ring_get(&ring);
+	if (err) {
+		XNVME_DEBUG("FAILED: sync_ring_get(), err: %d", err);
+		return err;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		return -EAGAIN;
+	}
+	io_uring_prep_rw(opcode, sqe, state->fd, dbuf, dbuf_nbytes,
+			 cmd->lblk.slba << dev->ssw);
+	sqe->user_data = (unsigned long)req;
+
+	if (state->poll_sync) {
+		err = io_uring_submit(ring);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+			return err;
+		}
+		do {
+			err = io_uring_peek_cqe(ring, &cqe);
+		} while (err == -EAGAIN);
+	} else {
+		err = io_uring_submit_and_wait(ring, 1);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: io_uring_submit_and_wait(), err: %d",
+				    err);
+			return err;
+		}
+		err = io_uring_wait_cqe(ring, &cqe);
+	}
+	if (err) {
+		XNVME_DEBUG("FAILED: retrieving cqe, err: %d", err);
+		return err;
+	}
+
+	res = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+
+	if (res < 0) {
+		XNVME_DEBUG("FAILED: cqe->res: %d", res);
+		if (req) {
+			req->cpl.status.sc = res;
+		}
+		return res;
+	}
+	if ((size_t)res != dbuf_nbytes) {
+		XNVME_DEBUG("FAILED: short transfer, res: %d", res);
+		return -EIO;
+	}
+
+	return 0;
+}
+
 int
 xnvme_be_liou_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 		       void *dbuf, size_t dbuf_nbytes, void *mbuf,
 		       size_t mbuf_nbytes, int opts, struct xnvme_req *req)
 {
+	int err;
+
+	// NOTE: io_uring does not carry meta-data, thus sync. commands with
+	// meta-data and any opcode besides read/write go through the ioctl
+	if (!(opts & XNVME_CMD_ASYNC) && !(mbuf || mbuf_nbytes)) {
+		switch (cmd->common.opcode) {
+		case XNVME_SPEC_OPC_WRITE:
+			return sync_io(dev, IORING_OP_WRITE, cmd, dbuf,
+				       dbuf_nbytes, req);
+
+		case XNVME_SPEC_OPC_READ:
+			return sync_io(dev, IORING_OP_READ, cmd, dbuf,
+				       dbuf_nbytes, req);
+		}
+	}
 	if (!(opts & XNVME_CMD_ASYNC)) {
 		return xnvme_be_lioc_cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf,
 					      mbuf_nbytes, opts, req);
@@ -319,15 +525,92 @@ xnvme_be_liou_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 
 	switch (cmd->common.opcode) {
 	case XNVME_SPEC_OPC_WRITE:
-		return async_io(dev, IORING_OP_WRITE, cmd, dbuf, dbuf_nbytes,
-				mbuf, mbuf_nbytes, opts, req);
+		err = async_io(dev, IORING_OP_WRITE, cmd, dbuf, dbuf_nbytes,
+			       mbuf, mbuf_nbytes, opts, req);
+		break;
 
 	case XNVME_SPEC_OPC_READ:
-		return async_io(dev, IORING_OP_READ, cmd, dbuf, dbuf_nbytes,
-				mbuf, mbuf_nbytes, opts, req);
+		err = async_io(dev, IORING_OP_READ, cmd, dbuf, dbuf_nbytes,
+			       mbuf, mbuf_nbytes, opts, req);
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		err = async_io(dev, IORING_OP_FSYNC, cmd, NULL, 0, mbuf,
+			       mbuf_nbytes, opts, req);
+		break;
+
+	default:
+		err = -ENOSYS;
+		break;
+	}
+	if (err) {
+		async_link_term((void *)req->async.ctx);
 	}
 
-	return -ENOSYS;
+	return err;
+}
+
+int
+xnvme_be_liou_bufgrp_provide(struct xnvme_bufgrp *grp, uint32_t bid,
+			     uint32_t nbufs)
+{
+	struct xnvme_async_ctx_liou *lctx = (void *)grp->ctx;
+	struct io_uring_sqe *sqe = NULL;
+	int err;
+
+	// NOTE: on the initial provide, check that the Kernel supports it
+	if (!grp->native) {
+		struct io_uring_probe *probe = io_uring_get_probe();
+		int supported;
+
+		supported = probe && io_uring_opcode_supported(probe,
+				IORING_OP_PROVIDE_BUFFERS);
+		free(probe);
+		if (!supported) {
+			XNVME_DEBUG("FAILED: no IORING_OP_PROVIDE_BUFFERS");
+			return -ENOSYS;
+		}
+	}
+
+	sqe = io_uring_get_sqe(&lctx->ring);
+	if (!sqe) {
+		return -EAGAIN;
+	}
+	io_uring_prep_provide_buffers(sqe, grp->bufs +
+				      (size_t)bid * grp->buf_nbytes,
+				      grp->buf_nbytes, nbufs, grp->bgid, bid);
+	sqe->user_data = XNVME_BE_LIOU_UDATA_INTERNAL;
+
+	err = io_uring_submit(&lctx->ring);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_liou_bufgrp_remove(struct xnvme_bufgrp *grp)
+{
+	struct xnvme_async_ctx_liou *lctx = (void *)grp->ctx;
+	struct io_uring_sqe *sqe = NULL;
+	int err;
+
+	sqe = io_uring_get_sqe(&lctx->ring);
+	if (!sqe) {
+		return -EAGAIN;
+	}
+	io_uring_prep_remove_buffers(sqe, grp->nbufs, grp->bgid);
+	sqe->user_data = XNVME_BE_LIOU_UDATA_INTERNAL;
+
+	err = io_uring_submit(&lctx->ring);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+		return err;
+	}
+
+	return 0;
 }
 
 void
@@ -379,6 +662,9 @@ xnvme_be_liou_state_init(struct xnvme_dev *dev)
 	if (xnvme_ident_opt_to_val(&dev->ident, "pseudo", &opt_val)) {
 		state->pseudo = opt_val == 1;
 	}
+	if (xnvme_ident_opt_to_val(&dev->ident, "poll_sync", &opt_val)) {
+		state->poll_sync = opt_val == 1;
+	}
 
 	// NOTE: Disabling IOPOLL, to avoid lock-up, until fixed
 	if (state->poll_io) {
@@ -389,6 +675,7 @@ xnvme_be_liou_state_init(struct xnvme_dev *dev)
 	XNVME_DEBUG("state->poll_io: %d", state->poll_io);
 	XNVME_DEBUG("state->poll_sq: %d", state->poll_sq);
 	XNVME_DEBUG("state->pseudo: %d", state->pseudo);
+	XNVME_DEBUG("state->poll_sync: %d", state->poll_sync);
 
 	return 0;
 }
@@ -513,6 +800,9 @@ struct xnvme_be xnvme_be_liou = {
 		.buf_realloc = xnvme_be_lioc_buf_realloc,
 		.buf_free = xnvme_be_liou_buf_free,
 
+		.bufgrp_provide = xnvme_be_liou_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_liou_bufgrp_remove,
+
 		.enumerate = xnvme_be_liou_enumerate,
 
 		.dev_from_ident = xnvme_be_liou_dev_from_ident,
@@ -528,6 +818,7 @@ struct xnvme_be xnvme_be_liou = {
 #else
 		.enabled = 0,
 #endif
+		.caps = XNVME_BE_CAP_LINK,
 		.schemes = g_schemes,
 		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
 	},
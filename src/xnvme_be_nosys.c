@@ -30,6 +30,22 @@ xnvme_be_nosys_dev_close(struct xnvme_dev *XNVME_UNUSED(dev))
 	return;
 }
 
+int
+xnvme_be_nosys_bufgrp_provide(struct xnvme_bufgrp *XNVME_UNUSED(grp),
+			      uint32_t XNVME_UNUSED(bid),
+			      uint32_t XNVME_UNUSED(nbufs))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_bufgrp_remove(struct xnvme_bufgrp *XNVME_UNUSED(grp))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
 int
 xnvme_be_nosys_async_init(struct xnvme_dev *XNVME_UNUSED(dev),
 			  struct xnvme_async_ctx **XNVME_UNUSED(ctx),
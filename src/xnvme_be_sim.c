@@ -0,0 +1,1332 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_SIM_NAME "sim"
+
+#ifdef XNVME_BE_SIM_ENABLED
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xnvme_async.h>
+#include <xnvme_be_sim.h>
+#include <xnvme_dev.h>
+
+/**
+ * Discrete-event simulated device
+ *
+ * A namespace served by a model of a device rather than by a device. Commands
+ * are timed on submission, from the state of the model, and complete when the
+ * virtual clock of the device reaches their completion time. The clock only
+ * moves by completing commands and time spent by the host is not accounted
+ * for, thus hours of device time are simulated in seconds, and, given the
+ * model and its seed, a run is reproducible.
+ *
+ * The LBAs are striped over a number of channels, each serving a command at a
+ * time. A read or write occupies the channel of its first LBA, from when it is
+ * submitted and the channel is idle, for a service time drawn from the
+ * distribution of the opcode plus a transfer time proportional to its size.
+ * A flush completes a service time after all channels are idle. Garbage-
+ * collection is modelled as a stall of a number of channels, round-robin,
+ * every time a given amount of data has been written.
+ *
+ * The model is either the built-in one, 'sim:default', or read from the file
+ * given as target, e.g. 'sim:/path/to/model.conf', consisting of lines of
+ * 'key = value', see g_sim_keys, where '#' starts a comment. Distributions
+ * are given as a name followed by its parameters, in nanoseconds:
+ *
+ *   const VAL | uniform MIN MAX | exp MEAN | normal MEAN SD |
+ *   lognormal MEDIAN SIGMA
+ *
+ * Data is discarded, and the payload of reads left as is, unless 'data=1' is
+ * given; it is then kept in memory, allocated on first write, or, when the
+ * model gives a 'data.file', in that file, and thus across opens.
+ */
+
+#define SIM_TWO_PI 6.283185307179586
+
+enum sim_dist_type {
+	SIM_DIST_CONST = 0x0,
+	SIM_DIST_UNIFORM = 0x1,
+	SIM_DIST_EXP = 0x2,
+	SIM_DIST_NORMAL = 0x3,
+	SIM_DIST_LOGNORMAL = 0x4,
+	SIM_DIST_NTYPES = 0x5,
+};
+
+static const struct {
+	const char *name;
+	int nparams;
+} g_sim_dists[] = {
+	[SIM_DIST_CONST] = { "const", 1 },
+	[SIM_DIST_UNIFORM] = { "uniform", 2 },
+	[SIM_DIST_EXP] = { "exp", 1 },
+	[SIM_DIST_NORMAL] = { "normal", 2 },
+	[SIM_DIST_LOGNORMAL] = { "lognormal", 2 },
+};
+
+struct sim_dist {
+	int type;		///< See enum sim_dist_type
+	double a;
+	double b;
+};
+
+struct sim_model {
+	uint64_t nlb;			///< Namespace size, in LBAs
+	uint32_t lba_nbytes;
+	uint32_t mdts_nbytes;
+	uint32_t nchan;			///< Number of channels
+	uint32_t stripe_nbytes;		///< Bytes per channel in turn
+	uint64_t seed;
+	uint32_t data;			///< Whether data is retained
+	char data_file[128];		///< Retain data in a file, not in memory
+
+	struct sim_dist read;
+	struct sim_dist write;
+	struct sim_dist flush;
+	uint64_t read_xfer;		///< Transfer time, in ns per KiB
+	uint64_t write_xfer;
+
+	uint64_t gc_interval;		///< Bytes written between stalls
+	struct sim_dist gc_stall;
+	uint32_t gc_nchan;		///< Channels stalled at a time
+};
+
+/**
+ * A device in the same ballpark as a datacenter TLC drive, with its write-
+ * cache enabled and without garbage-collection
+ */
+static const struct sim_model g_sim_model_def = {
+	.nlb = 1ULL << 28,
+	.lba_nbytes = 4096,
+	.mdts_nbytes = 128 * 1024,
+	.nchan = 8,
+	.stripe_nbytes = 64 * 1024,
+	.seed = 1,
+	.data = 0,
+
+	.read = { SIM_DIST_LOGNORMAL, 80000, 0.2 },
+	.write = { SIM_DIST_LOGNORMAL, 20000, 0.3 },
+	.flush = { SIM_DIST_CONST, 50000, 0 },
+	.read_xfer = 1000,
+	.write_xfer = 1000,
+
+	.gc_interval = 0,
+	.gc_stall = { SIM_DIST_UNIFORM, 1000000, 5000000 },
+	.gc_nchan = 1,
+};
+
+enum sim_key_type {
+	SIM_KEY_U32 = 0x0,
+	SIM_KEY_U64 = 0x1,
+	SIM_KEY_DIST = 0x2,
+	SIM_KEY_STR = 0x3,
+};
+
+static const struct {
+	const char *name;
+	int type;		///< See enum sim_key_type
+	size_t ofz;		///< Offset of the member in struct sim_model
+} g_sim_keys[] = {
+	{ "nlb", SIM_KEY_U64, offsetof(struct sim_model, nlb) },
+	{ "lba_nbytes", SIM_KEY_U32, offsetof(struct sim_model, lba_nbytes) },
+	{ "mdts_nbytes", SIM_KEY_U32, offsetof(struct sim_model, mdts_nbytes) },
+	{ "channels", SIM_KEY_U32, offsetof(struct sim_model, nchan) },
+	{
+		"stripe_nbytes", SIM_KEY_U32,
+		offsetof(struct sim_model, stripe_nbytes)
+	},
+	{ "seed", SIM_KEY_U64, offsetof(struct sim_model, seed) },
+	{ "data", SIM_KEY_U32, offsetof(struct sim_model, data) },
+	{ "data.file", SIM_KEY_STR, offsetof(struct sim_model, data_file) },
+	{ "read", SIM_KEY_DIST, offsetof(struct sim_model, read) },
+	{ "write", SIM_KEY_DIST, offsetof(struct sim_model, write) },
+	{ "flush", SIM_KEY_DIST, offsetof(struct sim_model, flush) },
+	{ "read.xfer", SIM_KEY_U64, offsetof(struct sim_model, read_xfer) },
+	{ "write.xfer", SIM_KEY_U64, offsetof(struct sim_model, write_xfer) },
+	{ "gc.interval", SIM_KEY_U64, offsetof(struct sim_model, gc_interval) },
+	{ "gc.stall", SIM_KEY_DIST, offsetof(struct sim_model, gc_stall) },
+	{ "gc.channels", SIM_KEY_U32, offsetof(struct sim_model, gc_nchan) },
+};
+
+struct sim_cmd {
+	struct xnvme_req *req;
+	uint64_t t;		///< Completion time
+	uint64_t seq;		///< Submission order, breaks ties in 't'
+};
+
+struct xnvme_sim {
+	struct sim_model model;
+
+	pthread_mutex_t lock;	///< Protects all of the below
+	uint64_t now;		///< The virtual clock, in nanoseconds
+	uint64_t seq;
+	uint64_t rng;		///< State of the xorshift64* generator
+	uint64_t *chan;		///< Time at which each channel is idle
+	uint64_t gc_nbytes;	///< Written since the previous stall
+	uint32_t gc_next;	///< First channel of the next stall
+	struct xnvme_sim_stats stats;
+
+	uint8_t **segs;		///< Retained data, allocated on write
+	uint64_t nsegs;
+	int fd;			///< Of 'data.file', -1 when not given
+};
+
+static inline uint64_t
+sim_max(uint64_t a, uint64_t b)
+{
+	return a > b ? a : b;
+}
+
+static inline uint64_t
+sim_min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline uint64_t
+sim_rand(struct xnvme_sim *sim)
+{
+	sim->rng ^= sim->rng >> 12;
+	sim->rng ^= sim->rng << 25;
+	sim->rng ^= sim->rng >> 27;
+
+	return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Uniform in the open interval (0, 1)
+ */
+static inline double
+sim_rand_unit(struct xnvme_sim *sim)
+{
+	return ((sim_rand(sim) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/**
+ * Standard normal, via Box-Muller
+ */
+static inline double
+sim_rand_normal(struct xnvme_sim *sim)
+{
+	double u1 = sim_rand_unit(sim);
+	double u2 = sim_rand_unit(sim);
+
+	return sqrt(-2.0 * log(u1)) * cos(SIM_TWO_PI * u2);
+}
+
+/**
+ * Draw a time from the given distribution, negative values are truncated
+ */
+static uint64_t
+sim_dist_sample(struct xnvme_sim *sim, const struct sim_dist *dist)
+{
+	double val = dist->a;
+
+	switch (dist->type) {
+	case SIM_DIST_CONST:
+		break;
+	case SIM_DIST_UNIFORM:
+		val = dist->a + (dist->b - dist->a) * sim_rand_unit(sim);
+		break;
+	case SIM_DIST_EXP:
+		val = -dist->a * log(sim_rand_unit(sim));
+		break;
+	case SIM_DIST_NORMAL:
+		val = dist->a + dist->b * sim_rand_normal(sim);
+		break;
+	case SIM_DIST_LOGNORMAL:
+		val = dist->a * exp(dist->b * sim_rand_normal(sim));
+		break;
+	}
+
+	return val > 0 ? (uint64_t)(val + 0.5) : 0;
+}
+
+static int
+sim_dist_parse(const char *val, struct sim_dist *dist)
+{
+	char name[16] = { 0 };
+	double a = 0, b = 0;
+	char extra;
+	int type, n;
+
+	n = sscanf(val, "%15s %lf %lf %c", name, &a, &b, &extra);
+	for (type = 0; type < SIM_DIST_NTYPES; ++type) {
+		if (!strcmp(name, g_sim_dists[type].name)) {
+			break;
+		}
+	}
+	if ((type == SIM_DIST_NTYPES) || (n != g_sim_dists[type].nparams + 1)) {
+		XNVME_DEBUG("FAILED: invalid distribution: '%s'", val);
+		return -EINVAL;
+	}
+	if ((!(a >= 0)) || (!(b >= 0)) ||
+	    ((type == SIM_DIST_UNIFORM) && (a > b)) ||
+	    ((type == SIM_DIST_EXP) && (!a)) ||
+	    ((type == SIM_DIST_LOGNORMAL) && (!a))) {
+		XNVME_DEBUG("FAILED: invalid parameters: '%s'", val);
+		return -EINVAL;
+	}
+
+	dist->type = type;
+	dist->a = a;
+	dist->b = b;
+
+	return 0;
+}
+
+static int
+sim_model_set(struct sim_model *model, const char *key, const char *val)
+{
+	for (size_t i = 0; i < sizeof g_sim_keys / sizeof(*g_sim_keys); ++i) {
+		void *member = (uint8_t *)model + g_sim_keys[i].ofz;
+		unsigned long long num;
+		char *end;
+
+		if (strcmp(key, g_sim_keys[i].name)) {
+			continue;
+		}
+		if (g_sim_keys[i].type == SIM_KEY_DIST) {
+			return sim_dist_parse(val, member);
+		}
+		if (g_sim_keys[i].type == SIM_KEY_STR) {
+			size_t len = strlen(val);
+
+			while (len && isspace((unsigned char)val[len - 1])) {
+				--len;
+			}
+			if ((!len) || (len >= sizeof(model->data_file))) {
+				XNVME_DEBUG("FAILED: invalid value: '%s'", val);
+				return -EINVAL;
+			}
+			memcpy(member, val, len);
+			((char *)member)[len] = '\0';
+
+			// A file to retain data in is of no use without retaining
+			model->data = 1;
+
+			return 0;
+		}
+
+		errno = 0;
+		num = strtoull(val, &end, 0);
+		while (isspace((unsigned char)*end)) {
+			++end;
+		}
+		if (errno || (end == val) || (*end) || (val[0] == '-') ||
+		    ((g_sim_keys[i].type == SIM_KEY_U32) &&
+		     (num > UINT32_MAX))) {
+			XNVME_DEBUG("FAILED: invalid value: '%s'", val);
+			return -EINVAL;
+		}
+
+		if (g_sim_keys[i].type == SIM_KEY_U32) {
+			*(uint32_t *)member = num;
+		} else {
+			*(uint64_t *)member = num;
+		}
+
+		return 0;
+	}
+
+	XNVME_DEBUG("FAILED: unknown key: '%s'", key);
+
+	return -EINVAL;
+}
+
+static int
+sim_model_parse(const char *path, struct sim_model *model)
+{
+	char line[256];
+	int lineno = 0;
+	int err = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		XNVME_DEBUG("FAILED: fopen(%s), errno: %d", path, errno);
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char key[32] = { 0 }, val[128] = { 0 };
+		char *comment = strchr(line, '#');
+
+		lineno += 1;
+		if (comment) {
+			*comment = '\0';
+		}
+		if (sscanf(line, " %c", key) != 1) {
+			continue;
+		}
+
+		if (sscanf(line, " %31[^= \t] = %127[^\n]", key, val) != 2) {
+			XNVME_DEBUG("FAILED: %s:%d, expected 'key = value'",
+				    path, lineno);
+			err = -EINVAL;
+			break;
+		}
+		err = sim_model_set(model, key, val);
+		if (err) {
+			XNVME_DEBUG("FAILED: %s:%d, sim_model_set()", path,
+				    lineno);
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	return err;
+}
+
+static int
+sim_model_check(const struct sim_model *model)
+{
+	if ((model->lba_nbytes < 512) || (model->lba_nbytes > 65536) ||
+	    (model->lba_nbytes & (model->lba_nbytes - 1))) {
+		XNVME_DEBUG("FAILED: lba_nbytes: %u", model->lba_nbytes);
+		return -EINVAL;
+	}
+	if ((model->mdts_nbytes < sim_max(4096, model->lba_nbytes)) ||
+	    (model->mdts_nbytes & (model->mdts_nbytes - 1))) {
+		XNVME_DEBUG("FAILED: mdts_nbytes: %u", model->mdts_nbytes);
+		return -EINVAL;
+	}
+	if ((!model->nlb) || (model->nlb > UINT64_MAX / model->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: nlb: %"PRIu64, model->nlb);
+		return -EINVAL;
+	}
+	if ((!model->nchan) || (model->nchan > XNVME_BE_SIM_NCHAN_MAX)) {
+		XNVME_DEBUG("FAILED: channels: %u", model->nchan);
+		return -EINVAL;
+	}
+	if ((!model->stripe_nbytes) ||
+	    (model->stripe_nbytes % model->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: stripe_nbytes: %u", model->stripe_nbytes);
+		return -EINVAL;
+	}
+	if ((!model->gc_nchan) || (model->gc_nchan > model->nchan)) {
+		XNVME_DEBUG("FAILED: gc.channels: %u", model->gc_nchan);
+		return -EINVAL;
+	}
+	if ((model->data > 1) || (model->data_file[0] && (!model->data))) {
+		XNVME_DEBUG("FAILED: data: %u, data.file: '%s'", model->data,
+			    model->data_file);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void
+sim_gc(struct xnvme_sim *sim, uint64_t nbytes)
+{
+	const struct sim_model *model = &sim->model;
+
+	if (!model->gc_interval) {
+		return;
+	}
+
+	sim->gc_nbytes += nbytes;
+	while (sim->gc_nbytes >= model->gc_interval) {
+		uint64_t stall = sim_dist_sample(sim, &model->gc_stall);
+
+		sim->gc_nbytes -= model->gc_interval;
+		for (uint32_t i = 0; i < model->gc_nchan; ++i) {
+			uint64_t *chan = &sim->chan[sim->gc_next];
+
+			*chan = sim_max(*chan, sim->now) + stall;
+			sim->gc_next = (sim->gc_next + 1) % model->nchan;
+		}
+		sim->stats.gc_nstalls += 1;
+		sim->stats.gc_stall += stall * model->gc_nchan;
+	}
+}
+
+/**
+ * Advance the state of the model by a command submitted now, returns its
+ * completion time
+ */
+static uint64_t
+sim_schedule(struct xnvme_sim *sim, uint8_t opcode, uint64_t slba,
+	     uint64_t nbytes)
+{
+	const struct sim_model *model = &sim->model;
+	uint64_t *chan, svc, done;
+
+	if (opcode == XNVME_SPEC_OPC_FLUSH) {
+		uint64_t idle = sim->now;
+
+		for (uint32_t i = 0; i < model->nchan; ++i) {
+			idle = sim_max(idle, sim->chan[i]);
+		}
+		sim->stats.nflushes += 1;
+
+		return idle + sim_dist_sample(sim, &model->flush);
+	}
+
+	chan = &sim->chan[(slba * model->lba_nbytes / model->stripe_nbytes) %
+			  model->nchan];
+
+	if (opcode == XNVME_SPEC_OPC_READ) {
+		svc = sim_dist_sample(sim, &model->read) +
+		      nbytes * model->read_xfer / 1024;
+		sim->stats.nreads += 1;
+		sim->stats.read_nbytes += nbytes;
+	} else {
+		svc = sim_dist_sample(sim, &model->write) +
+		      nbytes * model->write_xfer / 1024;
+		sim->stats.nwrites += 1;
+		sim->stats.write_nbytes += nbytes;
+	}
+	sim->stats.busy += svc;
+
+	done = sim_max(*chan, sim->now) + svc;
+	*chan = done;
+
+	if (opcode == XNVME_SPEC_OPC_WRITE) {
+		sim_gc(sim, nbytes);
+	}
+
+	return done;
+}
+
+/**
+ * Read or write the data file, reads beyond its end produce zeroes
+ */
+static int
+sim_data_rw_file(struct xnvme_sim *sim, uint8_t opcode, uint64_t ofz,
+		 uint64_t nbytes, uint8_t *dbuf)
+{
+	while (nbytes) {
+		ssize_t ret;
+
+		if (opcode == XNVME_SPEC_OPC_WRITE) {
+			ret = pwrite(sim->fd, dbuf, nbytes, ofz);
+		} else {
+			ret = pread(sim->fd, dbuf, nbytes, ofz);
+		}
+		if ((ret < 0) && (errno == EINTR)) {
+			continue;
+		}
+		if (ret < 0) {
+			XNVME_DEBUG("FAILED: pread/pwrite(), errno: %d", errno);
+			return -errno;
+		}
+		if (!ret) {
+			if (opcode == XNVME_SPEC_OPC_WRITE) {
+				return -EIO;
+			}
+			memset(dbuf, 0, nbytes);
+			break;
+		}
+
+		ofz += ret;
+		dbuf += ret;
+		nbytes -= ret;
+	}
+
+	return 0;
+}
+
+static int
+sim_data_rw(struct xnvme_sim *sim, uint8_t opcode, uint64_t slba,
+	    uint64_t nbytes, uint8_t *dbuf)
+{
+	uint64_t ofz = slba * sim->model.lba_nbytes;
+
+	if (sim->fd >= 0) {
+		return sim_data_rw_file(sim, opcode, ofz, nbytes, dbuf);
+	}
+
+	while (nbytes) {
+		uint8_t **seg = &sim->segs[ofz / XNVME_BE_SIM_SEG_NBYTES];
+		uint64_t seg_ofz = ofz % XNVME_BE_SIM_SEG_NBYTES;
+		uint64_t n = sim_min(nbytes, XNVME_BE_SIM_SEG_NBYTES - seg_ofz);
+
+		if ((!*seg) && (opcode == XNVME_SPEC_OPC_WRITE)) {
+			*seg = calloc(1, XNVME_BE_SIM_SEG_NBYTES);
+			if (!*seg) {
+				XNVME_DEBUG("FAILED: calloc(), errno: %d",
+					    errno);
+				return -ENOMEM;
+			}
+		}
+
+		if (opcode == XNVME_SPEC_OPC_WRITE) {
+			memcpy(*seg + seg_ofz, dbuf, n);
+		} else if (*seg) {
+			memcpy(dbuf, *seg + seg_ofz, n);
+		} else {
+			memset(dbuf, 0, n);
+		}
+
+		ofz += n;
+		dbuf += n;
+		nbytes -= n;
+	}
+
+	return 0;
+}
+
+static void
+sim_term(struct xnvme_sim *sim)
+{
+	if (!sim) {
+		return;
+	}
+
+	for (uint64_t i = 0; sim->segs && (i < sim->nsegs); ++i) {
+		free(sim->segs[i]);
+	}
+	free(sim->segs);
+	if (sim->fd >= 0) {
+		close(sim->fd);
+	}
+	free(sim->chan);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim);
+}
+
+/**
+ * Set the model key 'opt' from the option of the same name in 'ident', when
+ * given; the value is parsed in full, as in a model file
+ */
+static int
+sim_model_set_opt(struct sim_model *model, const struct xnvme_ident *ident,
+		  const char *opt)
+{
+	char key[32], val[32];
+	const char *ofz;
+	size_t len;
+
+	snprintf(key, sizeof(key), "%s=", opt);
+	ofz = strstr(ident->opts, key);
+	if (!ofz) {
+		return 0;
+	}
+	ofz += strlen(key);
+
+	len = strcspn(ofz, "?&");
+	if ((!len) || (len >= sizeof(val))) {
+		XNVME_DEBUG("FAILED: invalid value of option: '%s'", opt);
+		return -EINVAL;
+	}
+	memcpy(val, ofz, len);
+	val[len] = '\0';
+
+	return sim_model_set(model, opt, val);
+}
+
+static int
+sim_init(const struct xnvme_ident *ident, struct xnvme_sim **sim)
+{
+	struct sim_model model = g_sim_model_def;
+	int err;
+
+	if (strcmp(ident->trgt, XNVME_BE_SIM_MODEL_DEF)) {
+		err = sim_model_parse(ident->trgt, &model);
+		if (err) {
+			XNVME_DEBUG("FAILED: sim_model_parse(%s), err: %d",
+				    ident->trgt, err);
+			return err;
+		}
+	}
+	err = sim_model_set_opt(&model, ident, "data");
+	err = err ? err : sim_model_set_opt(&model, ident, "seed");
+	if (err) {
+		XNVME_DEBUG("FAILED: sim_model_set_opt(), err: %d", err);
+		return err;
+	}
+
+	err = sim_model_check(&model);
+	if (err) {
+		XNVME_DEBUG("FAILED: sim_model_check(), err: %d", err);
+		return err;
+	}
+
+	(*sim) = calloc(1, sizeof(**sim));
+	if (!(*sim)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*sim)->model = model;
+	(*sim)->fd = -1;
+	(*sim)->rng = model.seed ^ 0x9E3779B97F4A7C15ULL;
+	(*sim)->rng = (*sim)->rng ? (*sim)->rng : 1;
+	pthread_mutex_init(&(*sim)->lock, NULL);
+
+	(*sim)->chan = calloc(model.nchan, sizeof(*(*sim)->chan));
+	if (!(*sim)->chan) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		err = -ENOMEM;
+		goto failed;
+	}
+
+	if (model.data && model.data_file[0]) {
+		(*sim)->fd = open(model.data_file, O_RDWR | O_CREAT, 0644);
+		if ((*sim)->fd < 0) {
+			XNVME_DEBUG("FAILED: open(%s), errno: %d",
+				    model.data_file, errno);
+			err = -errno;
+			goto failed;
+		}
+	} else if (model.data) {
+		uint64_t nbytes = model.nlb * model.lba_nbytes;
+
+		(*sim)->nsegs = (nbytes + XNVME_BE_SIM_SEG_NBYTES - 1) /
+				XNVME_BE_SIM_SEG_NBYTES;
+		(*sim)->segs = calloc((*sim)->nsegs, sizeof(*(*sim)->segs));
+		if (!(*sim)->segs) {
+			XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+			err = -ENOMEM;
+			goto failed;
+		}
+	}
+
+	return 0;
+
+failed:
+	sim_term(*sim);
+	*sim = NULL;
+
+	return err;
+}
+
+static inline int
+sim_cmd_before(const struct sim_cmd *a, const struct sim_cmd *b)
+{
+	return (a->t < b->t) || ((a->t == b->t) && (a->seq < b->seq));
+}
+
+static void
+sim_heap_push(struct xnvme_async_ctx_sim *actx, const struct sim_cmd *cmd)
+{
+	struct sim_cmd *heap = actx->heap;
+	uint32_t i = actx->outstanding;
+
+	while (i) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (!sim_cmd_before(cmd, &heap[parent])) {
+			break;
+		}
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = *cmd;
+
+	actx->outstanding += 1;
+}
+
+static void
+sim_heap_pop(struct xnvme_async_ctx_sim *actx, struct sim_cmd *cmd)
+{
+	struct sim_cmd *heap = actx->heap;
+	struct sim_cmd last;
+	uint32_t i = 0;
+
+	*cmd = heap[0];
+
+	actx->outstanding -= 1;
+	last = heap[actx->outstanding];
+
+	for (;;) {
+		uint32_t child = 2 * i + 1;
+
+		if (child >= actx->outstanding) {
+			break;
+		}
+		if ((child + 1 < actx->outstanding) &&
+		    sim_cmd_before(&heap[child + 1], &heap[child])) {
+			child += 1;
+		}
+		if (!sim_cmd_before(&heap[child], &last)) {
+			break;
+		}
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+}
+
+/**
+ * Complete, in order, at most 'max' of the commands due by 'until'; the clock
+ * is at the completion time of a command when its callback is invoked
+ */
+static int
+sim_reap(struct xnvme_sim *sim, struct xnvme_async_ctx_sim *actx,
+	 uint64_t until, uint32_t max)
+{
+	uint32_t completed = 0;
+
+	while (actx->outstanding && (completed < max) &&
+	       (actx->heap[0].t <= until)) {
+		struct sim_cmd cmd;
+
+		sim_heap_pop(actx, &cmd);
+
+		pthread_mutex_lock(&sim->lock);
+		sim->now = sim_max(sim->now, cmd.t);
+		pthread_mutex_unlock(&sim->lock);
+
+		completed += 1;
+
+		cmd.req->async.cb(cmd.req, cmd.req->async.cb_arg);
+	}
+
+	return completed;
+}
+
+int
+xnvme_be_sim_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		      void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		      size_t XNVME_UNUSED(mbuf_nbytes), int opts,
+		      struct xnvme_req *req)
+{
+	struct xnvme_be_sim_state *state = (void *)dev->be.state;
+	struct xnvme_sim *sim = state->sim;
+	const struct sim_model *model = &sim->model;
+	struct xnvme_async_ctx_sim *actx = NULL;
+	struct sim_cmd scmd = { 0 };
+	uint64_t slba = cmd->lblk.slba;
+	uint64_t nlb = cmd->lblk.nlb + 1;
+	uint64_t nbytes = 0;
+	int err = 0;
+
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		actx = (void *)req->async.ctx;
+		if (actx->outstanding == actx->depth) {
+			return -EBUSY;
+		}
+	}
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		nbytes = nlb * model->lba_nbytes;
+		if (mbuf || (!dbuf) || (slba >= model->nlb) ||
+		    (nlb > model->nlb - slba) ||
+		    (nbytes > model->mdts_nbytes) || (dbuf_nbytes < nbytes)) {
+			XNVME_DEBUG("FAILED: invalid slba: 0x%"PRIx64", nlb: "
+				    "%"PRIu64, slba, nlb);
+			return -EINVAL;
+		}
+		break;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	if (model->data && nbytes) {
+		err = sim_data_rw(sim, cmd->common.opcode, slba, nbytes, dbuf);
+	}
+	if (!err) {
+		scmd.req = req;
+		scmd.t = sim_schedule(sim, cmd->common.opcode, slba, nbytes);
+		scmd.seq = sim->seq++;
+		if (!actx) {
+			sim->now = sim_max(sim->now, scmd.t);
+		}
+	}
+	pthread_mutex_unlock(&sim->lock);
+	if (err) {
+		XNVME_DEBUG("FAILED: sim_data_rw(), err: %d", err);
+		return err;
+	}
+
+	memset(&req->cpl, 0, sizeof(req->cpl));
+	if (actx) {
+		sim_heap_push(actx, &scmd);
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_sim_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes,
+			    void *XNVME_UNUSED(mbuf),
+			    size_t XNVME_UNUSED(mbuf_nbytes),
+			    int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		if ((!dbuf) || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			return -EINVAL;
+		}
+		memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_NS:
+			memcpy(dbuf, &dev->id.ns, sizeof(dev->id.ns));
+			break;
+		case XNVME_SPEC_IDFY_CTRLR:
+			memcpy(dbuf, &dev->id.ctrlr, sizeof(dev->id.ctrlr));
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: unsupported cns: 0x%x",
+				    cmd->idfy.cns);
+			return -ENOSYS;
+		}
+		memset(&req->cpl, 0, sizeof(req->cpl));
+		return 0;
+	}
+
+	XNVME_DEBUG("FAILED: unsupported opcode: 0x%x", cmd->common.opcode);
+
+	return -ENOSYS;
+}
+
+int
+xnvme_be_sim_async_init(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx **ctx, uint16_t depth,
+			int XNVME_UNUSED(flags))
+{
+	struct xnvme_async_ctx_sim *actx;
+
+	if (!depth) {
+		XNVME_DEBUG("FAILED: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	actx = (void *)(*ctx);
+	actx->depth = depth;
+
+	actx->heap = calloc(depth, sizeof(*actx->heap));
+	if (!actx->heap) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		free(*ctx);
+		*ctx = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_sim_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_sim *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	free(actx->heap);
+	free(ctx);
+
+	return 0;
+}
+
+/**
+ * Nothing happens on the device between completions, thus, when nothing is
+ * due, the clock is advanced to the next completion
+ */
+int
+xnvme_be_sim_async_poke(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			uint32_t max)
+{
+	struct xnvme_be_sim_state *state = (void *)dev->be.state;
+	struct xnvme_sim *sim = state->sim;
+	struct xnvme_async_ctx_sim *actx = (void *)ctx;
+	uint64_t until;
+
+	if (!actx->outstanding) {
+		return 0;
+	}
+	max = max ? max : actx->outstanding;
+
+	pthread_mutex_lock(&sim->lock);
+	until = sim_max(sim->now, actx->heap[0].t);
+	pthread_mutex_unlock(&sim->lock);
+
+	return sim_reap(sim, actx, until, max);
+}
+
+int
+xnvme_be_sim_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		acc += xnvme_be_sim_async_poke(dev, ctx, 0);
+	}
+
+	return acc;
+}
+
+void *
+xnvme_be_sim_buf_alloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+		       size_t nbytes, uint64_t *XNVME_UNUSED(phys))
+{
+	void *buf = NULL;
+	int err;
+
+	err = posix_memalign(&buf, 0x1000, nbytes);
+	if (err) {
+		errno = err;
+		return NULL;
+	}
+
+	return buf;
+}
+
+void *
+xnvme_be_sim_buf_realloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *buf, size_t nbytes,
+			 uint64_t *XNVME_UNUSED(phys))
+{
+	return realloc(buf, nbytes);
+}
+
+void
+xnvme_be_sim_buf_free(const struct xnvme_dev *XNVME_UNUSED(dev), void *buf)
+{
+	free(buf);
+}
+
+int
+xnvme_be_sim_buf_vtophys(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *XNVME_UNUSED(buf),
+			 uint64_t *XNVME_UNUSED(phys))
+{
+	return -ENOSYS;
+}
+
+/**
+ * Simulated devices are instantiated by uri, thus there is nothing to
+ * enumerate
+ */
+int
+xnvme_be_sim_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+		       const char *XNVME_UNUSED(sys_uri),
+		       int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void
+xnvme_be_sim_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_sim_state *state;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+
+	sim_term(state->sim);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+static void
+sim_idfy_str(void *dst, size_t len, const char *src)
+{
+	memset(dst, ' ', len);
+	memcpy(dst, src, sim_min(strlen(src), len));
+}
+
+/**
+ * The device is presented as a controller with a single namespace, with the
+ * one LBA format of the model
+ */
+static void
+xnvme_be_sim_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_sim_state *state = (void *)dev->be.state;
+	const struct sim_model *model = &state->sim->model;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	memset(&dev->id.ctrlr, 0, sizeof(dev->id.ctrlr));
+	sim_idfy_str(dev->id.ctrlr.sn, sizeof(dev->id.ctrlr.sn), "SIM0001");
+	sim_idfy_str(dev->id.ctrlr.mn, sizeof(dev->id.ctrlr.mn),
+		     "xNVMe simulated device");
+	sim_idfy_str(dev->id.ctrlr.fr, sizeof(dev->id.ctrlr.fr), "1.0");
+	dev->id.ctrlr.mdts = XNVME_ILOG2(model->mdts_nbytes) - 12;
+	dev->id.ctrlr.nn = 1;
+	dev->id.ctrlr.vwc.present = 1;
+
+	memset(&dev->id.ns, 0, sizeof(dev->id.ns));
+	dev->id.ns.nsze = model->nlb;
+	dev->id.ns.ncap = model->nlb;
+	dev->id.ns.nuse = model->nlb;
+	dev->id.ns.lbaf[0].ds = XNVME_ILOG2(model->lba_nbytes);
+
+	memset(&dev->idcss, 0, sizeof(dev->idcss));
+}
+
+int
+xnvme_be_sim_dev_from_ident(const struct xnvme_ident *ident,
+			    struct xnvme_dev **dev)
+{
+	struct xnvme_be_sim_state *state;
+	int err;
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_sim;
+	state = (void *)(*dev)->be.state;
+
+	err = sim_init(ident, &state->sim);
+	if (err) {
+		XNVME_DEBUG("FAILED: sim_init(), err: %d", err);
+		free(*dev);
+		return err;
+	}
+
+	xnvme_be_sim_dev_idfy(*dev);
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_sim_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+
+static struct xnvme_sim *
+sim_from_dev(struct xnvme_dev *dev)
+{
+	struct xnvme_be_sim_state *state = (void *)dev->be.state;
+
+	if ((!dev->be.attr.name) ||
+	    strcmp(dev->be.attr.name, XNVME_BE_SIM_NAME)) {
+		XNVME_DEBUG("FAILED: not a simulated device");
+		return NULL;
+	}
+
+	return state->sim;
+}
+
+int
+xnvme_sim_get_time(struct xnvme_dev *dev, uint64_t *now)
+{
+	struct xnvme_sim *sim = sim_from_dev(dev);
+
+	if (!(sim && now)) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	*now = sim->now;
+	pthread_mutex_unlock(&sim->lock);
+
+	return 0;
+}
+
+int
+xnvme_sim_run(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+	      uint64_t until)
+{
+	struct xnvme_sim *sim = sim_from_dev(dev);
+	int completed = 0;
+
+	if (!sim) {
+		return -EINVAL;
+	}
+
+	if (ctx) {
+		completed = sim_reap(sim, (void *)ctx, until, UINT32_MAX);
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	sim->now = sim_max(sim->now, until);
+	pthread_mutex_unlock(&sim->lock);
+
+	return completed;
+}
+
+int
+xnvme_sim_get_stats(struct xnvme_dev *dev, struct xnvme_sim_stats *stats)
+{
+	struct xnvme_sim *sim = sim_from_dev(dev);
+
+	if (!(sim && stats)) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&sim->lock);
+	*stats = sim->stats;
+	stats->now = sim->now;
+	pthread_mutex_unlock(&sim->lock);
+
+	return 0;
+}
+#else
+int
+xnvme_sim_get_time(struct xnvme_dev *XNVME_UNUSED(dev),
+		   uint64_t *XNVME_UNUSED(now))
+{
+	return -ENOSYS;
+}
+
+int
+xnvme_sim_run(struct xnvme_dev *XNVME_UNUSED(dev),
+	      struct xnvme_async_ctx *XNVME_UNUSED(ctx),
+	      uint64_t XNVME_UNUSED(until))
+{
+	return -ENOSYS;
+}
+
+int
+xnvme_sim_get_stats(struct xnvme_dev *XNVME_UNUSED(dev),
+		    struct xnvme_sim_stats *XNVME_UNUSED(stats))
+{
+	return -ENOSYS;
+}
+#endif
+
+static int
+xnvme_sim_stats_yaml(FILE *stream, const struct xnvme_sim_stats *stats,
+		     int indent, const char *sep, int head)
+{
+	int wrtn = 0;
+
+	if (head) {
+		wrtn += fprintf(stream, "%*sxnvme_sim_stats:", indent, "");
+		indent += 2;
+	}
+	if (!stats) {
+		wrtn += fprintf(stream, " ~");
+		return wrtn;
+	}
+	if (head) {
+		wrtn += fprintf(stream, "\n");
+	}
+
+	wrtn += fprintf(stream, "%*snow: %"PRIu64"%s", indent, "",
+			stats->now, sep);
+	wrtn += fprintf(stream, "%*snreads: %"PRIu64"%s", indent, "",
+			stats->nreads, sep);
+	wrtn += fprintf(stream, "%*snwrites: %"PRIu64"%s", indent, "",
+			stats->nwrites, sep);
+	wrtn += fprintf(stream, "%*snflushes: %"PRIu64"%s", indent, "",
+			stats->nflushes, sep);
+	wrtn += fprintf(stream, "%*sread_nbytes: %"PRIu64"%s", indent, "",
+			stats->read_nbytes, sep);
+	wrtn += fprintf(stream, "%*swrite_nbytes: %"PRIu64"%s", indent, "",
+			stats->write_nbytes, sep);
+	wrtn += fprintf(stream, "%*sbusy: %"PRIu64"%s", indent, "",
+			stats->busy, sep);
+	wrtn += fprintf(stream, "%*sgc_nstalls: %"PRIu64"%s", indent, "",
+			stats->gc_nstalls, sep);
+	wrtn += fprintf(stream, "%*sgc_stall: %"PRIu64"", indent, "",
+			stats->gc_stall);
+
+	return wrtn;
+}
+
+int
+xnvme_sim_stats_fpr(FILE *stream, const struct xnvme_sim_stats *stats,
+		    int opts)
+{
+	int wrtn = 0;
+
+	switch (opts) {
+	case XNVME_PR_TERSE:
+		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
+		return wrtn;
+
+	case XNVME_PR_DEF:
+	case XNVME_PR_YAML:
+		break;
+	}
+
+	wrtn += xnvme_sim_stats_yaml(stream, stats, 0, "\n", 1);
+	wrtn += fprintf(stream, "\n");
+
+	return wrtn;
+}
+
+int
+xnvme_sim_stats_pr(const struct xnvme_sim_stats *stats, int opts)
+{
+	return xnvme_sim_stats_fpr(stdout, stats, opts);
+}
+
+static const char *g_schemes[] = {
+	XNVME_BE_SIM_NAME,
+};
+
+struct xnvme_be xnvme_be_sim = {
+#ifdef XNVME_BE_SIM_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_sim_cmd_pass,
+		.cmd_pass_admin = xnvme_be_sim_cmd_pass_admin,
+
+		.async_init = xnvme_be_sim_async_init,
+		.async_term = xnvme_be_sim_async_term,
+		.async_poke = xnvme_be_sim_async_poke,
+		.async_wait = xnvme_be_sim_async_wait,
+
+		.buf_alloc = xnvme_be_sim_buf_alloc,
+		.buf_realloc = xnvme_be_sim_buf_realloc,
+		.buf_free = xnvme_be_sim_buf_free,
+		.buf_vtophys = xnvme_be_sim_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_sim_enumerate,
+
+		.dev_from_ident = xnvme_be_sim_dev_from_ident,
+		.dev_close = xnvme_be_sim_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_SIM_NAME,
+#ifdef XNVME_BE_SIM_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
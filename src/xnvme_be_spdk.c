@@ -419,6 +419,148 @@ submit_ioc(struct spdk_nvme_ctrlr *ctrlr, struct spdk_nvme_qpair *qpair,
 			cb_fn, cb_arg);
 }
 
+static void
+bounce_pool_term(struct xnvme_be_spdk_bounce_pool *pool)
+{
+	if (!pool) {
+		return;
+	}
+
+	spdk_dma_free(pool->bufs);
+	free(pool->slots);
+	free(pool->free);
+	free(pool);
+}
+
+static int
+bounce_pool_init(struct xnvme_be_spdk_bounce_pool **pool, uint32_t nslots,
+		 size_t buf_nbytes)
+{
+	if (!buf_nbytes) {
+		XNVME_DEBUG("FAILED: invalid buf_nbytes: %zu", buf_nbytes);
+		return -EINVAL;
+	}
+
+	(*pool) = calloc(1, sizeof(**pool));
+	if (!(*pool)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*pool)->nslots = nslots;
+	(*pool)->buf_nbytes = buf_nbytes;
+
+	(*pool)->bufs = spdk_dma_malloc(nslots * buf_nbytes,
+					XNVME_BE_SPDK_ALIGN, NULL);
+	(*pool)->slots = calloc(nslots, sizeof(*(*pool)->slots));
+	(*pool)->free = calloc(nslots, sizeof(*(*pool)->free));
+	if ((!(*pool)->bufs) || (!(*pool)->slots) || (!(*pool)->free)) {
+		XNVME_DEBUG("FAILED: allocating pool of nslots: %u", nslots);
+		bounce_pool_term(*pool);
+		*pool = NULL;
+		return -ENOMEM;
+	}
+
+	for (uint32_t i = 0; i < nslots; ++i) {
+		struct xnvme_be_spdk_bounce *slot = &(*pool)->slots[i];
+
+		slot->pool = *pool;
+		slot->buf = (*pool)->bufs + i * buf_nbytes;
+		(*pool)->free[(*pool)->nfree++] = slot;
+	}
+
+	return 0;
+}
+
+static void
+bounce_cb(void *cb_arg, const struct spdk_nvme_cpl *cpl)
+{
+	struct xnvme_be_spdk_bounce *slot = cb_arg;
+	struct xnvme_be_spdk_bounce_pool *pool = slot->pool;
+
+	if (slot->c2h && spdk_nvme_cpl_is_success(cpl)) {
+		memcpy(slot->ubuf, slot->buf, slot->nbytes);
+	}
+	pool->free[pool->nfree++] = slot;
+
+	slot->cb(slot->cb_arg, cpl);
+}
+
+/**
+ * Returns true when the given buffer cannot be used for DMA, that is, when it
+ * is not backed by memory registered with the SPDK environment
+ */
+static inline bool
+bounce_needed(void *buf, size_t nbytes)
+{
+	return (spdk_vtophys(buf, NULL) == SPDK_VTOPHYS_ERROR) ||
+	       (spdk_vtophys((uint8_t *)buf + nbytes - 1, NULL) ==
+		SPDK_VTOPHYS_ERROR);
+}
+
+/**
+ * Submits the given command as submit_ioc() does, however, when 'dbuf' is not
+ * DMA-able then the payload is staged via a slot of the given bounce-pool,
+ * allocating the pool on first use
+ *
+ * @return On success, 0 is returned. When all slots are in use -EBUSY is
+ * returned. On error, negative `errno` is returned.
+ */
+static inline int
+submit_ioc_bounce(struct xnvme_dev *dev, struct spdk_nvme_qpair *qpair,
+		  struct xnvme_be_spdk_bounce_pool **pool, uint32_t nslots,
+		  struct xnvme_spec_cmd *cmd, void *dbuf, uint32_t dbuf_nbytes,
+		  void *mbuf, spdk_nvme_cmd_cb cb_fn, void *cb_arg)
+{
+	struct xnvme_be_spdk_state *state = (void *)dev->be.state;
+	struct xnvme_be_spdk_bounce *slot;
+	int err;
+
+	if ((!dbuf) || (!dbuf_nbytes) || (!state->bounce_check) ||
+	    (!bounce_needed(dbuf, dbuf_nbytes))) {
+		return submit_ioc(state->ctrlr, qpair, cmd, dbuf, dbuf_nbytes,
+				  mbuf, cb_fn, cb_arg);
+	}
+
+	if (!(*pool)) {
+		err = bounce_pool_init(pool, nslots, dev->geo.mdts_nbytes);
+		if (err) {
+			XNVME_DEBUG("FAILED: bounce_pool_init(), err: %d", err);
+			return err;
+		}
+	}
+	if (dbuf_nbytes > (*pool)->buf_nbytes) {
+		XNVME_DEBUG("FAILED: dbuf_nbytes: %u > buf_nbytes: %zu",
+			    dbuf_nbytes, (*pool)->buf_nbytes);
+		return -EINVAL;
+	}
+	if (!(*pool)->nfree) {
+		return -EBUSY;
+	}
+
+	slot = (*pool)->free[--(*pool)->nfree];
+	slot->ubuf = dbuf;
+	slot->nbytes = dbuf_nbytes;
+	slot->c2h = cmd->common.opcode & 0x2;
+	slot->cb = cb_fn;
+	slot->cb_arg = cb_arg;
+
+	// Data-transfer direction is given by the two low bits of the opcode
+	if (cmd->common.opcode & 0x1) {
+		memcpy(slot->buf, dbuf, dbuf_nbytes);
+	}
+
+	err = submit_ioc(state->ctrlr, qpair, cmd, slot->buf, dbuf_nbytes,
+			 mbuf, bounce_cb, slot);
+	if (err) {
+		(*pool)->free[(*pool)->nfree++] = slot;
+		return err;
+	}
+
+	__atomic_fetch_add(&dev->nbounced, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
 int
 _spdk_nvme_transport_id_pr(const struct spdk_nvme_transport_id *trid)
 {
@@ -526,6 +668,13 @@ attach_cb(void *cb_ctx, const struct spdk_nvme_transport_id *XNVME_UNUSED(trid),
 
 	XNVME_DEBUG("INFO: nsid: %d", dev->nsid);
 
+	// Controller handle, IO is issued to any namespace given by cmd.nsid
+	if (!dev->nsid) {
+		state->ctrlr = ctrlr;
+		state->attached = 1;
+		return;
+	}
+
 	ns = spdk_nvme_ctrlr_get_ns(ctrlr, dev->nsid);
 	if (!ns) {
 		XNVME_DEBUG("FAILED: spdk_nvme_ctrlr_get_ns(0x%x)", dev->nsid);
@@ -552,6 +701,8 @@ xnvme_be_spdk_state_term(struct xnvme_be_spdk_state *state)
 	if (!state) {
 		return;
 	}
+	bounce_pool_term(state->bounce);
+	state->bounce = NULL;
 	if (state->qpair) {
 		spdk_nvme_ctrlr_free_io_qpair(state->qpair);
 		err = pthread_mutex_destroy(&state->qpair_lock);
@@ -806,7 +957,8 @@ xnvme_be_spdk_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
  * - Identify namespace-id	(setup: dev->nsid)
  * - Determine Command Set	(setup: dev->csi)
  *
- * TODO: fixup for XNVME_DEV_TYPE_NVME_CONTROLLER
+ * With 'nsid=0' the device is a controller handle, thus no namespace is
+ * identified
  */
 int
 xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
@@ -842,6 +994,13 @@ xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
 		err = -ENOMEM;
 		goto exit;
 	}
+	if (!dev->nsid) {
+		XNVME_DEBUG("INFO: nsid: 0, using controller handle");
+		memcpy(&dev->id.ctrlr, ctrlr_data, sizeof(dev->id.ctrlr));
+		dev->dtype = XNVME_DEV_TYPE_NVME_CONTROLLER;
+		err = 0;
+		goto exit;
+	}
 	ns_data = spdk_nvme_ns_get_data(state->ns);
 	if (!ns_data) {
 		XNVME_DEBUG("FAILED: spdk_nvme_ns_get_data()");
@@ -926,6 +1085,7 @@ int
 xnvme_be_spdk_state_init(struct xnvme_dev *dev)
 {
 	struct xnvme_be_spdk_state *state = (void *)dev->be.state;
+	const struct spdk_nvme_transport_id *ctrlr_trid;
 	uint32_t nsid;
 	uint32_t cmb_sqs = 0x0;
 	uint32_t css = 0x0;
@@ -967,7 +1127,10 @@ xnvme_be_spdk_state_init(struct xnvme_dev *dev)
 	}
 
 	state->ctrlr = _cref_lookup(&dev->ident);
-	if (state->ctrlr) {
+	if (state->ctrlr && (!dev->nsid)) {
+		state->attached = 1;
+		XNVME_DEBUG("INFO: re-using previously attached controller");
+	} else if (state->ctrlr) {
 		struct spdk_nvme_ns *ns;
 
 		ns = spdk_nvme_ctrlr_get_ns(state->ctrlr, dev->nsid);
@@ -1020,6 +1183,10 @@ probe:
 		}
 	}
 
+	// Only PCIe requires payloads in memory registered for DMA
+	ctrlr_trid = spdk_nvme_ctrlr_get_transport_id(state->ctrlr);
+	state->bounce_check = ctrlr_trid->trtype == SPDK_NVME_TRANSPORT_PCIE;
+
 	// Setup IO qpair lock for SYNC commands
 	err = pthread_mutex_init(&state->qpair_lock, NULL);
 	if (err) {
@@ -1152,6 +1319,8 @@ xnvme_be_spdk_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
 		return err;
 	}
 
+	bounce_pool_term(sctx->bounce);
+
 	free(ctx);
 
 	return err;
@@ -1283,8 +1452,9 @@ cmd_async_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 	       size_t dbuf_nbytes, void *mbuf, size_t XNVME_UNUSED(mbuf_nbytes),
 	       int XNVME_UNUSED(opts), struct xnvme_req *req)
 {
-	struct xnvme_be_spdk_state *state = (void *)dev->be.state;
 	struct xnvme_async_ctx_spdk *sctx = (void *)req->async.ctx;
+	const uint32_t nslots = XNVME_MIN(sctx->depth,
+					  XNVME_BE_SPDK_BOUNCE_NSLOTS);
 	int err;
 
 	// TODO: do something with mbuf?
@@ -1296,8 +1466,8 @@ cmd_async_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 	}
 
 	sctx->outstanding += 1;
-	err = submit_ioc(state->ctrlr, sctx->qpair, cmd, dbuf, dbuf_nbytes, mbuf,
-			 cmd_async_cb, req);
+	err = submit_ioc_bounce(dev, sctx->qpair, &sctx->bounce, nslots, cmd,
+				dbuf, dbuf_nbytes, mbuf, cmd_async_cb, req);
 	if (err) {
 		sctx->outstanding -= 1;
 		XNVME_DEBUG("FAILED: submission failed");
@@ -1329,9 +1499,14 @@ cmd_sync_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 		return -EINVAL;
 	}
 
+	// Wait for a bounce-slot to be released when they are all in use
 	pthread_mutex_lock(qpair_lock);
-	err = submit_ioc(state->ctrlr, qpair, cmd, dbuf, dbuf_nbytes,
-			 mbuf, cmd_sync_cb, req);
+	while ((err = submit_ioc_bounce(dev, qpair, &state->bounce,
+					XNVME_BE_SPDK_BOUNCE_NSLOTS, cmd, dbuf,
+					dbuf_nbytes, mbuf, cmd_sync_cb,
+					req)) == -EBUSY) {
+		spdk_nvme_qpair_process_completions(qpair, 0);
+	}
 	pthread_mutex_unlock(qpair_lock);
 	if (err) {
 		XNVME_DEBUG("FAILED: submit_ioc(), err: %d", err);
@@ -1366,6 +1541,10 @@ xnvme_be_spdk_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 			XNVME_DEBUG("FAILED: req: %p", (void *)req);
 			return -EINVAL;
 		}
+		if (opts & XNVME_CMD_LINK) {
+			XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+			return -ENOSYS;
+		}
 		return cmd_async_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf,
 				      mbuf_nbytes, cmd_opts, req);
 
@@ -1412,6 +1591,9 @@ struct xnvme_be xnvme_be_spdk = {
 		.buf_realloc = xnvme_be_spdk_buf_realloc,
 		.buf_free = xnvme_be_spdk_buf_free,
 
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
 		.enumerate = xnvme_be_spdk_enumerate,
 
 		.dev_from_ident = xnvme_be_spdk_dev_from_ident,
@@ -0,0 +1,2223 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#define XNVME_BE_TCP_NAME "tcp"
+
+#ifdef XNVME_BE_TCP_ENABLED
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <libznd.h>
+#include <xnvme_async.h>
+#include <xnvme_be_tcp.h>
+#include <xnvme_dev.h>
+
+/**
+ * NVMe/TCP initiator
+ *
+ * The controller is reached via an admin queue and any number of I/O queues,
+ * each on its own TCP connection, as defined by the NVMe/TCP transport
+ * specification. Synchronous commands are sent on a dedicated I/O queue,
+ * each asynchronous context connects queues of its own.
+ *
+ * Command payloads are sent with sendmsg() directly from the buffer given by
+ * the caller, and received with recv() directly into it; in-capsule when the
+ * controller accepts the size, otherwise in response to a R2T. Header and data
+ * digests are not negotiated.
+ */
+
+#define TCP_DISCOVERY_NQN "nqn.2014-08.org.nvmexpress.discovery"
+#define TCP_HOSTNQN_PATH "/etc/nvme/hostnqn"
+#define TCP_HOSTID_PATH "/etc/nvme/hostid"
+
+#define TCP_OPC_FABRICS 0x7F
+#define TCP_OPC_KEEP_ALIVE 0x18
+
+#define TCP_QID_MAX 256
+#define TCP_KATO_MS 30000	///< Keep-Alive Timeout, sent every third
+#define TCP_ADMIN_ICD_NBYTES 8192	///< In-capsule data on the admin queue
+
+#define TCP_REG_CAP 0x00
+#define TCP_REG_CC 0x14
+#define TCP_REG_CSTS 0x1C
+
+enum tcp_fctype {
+	TCP_FCTYPE_PROP_SET = 0x00,
+	TCP_FCTYPE_CONNECT = 0x01,
+	TCP_FCTYPE_PROP_GET = 0x04,
+};
+
+enum tcp_pdu_type {
+	TCP_PDU_ICREQ = 0x00,
+	TCP_PDU_ICRESP = 0x01,
+	TCP_PDU_H2C_TERM = 0x02,
+	TCP_PDU_C2H_TERM = 0x03,
+	TCP_PDU_CMD = 0x04,
+	TCP_PDU_RSP = 0x05,
+	TCP_PDU_H2C_DATA = 0x06,
+	TCP_PDU_C2H_DATA = 0x07,
+	TCP_PDU_R2T = 0x09,
+};
+
+#define TCP_PDU_FLAG_LAST 0x04
+#define TCP_PDU_FLAG_SUCCESS 0x08
+#define TCP_PDU_TERM_HLEN 24	///< H2C/C2HTermReq header, ch + fes + fei
+
+struct tcp_pdu_ch {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t hlen;		///< Header length
+	uint8_t pdo;		///< PDU data offset, zero when no data
+	uint32_t plen;		///< PDU length, header, padding, and data
+};
+
+/**
+ * Initialize Connection Request and Response
+ */
+struct tcp_pdu_ic {
+	struct tcp_pdu_ch ch;
+	uint16_t pfv;
+	uint8_t pda;		///< ICReq: HPDA, ICResp: CPDA
+	uint8_t dgst;
+	uint32_t maxdata;	///< ICReq: MAXR2T, ICResp: MAXH2CDATA
+	uint8_t rsvd[112];
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_pdu_ic) == 128, "Incorrect size")
+
+struct tcp_pdu_cmd {
+	struct tcp_pdu_ch ch;
+	struct xnvme_spec_cmd cmd;
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_pdu_cmd) == 72, "Incorrect size")
+
+struct tcp_pdu_rsp {
+	struct tcp_pdu_ch ch;
+	struct xnvme_spec_cpl cpl;
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_pdu_rsp) == 24, "Incorrect size")
+
+/**
+ * Layout shared by H2CData, C2HData, and R2T; 'ttag' is reserved in C2HData
+ */
+struct tcp_pdu_data {
+	struct tcp_pdu_ch ch;
+	uint16_t cccid;
+	uint16_t ttag;
+	uint32_t ofz;		///< DATAO / R2TO
+	uint32_t len;		///< DATAL / R2TL
+	uint32_t rsvd;
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_pdu_data) == 24, "Incorrect size")
+
+/**
+ * Fabrics Command Capsule, the SGL is located as for other commands
+ */
+struct tcp_cmd_fabrics {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t cid;
+	uint8_t fctype;
+	uint8_t rsvd1[19];
+	struct xnvme_spec_sgl_descriptor sgl;
+	union {
+		struct {
+			uint16_t recfmt;
+			uint16_t qid;
+			uint16_t sqsize;	///< Zero-based
+			uint8_t cattr;
+			uint8_t rsvd;
+			uint32_t kato;
+			uint8_t rsvd2[12];
+		} connect;
+		struct {
+			uint8_t attrib;		///< 0: 4 bytes, 1: 8 bytes
+			uint8_t rsvd[3];
+			uint32_t ofst;
+			uint64_t value;
+			uint8_t rsvd2[8];
+		} prop;
+	};
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_cmd_fabrics) == 64, "Incorrect size")
+
+struct tcp_connect_data {
+	uint8_t hostid[16];
+	uint16_t cntlid;
+	uint8_t rsvd1[238];
+	char subnqn[256];
+	char hostnqn[256];
+	uint8_t rsvd2[256];
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_connect_data) == 1024, "Incorrect size")
+
+struct tcp_disc_entry {
+	uint8_t trtype;
+	uint8_t adrfam;
+	uint8_t subtype;
+	uint8_t treq;
+	uint16_t portid;
+	uint16_t cntlid;
+	uint16_t asqsz;
+	uint8_t rsvd1[22];
+	char trsvcid[32];
+	uint8_t rsvd2[192];
+	char subnqn[256];
+	char traddr[256];
+	uint8_t tsas[256];
+};
+XNVME_STATIC_ASSERT(sizeof(struct tcp_disc_entry) == 1024, "Incorrect size")
+
+#define TCP_DISC_TRTYPE_TCP 3
+#define TCP_DISC_SUBTYPE_NVME 2
+#define TCP_DISC_NENTRIES_MAX 64
+
+enum tcp_slot_state {
+	TCP_SLOT_FREE = 0,
+	TCP_SLOT_INFLIGHT,
+	TCP_SLOT_DONE,
+};
+
+/**
+ * Command in flight on a queue, indexed by its command identifier
+ */
+struct tcp_slot {
+	enum tcp_slot_state state;
+	struct xnvme_req *req;
+	struct xnvme_spec_cpl cpl;
+
+	uint8_t *dbuf;
+	uint32_t dbuf_nbytes;
+	int h2c;		///< Data is transferred to the controller
+
+	uint16_t ttag;		///< Pending R2T
+	uint32_t r2to;
+	uint32_t r2tl;
+};
+
+enum tcp_rx_stage {
+	TCP_RX_CH = 0,		///< Common header
+	TCP_RX_HDR,		///< PDU specific header
+	TCP_RX_PAD,		///< Padding up to the data offset
+	TCP_RX_DATA,		///< Data, directly into the buffer of the command
+	TCP_RX_TRAIL,		///< Anything after the data
+};
+
+struct xnvme_tcp_qpair {
+	struct xnvme_tcp_ctrlr *ctrlr;
+	int fd;
+	uint16_t qid;
+	uint16_t depth;
+
+	uint32_t icd_nbytes;	///< Max. in-capsule data
+	uint32_t maxh2cdata;	///< Max. data of a H2CData PDU
+	uint32_t pda_nbytes;	///< Alignment of PDU data offset
+	int err;		///< Transport error, the queue is unusable
+
+	struct tcp_slot *slots;
+	uint16_t *free;		///< Stack of free command identifiers
+	uint32_t nfree;
+
+	uint16_t *cpls;		///< Ring of completed commands, for async.
+	uint32_t cpls_head;
+	uint32_t ncpls;
+	int async;
+
+	uint16_t *r2ts;		///< Ring of commands with a pending R2T
+	uint32_t r2ts_head;
+	uint32_t nr2ts;
+
+	struct {
+		enum tcp_rx_stage stage;
+		uint8_t hdr[128];
+		uint32_t nbytes;	///< Received in the current stage
+		uint32_t pad;
+		uint32_t dlen;
+		uint32_t trail;
+		uint8_t *dst;
+		struct tcp_slot *slot;
+	} rx;
+};
+
+struct xnvme_tcp_ctrlr {
+	char traddr[256];
+	char trsvcid[32];
+	char subnqn[256];
+	char hostnqn[256];
+	uint8_t hostid[16];
+	uint16_t cntlid;
+
+	uint32_t mqes;		///< Max. queue entries, NOT zero-based
+	uint32_t ioccsz_nbytes;	///< Max. in-capsule data on I/O queues
+	uint32_t nconn;		///< Queues per asynchronous context
+	uint32_t kato;
+
+	pthread_mutex_t lock;	///< Protects 'qids'
+	uint8_t qids[TCP_QID_MAX / 8];
+
+	struct xnvme_tcp_qpair *aq;
+	pthread_mutex_t aq_lock;
+	struct xnvme_tcp_qpair *sq;
+	pthread_mutex_t sq_lock;
+
+	pthread_t ka_thread;
+	pthread_cond_t ka_cond;
+	int ka_running;
+};
+
+static const uint8_t g_zeros[128];
+
+static inline uint32_t
+tcp_align(uint32_t val, uint32_t align)
+{
+	return ((val + align - 1) / align) * align;
+}
+
+static inline uint64_t
+tcp_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Copy the string value of option 'opt' in the ident-options into 'val'
+ */
+static bool
+tcp_ident_opt_to_str(const struct xnvme_ident *ident, const char *opt,
+		     char *val, size_t val_len)
+{
+	char key[32];
+	const char *ofz;
+	size_t len;
+
+	snprintf(key, sizeof(key), "%s=", opt);
+	ofz = strstr(ident->opts, key);
+	if (!ofz) {
+		return false;
+	}
+	ofz += strlen(key);
+
+	len = strcspn(ofz, "?&");
+	if ((!len) || (len >= val_len)) {
+		return false;
+	}
+	memcpy(val, ofz, len);
+	val[len] = '\0';
+
+	return true;
+}
+
+/**
+ * Copy a space or NUL padded string from a discovery log entry
+ */
+static void
+tcp_strtrim(char *dst, const char *src, size_t len)
+{
+	memcpy(dst, src, len);
+	dst[len - 1] = '\0';
+	for (len = strlen(dst); len && (dst[len - 1] == ' '); --len) {
+		dst[len - 1] = '\0';
+	}
+}
+
+static void
+tcp_slot_release(struct xnvme_tcp_qpair *qp, struct tcp_slot *slot)
+{
+	slot->state = TCP_SLOT_FREE;
+	slot->req = NULL;
+	qp->free[qp->nfree++] = slot - qp->slots;
+}
+
+static void
+tcp_slot_complete(struct xnvme_tcp_qpair *qp, struct tcp_slot *slot)
+{
+	slot->state = TCP_SLOT_DONE;
+	if (qp->async) {
+		qp->cpls[(qp->cpls_head + qp->ncpls) % qp->depth] =
+			slot - qp->slots;
+		qp->ncpls += 1;
+	}
+}
+
+static struct tcp_slot *
+tcp_slot_lookup(struct xnvme_tcp_qpair *qp, uint16_t cid)
+{
+	if ((cid >= qp->depth) || (qp->slots[cid].state != TCP_SLOT_INFLIGHT)) {
+		XNVME_DEBUG("FAILED: invalid cid: %u", cid);
+		return NULL;
+	}
+
+	return &qp->slots[cid];
+}
+
+/**
+ * Validate and act on a received PDU header; data is placed directly into the
+ * buffer of the command it belongs to
+ */
+static int
+tcp_rx_hdr(struct xnvme_tcp_qpair *qp)
+{
+	const struct tcp_pdu_ch *ch = (void *)qp->rx.hdr;
+	const struct tcp_pdu_data *data = (void *)qp->rx.hdr;
+	uint32_t dofz = ch->pdo ? ch->pdo : ch->hlen;
+	struct tcp_slot *slot;
+	size_t hlen = 0;
+
+	qp->rx.pad = 0;
+	qp->rx.dlen = 0;
+	qp->rx.slot = NULL;
+
+	switch (ch->type) {
+	case TCP_PDU_C2H_DATA:
+		hlen = sizeof(struct tcp_pdu_data);
+		slot = tcp_slot_lookup(qp, data->cccid);
+		if ((!slot) || slot->h2c || (!ch->pdo) || (ch->pdo < ch->hlen) ||
+		    (data->len > slot->dbuf_nbytes) ||
+		    (data->ofz > slot->dbuf_nbytes - data->len)) {
+			XNVME_DEBUG("FAILED: invalid C2HData");
+			return -EPROTO;
+		}
+		qp->rx.slot = slot;
+		qp->rx.pad = ch->pdo - ch->hlen;
+		qp->rx.dlen = data->len;
+		qp->rx.dst = slot->dbuf + data->ofz;
+		break;
+
+	case TCP_PDU_RSP:
+		hlen = sizeof(struct tcp_pdu_rsp);
+		dofz = ch->hlen;
+		break;
+	case TCP_PDU_R2T:
+		hlen = sizeof(struct tcp_pdu_data);
+		dofz = ch->hlen;
+		break;
+	case TCP_PDU_C2H_TERM:
+		hlen = TCP_PDU_TERM_HLEN;
+		dofz = ch->hlen;
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unexpected pdu-type: 0x%x", ch->type);
+		return -EPROTO;
+	}
+
+	// The header of each type is fixed-size; anything else is a framing error
+	if (ch->hlen != hlen) {
+		XNVME_DEBUG("FAILED: invalid hlen: %u, pdu-type: 0x%x",
+			    ch->hlen, ch->type);
+		return -EPROTO;
+	}
+
+	if (ch->plen < dofz + qp->rx.dlen) {
+		XNVME_DEBUG("FAILED: invalid plen: %u", ch->plen);
+		return -EPROTO;
+	}
+	qp->rx.trail = ch->plen - dofz - qp->rx.dlen;
+
+	return 0;
+}
+
+static int
+tcp_rx_pdu(struct xnvme_tcp_qpair *qp)
+{
+	const struct tcp_pdu_ch *ch = (void *)qp->rx.hdr;
+	const struct tcp_pdu_rsp *rsp = (void *)qp->rx.hdr;
+	const struct tcp_pdu_data *r2t = (void *)qp->rx.hdr;
+	struct tcp_slot *slot;
+
+	switch (ch->type) {
+	case TCP_PDU_RSP:
+		slot = tcp_slot_lookup(qp, rsp->cpl.cid);
+		if (!slot) {
+			return -EPROTO;
+		}
+		slot->cpl = rsp->cpl;
+		tcp_slot_complete(qp, slot);
+		break;
+
+	case TCP_PDU_C2H_DATA:
+		if (ch->flags & TCP_PDU_FLAG_SUCCESS) {
+			slot = qp->rx.slot;
+			memset(&slot->cpl, 0, sizeof(slot->cpl));
+			slot->cpl.cid = slot - qp->slots;
+			slot->cpl.sqid = qp->qid;
+			tcp_slot_complete(qp, slot);
+		}
+		break;
+
+	case TCP_PDU_R2T:
+		slot = tcp_slot_lookup(qp, r2t->cccid);
+		if ((!slot) || (!slot->h2c) || (!r2t->len) ||
+		    (r2t->len > slot->dbuf_nbytes) ||
+		    (r2t->ofz > slot->dbuf_nbytes - r2t->len)) {
+			XNVME_DEBUG("FAILED: invalid R2T");
+			return -EPROTO;
+		}
+		slot->ttag = r2t->ttag;
+		slot->r2to = r2t->ofz;
+		slot->r2tl = r2t->len;
+		qp->r2ts[(qp->r2ts_head + qp->nr2ts) % qp->depth] =
+			slot - qp->slots;
+		qp->nr2ts += 1;
+		break;
+
+	case TCP_PDU_C2H_TERM:
+		XNVME_DEBUG("FAILED: C2HTermReq, fes: 0x%x",
+			    qp->rx.hdr[8] | (qp->rx.hdr[9] << 8));
+		return -ECONNRESET;
+	}
+
+	return 0;
+}
+
+/**
+ * Receive whatever is available on the connection, without blocking
+ */
+static int
+tcp_rx(struct xnvme_tcp_qpair *qp)
+{
+	uint8_t scratch[512];
+
+	if (qp->err) {
+		return qp->err;
+	}
+
+	for (;;) {
+		const struct tcp_pdu_ch *ch = (void *)qp->rx.hdr;
+		uint8_t *dst = NULL;
+		size_t len = 0;
+		ssize_t res;
+		int err;
+
+		switch (qp->rx.stage) {
+		case TCP_RX_CH:
+			dst = qp->rx.hdr + qp->rx.nbytes;
+			len = sizeof(*ch) - qp->rx.nbytes;
+			break;
+		case TCP_RX_HDR:
+			dst = qp->rx.hdr + qp->rx.nbytes;
+			len = ch->hlen - qp->rx.nbytes;
+			break;
+		case TCP_RX_PAD:
+			dst = scratch;
+			len = XNVME_MIN(qp->rx.pad - qp->rx.nbytes, sizeof(scratch));
+			break;
+		case TCP_RX_DATA:
+			dst = qp->rx.dst + qp->rx.nbytes;
+			len = qp->rx.dlen - qp->rx.nbytes;
+			break;
+		case TCP_RX_TRAIL:
+			dst = scratch;
+			len = XNVME_MIN(qp->rx.trail - qp->rx.nbytes, sizeof(scratch));
+			break;
+		}
+
+		if (len) {
+			res = recv(qp->fd, dst, len, MSG_DONTWAIT);
+			if (!res) {
+				XNVME_DEBUG("FAILED: connection closed");
+				return qp->err = -ECONNRESET;
+			}
+			if ((res < 0) && (errno == EINTR)) {
+				continue;
+			}
+			if ((res < 0) && ((errno == EAGAIN) ||
+					  (errno == EWOULDBLOCK))) {
+				return 0;
+			}
+			if (res < 0) {
+				XNVME_DEBUG("FAILED: recv(), errno: %d", errno);
+				return qp->err = -errno;
+			}
+			qp->rx.nbytes += res;
+			if ((size_t)res < len) {
+				continue;
+			}
+		}
+
+		// The stage is complete, move to the next
+		qp->rx.nbytes = 0;
+		switch (qp->rx.stage) {
+		case TCP_RX_CH:
+			if ((ch->hlen < sizeof(*ch)) ||
+			    (ch->hlen > sizeof(qp->rx.hdr)) ||
+			    (ch->plen < ch->hlen)) {
+				XNVME_DEBUG("FAILED: invalid hlen: %u", ch->hlen);
+				return qp->err = -EPROTO;
+			}
+			qp->rx.nbytes = sizeof(*ch);
+			qp->rx.stage = TCP_RX_HDR;
+			break;
+
+		case TCP_RX_HDR:
+			err = tcp_rx_hdr(qp);
+			if (err) {
+				return qp->err = err;
+			}
+			qp->rx.stage = TCP_RX_PAD;
+			break;
+
+		case TCP_RX_PAD:
+			qp->rx.stage = TCP_RX_DATA;
+			break;
+
+		case TCP_RX_DATA:
+			qp->rx.stage = TCP_RX_TRAIL;
+			break;
+
+		case TCP_RX_TRAIL:
+			err = tcp_rx_pdu(qp);
+			if (err) {
+				return qp->err = err;
+			}
+			qp->rx.stage = TCP_RX_CH;
+			break;
+		}
+	}
+}
+
+/**
+ * Send the given vector in full; while the socket is full, then receive, as
+ * the controller might be blocked on sending to us
+ */
+static int
+tcp_tx(struct xnvme_tcp_qpair *qp, struct iovec *iov, int iovcnt)
+{
+	struct msghdr msg = { 0 };
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+
+	while (msg.msg_iovlen) {
+		struct pollfd pfd = { .fd = qp->fd, .events = POLLIN | POLLOUT };
+		ssize_t res;
+
+		res = sendmsg(qp->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if ((res < 0) && (errno == EINTR)) {
+			continue;
+		}
+		if ((res < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+			XNVME_DEBUG("FAILED: sendmsg(), errno: %d", errno);
+			return -errno;
+		}
+		if (res < 0) {
+			res = poll(&pfd, 1, XNVME_BE_TCP_TIMEOUT_MS);
+			if (!res) {
+				return -ETIMEDOUT;
+			}
+			if ((res > 0) && (pfd.revents & POLLIN)) {
+				int err = tcp_rx(qp);
+
+				if (err) {
+					return err;
+				}
+			}
+			continue;
+		}
+
+		while (msg.msg_iovlen && ((size_t)res >= msg.msg_iov->iov_len)) {
+			res -= msg.msg_iov->iov_len;
+			msg.msg_iov += 1;
+			msg.msg_iovlen -= 1;
+		}
+		if (msg.msg_iovlen) {
+			msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + res;
+			msg.msg_iov->iov_len -= res;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Send the data requested by the pending R2T of the given command
+ */
+static int
+tcp_tx_h2c(struct xnvme_tcp_qpair *qp, struct tcp_slot *slot)
+{
+	const uint32_t pdo = tcp_align(sizeof(struct tcp_pdu_data),
+				       qp->pda_nbytes);
+	const uint32_t end = slot->r2to + slot->r2tl;
+
+	for (uint32_t ofz = slot->r2to; ofz < end;) {
+		uint32_t len = XNVME_MIN(end - ofz, qp->maxh2cdata);
+		struct tcp_pdu_data pdu = { 0 };
+		struct iovec iov[3];
+		int iovcnt = 0;
+		int err;
+
+		pdu.ch.type = TCP_PDU_H2C_DATA;
+		pdu.ch.flags = (ofz + len == end) ? TCP_PDU_FLAG_LAST : 0;
+		pdu.ch.hlen = sizeof(pdu);
+		pdu.ch.pdo = pdo;
+		pdu.ch.plen = pdo + len;
+		pdu.cccid = slot - qp->slots;
+		pdu.ttag = slot->ttag;
+		pdu.ofz = ofz;
+		pdu.len = len;
+
+		iov[iovcnt].iov_base = &pdu;
+		iov[iovcnt++].iov_len = sizeof(pdu);
+		if (pdo > sizeof(pdu)) {
+			iov[iovcnt].iov_base = (void *)g_zeros;
+			iov[iovcnt++].iov_len = pdo - sizeof(pdu);
+		}
+		iov[iovcnt].iov_base = slot->dbuf + ofz;
+		iov[iovcnt++].iov_len = len;
+
+		err = tcp_tx(qp, iov, iovcnt);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_tx(), err: %d", err);
+			return err;
+		}
+
+		ofz += len;
+	}
+
+	return 0;
+}
+
+/**
+ * Receive what is available, and answer R2Ts
+ */
+static int
+tcp_qpair_progress(struct xnvme_tcp_qpair *qp)
+{
+	int err;
+
+	err = tcp_rx(qp);
+	if (err) {
+		return err;
+	}
+
+	while (qp->nr2ts) {
+		struct tcp_slot *slot = &qp->slots[qp->r2ts[qp->r2ts_head]];
+
+		qp->r2ts_head = (qp->r2ts_head + 1) % qp->depth;
+		qp->nr2ts -= 1;
+
+		if (slot->state != TCP_SLOT_INFLIGHT) {
+			continue;
+		}
+
+		err = tcp_tx_h2c(qp, slot);
+		if (err) {
+			return qp->err = err;
+		}
+	}
+
+	return 0;
+}
+
+static int
+tcp_qpair_poll(struct xnvme_tcp_qpair *qp, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = qp->fd, .events = POLLIN };
+	int res;
+
+	res = poll(&pfd, 1, timeout_ms);
+	if ((res < 0) && (errno != EINTR)) {
+		return -errno;
+	}
+	if (!res) {
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+/**
+ * The data direction is given by the two lower bits of the opcode, or of the
+ * fctype for Fabrics commands
+ */
+static inline int
+tcp_cmd_h2c(const struct xnvme_spec_cmd *cmd)
+{
+	const struct tcp_cmd_fabrics *fcmd = (const void *)cmd;
+
+	if (fcmd->opcode == TCP_OPC_FABRICS) {
+		return (fcmd->fctype & 0x3) == 0x1;
+	}
+
+	return (fcmd->opcode & 0x3) == 0x1;
+}
+
+static int
+tcp_qpair_submit(struct xnvme_tcp_qpair *qp, const struct xnvme_spec_cmd *cmd,
+		 void *dbuf, size_t dbuf_nbytes, struct xnvme_req *req,
+		 struct tcp_slot **slot_out)
+{
+	struct tcp_pdu_cmd pdu = { 0 };
+	struct xnvme_spec_sgl_descriptor *sgl = &pdu.cmd.common.dptr.sgl;
+	struct tcp_slot *slot;
+	struct iovec iov[3];
+	int iovcnt = 0;
+	uint16_t cid;
+	int icd;
+	int err;
+
+	if (qp->err) {
+		return qp->err;
+	}
+	if (!qp->nfree) {
+		return -EBUSY;
+	}
+	if (dbuf_nbytes > UINT32_MAX) {
+		XNVME_DEBUG("FAILED: dbuf_nbytes: %zu", dbuf_nbytes);
+		return -EINVAL;
+	}
+
+	cid = qp->free[--qp->nfree];
+	slot = &qp->slots[cid];
+	slot->state = TCP_SLOT_INFLIGHT;
+	slot->req = req;
+	slot->dbuf = dbuf;
+	slot->dbuf_nbytes = dbuf ? dbuf_nbytes : 0;
+	slot->h2c = tcp_cmd_h2c(cmd);
+
+	pdu.cmd = *cmd;
+	pdu.cmd.common.cid = cid;
+	pdu.cmd.common.psdt = 0x1;
+
+	icd = slot->h2c && slot->dbuf_nbytes &&
+	      (slot->dbuf_nbytes <= qp->icd_nbytes);
+
+	memset(sgl, 0, sizeof(*sgl));
+	sgl->unkeyed.len = slot->dbuf_nbytes;
+	if (icd) {
+		sgl->unkeyed.type = XNVME_SPEC_SGL_DESCR_TYPE_DATA_BLOCK;
+		sgl->unkeyed.subtype = XNVME_SPEC_SGL_DESCR_SUBTYPE_OFFSET;
+	} else {
+		sgl->unkeyed.type = 0x5;	// Transport Data Block
+		sgl->unkeyed.subtype = 0xA;	// Transport specific
+	}
+
+	pdu.ch.type = TCP_PDU_CMD;
+	pdu.ch.hlen = sizeof(pdu);
+	pdu.ch.pdo = icd ? tcp_align(sizeof(pdu), qp->pda_nbytes) : 0;
+	pdu.ch.plen = icd ? pdu.ch.pdo + slot->dbuf_nbytes : sizeof(pdu);
+
+	iov[iovcnt].iov_base = &pdu;
+	iov[iovcnt++].iov_len = sizeof(pdu);
+	if (icd && (pdu.ch.pdo > sizeof(pdu))) {
+		iov[iovcnt].iov_base = (void *)g_zeros;
+		iov[iovcnt++].iov_len = pdu.ch.pdo - sizeof(pdu);
+	}
+	if (icd) {
+		iov[iovcnt].iov_base = slot->dbuf;
+		iov[iovcnt++].iov_len = slot->dbuf_nbytes;
+	}
+
+	err = tcp_tx(qp, iov, iovcnt);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_tx(), err: %d", err);
+		// A partially sent capsule leaves the connection unusable
+		qp->err = err;
+		tcp_slot_release(qp, slot);
+		return err;
+	}
+
+	if (slot_out) {
+		*slot_out = slot;
+	}
+
+	return 0;
+}
+
+/**
+ * Submit the command and wait for its completion
+ */
+static int
+tcp_qpair_exec(struct xnvme_tcp_qpair *qp, const struct xnvme_spec_cmd *cmd,
+	       void *dbuf, size_t dbuf_nbytes, struct xnvme_spec_cpl *cpl)
+{
+	const uint64_t deadline = tcp_now_ms() + XNVME_BE_TCP_TIMEOUT_MS;
+	struct tcp_slot *slot = NULL;
+	int err;
+
+	err = tcp_qpair_submit(qp, cmd, dbuf, dbuf_nbytes, NULL, &slot);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_qpair_submit(), err: %d", err);
+		return err;
+	}
+
+	for (;;) {
+		uint64_t now;
+
+		err = tcp_qpair_progress(qp);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_qpair_progress(), err: %d", err);
+			return err;
+		}
+		if (slot->state == TCP_SLOT_DONE) {
+			break;
+		}
+
+		now = tcp_now_ms();
+		err = now < deadline ? tcp_qpair_poll(qp, deadline - now) :
+		      -ETIMEDOUT;
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_qpair_poll(), err: %d", err);
+			// The command is still owned by the controller
+			return qp->err = err;
+		}
+	}
+
+	if (cpl) {
+		*cpl = slot->cpl;
+	}
+	tcp_slot_release(qp, slot);
+
+	return 0;
+}
+
+static int
+tcp_prop_get(struct xnvme_tcp_qpair *qp, uint32_t ofst, int nbytes,
+	     uint64_t *val)
+{
+	struct tcp_cmd_fabrics cmd = { 0 };
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	cmd.opcode = TCP_OPC_FABRICS;
+	cmd.fctype = TCP_FCTYPE_PROP_GET;
+	cmd.prop.attrib = nbytes == 8 ? 1 : 0;
+	cmd.prop.ofst = ofst;
+
+	err = tcp_qpair_exec(qp, (void *)&cmd, NULL, 0, &cpl);
+	if (err || cpl.status.val) {
+		XNVME_DEBUG("FAILED: property get: 0x%x, err: %d", ofst, err);
+		return err ? err : -EIO;
+	}
+	*val = nbytes == 8 ? cpl.result : cpl.cdw0;
+
+	return 0;
+}
+
+static int
+tcp_prop_set(struct xnvme_tcp_qpair *qp, uint32_t ofst, uint32_t val)
+{
+	struct tcp_cmd_fabrics cmd = { 0 };
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	cmd.opcode = TCP_OPC_FABRICS;
+	cmd.fctype = TCP_FCTYPE_PROP_SET;
+	cmd.prop.ofst = ofst;
+	cmd.prop.value = val;
+
+	err = tcp_qpair_exec(qp, (void *)&cmd, NULL, 0, &cpl);
+	if (err || cpl.status.val) {
+		XNVME_DEBUG("FAILED: property set: 0x%x, err: %d", ofst, err);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+static void
+tcp_qpair_term(struct xnvme_tcp_qpair *qp)
+{
+	if (!qp) {
+		return;
+	}
+	if (qp->fd >= 0) {
+		close(qp->fd);
+	}
+	free(qp->slots);
+	free(qp->free);
+	free(qp->cpls);
+	free(qp->r2ts);
+	free(qp);
+}
+
+static int
+tcp_socket(const struct xnvme_tcp_ctrlr *ctrlr)
+{
+	struct addrinfo hints = { 0 }, *res = NULL, *ai;
+	int one = 1;
+	int err;
+	int fd = -1;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	err = getaddrinfo(ctrlr->traddr, ctrlr->trsvcid, &hints, &res);
+	if (err) {
+		XNVME_DEBUG("FAILED: getaddrinfo(%s:%s), err: %s",
+			    ctrlr->traddr, ctrlr->trsvcid, gai_strerror(err));
+		return -EHOSTUNREACH;
+	}
+
+	err = -ECONNREFUSED;
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) {
+			err = -errno;
+			continue;
+		}
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			err = 0;
+			break;
+		}
+		err = -errno;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0) {
+		XNVME_DEBUG("FAILED: connect(%s:%s), err: %d", ctrlr->traddr,
+			    ctrlr->trsvcid, err);
+		return err;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+/**
+ * Establish the connection of a queue: exchange ICReq/ICResp, then send the
+ * Fabrics Connect command
+ */
+static int
+tcp_qpair_init(struct xnvme_tcp_ctrlr *ctrlr, uint16_t qid, uint16_t depth,
+	       struct xnvme_tcp_qpair **qp)
+{
+	struct tcp_pdu_ic ic = { 0 };
+	struct tcp_cmd_fabrics cmd = { 0 };
+	struct tcp_connect_data *data = NULL;
+	struct xnvme_spec_cpl cpl = { 0 };
+	struct iovec iov;
+	int err;
+
+	(*qp) = calloc(1, sizeof(**qp));
+	if (!(*qp)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*qp)->ctrlr = ctrlr;
+	(*qp)->qid = qid;
+	(*qp)->depth = depth;
+	(*qp)->icd_nbytes = qid ? ctrlr->ioccsz_nbytes : TCP_ADMIN_ICD_NBYTES;
+	(*qp)->fd = -1;
+
+	(*qp)->slots = calloc(depth, sizeof(*(*qp)->slots));
+	(*qp)->free = calloc(depth, sizeof(*(*qp)->free));
+	(*qp)->cpls = calloc(depth, sizeof(*(*qp)->cpls));
+	(*qp)->r2ts = calloc(depth, sizeof(*(*qp)->r2ts));
+	if (!((*qp)->slots && (*qp)->free && (*qp)->cpls && (*qp)->r2ts)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+	for (uint16_t cid = depth; cid; --cid) {
+		(*qp)->free[(*qp)->nfree++] = cid - 1;
+	}
+
+	(*qp)->fd = tcp_socket(ctrlr);
+	if ((*qp)->fd < 0) {
+		err = (*qp)->fd;
+		XNVME_DEBUG("FAILED: tcp_socket(), err: %d", err);
+		goto failed;
+	}
+
+	ic.ch.type = TCP_PDU_ICREQ;
+	ic.ch.hlen = sizeof(ic);
+	ic.ch.plen = sizeof(ic);
+	iov.iov_base = &ic;
+	iov.iov_len = sizeof(ic);
+	err = tcp_tx(*qp, &iov, 1);
+	if (err) {
+		XNVME_DEBUG("FAILED: ICReq, err: %d", err);
+		goto failed;
+	}
+
+	for (size_t nbytes = 0; nbytes < sizeof(ic);) {
+		ssize_t res = recv((*qp)->fd, (uint8_t *)&ic + nbytes,
+				   sizeof(ic) - nbytes, 0);
+
+		if ((res < 0) && (errno == EINTR)) {
+			continue;
+		}
+		if (res <= 0) {
+			err = res ? -errno : -ECONNRESET;
+			XNVME_DEBUG("FAILED: ICResp, err: %d", err);
+			goto failed;
+		}
+		nbytes += res;
+	}
+	if ((ic.ch.type != TCP_PDU_ICRESP) || (ic.ch.plen != sizeof(ic)) ||
+	    ic.pfv || ic.dgst || (ic.maxdata < 4096)) {
+		XNVME_DEBUG("FAILED: invalid ICResp");
+		err = -EPROTO;
+		goto failed;
+	}
+	(*qp)->pda_nbytes = (ic.pda + 1) * 4;
+	(*qp)->maxh2cdata = ic.maxdata;
+
+	data = calloc(1, sizeof(*data));
+	if (!data) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+	memcpy(data->hostid, ctrlr->hostid, sizeof(data->hostid));
+	data->cntlid = qid ? ctrlr->cntlid : 0xFFFF;
+	snprintf(data->subnqn, sizeof(data->subnqn), "%s", ctrlr->subnqn);
+	snprintf(data->hostnqn, sizeof(data->hostnqn), "%s", ctrlr->hostnqn);
+
+	cmd.opcode = TCP_OPC_FABRICS;
+	cmd.fctype = TCP_FCTYPE_CONNECT;
+	cmd.connect.qid = qid;
+	cmd.connect.sqsize = depth - 1;
+	cmd.connect.kato = qid ? 0 : ctrlr->kato;
+
+	err = tcp_qpair_exec(*qp, (void *)&cmd, data, sizeof(*data), &cpl);
+	if (err || cpl.status.val) {
+		XNVME_DEBUG("FAILED: connect, qid: %u, err: %d, sc: 0x%x",
+			    qid, err, cpl.status.sc);
+		err = err ? err : -ECONNREFUSED;
+		goto failed;
+	}
+	if (!qid) {
+		ctrlr->cntlid = cpl.cdw0 & 0xFFFF;
+	}
+
+	free(data);
+
+	return 0;
+
+failed:
+	free(data);
+	tcp_qpair_term(*qp);
+	*qp = NULL;
+
+	return err;
+}
+
+static int
+tcp_qid_alloc(struct xnvme_tcp_ctrlr *ctrlr)
+{
+	int qid = -EBUSY;
+
+	pthread_mutex_lock(&ctrlr->lock);
+	for (int i = 1; i < TCP_QID_MAX; ++i) {
+		if (!(ctrlr->qids[i / 8] & (1 << (i % 8)))) {
+			ctrlr->qids[i / 8] |= 1 << (i % 8);
+			qid = i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ctrlr->lock);
+
+	return qid;
+}
+
+static void
+tcp_qid_free(struct xnvme_tcp_ctrlr *ctrlr, uint16_t qid)
+{
+	pthread_mutex_lock(&ctrlr->lock);
+	ctrlr->qids[qid / 8] &= ~(1 << (qid % 8));
+	pthread_mutex_unlock(&ctrlr->lock);
+}
+
+/**
+ * Connect an I/O queue, of at most CAP.MQES entries
+ */
+static int
+tcp_ioq_init(struct xnvme_tcp_ctrlr *ctrlr, uint32_t depth,
+	     struct xnvme_tcp_qpair **qp)
+{
+	int qid;
+	int err;
+
+	depth = XNVME_MAX(XNVME_MIN(depth, ctrlr->mqes), 2);
+
+	qid = tcp_qid_alloc(ctrlr);
+	if (qid < 0) {
+		XNVME_DEBUG("FAILED: tcp_qid_alloc(), err: %d", qid);
+		return qid;
+	}
+
+	err = tcp_qpair_init(ctrlr, qid, depth, qp);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_qpair_init(), err: %d", err);
+		tcp_qid_free(ctrlr, qid);
+		return err;
+	}
+
+	return 0;
+}
+
+static void
+tcp_ioq_term(struct xnvme_tcp_ctrlr *ctrlr, struct xnvme_tcp_qpair *qp)
+{
+	if (!qp) {
+		return;
+	}
+
+	tcp_qid_free(ctrlr, qp->qid);
+	tcp_qpair_term(qp);
+}
+
+/**
+ * Set CC.EN and wait for CSTS.RDY, bounded by CAP.TO
+ */
+static int
+tcp_ctrlr_enable(struct xnvme_tcp_ctrlr *ctrlr)
+{
+	uint64_t cap, csts = 0, deadline;
+	uint32_t cc;
+	int err;
+
+	err = tcp_prop_get(ctrlr->aq, TCP_REG_CAP, 8, &cap);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_prop_get(CAP), err: %d", err);
+		return err;
+	}
+	ctrlr->mqes = (cap & 0xFFFF) + 1;
+
+	cc = 0x1;			// EN
+	cc |= 6 << 16;			// IOSQES: 64 bytes
+	cc |= 4 << 20;			// IOCQES: 16 bytes
+	if (cap & (1ULL << 43)) {	// CAP.CSS: I/O Command Sets
+		cc |= 0x6 << 4;
+	}
+
+	err = tcp_prop_set(ctrlr->aq, TCP_REG_CC, cc);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_prop_set(CC), err: %d", err);
+		return err;
+	}
+
+	deadline = tcp_now_ms() + (((cap >> 24) & 0xFF) + 1) * 500;
+	while (!(csts & 0x1)) {
+		err = tcp_prop_get(ctrlr->aq, TCP_REG_CSTS, 4, &csts);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_prop_get(CSTS), err: %d", err);
+			return err;
+		}
+		if (csts & 0x2) {
+			XNVME_DEBUG("FAILED: CSTS.CFS");
+			return -EIO;
+		}
+		if (tcp_now_ms() > deadline) {
+			XNVME_DEBUG("FAILED: timeout waiting for CSTS.RDY");
+			return -ETIMEDOUT;
+		}
+		if (!(csts & 0x1)) {
+			usleep(1000);
+		}
+	}
+
+	return 0;
+}
+
+static int
+tcp_admin_exec(struct xnvme_tcp_ctrlr *ctrlr, const struct xnvme_spec_cmd *cmd,
+	       void *dbuf, size_t dbuf_nbytes, struct xnvme_spec_cpl *cpl)
+{
+	int err;
+
+	pthread_mutex_lock(&ctrlr->aq_lock);
+	err = tcp_qpair_exec(ctrlr->aq, cmd, dbuf, dbuf_nbytes, cpl);
+	pthread_mutex_unlock(&ctrlr->aq_lock);
+
+	return err;
+}
+
+static void *
+tcp_ka_main(void *arg)
+{
+	struct xnvme_tcp_ctrlr *ctrlr = arg;
+	struct xnvme_spec_cmd cmd = { 0 };
+
+	cmd.common.opcode = TCP_OPC_KEEP_ALIVE;
+
+	pthread_mutex_lock(&ctrlr->lock);
+	while (ctrlr->ka_running) {
+		struct timespec ts;
+		uint64_t ns;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ns = ts.tv_nsec + (ctrlr->kato / 3) * 1000000ULL;
+		ts.tv_sec += ns / 1000000000ULL;
+		ts.tv_nsec = ns % 1000000000ULL;
+
+		if (!pthread_cond_timedwait(&ctrlr->ka_cond, &ctrlr->lock,
+					    &ts)) {
+			continue;
+		}
+		pthread_mutex_unlock(&ctrlr->lock);
+
+		tcp_admin_exec(ctrlr, &cmd, NULL, 0, NULL);
+
+		pthread_mutex_lock(&ctrlr->lock);
+	}
+	pthread_mutex_unlock(&ctrlr->lock);
+
+	return NULL;
+}
+
+static void
+tcp_ctrlr_term(struct xnvme_tcp_ctrlr *ctrlr)
+{
+	if (!ctrlr) {
+		return;
+	}
+
+	if (ctrlr->ka_running) {
+		pthread_mutex_lock(&ctrlr->lock);
+		ctrlr->ka_running = 0;
+		pthread_cond_signal(&ctrlr->ka_cond);
+		pthread_mutex_unlock(&ctrlr->lock);
+		pthread_join(ctrlr->ka_thread, NULL);
+	}
+
+	tcp_ioq_term(ctrlr, ctrlr->sq);
+	tcp_qpair_term(ctrlr->aq);
+
+	pthread_cond_destroy(&ctrlr->ka_cond);
+	pthread_mutex_destroy(&ctrlr->sq_lock);
+	pthread_mutex_destroy(&ctrlr->aq_lock);
+	pthread_mutex_destroy(&ctrlr->lock);
+	free(ctrlr);
+}
+
+/**
+ * Host identity as configured for nvme-cli, or else one for this process
+ */
+static void
+tcp_host_ident(struct xnvme_tcp_ctrlr *ctrlr)
+{
+	char hostid[64] = { 0 };
+	FILE *fp;
+
+	fp = fopen(TCP_HOSTNQN_PATH, "r");
+	if (fp) {
+		if (!fgets(ctrlr->hostnqn, sizeof(ctrlr->hostnqn), fp)) {
+			ctrlr->hostnqn[0] = '\0';
+		}
+		ctrlr->hostnqn[strcspn(ctrlr->hostnqn, "\r\n")] = '\0';
+		fclose(fp);
+	}
+	fp = fopen(TCP_HOSTID_PATH, "r");
+	if (fp) {
+		unsigned int b[16];
+
+		if (fgets(hostid, sizeof(hostid), fp) &&
+		    (sscanf(hostid, "%2x%2x%2x%2x-%2x%2x-%2x%2x-%2x%2x-"
+			    "%2x%2x%2x%2x%2x%2x", &b[0], &b[1], &b[2], &b[3],
+			    &b[4], &b[5], &b[6], &b[7], &b[8], &b[9], &b[10],
+			    &b[11], &b[12], &b[13], &b[14], &b[15]) == 16)) {
+			for (int i = 0; i < 16; ++i) {
+				ctrlr->hostid[i] = b[i];
+			}
+		}
+		fclose(fp);
+	}
+
+	if (!ctrlr->hostid[0] && !ctrlr->hostid[15]) {
+		uint64_t seed = tcp_now_ms() ^ ((uint64_t)getpid() << 32);
+
+		for (int i = 0; i < 16; ++i) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			ctrlr->hostid[i] = seed >> 56;
+		}
+		ctrlr->hostid[6] = (ctrlr->hostid[6] & 0x0F) | 0x40;
+		ctrlr->hostid[8] = (ctrlr->hostid[8] & 0x3F) | 0x80;
+	}
+	if (!ctrlr->hostnqn[0]) {
+		const uint8_t *b = ctrlr->hostid;
+
+		snprintf(ctrlr->hostnqn, sizeof(ctrlr->hostnqn),
+			 "nqn.2014-08.org.nvmexpress:uuid:"
+			 "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+			 "%02x%02x%02x%02x%02x%02x", b[0], b[1], b[2], b[3],
+			 b[4], b[5], b[6], b[7], b[8], b[9], b[10], b[11],
+			 b[12], b[13], b[14], b[15]);
+	}
+}
+
+/**
+ * Parse "<traddr>:<trsvcid>", with IPv6 addresses in brackets
+ */
+static int
+tcp_trgt_parse(const char *trgt, struct xnvme_tcp_ctrlr *ctrlr)
+{
+	const char *sep;
+	size_t len;
+
+	if (trgt[0] == '[') {
+		sep = strchr(trgt, ']');
+		if (!sep) {
+			return -EINVAL;
+		}
+		len = sep - trgt - 1;
+		trgt += 1;
+		sep = sep[1] == ':' ? sep + 1 : NULL;
+	} else {
+		sep = strrchr(trgt, ':');
+		len = sep ? (size_t)(sep - trgt) : strlen(trgt);
+	}
+	if ((!len) || (len >= sizeof(ctrlr->traddr))) {
+		return -EINVAL;
+	}
+	memcpy(ctrlr->traddr, trgt, len);
+	ctrlr->traddr[len] = '\0';
+
+	snprintf(ctrlr->trsvcid, sizeof(ctrlr->trsvcid), "%s",
+		 (sep && sep[1]) ? sep + 1 : XNVME_BE_TCP_PORT);
+
+	return 0;
+}
+
+static int
+tcp_ctrlr_alloc(const struct xnvme_ident *ident,
+		struct xnvme_tcp_ctrlr **ctrlr)
+{
+	int err;
+
+	(*ctrlr) = calloc(1, sizeof(**ctrlr));
+	if (!(*ctrlr)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	pthread_mutex_init(&(*ctrlr)->lock, NULL);
+	pthread_mutex_init(&(*ctrlr)->aq_lock, NULL);
+	pthread_mutex_init(&(*ctrlr)->sq_lock, NULL);
+	pthread_cond_init(&(*ctrlr)->ka_cond, NULL);
+	(*ctrlr)->mqes = XNVME_BE_TCP_AQ_DEPTH;
+	(*ctrlr)->nconn = 1;
+
+	err = tcp_trgt_parse(ident->trgt, *ctrlr);
+	if (err) {
+		XNVME_DEBUG("FAILED: invalid trgt: '%s'", ident->trgt);
+		tcp_ctrlr_term(*ctrlr);
+		*ctrlr = NULL;
+		return err;
+	}
+	tcp_host_ident(*ctrlr);
+
+	return 0;
+}
+
+/**
+ * Connect the admin queue, enable the controller, and identify it
+ */
+static int
+tcp_ctrlr_admin_init(struct xnvme_tcp_ctrlr *ctrlr,
+		     struct xnvme_spec_idfy_ctrlr *idfy)
+{
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	err = tcp_qpair_init(ctrlr, 0, XNVME_BE_TCP_AQ_DEPTH, &ctrlr->aq);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_qpair_init(admin), err: %d", err);
+		return err;
+	}
+	pthread_mutex_lock(&ctrlr->lock);
+	ctrlr->qids[0] |= 0x1;
+	pthread_mutex_unlock(&ctrlr->lock);
+
+	err = tcp_ctrlr_enable(ctrlr);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_enable(), err: %d", err);
+		return err;
+	}
+
+	cmd.common.opcode = XNVME_SPEC_OPC_IDFY;
+	cmd.idfy.cns = XNVME_SPEC_IDFY_CTRLR;
+	err = tcp_admin_exec(ctrlr, &cmd, idfy, sizeof(*idfy), &cpl);
+	if (err || cpl.status.val) {
+		XNVME_DEBUG("FAILED: identify controller, err: %d", err);
+		return err ? err : -EIO;
+	}
+
+	// In-capsule data on I/O queues, beyond the 64 byte command
+	if (idfy->nvmf_specific.ioccsz > 4) {
+		ctrlr->ioccsz_nbytes = (idfy->nvmf_specific.ioccsz - 4) * 16;
+	}
+
+	return 0;
+}
+
+static int
+tcp_disc_log(struct xnvme_tcp_ctrlr *disc, uint8_t *log, size_t log_nbytes)
+{
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	cmd.common.opcode = XNVME_SPEC_OPC_LOG;
+	cmd.log.lid = 0x70;
+	cmd.log.numdl = ((log_nbytes / 4) - 1) & 0xFFFF;
+	cmd.log.numdu = ((log_nbytes / 4) - 1) >> 16;
+	err = tcp_admin_exec(disc, &cmd, log, log_nbytes, &cpl);
+	if (err || cpl.status.val) {
+		XNVME_DEBUG("FAILED: discovery log page, err: %d", err);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Retrieve the NVMe/TCP subsystems from the discovery controller at the
+ * address of the given controller, of the first TCP_DISC_NENTRIES_MAX records
+ * of its log, up to nentries_max of them; returns the number of entries
+ */
+static int
+tcp_discover(const struct xnvme_tcp_ctrlr *ctrlr,
+	     struct tcp_disc_entry *entries, int nentries_max)
+{
+	struct xnvme_tcp_ctrlr *disc = NULL;
+	struct xnvme_spec_idfy_ctrlr *idfy = NULL;
+	uint8_t *log = NULL;
+	size_t log_nbytes = (TCP_DISC_NENTRIES_MAX + 1) * sizeof(*entries);
+	uint64_t numrec;
+	int nentries = 0;
+	int err;
+
+	disc = calloc(1, sizeof(*disc));
+	idfy = calloc(1, sizeof(*idfy));
+	log = calloc(1, log_nbytes);
+	if (!(disc && idfy && log)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		free(disc);
+		goto exit;
+	}
+	memcpy(disc, ctrlr, sizeof(*disc));
+	disc->aq = NULL;
+	disc->sq = NULL;
+	disc->ka_running = 0;
+	disc->kato = 0;
+	pthread_mutex_init(&disc->lock, NULL);
+	pthread_mutex_init(&disc->aq_lock, NULL);
+	pthread_mutex_init(&disc->sq_lock, NULL);
+	pthread_cond_init(&disc->ka_cond, NULL);
+	snprintf(disc->subnqn, sizeof(disc->subnqn), "%s", TCP_DISCOVERY_NQN);
+
+	err = tcp_ctrlr_admin_init(disc, idfy);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_admin_init(), err: %d", err);
+		goto exit;
+	}
+
+	// The header gives the number of records, these are then fetched in
+	// full, as records of other kinds, e.g. the current discovery
+	// subsystem, can precede those of NVMe subsystems
+	err = tcp_disc_log(disc, log, sizeof(*entries));
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_disc_log(), err: %d", err);
+		goto exit;
+	}
+	memcpy(&numrec, log + 8, sizeof(numrec));
+	if (numrec > TCP_DISC_NENTRIES_MAX) {
+		numrec = TCP_DISC_NENTRIES_MAX;
+	}
+	if (!numrec) {
+		goto exit;
+	}
+
+	err = tcp_disc_log(disc, log, (numrec + 1) * sizeof(*entries));
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_disc_log(), err: %d", err);
+		goto exit;
+	}
+	for (uint64_t i = 0; (i < numrec) && (nentries < nentries_max); ++i) {
+		const struct tcp_disc_entry *entry = (void *)(log + 1024 * (i + 1));
+
+		if ((entry->trtype != TCP_DISC_TRTYPE_TCP) ||
+		    (entry->subtype != TCP_DISC_SUBTYPE_NVME)) {
+			continue;
+		}
+		entries[nentries++] = *entry;
+	}
+
+exit:
+	tcp_ctrlr_term(disc);
+	free(idfy);
+	free(log);
+
+	return err ? err : nentries;
+}
+
+/**
+ * Connect to the subsystem given by the 'subnqn' option, or else the first
+ * NVMe subsystem reported by the discovery controller
+ */
+static int
+tcp_ctrlr_init(const struct xnvme_ident *ident, struct xnvme_spec_idfy_ctrlr *idfy,
+	       struct xnvme_tcp_ctrlr **ctrlr)
+{
+	uint32_t nconn = 0;
+	int err;
+
+	err = tcp_ctrlr_alloc(ident, ctrlr);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_alloc(), err: %d", err);
+		return err;
+	}
+	if (xnvme_ident_opt_to_val(ident, "nconn", &nconn) && nconn) {
+		(*ctrlr)->nconn = XNVME_MIN(nconn, XNVME_BE_TCP_NCONN_MAX);
+	}
+
+	if (!tcp_ident_opt_to_str(ident, "subnqn", (*ctrlr)->subnqn,
+				  sizeof((*ctrlr)->subnqn))) {
+		struct tcp_disc_entry entry;
+
+		err = tcp_discover(*ctrlr, &entry, 1);
+		if (err < 1) {
+			XNVME_DEBUG("FAILED: tcp_discover(), err: %d", err);
+			err = err < 0 ? err : -ENXIO;
+			goto failed;
+		}
+		tcp_strtrim((*ctrlr)->subnqn, entry.subnqn,
+			    sizeof(entry.subnqn));
+	}
+
+	(*ctrlr)->kato = TCP_KATO_MS;
+	err = tcp_ctrlr_admin_init(*ctrlr, idfy);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_admin_init(), err: %d", err);
+		goto failed;
+	}
+
+	err = pthread_create(&(*ctrlr)->ka_thread, NULL, tcp_ka_main, *ctrlr);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+		err = -err;
+		goto failed;
+	}
+	(*ctrlr)->ka_running = 1;
+
+	err = tcp_ioq_init(*ctrlr, XNVME_BE_TCP_SQ_DEPTH, &(*ctrlr)->sq);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ioq_init(), err: %d", err);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	tcp_ctrlr_term(*ctrlr);
+	*ctrlr = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_tcp_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		      void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		      size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_be_tcp_state *state = (void *)dev->be.state;
+	struct xnvme_tcp_ctrlr *ctrlr = state->ctrlr;
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	if (mbuf || mbuf_nbytes) {
+		XNVME_DEBUG("FAILED: separate meta-data is not supported");
+		return -ENOSYS;
+	}
+	if (opts & XNVME_CMD_LINK) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_LINK is not supported");
+		return -ENOSYS;
+	}
+
+	if (opts & XNVME_CMD_ASYNC) {
+		struct xnvme_async_ctx_tcp *actx = (void *)req->async.ctx;
+		struct xnvme_tcp_qpair *qp = NULL;
+
+		if (actx->outstanding >= actx->depth) {
+			return -EBUSY;
+		}
+		for (uint32_t i = 0; i < actx->nqpairs; ++i) {
+			struct xnvme_tcp_qpair *cand = actx->qpairs[i];
+
+			if (cand->nfree && ((!qp) || (cand->nfree > qp->nfree))) {
+				qp = cand;
+			}
+		}
+		if (!qp) {
+			return -EBUSY;
+		}
+
+		err = tcp_qpair_submit(qp, cmd, dbuf, dbuf_nbytes, req, NULL);
+		if (err) {
+			return err;
+		}
+		actx->outstanding += 1;
+
+		return 0;
+	}
+
+	pthread_mutex_lock(&ctrlr->sq_lock);
+	err = tcp_qpair_exec(ctrlr->sq, cmd, dbuf, dbuf_nbytes, &cpl);
+	pthread_mutex_unlock(&ctrlr->sq_lock);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_qpair_exec(), err: %d", err);
+		return err;
+	}
+	if (req) {
+		req->cpl = cpl;
+	}
+
+	return cpl.status.val ? -EIO : 0;
+}
+
+int
+xnvme_be_tcp_cmd_pass_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			    size_t mbuf_nbytes, int XNVME_UNUSED(opts),
+			    struct xnvme_req *req)
+{
+	struct xnvme_be_tcp_state *state = (void *)dev->be.state;
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	if (mbuf || mbuf_nbytes) {
+		XNVME_DEBUG("FAILED: separate meta-data is not supported");
+		return -ENOSYS;
+	}
+
+	err = tcp_admin_exec(state->ctrlr, cmd, dbuf, dbuf_nbytes, &cpl);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_admin_exec(), err: %d", err);
+		return err;
+	}
+	if (req) {
+		req->cpl = cpl;
+	}
+
+	return cpl.status.val ? -EIO : 0;
+}
+
+int
+xnvme_be_tcp_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+			uint16_t depth, int XNVME_UNUSED(flags))
+{
+	struct xnvme_be_tcp_state *state = (void *)dev->be.state;
+	struct xnvme_tcp_ctrlr *ctrlr = state->ctrlr;
+	struct xnvme_async_ctx_tcp *actx;
+	uint32_t qp_depth;
+	int err;
+
+	if (!depth) {
+		XNVME_DEBUG("FAILED: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	(*ctx) = calloc(1, sizeof(**ctx));
+	if (!(*ctx)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	actx = (void *)(*ctx);
+	actx->depth = depth;
+
+	qp_depth = (depth + ctrlr->nconn - 1) / ctrlr->nconn;
+	for (uint32_t i = 0; (i < ctrlr->nconn) && (i < depth); ++i) {
+		err = tcp_ioq_init(ctrlr, qp_depth, &actx->qpairs[i]);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_ioq_init(), err: %d", err);
+			goto failed;
+		}
+		actx->qpairs[i]->async = 1;
+		actx->nqpairs += 1;
+	}
+
+	return 0;
+
+failed:
+	for (uint32_t i = 0; i < actx->nqpairs; ++i) {
+		tcp_ioq_term(ctrlr, actx->qpairs[i]);
+	}
+	free(*ctx);
+	*ctx = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_tcp_async_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_be_tcp_state *state = (void *)dev->be.state;
+	struct xnvme_async_ctx_tcp *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	for (uint32_t i = 0; i < actx->nqpairs; ++i) {
+		tcp_ioq_term(state->ctrlr, actx->qpairs[i]);
+	}
+	free(ctx);
+
+	return 0;
+}
+
+int
+xnvme_be_tcp_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_tcp *actx = (void *)ctx;
+	uint32_t completed = 0;
+
+	max = max ? max : actx->outstanding;
+
+	for (uint32_t i = 0; i < actx->nqpairs; ++i) {
+		struct xnvme_tcp_qpair *qp = actx->qpairs[i];
+		int err;
+
+		err = tcp_qpair_progress(qp);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_qpair_progress(), err: %d", err);
+			return err;
+		}
+
+		while (qp->ncpls && (completed < max)) {
+			struct tcp_slot *slot = &qp->slots[qp->cpls[qp->cpls_head]];
+			struct xnvme_req *req = slot->req;
+
+			qp->cpls_head = (qp->cpls_head + 1) % qp->depth;
+			qp->ncpls -= 1;
+
+			req->cpl = slot->cpl;
+			tcp_slot_release(qp, slot);
+			actx->outstanding -= 1;
+			completed += 1;
+
+			req->async.cb(req, req->async.cb_arg);
+		}
+	}
+
+	return completed;
+}
+
+int
+xnvme_be_tcp_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_tcp *actx = (void *)ctx;
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		struct pollfd pfds[XNVME_BE_TCP_NCONN_MAX];
+		int res;
+
+		res = xnvme_be_tcp_async_poke(dev, ctx, 0);
+		if (res < 0) {
+			XNVME_DEBUG("FAILED: xnvme_be_tcp_async_poke(), err: %d",
+				    res);
+			return res;
+		}
+		acc += res;
+		if (res || (!ctx->outstanding)) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < actx->nqpairs; ++i) {
+			pfds[i].fd = actx->qpairs[i]->fd;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+		res = poll(pfds, actx->nqpairs, XNVME_BE_TCP_TIMEOUT_MS);
+		if (!res) {
+			XNVME_DEBUG("FAILED: timeout, outstanding: %u",
+				    ctx->outstanding);
+			return -ETIMEDOUT;
+		}
+	}
+
+	return acc;
+}
+
+/**
+ * Payloads are sent and received by the kernel from wherever they are, thus
+ * page-aligned heap memory will do
+ */
+void *
+xnvme_be_tcp_buf_alloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+		       size_t nbytes, uint64_t *XNVME_UNUSED(phys))
+{
+	void *buf = NULL;
+	int err;
+
+	err = posix_memalign(&buf, 0x1000, nbytes);
+	if (err) {
+		errno = err;
+		return NULL;
+	}
+
+	return buf;
+}
+
+void *
+xnvme_be_tcp_buf_realloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *buf, size_t nbytes,
+			 uint64_t *XNVME_UNUSED(phys))
+{
+	return realloc(buf, nbytes);
+}
+
+void
+xnvme_be_tcp_buf_free(const struct xnvme_dev *XNVME_UNUSED(dev), void *buf)
+{
+	free(buf);
+}
+
+int
+xnvme_be_tcp_buf_vtophys(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *XNVME_UNUSED(buf),
+			 uint64_t *XNVME_UNUSED(phys))
+{
+	return -ENOSYS;
+}
+
+/**
+ * Enumerate the namespaces of the NVMe/TCP subsystems reported by the
+ * discovery controller at 'sys_uri', e.g. "tcp:10.9.8.1:4420"
+ */
+int
+xnvme_be_tcp_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
+		       int XNVME_UNUSED(opts))
+{
+	struct tcp_disc_entry *entries = NULL;
+	struct xnvme_spec_idfy_ctrlr *idfy = NULL;
+	uint32_t *nslist = NULL;
+	struct xnvme_tcp_ctrlr *disc = NULL;
+	struct xnvme_ident ident = { 0 };
+	int nentries;
+	int err;
+
+	if ((!sys_uri) || xnvme_ident_from_uri(sys_uri, &ident) ||
+	    strcmp(ident.schm, XNVME_BE_TCP_NAME)) {
+		return 0;
+	}
+
+	entries = calloc(TCP_DISC_NENTRIES_MAX, sizeof(*entries));
+	idfy = calloc(1, sizeof(*idfy));
+	nslist = calloc(1024, sizeof(*nslist));
+	if (!(entries && idfy && nslist)) {
+		err = -ENOMEM;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto exit;
+	}
+
+	err = tcp_ctrlr_alloc(&ident, &disc);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_alloc(), err: %d", err);
+		goto exit;
+	}
+	nentries = tcp_discover(disc, entries, TCP_DISC_NENTRIES_MAX);
+	tcp_ctrlr_term(disc);
+	if (nentries < 0) {
+		err = nentries;
+		XNVME_DEBUG("FAILED: tcp_discover(), err: %d", err);
+		goto exit;
+	}
+
+	for (int i = 0; i < nentries; ++i) {
+		struct xnvme_tcp_ctrlr *ctrlr = NULL;
+		struct xnvme_spec_cmd cmd = { 0 };
+		struct xnvme_spec_cpl cpl = { 0 };
+		char subnqn[256], traddr[256], trsvcid[32];
+
+		tcp_strtrim(subnqn, entries[i].subnqn, sizeof(subnqn));
+		tcp_strtrim(traddr, entries[i].traddr, sizeof(traddr));
+		tcp_strtrim(trsvcid, entries[i].trsvcid, sizeof(trsvcid));
+
+		err = tcp_ctrlr_alloc(&ident, &ctrlr);
+		if (err) {
+			XNVME_DEBUG("FAILED: tcp_ctrlr_alloc(), err: %d", err);
+			goto exit;
+		}
+		snprintf(ctrlr->subnqn, sizeof(ctrlr->subnqn), "%s", subnqn);
+		if (traddr[0] && trsvcid[0]) {
+			snprintf(ctrlr->traddr, sizeof(ctrlr->traddr), "%s", traddr);
+			snprintf(ctrlr->trsvcid, sizeof(ctrlr->trsvcid), "%s",
+				 trsvcid);
+		}
+
+		err = tcp_ctrlr_admin_init(ctrlr, idfy);
+		if (!err) {
+			memset(nslist, 0, 4096);
+			cmd.common.opcode = XNVME_SPEC_OPC_IDFY;
+			cmd.idfy.cns = XNVME_SPEC_IDFY_NSLIST;
+			err = tcp_admin_exec(ctrlr, &cmd, nslist, 4096, &cpl);
+			err = err ? err : (cpl.status.val ? -EIO : 0);
+		}
+		if (err) {
+			XNVME_DEBUG("SKIP: subnqn: %s, err: %d", subnqn, err);
+			tcp_ctrlr_term(ctrlr);
+			err = 0;
+			continue;
+		}
+
+		for (int j = 0; (j < 1024) && nslist[j]; ++j) {
+			struct xnvme_ident entry = { 0 };
+			char uri[XNVME_IDENT_URI_LEN] = { 0 };
+			int len;
+
+			// Options are single-digit values, see xnvme_ident_opt_to_val()
+			if (nslist[j] > 9) {
+				XNVME_DEBUG("SKIP: nsid: %u", nslist[j]);
+				continue;
+			}
+
+			len = snprintf(uri, sizeof(uri), "%s:%s%s%s:%s?nsid=%u&subnqn=%s",
+				       XNVME_BE_TCP_NAME,
+				       strchr(ctrlr->traddr, ':') ? "[" : "",
+				       ctrlr->traddr,
+				       strchr(ctrlr->traddr, ':') ? "]" : "",
+				       ctrlr->trsvcid, nslist[j], subnqn);
+			if ((len >= (int)sizeof(uri)) ||
+			    xnvme_ident_from_uri(uri, &entry) ||
+			    (strlen(entry.opts) >= XNVME_IDENT_OPTS_LEN - 1)) {
+				XNVME_DEBUG("SKIP: uri too long: %s", uri);
+				continue;
+			}
+			if (xnvme_enumeration_append(list, &entry)) {
+				XNVME_DEBUG("FAILED: xnvme_enumeration_append()");
+			}
+		}
+
+		tcp_ctrlr_term(ctrlr);
+	}
+
+exit:
+	free(entries);
+	free(idfy);
+	free(nslist);
+
+	return err;
+}
+
+void
+xnvme_be_tcp_dev_close(struct xnvme_dev *dev)
+{
+	struct xnvme_be_tcp_state *state;
+
+	if (!dev) {
+		return;
+	}
+	state = (void *)dev->be.state;
+
+	tcp_ctrlr_term(state->ctrlr);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * With 'nsid=0' the device is a controller handle, thus no namespace is
+ * identified
+ */
+static int
+xnvme_be_tcp_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_spec_idfy *idfy_ctrlr = NULL, *idfy_ns = NULL;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_NOCHECK;
+
+	if (!dev->nsid) {
+		XNVME_DEBUG("INFO: nsid: 0, using controller handle");
+		dev->dtype = XNVME_DEV_TYPE_NVME_CONTROLLER;
+		return 0;
+	}
+
+	idfy_ctrlr = xnvme_buf_alloc(dev, sizeof(*idfy_ctrlr), NULL);
+	idfy_ns = xnvme_buf_alloc(dev, sizeof(*idfy_ns), NULL);
+	if (!(idfy_ctrlr && idfy_ns)) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		err = -ENOMEM;
+		goto exit;
+	}
+
+	memset(idfy_ns, 0, sizeof(*idfy_ns));
+	err = xnvme_cmd_idfy_ns(dev, dev->nsid, idfy_ns, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify namespace, err: %d", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	memcpy(&dev->id.ns, idfy_ns, sizeof(*idfy_ns));
+
+	// Attempt to identify Zoned Namespace
+	{
+		struct znd_idfy_ns *zns = (void *)idfy_ns;
+
+		memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_idfy_ctrlr_csi(dev, XNVME_SPEC_CSI_ZONED,
+					       idfy_ctrlr, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("INFO: !id-ctrlr-zns");
+			goto not_zns;
+		}
+
+		memset(idfy_ns, 0, sizeof(*idfy_ns));
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_idfy_ns_csi(dev, dev->nsid,
+					    XNVME_SPEC_CSI_ZONED, idfy_ns,
+					    &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("INFO: !id-ns-zns");
+			goto not_zns;
+		}
+
+		if (!zns->lbafe[0].zsze) {
+			goto not_zns;
+		}
+
+		memcpy(&dev->idcss.ctrlr, idfy_ctrlr, sizeof(*idfy_ctrlr));
+		memcpy(&dev->idcss.ns, idfy_ns, sizeof(*idfy_ns));
+		dev->csi = XNVME_SPEC_CSI_ZONED;
+
+		XNVME_DEBUG("INFO: looks like csi(ZNS)");
+		err = 0;
+		goto exit;
+
+not_zns:
+		XNVME_DEBUG("INFO: failed idfy with csi(ZNS)");
+	}
+
+	// Attempt to identify LBLK Namespace
+	memset(idfy_ns, 0, sizeof(*idfy_ns));
+	memset(&req, 0, sizeof(req));
+	err = xnvme_cmd_idfy_ns_csi(dev, dev->nsid, XNVME_SPEC_CSI_LBLK,
+				    idfy_ns, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("INFO: failed determining Command Set");
+		err = 0;
+		goto exit;
+	}
+
+	XNVME_DEBUG("INFO: NS/CS looks like NVM");
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	memcpy(&dev->idcss.ns, idfy_ns, sizeof(*idfy_ns));
+
+exit:
+	xnvme_buf_free(dev, idfy_ctrlr);
+	xnvme_buf_free(dev, idfy_ns);
+
+	return err;
+}
+
+int
+xnvme_be_tcp_dev_from_ident(const struct xnvme_ident *ident,
+			    struct xnvme_dev **dev)
+{
+	struct xnvme_be_tcp_state *state;
+	uint32_t nsid;
+	int err;
+
+	if (!xnvme_ident_opt_to_val(ident, "nsid", &nsid)) {
+		XNVME_DEBUG("FAILED: !xnvme_ident_opt_to_val(opt:nsid)");
+		return -EINVAL;
+	}
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_tcp;
+	(*dev)->nsid = nsid;
+	state = (void *)(*dev)->be.state;
+
+	err = tcp_ctrlr_init(ident, &(*dev)->id.ctrlr, &state->ctrlr);
+	if (err) {
+		XNVME_DEBUG("FAILED: tcp_ctrlr_init(), err: %d", err);
+		free(*dev);
+		return err;
+	}
+
+	err = xnvme_be_tcp_dev_idfy(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_tcp_dev_idfy()");
+		xnvme_be_tcp_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_tcp_dev_close(*dev);
+		free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	XNVME_BE_TCP_NAME,
+};
+
+struct xnvme_be xnvme_be_tcp = {
+#ifdef XNVME_BE_TCP_ENABLED
+	.func = {
+		.cmd_pass = xnvme_be_tcp_cmd_pass,
+		.cmd_pass_admin = xnvme_be_tcp_cmd_pass_admin,
+
+		.async_init = xnvme_be_tcp_async_init,
+		.async_term = xnvme_be_tcp_async_term,
+		.async_poke = xnvme_be_tcp_async_poke,
+		.async_wait = xnvme_be_tcp_async_wait,
+
+		.buf_alloc = xnvme_be_tcp_buf_alloc,
+		.buf_realloc = xnvme_be_tcp_buf_realloc,
+		.buf_free = xnvme_be_tcp_buf_free,
+		.buf_vtophys = xnvme_be_tcp_buf_vtophys,
+
+		.bufgrp_provide = xnvme_be_nosys_bufgrp_provide,
+		.bufgrp_remove = xnvme_be_nosys_bufgrp_remove,
+
+		.enumerate = xnvme_be_tcp_enumerate,
+
+		.dev_from_ident = xnvme_be_tcp_dev_from_ident,
+		.dev_close = xnvme_be_tcp_dev_close,
+	},
+#else
+	.func = XNVME_BE_NOSYS_FUNC,
+#endif
+	.attr = {
+		.name = XNVME_BE_TCP_NAME,
+#ifdef XNVME_BE_TCP_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
@@ -0,0 +1,170 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_bufgrp.h>
+
+static uint16_t g_bgid;
+
+int
+xnvme_bufgrp_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		  uint32_t nbufs, uint32_t buf_nbytes,
+		  struct xnvme_bufgrp **grp)
+{
+	int err;
+
+	if (!(ctx && nbufs && buf_nbytes) || (nbufs > 0x10000)) {
+		XNVME_DEBUG("FAILED: invalid ctx, nbufs: %u or buf_nbytes: %u",
+			    nbufs, buf_nbytes);
+		return -EINVAL;
+	}
+
+	(*grp) = calloc(1, sizeof(**grp));
+	if (!(*grp)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*grp)->dev = dev;
+	(*grp)->ctx = ctx;
+	(*grp)->nbufs = nbufs;
+	(*grp)->buf_nbytes = buf_nbytes;
+	(*grp)->bgid = __atomic_fetch_add(&g_bgid, 1, __ATOMIC_RELAXED);
+
+	(*grp)->bufs = xnvme_buf_alloc(dev, (size_t)nbufs * buf_nbytes, NULL);
+	if (!(*grp)->bufs) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+		goto failed;
+	}
+
+	err = dev->be.func.bufgrp_provide(*grp, 0, nbufs);
+	switch (err) {
+	case 0:
+		(*grp)->native = 1;
+		return 0;
+
+	case -ENOSYS:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: bufgrp_provide(), err: %d", err);
+		goto failed;
+	}
+
+	// Without backend support, buffers are selected on submission
+	(*grp)->free = calloc(nbufs, sizeof(*(*grp)->free));
+	if (!(*grp)->free) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+	for (uint32_t bid = 0; bid < nbufs; ++bid) {
+		(*grp)->free[bid] = nbufs - 1 - bid;
+	}
+	(*grp)->nfree = nbufs;
+
+	return 0;
+
+failed:
+	xnvme_buf_free(dev, (*grp)->bufs);
+	free(*grp);
+	*grp = NULL;
+
+	return err;
+}
+
+int
+xnvme_bufgrp_term(struct xnvme_bufgrp *grp)
+{
+	int err = 0;
+
+	if (!grp) {
+		return 0;
+	}
+
+	if (grp->native) {
+		err = grp->dev->be.func.bufgrp_remove(grp);
+		if (err) {
+			XNVME_DEBUG("FAILED: bufgrp_remove(), err: %d", err);
+		}
+	}
+
+	xnvme_buf_free(grp->dev, grp->bufs);
+	free(grp->free);
+	free(grp);
+
+	return err;
+}
+
+int
+xnvme_bufgrp_read(struct xnvme_bufgrp *grp, uint32_t nsid, uint64_t slba,
+		  uint16_t nlb, struct xnvme_req *req)
+{
+	const size_t nbytes = (size_t)grp->dev->geo.lba_nbytes * (nlb + 1);
+	struct xnvme_spec_cmd cmd = { 0 };
+	uint32_t bid;
+	int err;
+
+	if (nbytes > grp->buf_nbytes) {
+		XNVME_DEBUG("FAILED: nbytes: %zu > buf_nbytes: %u", nbytes,
+			    grp->buf_nbytes);
+		return -EINVAL;
+	}
+
+	cmd.common.opcode = XNVME_SPEC_OPC_READ;
+	cmd.common.nsid = nsid;
+	cmd.lblk.slba = slba;
+	cmd.lblk.nlb = nlb;
+
+	req->async.ctx = grp->ctx;
+	req->async.dbuf = NULL;
+
+	if (grp->native) {
+		return xnvme_cmd_pass(grp->dev, &cmd, grp, nbytes, NULL, 0,
+				      XNVME_CMD_ASYNC | XNVME_CMD_BUFSEL, req);
+	}
+
+	if (!grp->nfree) {
+		return -EBUSY;
+	}
+	bid = grp->free[grp->nfree - 1];
+
+	req->async.dbuf = grp->bufs + (size_t)bid * grp->buf_nbytes;
+	err = xnvme_cmd_pass(grp->dev, &cmd, req->async.dbuf, nbytes, NULL, 0,
+			     XNVME_CMD_ASYNC, req);
+	if (err) {
+		req->async.dbuf = NULL;
+		return err;
+	}
+	grp->nfree -= 1;
+
+	return 0;
+}
+
+int
+xnvme_bufgrp_put(struct xnvme_bufgrp *grp, void *buf)
+{
+	size_t ofz = (uint8_t *)buf - grp->bufs;
+	uint32_t bid = ofz / grp->buf_nbytes;
+
+	if ((!buf) || ((uint8_t *)buf < grp->bufs) || (bid >= grp->nbufs) ||
+	    (ofz % grp->buf_nbytes)) {
+		XNVME_DEBUG("FAILED: buf: %p is not of the group", buf);
+		return -EINVAL;
+	}
+
+	if (grp->native) {
+		return grp->dev->be.func.bufgrp_provide(grp, bid, 1);
+	}
+
+	if (grp->nfree == grp->nbufs) {
+		XNVME_DEBUG("FAILED: all buffers of the group are free");
+		return -EINVAL;
+	}
+	grp->free[grp->nfree++] = bid;
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <errno.h>
+#include <string.h>
 #include <libxnvme.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
@@ -281,6 +282,12 @@ xnvme_cmd_read(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	// TODO: consider returning -EINVAL when mbuf is provided and namespace
 	// have extended-lba in effect
 
+	// A controller handle has no LBA size, the payload cannot be sized
+	if (!dev->geo.lba_nbytes) {
+		XNVME_DEBUG("FAILED: !dev->geo.lba_nbytes");
+		return -EINVAL;
+	}
+
 	cmd.common.opcode = XNVME_SPEC_OPC_READ;
 	cmd.common.nsid = nsid;
 	cmd.lblk.slba = slba;
@@ -290,6 +297,41 @@ xnvme_cmd_read(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 				     mbuf_nbytes, opts, ret);
 }
 
+int
+xnvme_cmd_prep_init(struct xnvme_cmd_prep *prep, struct xnvme_dev *dev,
+		    uint8_t opcode, uint32_t nsid, int opts)
+{
+	if (!dev->geo.lba_nbytes) {
+		XNVME_DEBUG("FAILED: !dev->geo.lba_nbytes");
+		return -EINVAL;
+	}
+
+	memset(prep, 0, sizeof(*prep));
+	prep->cmd.common.opcode = opcode;
+	prep->cmd.common.nsid = nsid;
+	prep->dev = dev;
+	prep->lba_nbytes = dev->geo.lba_nbytes;
+	prep->oob_nbytes = dev->geo.nbytes_oob;
+	prep->opts = opts;
+
+	return 0;
+}
+
+int
+xnvme_cmd_prep_pass(struct xnvme_cmd_prep *prep, uint64_t slba, uint16_t nlb,
+		    void *dbuf, void *mbuf, struct xnvme_req *req)
+{
+	size_t dbuf_nbytes = dbuf ? (size_t)prep->lba_nbytes * (nlb + 1) : 0;
+	size_t mbuf_nbytes = mbuf ? (size_t)prep->oob_nbytes * (nlb + 1) : 0;
+
+	prep->cmd.lblk.slba = slba;
+	prep->cmd.lblk.nlb = nlb;
+
+	return prep->dev->be.func.cmd_pass(prep->dev, &prep->cmd, dbuf,
+					   dbuf_nbytes, mbuf, mbuf_nbytes,
+					   prep->opts, req);
+}
+
 int
 xnvme_cmd_write(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 		uint16_t nlb, const void *dbuf, const void *mbuf, int opts,
@@ -305,6 +347,12 @@ xnvme_cmd_write(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	// TODO: consider returning -EINVAL when mbuf is provided and namespace
 	// have extended-lba in effect
 
+	// A controller handle has no LBA size, the payload cannot be sized
+	if (!dev->geo.lba_nbytes) {
+		XNVME_DEBUG("FAILED: !dev->geo.lba_nbytes");
+		return -EINVAL;
+	}
+
 	cmd.common.opcode = XNVME_SPEC_OPC_WRITE;
 	cmd.common.nsid = nsid;
 	cmd.lblk.slba = slba;
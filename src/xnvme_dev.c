@@ -140,6 +140,65 @@ xnvme_dev_get_ssw(const struct xnvme_dev *dev)
 	return dev->ssw;
 }
 
+int
+xnvme_dev_get_nslist(struct xnvme_dev *dev, uint32_t *nsids, uint32_t nnsids)
+{
+	struct xnvme_spec_idfy *idfy = NULL;
+	uint32_t start = 0;
+	int count = 0;
+	int err;
+
+	idfy = xnvme_buf_alloc(dev, sizeof(*idfy), NULL);
+	if (!idfy) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		return -errno;
+	}
+
+	// The list holds nsids greater than cmd.nsid, thus page through it
+	for (;;) {
+		struct xnvme_spec_cmd cmd = { 0 };
+		struct xnvme_req req = { 0 };
+		uint32_t i;
+
+		cmd.common.opcode = XNVME_SPEC_OPC_IDFY;
+		cmd.common.nsid = start;
+		cmd.idfy.cns = XNVME_SPEC_IDFY_NSLIST;
+
+		memset(idfy, 0, sizeof(*idfy));
+		err = xnvme_cmd_pass_admin(dev, &cmd, idfy, sizeof(*idfy), NULL,
+					   0x0, 0x0, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: identify nslist, err: %d", err);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+
+		for (i = 0; (i < 1024) && idfy->nslist.nsid[i]; ++i) {
+			if ((uint32_t)count < nnsids) {
+				nsids[count] = idfy->nslist.nsid[i];
+			}
+			start = idfy->nslist.nsid[i];
+			count += 1;
+		}
+		if (i < 1024) {
+			break;
+		}
+	}
+
+	err = count;
+
+exit:
+	xnvme_buf_free(dev, idfy);
+
+	return err;
+}
+
+uint64_t
+xnvme_dev_get_nbounced(const struct xnvme_dev *dev)
+{
+	return __atomic_load_n(&dev->nbounced, __ATOMIC_RELAXED);
+}
+
 const void *
 xnvme_dev_get_be_state(const struct xnvme_dev *dev)
 {
@@ -150,6 +209,7 @@ struct xnvme_dev *
 xnvme_dev_openf(const char *dev_uri, int cmd_opts)
 {
 	struct xnvme_dev *dev = NULL;
+	uint32_t gcommit = 0;
 	int err;
 
 	err = xnvme_be_factory(dev_uri, &dev);
@@ -174,6 +234,18 @@ xnvme_dev_openf(const char *dev_uri, int cmd_opts)
 		dev->cmd_opts |= XNVME_CMD_DEF_UPLD;
 	}
 
+	if (xnvme_ident_opt_to_val(&dev->ident, "gcommit", &gcommit) &&
+	    gcommit) {
+		err = xnvme_gcommit_init(dev, XNVME_GCOMMIT_DEPTH);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_gcommit_init(), err: %d",
+				    err);
+			xnvme_dev_close(dev);
+			errno = -err;
+			return NULL;
+		}
+	}
+
 	return dev;
 }
 
@@ -190,6 +262,7 @@ xnvme_dev_close(struct xnvme_dev *dev)
 		return;
 	}
 
+	xnvme_gcommit_term(dev);
 	dev->be.func.dev_close(dev);
 	free(dev);
 }
@@ -0,0 +1,291 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <libxnvme.h>
+#include <xnvme_dev.h>
+
+/**
+ * A synchronous caller, registered with the group for the duration of its
+ * command, waiting on its own condition-variable for the completion
+ */
+struct gcommit_waiter {
+	struct xnvme_gcommit *gc;
+	struct xnvme_spec_cmd cmd;
+	void *dbuf;
+	size_t dbuf_nbytes;
+	void *mbuf;
+	size_t mbuf_nbytes;
+	int opts;
+	struct xnvme_req *req;
+
+	int submitted;
+	int done;
+	int err;
+	pthread_cond_t cond;
+
+	struct gcommit_waiter *prev;
+	struct gcommit_waiter *next;
+};
+
+/**
+ * Synchronous commands are funnelled into a shared asynchronous context by
+ * flat-combining: one of the waiting callers acts as combiner, submitting the
+ * commands of all registered callers as a batch and processing completions,
+ * until its own command has completed, it then hands the role over to a
+ * caller still waiting
+ */
+struct xnvme_gcommit {
+	struct xnvme_async_ctx *ctx;
+	pthread_mutex_t lock;
+	int combining;			///< Whether a caller is the combiner
+	int flush_sync;			///< Flushes are not served async.
+
+	struct gcommit_waiter *head;	///< Registered callers
+	struct gcommit_waiter *tail;
+
+	/// The cmd_pass() of the backend, used for submission
+	int (*cmd_pass)(struct xnvme_dev *, struct xnvme_spec_cmd *, void *,
+			size_t, void *, size_t, int, struct xnvme_req *);
+};
+
+static void
+gcommit_cb(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	struct gcommit_waiter *waiter = cb_arg;
+
+	pthread_mutex_lock(&waiter->gc->lock);
+	waiter->done = 1;
+	pthread_cond_signal(&waiter->cond);
+	pthread_mutex_unlock(&waiter->gc->lock);
+}
+
+/**
+ * Submit the commands of registered callers and process completions until
+ * the command of 'self' has completed, must be called with 'gc->lock' held
+ */
+static void
+gcommit_combine(struct xnvme_dev *dev, struct xnvme_gcommit *gc,
+		struct gcommit_waiter *self)
+{
+	while (!self->done) {
+		int err;
+
+		for (struct gcommit_waiter *w = gc->head; w; w = w->next) {
+			if (w->submitted) {
+				continue;
+			}
+
+			err = gc->cmd_pass(dev, &w->cmd, w->dbuf,
+					   w->dbuf_nbytes, w->mbuf,
+					   w->mbuf_nbytes, w->opts, w->req);
+			if ((err == -EBUSY) || (err == -EAGAIN)) {
+				break;
+			}
+
+			w->submitted = 1;
+			if (err) {
+				if (err != -ENOSYS) {
+					XNVME_DEBUG("FAILED: cmd_pass(), err: %d",
+						    err);
+				} else if (w->cmd.common.opcode ==
+					   XNVME_SPEC_OPC_FLUSH) {
+					gc->flush_sync = 1;
+				}
+				w->err = err;
+				w->done = 1;
+				pthread_cond_signal(&w->cond);
+			}
+		}
+		if (self->done) {
+			break;
+		}
+
+		pthread_mutex_unlock(&gc->lock);
+		err = xnvme_async_poke(dev, gc->ctx, 0);
+		pthread_mutex_lock(&gc->lock);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+		}
+	}
+}
+
+static int
+gcommit_sync_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		  void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		  size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_gcommit *gc = dev->gcommit;
+	struct gcommit_waiter waiter = { 0 };
+	struct xnvme_req req_local = { 0 };
+
+	if (!req) {
+		req = &req_local;
+	}
+
+	waiter.gc = gc;
+	waiter.cmd = *cmd;
+	waiter.dbuf = dbuf;
+	waiter.dbuf_nbytes = dbuf_nbytes;
+	waiter.mbuf = mbuf;
+	waiter.mbuf_nbytes = mbuf_nbytes;
+	waiter.opts = (opts & ~XNVME_CMD_MASK_IOMD) | XNVME_CMD_ASYNC;
+	waiter.req = req;
+	pthread_cond_init(&waiter.cond, NULL);
+
+	req->async.ctx = gc->ctx;
+	req->async.cb = gcommit_cb;
+	req->async.cb_arg = &waiter;
+
+	pthread_mutex_lock(&gc->lock);
+
+	waiter.prev = gc->tail;
+	if (gc->tail) {
+		gc->tail->next = &waiter;
+	} else {
+		gc->head = &waiter;
+	}
+	gc->tail = &waiter;
+
+	while (!waiter.done) {
+		if (!gc->combining) {
+			gc->combining = 1;
+			gcommit_combine(dev, gc, &waiter);
+			gc->combining = 0;
+			break;
+		}
+		pthread_cond_wait(&waiter.cond, &gc->lock);
+	}
+
+	if (waiter.prev) {
+		waiter.prev->next = waiter.next;
+	} else {
+		gc->head = waiter.next;
+	}
+	if (waiter.next) {
+		waiter.next->prev = waiter.prev;
+	} else {
+		gc->tail = waiter.prev;
+	}
+
+	// Hand over the role of combiner to a caller still waiting
+	if (!gc->combining) {
+		for (struct gcommit_waiter *w = gc->head; w; w = w->next) {
+			if (!w->done) {
+				pthread_cond_signal(&w->cond);
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&gc->lock);
+	pthread_cond_destroy(&waiter.cond);
+
+	req->async.ctx = NULL;
+	req->async.cb = NULL;
+	req->async.cb_arg = NULL;
+
+	// The async. path of the backend does not serve the command, e.g. flush
+	// on laio, it is then passed synchronously by the caller itself
+	if (waiter.err == -ENOSYS) {
+		return gc->cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				    mbuf_nbytes, opts, req);
+	}
+	if (waiter.err) {
+		return waiter.err;
+	}
+
+	return xnvme_req_cpl_status(req) ? -EIO : 0;
+}
+
+static int
+gcommit_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
+		 size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes, int opts,
+		 struct xnvme_req *req)
+{
+	// Only read, write and flush without meta-data are funnelled. Read and
+	// write are served by the async. contexts of all backends, flush is not,
+	// e.g. not by laio, when it is rejected with -ENOSYS, then it is passed
+	// synchronously, by this and by any later call
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_FLUSH:
+		if (dev->gcommit->flush_sync) {
+			break;
+		}
+	// fall through
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		if ((opts & XNVME_CMD_ASYNC) || mbuf) {
+			break;
+		}
+		return gcommit_sync_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+					 mbuf_nbytes, opts, req);
+	}
+
+	return dev->gcommit->cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				      mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_gcommit_term(struct xnvme_dev *dev)
+{
+	struct xnvme_gcommit *gc = dev->gcommit;
+	int err;
+
+	if (!gc) {
+		return 0;
+	}
+
+	dev->be.func.cmd_pass = gc->cmd_pass;
+	dev->gcommit = NULL;
+
+	err = xnvme_async_term(dev, gc->ctx);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_term(), err: %d", err);
+	}
+	pthread_mutex_destroy(&gc->lock);
+	free(gc);
+
+	return err;
+}
+
+int
+xnvme_gcommit_init(struct xnvme_dev *dev, uint16_t depth)
+{
+	struct xnvme_gcommit *gc;
+	int err;
+
+	if (dev->gcommit) {
+		XNVME_DEBUG("FAILED: group commit is already enabled");
+		return -EEXIST;
+	}
+
+	gc = calloc(1, sizeof(*gc));
+	if (!gc) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+
+	err = xnvme_async_init(dev, &gc->ctx, depth, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		free(gc);
+		return err;
+	}
+
+	err = pthread_mutex_init(&gc->lock, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_mutex_init(), err: %d", err);
+		xnvme_async_term(dev, gc->ctx);
+		free(gc);
+		return -err;
+	}
+
+	gc->cmd_pass = dev->be.func.cmd_pass;
+	dev->be.func.cmd_pass = gcommit_cmd_pass;
+	dev->gcommit = gc;
+
+	return 0;
+}
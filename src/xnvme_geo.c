@@ -13,6 +13,8 @@ xnvme_geo_type_str(int type)
 		return "XNVME_GEO_CONVENTIONAL";
 	case XNVME_GEO_ZONED:
 		return "XNVME_GEO_ZONED";
+	case XNVME_GEO_KV:
+		return "XNVME_GEO_KV";
 	default:
 		return "XNVME_GEO_ENOSYS";
 	}
@@ -59,8 +61,13 @@ xnvme_geo_yaml(FILE *stream, const struct xnvme_geo *geo, int indent,
 
 	wrtn += fprintf(stream, "%*slba_nbytes: %u%s", indent, "",
 			geo->lba_nbytes, sep);
-	wrtn += fprintf(stream, "%*slba_extended: %u", indent, "",
-			geo->lba_extended);
+	wrtn += fprintf(stream, "%*slba_extended: %u%s", indent, "",
+			geo->lba_extended, sep);
+
+	wrtn += fprintf(stream, "%*snpwg: %u%s", indent, "", geo->npwg, sep);
+	wrtn += fprintf(stream, "%*snpwa: %u%s", indent, "", geo->npwa, sep);
+	wrtn += fprintf(stream, "%*snpdg: %u%s", indent, "", geo->npdg, sep);
+	wrtn += fprintf(stream, "%*snows: %u", indent, "", geo->nows);
 
 	return wrtn;
 }
@@ -0,0 +1,319 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <string.h>
+#include <libxnvme.h>
+#include <xnvme_lower.h>
+
+static inline uint64_t
+lower_min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+int
+xnvme_lower_rw(const struct xnvme_lower *lower, uint8_t opcode, uint64_t slba,
+	       uint64_t nlb, void *dbuf)
+{
+	uint8_t *buf = dbuf;
+
+	while (nlb) {
+		uint64_t n = lower_min(nlb, lower->io_nlb);
+		struct xnvme_req req = { 0 };
+		int err;
+
+		if (opcode == XNVME_SPEC_OPC_READ) {
+			err = xnvme_cmd_read(lower->dev, lower->nsid, slba, n - 1,
+					     buf, NULL, XNVME_CMD_SYNC, &req);
+		} else {
+			err = xnvme_cmd_write(lower->dev, lower->nsid, slba,
+					      n - 1, buf, NULL, XNVME_CMD_SYNC,
+					      &req);
+		}
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: opcode: 0x%x, slba: 0x%lx, err: %d",
+				    opcode, slba, err);
+			return err ? err : -EIO;
+		}
+
+		slba += n;
+		nlb -= n;
+		buf += n * lower->lba_nbytes;
+	}
+
+	return 0;
+}
+
+int
+xnvme_lower_flush(const struct xnvme_lower *lower)
+{
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	int err;
+
+	if (!xnvme_dev_get_ctrlr(lower->dev)->vwc.present) {
+		return 0;
+	}
+
+	cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+	cmd.common.nsid = lower->nsid;
+
+	err = xnvme_cmd_pass(lower->dev, &cmd, NULL, 0, NULL, 0,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: flush, err: %d", err);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+uint64_t
+xnvme_lower_csum(uint64_t csum, const void *buf, uint64_t nbytes)
+{
+	const uint64_t *words = buf;
+
+	for (uint64_t i = 0; i < nbytes / sizeof(*words); ++i) {
+		csum ^= words[i];
+		csum *= 0x100000001b3ULL;
+	}
+
+	return csum;
+}
+
+static int
+ckpt_area_rw(struct xnvme_ckpt *ckpt, uint8_t opcode, uint32_t area,
+	     uint64_t lin, uint64_t nlb)
+{
+	if (ckpt->area_rw) {
+		return ckpt->area_rw(ckpt->cb_arg, opcode, area, lin, nlb,
+				     ckpt->iobuf);
+	}
+
+	return xnvme_lower_rw(ckpt->lower, opcode, area * ckpt->area_nlb + lin,
+			      nlb, ckpt->iobuf);
+}
+
+/**
+ * Traverse the table of the given header in chunks of 'io_nlb' LBAs, via
+ * 'get' when writing and 'put' when reading, accumulating its checksum
+ */
+static int
+ckpt_tbl(struct xnvme_ckpt *ckpt, uint8_t opcode, uint32_t area,
+	 const struct xnvme_ckpt_hdr *hdr, uint64_t *csum)
+{
+	const struct xnvme_lower *lower = ckpt->lower;
+	const uint64_t io_nbytes = (uint64_t)lower->io_nlb * lower->lba_nbytes;
+	uint64_t lin = 1;
+
+	*csum = XNVME_LOWER_CSUM_INIT;
+
+	for (uint64_t ofz = 0; ofz < hdr->tbl_nbytes;) {
+		uint64_t nbytes = lower_min(hdr->tbl_nbytes - ofz, io_nbytes);
+		uint64_t nlb = (nbytes + lower->lba_nbytes - 1) / lower->lba_nbytes;
+		int err;
+
+		if (opcode == XNVME_SPEC_OPC_READ) {
+			err = ckpt_area_rw(ckpt, opcode, area, lin, nlb);
+			if (err) {
+				return err;
+			}
+			*csum = xnvme_lower_csum(*csum, ckpt->iobuf, nbytes);
+
+			err = ckpt->put(ckpt->cb_arg, ofz, ckpt->iobuf, nbytes);
+			if (err) {
+				return err;
+			}
+		} else {
+			memset(ckpt->iobuf + nbytes, 0,
+			       nlb * lower->lba_nbytes - nbytes);
+			err = ckpt->get(ckpt->cb_arg, ofz, ckpt->iobuf, nbytes);
+			if (err) {
+				return err;
+			}
+			*csum = xnvme_lower_csum(*csum, ckpt->iobuf, nbytes);
+
+			err = ckpt_area_rw(ckpt, opcode, area, lin, nlb);
+			if (err) {
+				return err;
+			}
+		}
+
+		lin += nlb;
+		ofz += nbytes;
+	}
+
+	return 0;
+}
+
+static int
+ckpt_hdr_write(struct xnvme_ckpt *ckpt, uint32_t area, uint64_t lin,
+	       const struct xnvme_ckpt_hdr *hdr)
+{
+	memset(ckpt->iobuf, 0, ckpt->lower->lba_nbytes);
+	memcpy(ckpt->iobuf, hdr, ckpt->hdr_nbytes);
+
+	return ckpt_area_rw(ckpt, XNVME_SPEC_OPC_WRITE, area, lin, 1);
+}
+
+int
+xnvme_ckpt_write(struct xnvme_ckpt *ckpt, struct xnvme_ckpt_hdr *hdr)
+{
+	const struct xnvme_lower *lower = ckpt->lower;
+	const uint32_t area = !ckpt->area;
+	uint64_t csum = XNVME_LOWER_CSUM_INIT;
+	int err;
+
+	if (hdr->tbl_nbytes > ckpt->tbl_nlb * lower->lba_nbytes) {
+		XNVME_DEBUG("FAILED: tbl_nbytes: %lu", hdr->tbl_nbytes);
+		return -EINVAL;
+	}
+
+	// The checksum goes in the header, which is written first, thus the
+	// table is produced twice; once for the checksum, once for writing
+	for (uint64_t ofz = 0; ofz < hdr->tbl_nbytes;) {
+		uint64_t nbytes = lower_min(hdr->tbl_nbytes - ofz,
+					    (uint64_t)lower->io_nlb *
+					    lower->lba_nbytes);
+
+		err = ckpt->get(ckpt->cb_arg, ofz, ckpt->iobuf, nbytes);
+		if (err) {
+			return err;
+		}
+		csum = xnvme_lower_csum(csum, ckpt->iobuf, nbytes);
+
+		ofz += nbytes;
+	}
+
+	hdr->magic = ckpt->magic;
+	hdr->version = ckpt->version;
+	hdr->lba_nbytes = lower->lba_nbytes;
+	hdr->seq = ckpt->seq + 1;
+	hdr->csum = csum;
+
+	err = ckpt_hdr_write(ckpt, area, 0, hdr);
+	if (err) {
+		return err;
+	}
+	err = ckpt_tbl(ckpt, XNVME_SPEC_OPC_WRITE, area, hdr, &csum);
+	if (err) {
+		return err;
+	}
+	if (csum != hdr->csum) {
+		XNVME_DEBUG("FAILED: the table changed while writing");
+		return -EIO;
+	}
+	err = ckpt_hdr_write(ckpt, area, 1 + ckpt->tbl_nlb, hdr);
+	if (err) {
+		return err;
+	}
+
+	err = xnvme_lower_flush(lower);
+	if (err) {
+		return err;
+	}
+
+	ckpt->seq = hdr->seq;
+	ckpt->area = area;
+
+	return 0;
+}
+
+/**
+ * Read and verify the copies of the header of the checkpoint in 'area'
+ */
+static int
+ckpt_probe(struct xnvme_ckpt *ckpt, uint32_t area, struct xnvme_ckpt_hdr *hdr,
+	   int *found)
+{
+	const struct xnvme_lower *lower = ckpt->lower;
+	int err;
+
+	err = ckpt_area_rw(ckpt, XNVME_SPEC_OPC_READ, area, 0, 1);
+	if (err) {
+		return err;
+	}
+	memcpy(hdr, ckpt->iobuf, ckpt->hdr_nbytes);
+
+	if (hdr->magic != ckpt->magic) {
+		return -ENOENT;
+	}
+	*found = 1;
+
+	if ((hdr->version != ckpt->version) ||
+	    (hdr->lba_nbytes != lower->lba_nbytes) ||
+	    (hdr->tbl_nbytes > ckpt->tbl_nlb * lower->lba_nbytes) ||
+	    (ckpt->check && ckpt->check(ckpt->cb_arg, hdr))) {
+		XNVME_DEBUG("FAILED: area: %u, geometry mismatch", area);
+		return -EINVAL;
+	}
+
+	err = ckpt_area_rw(ckpt, XNVME_SPEC_OPC_READ, area, 1 + ckpt->tbl_nlb,
+			   1);
+	if (err) {
+		return err;
+	}
+	if (memcmp(hdr, ckpt->iobuf, ckpt->hdr_nbytes)) {
+		XNVME_DEBUG("INFO: area: %u, incomplete checkpoint", area);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int
+xnvme_ckpt_load(struct xnvme_ckpt *ckpt, struct xnvme_ckpt_hdr *hdr)
+{
+	uint64_t hdrs[2][XNVME_CKPT_HDR_NBYTES_MAX / sizeof(uint64_t)] = { 0 };
+	struct xnvme_ckpt_hdr *cand[2] = {
+		(void *)hdrs[0], (void *)hdrs[1]
+	};
+	int valid[2] = { 0 };
+	int found = 0;
+
+	if ((ckpt->hdr_nbytes < sizeof(*hdr)) ||
+	    (ckpt->hdr_nbytes > XNVME_CKPT_HDR_NBYTES_MAX)) {
+		XNVME_DEBUG("FAILED: hdr_nbytes: %u", ckpt->hdr_nbytes);
+		return -EINVAL;
+	}
+
+	for (uint32_t area = 0; area < 2; ++area) {
+		valid[area] = !ckpt_probe(ckpt, area, cand[area], &found);
+	}
+	for (int i = 0; i < 2; ++i) {
+		uint32_t area = (cand[1]->seq > cand[0]->seq) ? !i : i;
+		uint64_t csum;
+
+		if ((!valid[area]) ||
+		    ckpt_tbl(ckpt, XNVME_SPEC_OPC_READ, area, cand[area],
+			     &csum)) {
+			continue;
+		}
+		if (csum != cand[area]->csum) {
+			XNVME_DEBUG("FAILED: area: %u, checksum mismatch", area);
+			continue;
+		}
+
+		memcpy(hdr, cand[area], ckpt->hdr_nbytes);
+		ckpt->seq = cand[area]->seq;
+		ckpt->area = area;
+
+		return 0;
+	}
+
+	if (found) {
+		XNVME_DEBUG("FAILED: no valid checkpoint, use format=1");
+		return -EIO;
+	}
+
+	return -ENOENT;
+}
+
+void
+xnvme_ckpt_format(struct xnvme_ckpt *ckpt)
+{
+	XNVME_DEBUG("INFO: formatting");
+
+	ckpt->seq = 0;
+	ckpt->area = 1;
+}
@@ -0,0 +1,296 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_dev.h>
+
+struct xnvme_mget_batch {
+	struct xnvme_mget_item *items;
+	uint32_t nitems;
+	uint32_t nerrs;
+	uint32_t nremaining;	///< Items not yet completed, +1 while submitting
+	xnvme_mget_cb cb;
+	void *cb_arg;
+
+	struct xnvme_mget_batch *next;	///< Link in the free-list
+};
+
+/**
+ * The request of a read is taken from 'reqs', the read is identified by the
+ * entry in 'reads' at the index of its request
+ */
+struct xnvme_mget_read {
+	struct xnvme_mget_batch *batch;
+	uint32_t idx;		///< Index of the item within the batch
+};
+
+struct xnvme_mget {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;
+	uint32_t capacity;
+	uint32_t nfree;		///< Requests in 'reqs' not reserved by a batch
+
+	struct xnvme_req_pool *reqs;
+	struct xnvme_mget_read *reads;
+	struct xnvme_mget_batch *batches;
+	struct xnvme_mget_batch *free;
+};
+
+static void
+mget_batch_put(struct xnvme_mget *mg, struct xnvme_mget_batch *batch,
+	       uint32_t count)
+{
+	struct xnvme_mget_item *items = batch->items;
+	const uint32_t nitems = batch->nitems;
+	const uint32_t nerrs = batch->nerrs;
+	xnvme_mget_cb cb = batch->cb;
+	void *cb_arg = batch->cb_arg;
+
+	batch->nremaining -= count;
+	if (batch->nremaining) {
+		return;
+	}
+
+	// Released before calling back, such that the callback can submit
+	batch->next = mg->free;
+	mg->free = batch;
+
+	cb(items, nitems, nerrs, cb_arg);
+}
+
+static void
+mget_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_mget *mg = cb_arg;
+	struct xnvme_mget_read *read = &mg->reads[req - mg->reqs->elm];
+	struct xnvme_mget_batch *batch = read->batch;
+
+	batch->items[read->idx].cpl = req->cpl;
+	if (xnvme_req_cpl_status(req)) {
+		batch->nerrs += 1;
+	}
+
+	SLIST_INSERT_HEAD(&mg->reqs->head, req, link);
+	mg->nfree += 1;
+
+	mget_batch_put(mg, batch, 1);
+}
+
+int
+xnvme_mget_submit(struct xnvme_mget *mg, uint32_t nsid,
+		  struct xnvme_mget_item *items, uint32_t nitems,
+		  xnvme_mget_cb cb, void *cb_arg)
+{
+	struct xnvme_mget_batch *batch;
+	struct xnvme_cmd_prep prep;
+	uint32_t idx;
+	int err;
+
+	if (!(items && nitems && cb) || (nitems > mg->capacity)) {
+		XNVME_DEBUG("FAILED: invalid items, nitems: %u or cb", nitems);
+		return -EINVAL;
+	}
+	if ((nitems > mg->nfree) || (!mg->free)) {
+		return -EBUSY;
+	}
+
+	err = xnvme_cmd_prep_init(&prep, mg->dev, XNVME_SPEC_OPC_READ, nsid,
+				  XNVME_CMD_ASYNC);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_prep_init(), err: %d", err);
+		return err;
+	}
+
+	// Reserve the requests, as completions reaped on -EBUSY/-EAGAIN below
+	// may call back into a submission of another batch
+	mg->nfree -= nitems;
+
+	batch = mg->free;
+	mg->free = batch->next;
+	batch->items = items;
+	batch->nitems = nitems;
+	batch->nerrs = 0;
+	batch->nremaining = nitems + 1;
+	batch->cb = cb;
+	batch->cb_arg = cb_arg;
+
+	for (idx = 0; idx < nitems; ++idx) {
+		struct xnvme_mget_item *item = &items[idx];
+		struct xnvme_req *req = SLIST_FIRST(&mg->reqs->head);
+		struct xnvme_mget_read *read = &mg->reads[req - mg->reqs->elm];
+
+		SLIST_REMOVE_HEAD(&mg->reqs->head, link);
+		read->batch = batch;
+		read->idx = idx;
+		memset(&req->cpl, 0, sizeof(req->cpl));
+
+submit:
+		err = xnvme_cmd_prep_pass(&prep, item->slba, item->nlb,
+					  item->dbuf, NULL, req);
+		switch (err) {
+		case 0:
+			continue;
+
+		case -EBUSY:
+		case -EAGAIN:
+			err = xnvme_async_poke(mg->dev, mg->ctx, 0);
+			if (err >= 0) {
+				goto submit;
+			}
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: submission, idx: %u, err: %d", idx,
+				    err);
+			break;
+		}
+
+		SLIST_INSERT_HEAD(&mg->reqs->head, req, link);
+		break;
+	}
+
+	if (idx < nitems) {
+		// Nothing in-flight, thus fail the submission as a whole
+		if (!idx) {
+			mg->nfree += nitems;
+			batch->next = mg->free;
+			mg->free = batch;
+
+			return err < 0 ? err : -EIO;
+		}
+
+		for (uint32_t i = idx; i < nitems; ++i) {
+			items[i].cpl.status.sct = 0x0;
+			items[i].cpl.status.sc = XNVME_SPEC_SC_INTERNAL;
+		}
+		batch->nerrs += nitems - idx;
+		mg->nfree += nitems - idx;
+		mget_batch_put(mg, batch, nitems - idx);
+	}
+
+	mget_batch_put(mg, batch, 1);
+
+	return 0;
+}
+
+struct mget_read_args {
+	uint32_t nerrs;
+	int done;
+};
+
+static void
+mget_read_cb(struct xnvme_mget_item *XNVME_UNUSED(items),
+	     uint32_t XNVME_UNUSED(nitems), uint32_t nerrs, void *cb_arg)
+{
+	struct mget_read_args *args = cb_arg;
+
+	args->nerrs = nerrs;
+	args->done = 1;
+}
+
+int
+xnvme_mget_read(struct xnvme_mget *mg, uint32_t nsid,
+		struct xnvme_mget_item *items, uint32_t nitems)
+{
+	struct mget_read_args args = { 0 };
+	int err;
+
+	for (;;) {
+		err = xnvme_mget_submit(mg, nsid, items, nitems, mget_read_cb,
+					&args);
+		if (err != -EBUSY) {
+			break;
+		}
+
+		err = xnvme_async_poke(mg->dev, mg->ctx, 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			return err;
+		}
+	}
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_mget_submit(), err: %d", err);
+		return err;
+	}
+
+	while (!args.done) {
+		err = xnvme_async_poke(mg->dev, mg->ctx, 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			return err;
+		}
+	}
+
+	return args.nerrs ? -EIO : 0;
+}
+
+void
+xnvme_mget_term(struct xnvme_mget *mg)
+{
+	if (!mg) {
+		return;
+	}
+
+	xnvme_req_pool_free(mg->reqs);
+	free(mg->reads);
+	free(mg->batches);
+	free(mg);
+}
+
+int
+xnvme_mget_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		struct xnvme_mget **mg, uint32_t capacity)
+{
+	int err;
+
+	if (!(ctx && capacity) || (capacity > xnvme_async_get_depth(ctx))) {
+		XNVME_DEBUG("FAILED: invalid ctx or capacity: %u", capacity);
+		return -EINVAL;
+	}
+
+	(*mg) = calloc(1, sizeof(**mg));
+	if (!(*mg)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*mg)->dev = dev;
+	(*mg)->ctx = ctx;
+	(*mg)->capacity = capacity;
+	(*mg)->nfree = capacity;
+
+	err = xnvme_req_pool_alloc(&(*mg)->reqs, capacity);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_req_pool_alloc(), err: %d", err);
+		(*mg)->reqs = NULL;
+		goto failed;
+	}
+	err = xnvme_req_pool_init((*mg)->reqs, ctx, mget_cb, *mg);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_req_pool_init(), err: %d", err);
+		goto failed;
+	}
+
+	// A batch holds at least one read, thus 'capacity' batches suffice
+	(*mg)->reads = calloc(capacity, sizeof(*(*mg)->reads));
+	(*mg)->batches = calloc(capacity, sizeof(*(*mg)->batches));
+	if (!((*mg)->reads && (*mg)->batches)) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+	for (uint32_t i = 0; i < capacity; ++i) {
+		(*mg)->batches[i].next = (*mg)->free;
+		(*mg)->free = &(*mg)->batches[i];
+	}
+
+	return 0;
+
+failed:
+	xnvme_mget_term(*mg);
+	*mg = NULL;
+
+	return err;
+}
@@ -0,0 +1,993 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_dev.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+#define XNVME_MMAP_NIOS 64		///< Reads and write-backs in flight
+#define XNVME_MMAP_RA_MAX 32		///< Max. read-ahead window, in blocks
+#define XNVME_MMAP_RESIDENT_DEF (64 * 1024 * 1024)
+#define XNVME_MMAP_RESIDENT_MIN (4 * XNVME_MMAP_NIOS)	///< In blocks
+
+enum xnvme_mmap_blk_state {
+	XNVME_MMAP_BLK_ABSENT = 0x0,	///< Not mapped
+	XNVME_MMAP_BLK_READING = 0x1,	///< Read in flight, then mapped
+	XNVME_MMAP_BLK_CLEAN = 0x2,	///< Mapped write-protected
+	XNVME_MMAP_BLK_DIRTY = 0x3,	///< Mapped and written to
+	XNVME_MMAP_BLK_WRITEBACK = 0x4,	///< Evicted, write-back in flight
+	XNVME_MMAP_BLK_FAILED = 0x5,	///< Read failed, mapped zero-filled
+};
+
+/**
+ * A buffer with a command in flight, reading a block to be mapped, or
+ * writing back an evicted block
+ */
+struct xnvme_mmap_io {
+	struct xnvme_mmap *map;
+	uint64_t blk;
+	int write;
+	int inflight;
+	uint8_t *payload;
+	struct xnvme_req req;
+	struct xnvme_mmap_io *next;	///< Free-list linkage
+};
+
+struct xnvme_mmap {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;	///< Used by the fault-handler only
+	uint32_t nsid;
+	int opts;
+
+	uint64_t slba;
+	uint64_t nlb;			///< Number of LBAs, NOT zero-based
+	uint8_t *addr;
+	uint64_t nbytes;
+
+	uint32_t blk_nbytes;		///< Page, or LBA when larger
+	uint32_t blk_nlb;		///< LBAs per block, NOT zero-based
+	uint64_t nblks;
+	uint8_t *state;			///< See enum xnvme_mmap_blk_state
+
+	uint64_t *fifo;			///< Resident blocks, in order of arrival
+	uint64_t fifo_cap;		///< Bound on the number of resident blocks
+	uint64_t fifo_head;
+	uint64_t fifo_len;
+
+	uint64_t next;			///< Block following the last fault
+	uint64_t ra_next;		///< Block at which to continue read-ahead
+	uint32_t window;		///< Read-ahead window in blocks
+
+	struct xnvme_mmap_io *ios;
+	struct xnvme_mmap_io *free;
+
+	uint8_t *sbuf;			///< Staging for xnvme_msync()
+	uint32_t sbuf_nblks;
+
+	int uffd;
+	int efd;			///< Signals the fault-handler to stop
+	pthread_t thread;
+	int running;
+	pthread_mutex_t lock;		///< Held by the fault-handler when busy
+	pthread_cond_t cond;		///< Signalled after reaping completions
+	int err;			///< Write-back and read errors, sticky
+
+	struct xnvme_mmap_stats stats;
+};
+
+static inline uint64_t
+u64_min(uint64_t x, uint64_t y)
+{
+	return x < y ? x : y;
+}
+
+static inline uint64_t
+u64_max(uint64_t x, uint64_t y)
+{
+	return x > y ? x : y;
+}
+
+static inline uint8_t *
+blk_addr(struct xnvme_mmap *map, uint64_t blk)
+{
+	return map->addr + blk * map->blk_nbytes;
+}
+
+/**
+ * Number of LBAs backing the given blocks, the last block may be partial
+ */
+static inline uint64_t
+blk_nlb(struct xnvme_mmap *map, uint64_t blk, uint64_t nblks)
+{
+	return u64_min(nblks * map->blk_nlb, map->nlb - blk * map->blk_nlb);
+}
+
+static inline void
+fifo_push(struct xnvme_mmap *map, uint64_t blk)
+{
+	map->fifo[(map->fifo_head + map->fifo_len) % map->fifo_cap] = blk;
+	map->fifo_len += 1;
+}
+
+static inline uint64_t
+fifo_pop(struct xnvme_mmap *map)
+{
+	uint64_t blk = map->fifo[map->fifo_head];
+
+	map->fifo_head = (map->fifo_head + 1) % map->fifo_cap;
+	map->fifo_len -= 1;
+
+	return blk;
+}
+
+static int
+mmap_copy(struct xnvme_mmap *map, uint64_t blk, const void *src, int wp)
+{
+	struct uffdio_copy copy = {
+		.dst = (uintptr_t)blk_addr(map, blk),
+		.src = (uintptr_t)src,
+		.len = map->blk_nbytes,
+		.mode = wp ? UFFDIO_COPY_MODE_WP : 0,
+	};
+
+	if (ioctl(map->uffd, UFFDIO_COPY, &copy) && (errno != EEXIST)) {
+		XNVME_DEBUG("FAILED: ioctl(UFFDIO_COPY), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+/**
+ * Write-protect, or release, the given blocks; releasing wakes up writers
+ */
+static int
+mmap_protect(struct xnvme_mmap *map, uint64_t blk, uint64_t nblks, int wp)
+{
+	struct uffdio_writeprotect prot = {
+		.range = {
+			.start = (uintptr_t)blk_addr(map, blk),
+			.len = nblks * map->blk_nbytes,
+		},
+		.mode = wp ? UFFDIO_WRITEPROTECT_MODE_WP : 0,
+	};
+
+	if (ioctl(map->uffd, UFFDIO_WRITEPROTECT, &prot)) {
+		XNVME_DEBUG("FAILED: ioctl(UFFDIO_WRITEPROTECT), errno: %d",
+			    errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int
+mmap_wake(struct xnvme_mmap *map, uint64_t blk)
+{
+	struct uffdio_range range = {
+		.start = (uintptr_t)blk_addr(map, blk),
+		.len = map->blk_nbytes,
+	};
+
+	if (ioctl(map->uffd, UFFDIO_WAKE, &range)) {
+		XNVME_DEBUG("FAILED: ioctl(UFFDIO_WAKE), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+/**
+ * Unmaps the given block, the next access faults it in again
+ */
+static int
+mmap_drop(struct xnvme_mmap *map, uint64_t blk)
+{
+	if (madvise(blk_addr(map, blk), map->blk_nbytes, MADV_DONTNEED)) {
+		XNVME_DEBUG("FAILED: madvise(), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void
+mmap_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_mmap_io *io = cb_arg;
+	struct xnvme_mmap *map = io->map;
+	int failed = xnvme_req_cpl_status(req);
+	int err;
+
+	io->inflight = 0;
+
+	if (io->write) {
+		if (failed) {
+			XNVME_DEBUG("FAILED: write-back of blk: %"PRIu64, io->blk);
+			map->err = -EIO;
+		}
+		// The block is DIRTY when faulted in again during write-back
+		if (map->state[io->blk] == XNVME_MMAP_BLK_WRITEBACK) {
+			map->state[io->blk] = XNVME_MMAP_BLK_ABSENT;
+		}
+		map->stats.written += 1;
+	} else {
+		if (failed) {
+			XNVME_DEBUG("FAILED: read of blk: %"PRIu64, io->blk);
+			memset(io->payload, 0, map->blk_nbytes);
+			map->err = -EIO;
+		}
+		map->state[io->blk] = failed ? XNVME_MMAP_BLK_FAILED :
+				      XNVME_MMAP_BLK_CLEAN;
+
+		err = mmap_copy(map, io->blk, io->payload,
+				!failed && !(map->opts & XNVME_MMAP_RDONLY));
+		if (err) {
+			map->err = err;
+		}
+	}
+
+	io->next = map->free;
+	map->free = io;
+}
+
+/**
+ * Returns a free buffer, reaping completions until one is available
+ */
+static struct xnvme_mmap_io *
+io_get(struct xnvme_mmap *map)
+{
+	struct xnvme_mmap_io *io;
+
+	while (!map->free) {
+		int err = xnvme_async_poke(map->dev, map->ctx, 0);
+
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			errno = -err;
+			return NULL;
+		}
+	}
+
+	io = map->free;
+	map->free = io->next;
+
+	return io;
+}
+
+static int
+io_submit(struct xnvme_mmap *map, struct xnvme_mmap_io *io, uint64_t blk,
+	  int write)
+{
+	const uint64_t slba = map->slba + blk * map->blk_nlb;
+	const uint64_t nlb = blk_nlb(map, blk, 1);
+	int err;
+
+	io->blk = blk;
+	io->write = write;
+	io->inflight = 1;
+
+	xnvme_req_clear(&io->req);
+	io->req.async.ctx = map->ctx;
+	io->req.async.cb = mmap_cb;
+	io->req.async.cb_arg = io;
+
+	if (write) {
+		err = xnvme_cmd_write(map->dev, map->nsid, slba, nlb - 1,
+				      io->payload, NULL, XNVME_CMD_ASYNC,
+				      &io->req);
+	} else {
+		if (nlb < map->blk_nlb) {
+			memset(io->payload, 0, map->blk_nbytes);
+		}
+		err = xnvme_cmd_read(map->dev, map->nsid, slba, nlb - 1,
+				     io->payload, NULL, XNVME_CMD_ASYNC,
+				     &io->req);
+	}
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_%s(), err: %d",
+			    write ? "write" : "read", err);
+		io->inflight = 0;
+		io->next = map->free;
+		map->free = io;
+	}
+
+	return err;
+}
+
+/**
+ * Evicts the oldest resident block. A modified block is write-protected,
+ * copied to a buffer and unmapped, the write-back of the buffer completes
+ * asynchronously; a fault on the block meanwhile maps the buffer
+ */
+static int
+mmap_evict(struct xnvme_mmap *map)
+{
+	uint64_t blk = fifo_pop(map);
+	struct xnvme_mmap_io *io;
+	int err;
+
+	switch (map->state[blk]) {
+	case XNVME_MMAP_BLK_READING:
+		fifo_push(map, blk);
+		return 0;
+
+	case XNVME_MMAP_BLK_DIRTY:
+		break;
+
+	default:
+		map->state[blk] = XNVME_MMAP_BLK_ABSENT;
+		map->stats.evicted += 1;
+		return mmap_drop(map, blk);
+	}
+
+	io = io_get(map);
+	if (!io) {
+		fifo_push(map, blk);
+		return -errno;
+	}
+
+	err = mmap_protect(map, blk, 1, 1);
+	if (err) {
+		io->next = map->free;
+		map->free = io;
+		fifo_push(map, blk);
+		return err;
+	}
+	memcpy(io->payload, blk_addr(map, blk), map->blk_nbytes);
+
+	map->state[blk] = XNVME_MMAP_BLK_WRITEBACK;
+	map->stats.evicted += 1;
+
+	err = mmap_drop(map, blk);
+	if (err) {
+		return err;
+	}
+
+	return io_submit(map, io, blk, 1);
+}
+
+/**
+ * Evicts blocks until there is room for another resident block
+ */
+static int
+mmap_reserve(struct xnvme_mmap *map)
+{
+	while (map->fifo_len >= map->fifo_cap) {
+		int err = mmap_evict(map);
+
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int
+mmap_read(struct xnvme_mmap *map, uint64_t blk)
+{
+	struct xnvme_mmap_io *io;
+	int err;
+
+	err = mmap_reserve(map);
+	if (err) {
+		return err;
+	}
+
+	io = io_get(map);
+	if (!io) {
+		return -errno;
+	}
+
+	err = io_submit(map, io, blk, 0);
+	if (err) {
+		return err;
+	}
+
+	map->state[blk] = XNVME_MMAP_BLK_READING;
+	fifo_push(map, blk);
+
+	return 0;
+}
+
+/**
+ * Grow the read-ahead window on faults continuing the stream, or landing in
+ * its window, reset it on others, and read ahead within it as long as
+ * buffers are free
+ */
+static int
+mmap_readahead(struct xnvme_mmap *map, uint64_t blk)
+{
+	uint64_t limit;
+
+	if ((blk == map->next) || ((blk > map->next) && (blk < map->ra_next))) {
+		map->window = map->window ? map->window * 2 : 1;
+		map->window = u64_min(map->window, XNVME_MMAP_RA_MAX);
+	} else {
+		map->window = 0;
+		map->ra_next = blk + 1;
+	}
+	map->next = blk + 1;
+	if (map->ra_next < map->next) {
+		map->ra_next = map->next;
+	}
+
+	limit = u64_min(map->next + map->window, map->nblks);
+	while ((map->ra_next < limit) && map->free) {
+		if (map->state[map->ra_next] == XNVME_MMAP_BLK_ABSENT) {
+			int err = mmap_read(map, map->ra_next);
+
+			if (err) {
+				return err;
+			}
+			map->stats.prefetched += 1;
+		}
+		map->ra_next += 1;
+	}
+
+	return 0;
+}
+
+static int
+mmap_fault(struct xnvme_mmap *map, uint64_t blk)
+{
+	struct xnvme_mmap_io *io = NULL;
+	int err;
+
+	if (map->state[blk] == XNVME_MMAP_BLK_WRITEBACK) {
+		err = mmap_reserve(map);
+		if (err) {
+			return err;
+		}
+	}
+
+	switch (map->state[blk]) {
+	case XNVME_MMAP_BLK_ABSENT:
+		map->stats.faults += 1;
+		err = mmap_read(map, blk);
+		if (err) {
+			return err;
+		}
+		break;
+
+	case XNVME_MMAP_BLK_READING:
+		map->stats.hits += 1;
+		break;
+
+	case XNVME_MMAP_BLK_WRITEBACK:
+		for (uint32_t i = 0; i < XNVME_MMAP_NIOS; ++i) {
+			if (map->ios[i].inflight && map->ios[i].write &&
+			    (map->ios[i].blk == blk)) {
+				io = &map->ios[i];
+			}
+		}
+		if (!io) {
+			XNVME_DEBUG("FAILED: no buffer for blk: %"PRIu64, blk);
+			return -EIO;
+		}
+		map->state[blk] = XNVME_MMAP_BLK_DIRTY;
+		fifo_push(map, blk);
+		return mmap_copy(map, blk, io->payload, 0);
+
+	default:
+		return mmap_wake(map, blk);
+	}
+
+	return mmap_readahead(map, blk);
+}
+
+static int
+mmap_fault_wp(struct xnvme_mmap *map, uint64_t blk)
+{
+	if (map->state[blk] == XNVME_MMAP_BLK_CLEAN) {
+		map->state[blk] = XNVME_MMAP_BLK_DIRTY;
+		return mmap_protect(map, blk, 1, 0);
+	}
+
+	return mmap_wake(map, blk);
+}
+
+static int
+mmap_drain(struct xnvme_mmap *map)
+{
+	struct uffd_msg msgs[16];
+
+	for (;;) {
+		ssize_t ret = read(map->uffd, msgs, sizeof(msgs));
+
+		if (ret < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR)) {
+				return 0;
+			}
+			XNVME_DEBUG("FAILED: read(), errno: %d", errno);
+			return -errno;
+		}
+
+		for (size_t i = 0; i < ret / sizeof(*msgs); ++i) {
+			const uint64_t addr = msgs[i].arg.pagefault.address;
+			uint64_t blk;
+			int err;
+
+			if (msgs[i].event != UFFD_EVENT_PAGEFAULT) {
+				continue;
+			}
+
+			blk = (addr - (uintptr_t)map->addr) / map->blk_nbytes;
+			if (msgs[i].arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) {
+				err = mmap_fault_wp(map, blk);
+			} else {
+				err = mmap_fault(map, blk);
+			}
+			if (err) {
+				XNVME_DEBUG("FAILED: fault on blk: %"PRIu64", "
+					    "err: %d", blk, err);
+				map->err = err;
+			}
+		}
+	}
+}
+
+/**
+ * The fault-handler, waits for faults, and polls for completions while
+ * commands are in flight
+ */
+static void *
+mmap_main(void *arg)
+{
+	struct xnvme_mmap *map = arg;
+	struct pollfd fds[2] = {
+		{ .fd = map->uffd, .events = POLLIN },
+		{ .fd = map->efd, .events = POLLIN },
+	};
+	int stop = 0;
+
+	while (!stop) {
+		int timeout = xnvme_async_get_outstanding(map->ctx) ? 0 : -1;
+		int err;
+
+		if (poll(fds, 2, timeout) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			XNVME_DEBUG("FAILED: poll(), errno: %d", errno);
+			break;
+		}
+		stop = fds[1].revents & POLLIN;
+
+		pthread_mutex_lock(&map->lock);
+		if (fds[0].revents & POLLIN) {
+			mmap_drain(map);
+		}
+		if (xnvme_async_get_outstanding(map->ctx)) {
+			err = xnvme_async_poke(map->dev, map->ctx, 0);
+			if (err < 0) {
+				XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d",
+					    err);
+				map->err = err;
+			}
+		}
+		pthread_cond_broadcast(&map->cond);
+		pthread_mutex_unlock(&map->lock);
+	}
+
+	pthread_mutex_lock(&map->lock);
+	xnvme_async_wait(map->dev, map->ctx);
+	pthread_mutex_unlock(&map->lock);
+
+	return NULL;
+}
+
+/**
+ * Writes back the given modified blocks, synchronously, via the staging
+ * buffer; the blocks are write-protected before they are copied
+ */
+static int
+mmap_writeback(struct xnvme_mmap *map, uint64_t blk, uint64_t nblks)
+{
+	const uint64_t slba = map->slba + blk * map->blk_nlb;
+	const uint64_t nlb = blk_nlb(map, blk, nblks);
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = mmap_protect(map, blk, nblks, 1);
+	if (err) {
+		return err;
+	}
+	memcpy(map->sbuf, blk_addr(map, blk), nblks * map->blk_nbytes);
+
+	err = xnvme_cmd_write(map->dev, map->nsid, slba, nlb - 1, map->sbuf,
+			      NULL, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_write(), err: %d", err);
+		mmap_protect(map, blk, nblks, 0);
+		return err ? err : -EIO;
+	}
+
+	for (uint64_t i = 0; i < nblks; ++i) {
+		map->state[blk + i] = XNVME_MMAP_BLK_CLEAN;
+	}
+	map->stats.written += nblks;
+
+	return 0;
+}
+
+int
+xnvme_msync(struct xnvme_mmap *map, uint64_t ofz, uint64_t nbytes)
+{
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	uint64_t first, end;
+	int err = 0;
+
+	if (ofz > map->nbytes) {
+		XNVME_DEBUG("FAILED: invalid ofz: %"PRIu64, ofz);
+		return -EINVAL;
+	}
+	nbytes = nbytes ? u64_min(nbytes, map->nbytes - ofz) :
+		 map->nbytes - ofz;
+	first = ofz / map->blk_nbytes;
+	end = (ofz + nbytes + map->blk_nbytes - 1) / map->blk_nbytes;
+
+	pthread_mutex_lock(&map->lock);
+
+	for (uint64_t blk = first; (blk < end) && !err;) {
+		uint64_t nblks = 0;
+
+		while ((blk + nblks < end) && (nblks < map->sbuf_nblks) &&
+		       (map->state[blk + nblks] == XNVME_MMAP_BLK_DIRTY)) {
+			nblks += 1;
+		}
+		if (!nblks) {
+			blk += 1;
+			continue;
+		}
+
+		err = mmap_writeback(map, blk, nblks);
+		blk += nblks;
+	}
+
+	// Wait for the write-back of blocks evicted
+	for (uint64_t blk = first; (blk < end) && !err; ++blk) {
+		while (map->state[blk] == XNVME_MMAP_BLK_WRITEBACK) {
+			pthread_cond_wait(&map->cond, &map->lock);
+		}
+	}
+
+	if (!err) {
+		err = map->err;
+		map->err = 0;
+	}
+
+	if (!err && xnvme_dev_get_ctrlr(map->dev)->vwc.present) {
+		cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+		cmd.common.nsid = map->nsid;
+
+		err = xnvme_cmd_pass(map->dev, &cmd, NULL, 0, NULL, 0,
+				     XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: xnvme_cmd_pass(), err: %d", err);
+			err = err ? err : -EIO;
+		}
+	}
+
+	pthread_mutex_unlock(&map->lock);
+
+	return err;
+}
+
+void *
+xnvme_mmap_get_addr(const struct xnvme_mmap *map)
+{
+	return map->addr;
+}
+
+uint64_t
+xnvme_mmap_get_nbytes(const struct xnvme_mmap *map)
+{
+	return map->nbytes;
+}
+
+const struct xnvme_mmap_stats *
+xnvme_mmap_get_stats(const struct xnvme_mmap *map)
+{
+	return &map->stats;
+}
+
+static void
+mmap_free(struct xnvme_mmap *map)
+{
+	if (map->running) {
+		uint64_t val = 1;
+
+		if (write(map->efd, &val, sizeof(val)) != sizeof(val)) {
+			XNVME_DEBUG("FAILED: write(), errno: %d", errno);
+		}
+		pthread_join(map->thread, NULL);
+	}
+
+	if (map->addr) {
+		struct uffdio_range range = {
+			.start = (uintptr_t)map->addr,
+			.len = map->nbytes,
+		};
+
+		if (map->uffd >= 0) {
+			ioctl(map->uffd, UFFDIO_UNREGISTER, &range);
+		}
+		munmap(map->addr, map->nbytes);
+	}
+	if (map->uffd >= 0) {
+		close(map->uffd);
+	}
+	if (map->efd >= 0) {
+		close(map->efd);
+	}
+
+	if (map->ctx) {
+		xnvme_async_term(map->dev, map->ctx);
+	}
+	for (uint32_t i = 0; map->ios && (i < XNVME_MMAP_NIOS); ++i) {
+		xnvme_buf_free(map->dev, map->ios[i].payload);
+	}
+	xnvme_buf_free(map->dev, map->sbuf);
+
+	pthread_cond_destroy(&map->cond);
+	pthread_mutex_destroy(&map->lock);
+
+	free(map->ios);
+	free(map->fifo);
+	free(map->state);
+	free(map);
+}
+
+int
+xnvme_munmap(struct xnvme_mmap *map)
+{
+	int err;
+
+	if (!map) {
+		return 0;
+	}
+
+	err = xnvme_msync(map, 0, 0);
+	mmap_free(map);
+
+	return err;
+}
+
+static int
+mmap_uffd(struct xnvme_mmap *map)
+{
+	const int rdonly = map->opts & XNVME_MMAP_RDONLY;
+	struct uffdio_api api = {
+		.api = UFFD_API,
+		.features = rdonly ? 0 : UFFD_FEATURE_PAGEFAULT_FLAG_WP,
+	};
+	struct uffdio_register reg = {
+		.range = {
+			.start = (uintptr_t)map->addr,
+			.len = map->nbytes,
+		},
+		.mode = UFFDIO_REGISTER_MODE_MISSING |
+			(rdonly ? 0 : UFFDIO_REGISTER_MODE_WP),
+	};
+
+	map->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if ((map->uffd < 0) && (errno == EPERM)) {
+		// Without privileges, faults by the kernel cannot be handled
+		map->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK |
+				    UFFD_USER_MODE_ONLY);
+	}
+	if (map->uffd < 0) {
+		XNVME_DEBUG("FAILED: userfaultfd(), errno: %d", errno);
+		return -errno;
+	}
+
+	if (ioctl(map->uffd, UFFDIO_API, &api)) {
+		XNVME_DEBUG("FAILED: ioctl(UFFDIO_API), errno: %d", errno);
+		return errno == EINVAL ? -ENOTSUP : -errno;
+	}
+	if (ioctl(map->uffd, UFFDIO_REGISTER, &reg)) {
+		XNVME_DEBUG("FAILED: ioctl(UFFDIO_REGISTER), errno: %d", errno);
+		return errno == EINVAL ? -ENOTSUP : -errno;
+	}
+	if (!rdonly && !(reg.ioctls & (1ULL << _UFFDIO_WRITEPROTECT))) {
+		XNVME_DEBUG("FAILED: no support for UFFDIO_WRITEPROTECT");
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+int
+xnvme_mmap(struct xnvme_dev *dev, struct xnvme_mmap **map, uint64_t slba,
+	   uint64_t nlb, uint64_t resident_nbytes, int opts)
+{
+	const struct xnvme_geo *geo = &dev->geo;
+	const long page_nbytes = sysconf(_SC_PAGESIZE);
+	uint64_t nlbas, sbuf_nbytes;
+	int err;
+
+	if ((!geo->lba_nbytes) || (page_nbytes <= 0)) {
+		XNVME_DEBUG("FAILED: invalid lba_nbytes: %u", geo->lba_nbytes);
+		return -EINVAL;
+	}
+	nlbas = geo->tbytes / geo->lba_nbytes;
+	nlb = nlb ? nlb : nlbas - u64_min(slba, nlbas);
+	if ((!nlb) || (slba >= nlbas) || (nlb > nlbas - slba)) {
+		XNVME_DEBUG("FAILED: invalid range, slba: %"PRIu64", "
+			    "nlb: %"PRIu64, slba, nlb);
+		return -EINVAL;
+	}
+
+	(*map) = calloc(1, sizeof(**map));
+	if (!(*map)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*map)->dev = dev;
+	(*map)->nsid = xnvme_dev_get_nsid(dev);
+	(*map)->opts = opts;
+	(*map)->slba = slba;
+	(*map)->nlb = nlb;
+	(*map)->uffd = -1;
+	(*map)->efd = -1;
+	pthread_mutex_init(&(*map)->lock, NULL);
+	pthread_cond_init(&(*map)->cond, NULL);
+
+	(*map)->blk_nbytes = u64_max(page_nbytes, geo->lba_nbytes);
+	(*map)->blk_nlb = (*map)->blk_nbytes / geo->lba_nbytes;
+	(*map)->nblks = (nlb + (*map)->blk_nlb - 1) / (*map)->blk_nlb;
+	(*map)->nbytes = (*map)->nblks * (*map)->blk_nbytes;
+
+	sbuf_nbytes = u64_min((uint64_t)geo->mdts_nbytes,
+				(UINT16_MAX + 1ULL) * geo->lba_nbytes);
+	if ((*map)->blk_nbytes > sbuf_nbytes) {
+		XNVME_DEBUG("FAILED: blk_nbytes: %u > mdts_nbytes: %u",
+			    (*map)->blk_nbytes, geo->mdts_nbytes);
+		err = -EINVAL;
+		goto failed;
+	}
+	(*map)->sbuf_nblks = sbuf_nbytes / (*map)->blk_nbytes;
+
+	resident_nbytes = resident_nbytes ? resident_nbytes :
+			  XNVME_MMAP_RESIDENT_DEF;
+	(*map)->fifo_cap = u64_max(resident_nbytes / (*map)->blk_nbytes,
+				     (uint64_t)XNVME_MMAP_RESIDENT_MIN);
+	(*map)->fifo_cap = u64_min((*map)->fifo_cap, (*map)->nblks);
+
+	(*map)->state = calloc((*map)->nblks, sizeof(*(*map)->state));
+	(*map)->fifo = calloc((*map)->fifo_cap, sizeof(*(*map)->fifo));
+	(*map)->ios = calloc(XNVME_MMAP_NIOS, sizeof(*(*map)->ios));
+	if (!(*map)->state || !(*map)->fifo || !(*map)->ios) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: calloc(), err: %d", err);
+		goto failed;
+	}
+
+	err = xnvme_async_init(dev, &(*map)->ctx, XNVME_MMAP_NIOS, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		(*map)->ctx = NULL;
+		goto failed;
+	}
+
+	for (uint32_t i = 0; i < XNVME_MMAP_NIOS; ++i) {
+		struct xnvme_mmap_io *io = &(*map)->ios[i];
+
+		io->map = *map;
+		io->payload = xnvme_buf_alloc(dev, (*map)->blk_nbytes, NULL);
+		if (!io->payload) {
+			err = -errno;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+			goto failed;
+		}
+		io->next = (*map)->free;
+		(*map)->free = io;
+	}
+
+	(*map)->sbuf = xnvme_buf_alloc(dev, (*map)->sbuf_nblks *
+				       (*map)->blk_nbytes, NULL);
+	if (!(*map)->sbuf) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+		goto failed;
+	}
+
+	(*map)->addr = mmap(NULL, (*map)->nbytes, (opts & XNVME_MMAP_RDONLY) ?
+			    PROT_READ : PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if ((*map)->addr == MAP_FAILED) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: mmap(), err: %d", err);
+		(*map)->addr = NULL;
+		goto failed;
+	}
+
+	err = mmap_uffd(*map);
+	if (err) {
+		XNVME_DEBUG("FAILED: mmap_uffd(), err: %d", err);
+		goto failed;
+	}
+
+	(*map)->efd = eventfd(0, EFD_CLOEXEC);
+	if ((*map)->efd < 0) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: eventfd(), err: %d", err);
+		goto failed;
+	}
+
+	err = -pthread_create(&(*map)->thread, NULL, mmap_main, *map);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+		goto failed;
+	}
+	(*map)->running = 1;
+
+	return 0;
+
+failed:
+	mmap_free(*map);
+	*map = NULL;
+
+	return err;
+}
+
+#else
+
+int
+xnvme_mmap(struct xnvme_dev *XNVME_UNUSED(dev),
+	   struct xnvme_mmap **XNVME_UNUSED(map), uint64_t XNVME_UNUSED(slba),
+	   uint64_t XNVME_UNUSED(nlb), uint64_t XNVME_UNUSED(resident_nbytes),
+	   int XNVME_UNUSED(opts))
+{
+	XNVME_DEBUG("FAILED: userfaultfd is not available");
+	return -ENOSYS;
+}
+
+void *
+xnvme_mmap_get_addr(const struct xnvme_mmap *XNVME_UNUSED(map))
+{
+	return NULL;
+}
+
+uint64_t
+xnvme_mmap_get_nbytes(const struct xnvme_mmap *XNVME_UNUSED(map))
+{
+	return 0;
+}
+
+int
+xnvme_msync(struct xnvme_mmap *XNVME_UNUSED(map), uint64_t XNVME_UNUSED(ofz),
+	    uint64_t XNVME_UNUSED(nbytes))
+{
+	return -ENOSYS;
+}
+
+const struct xnvme_mmap_stats *
+xnvme_mmap_get_stats(const struct xnvme_mmap *XNVME_UNUSED(map))
+{
+	return NULL;
+}
+
+int
+xnvme_munmap(struct xnvme_mmap *XNVME_UNUSED(map))
+{
+	return -ENOSYS;
+}
+
+#endif
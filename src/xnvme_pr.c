@@ -0,0 +1,132 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <xnvme_pr.h>
+
+void
+xnvme_pr_buf_init(struct xnvme_pr_buf *pb, FILE *stream)
+{
+	pb->stream = stream;
+	pb->len = 0;
+	pb->wrtn = 0;
+	pb->err = 0;
+}
+
+static void
+pr_buf_drain(struct xnvme_pr_buf *pb)
+{
+	if (pb->len && (!pb->err) &&
+	    (fwrite(pb->buf, 1, pb->len, pb->stream) != pb->len)) {
+		pb->err = errno ? -errno : -EIO;
+	}
+	pb->len = 0;
+}
+
+int
+xnvme_pr_buf_write(struct xnvme_pr_buf *pb, const void *data, size_t nbytes)
+{
+	if (nbytes > sizeof(pb->buf) - pb->len) {
+		pr_buf_drain(pb);
+	}
+
+	if (nbytes > sizeof(pb->buf)) {
+		if ((!pb->err) &&
+		    (fwrite(data, 1, nbytes, pb->stream) != nbytes)) {
+			pb->err = errno ? -errno : -EIO;
+		}
+	} else {
+		memcpy(pb->buf + pb->len, data, nbytes);
+		pb->len += nbytes;
+	}
+	pb->wrtn += nbytes;
+
+	return nbytes;
+}
+
+int
+xnvme_pr_buf_printf(struct xnvme_pr_buf *pb, const char *fmt, ...)
+{
+	va_list args;
+	int nbytes;
+
+	for (int retry = 0; retry < 2; ++retry) {
+		size_t room = sizeof(pb->buf) - pb->len;
+
+		va_start(args, fmt);
+		nbytes = vsnprintf(pb->buf + pb->len, room, fmt, args);
+		va_end(args);
+		if (nbytes < 0) {
+			return nbytes;
+		}
+		if ((size_t)nbytes < room) {
+			pb->len += nbytes;
+			pb->wrtn += nbytes;
+			return nbytes;
+		}
+
+		pr_buf_drain(pb);
+	}
+
+	// Larger than the buffer, thus written directly
+	va_start(args, fmt);
+	nbytes = vfprintf(pb->stream, fmt, args);
+	va_end(args);
+	if (nbytes < 0) {
+		pb->err = pb->err ? pb->err : -EIO;
+		return nbytes;
+	}
+	pb->wrtn += nbytes;
+
+	return nbytes;
+}
+
+int
+xnvme_pr_buf_csv_str(struct xnvme_pr_buf *pb, const char *str)
+{
+	int wrtn = 0;
+
+	if (!strpbrk(str, ",\"\r\n")) {
+		return xnvme_pr_buf_write(pb, str, strlen(str));
+	}
+
+	wrtn += xnvme_pr_buf_write(pb, "\"", 1);
+	for (const char *c = str; *c; ++c) {
+		if (*c == '"') {
+			wrtn += xnvme_pr_buf_write(pb, "\"", 1);
+		}
+		wrtn += xnvme_pr_buf_write(pb, c, 1);
+	}
+	wrtn += xnvme_pr_buf_write(pb, "\"", 1);
+
+	return wrtn;
+}
+
+int
+xnvme_pr_buf_json_str(struct xnvme_pr_buf *pb, const char *str)
+{
+	int wrtn = 0;
+
+	wrtn += xnvme_pr_buf_write(pb, "\"", 1);
+	for (const unsigned char *c = (const void *)str; *c; ++c) {
+		if ((*c == '"') || (*c == '\\')) {
+			wrtn += xnvme_pr_buf_printf(pb, "\\%c", *c);
+		} else if (*c < 0x20) {
+			wrtn += xnvme_pr_buf_printf(pb, "\\u%04x", *c);
+		} else {
+			wrtn += xnvme_pr_buf_write(pb, c, 1);
+		}
+	}
+	wrtn += xnvme_pr_buf_write(pb, "\"", 1);
+
+	return wrtn;
+}
+
+int
+xnvme_pr_buf_flush(struct xnvme_pr_buf *pb)
+{
+	pr_buf_drain(pb);
+
+	return pb->err ? pb->err : pb->wrtn;
+}
@@ -0,0 +1,510 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_dev.h>
+
+#define XNVME_PREFETCH_NSTREAMS 8
+
+enum xnvme_prefetch_buf_state {
+	XNVME_PREFETCH_BUF_FREE = 0x0,
+	XNVME_PREFETCH_BUF_INFLIGHT = 0x1,
+	XNVME_PREFETCH_BUF_READY = 0x2,
+	XNVME_PREFETCH_BUF_ERROR = 0x3,
+};
+
+struct xnvme_prefetch_buf {
+	uint64_t slba;		///< First LBA held by the buffer
+	uint32_t nlb;		///< Number of LBAs held, NOT zero-based
+	uint32_t state;		///< See enum xnvme_prefetch_buf_state
+	uint64_t tick;		///< For LRU reclaim of READY buffers
+	uint8_t *payload;
+	struct xnvme_req req;
+};
+
+/**
+ * A stream is identified by the LBA following the last read of it; a read
+ * starting there continues the stream
+ */
+struct xnvme_prefetch_stream {
+	uint64_t next;		///< LBA following the last read
+	uint64_t ra_next;	///< LBA at which to continue read-ahead
+	uint32_t nsid;
+	uint32_t window;	///< Read-ahead window in number of buffers
+	uint64_t tick;		///< For LRU replacement of streams
+};
+
+struct xnvme_prefetch {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;
+	uint64_t nlbas;		///< Number of LBAs on the device
+	uint32_t buf_nlb;	///< Number of LBAs per buffer, NOT zero-based
+	uint32_t nbufs;
+	uint64_t tick;
+
+	struct xnvme_prefetch_stats stats;
+	struct xnvme_prefetch_stream streams[XNVME_PREFETCH_NSTREAMS];
+	struct xnvme_prefetch_buf bufs[];
+};
+
+static void
+prefetch_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_prefetch_buf *buf = cb_arg;
+
+	buf->state = xnvme_req_cpl_status(req) ? XNVME_PREFETCH_BUF_ERROR :
+		     XNVME_PREFETCH_BUF_READY;
+}
+
+static inline int
+buf_contains(const struct xnvme_prefetch_buf *buf, uint64_t lba)
+{
+	return (buf->slba <= lba) && (lba < buf->slba + buf->nlb);
+}
+
+static inline void
+buf_release(struct xnvme_prefetch *pf, struct xnvme_prefetch_buf *buf,
+	    int consumed)
+{
+	if (!consumed && (buf->state == XNVME_PREFETCH_BUF_READY)) {
+		pf->stats.wasted += 1;
+	}
+	buf->state = XNVME_PREFETCH_BUF_FREE;
+}
+
+/**
+ * Waits for the given buffer, when it is in-flight
+ */
+static int
+buf_wait(struct xnvme_prefetch *pf, struct xnvme_prefetch_buf *buf)
+{
+	while (buf->state == XNVME_PREFETCH_BUF_INFLIGHT) {
+		int err = xnvme_async_poke(pf->dev, pf->ctx, 0);
+
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static struct xnvme_prefetch_buf *
+buf_lookup(struct xnvme_prefetch *pf, uint64_t lba)
+{
+	for (uint32_t i = 0; i < pf->nbufs; ++i) {
+		struct xnvme_prefetch_buf *buf = &pf->bufs[i];
+
+		switch (buf->state) {
+		case XNVME_PREFETCH_BUF_INFLIGHT:
+		case XNVME_PREFETCH_BUF_READY:
+			if (buf_contains(buf, lba)) {
+				return buf;
+			}
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Whether the given buffer is within the read-ahead window of a stream, that
+ * is, prefetched and yet to be read
+ */
+static int
+buf_in_window(struct xnvme_prefetch *pf, const struct xnvme_prefetch_buf *buf)
+{
+	for (int i = 0; i < XNVME_PREFETCH_NSTREAMS; ++i) {
+		const struct xnvme_prefetch_stream *stream = &pf->streams[i];
+
+		if (stream->window && (buf->slba + buf->nlb > stream->next) &&
+		    (buf->slba < stream->ra_next)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Returns a free buffer, reclaiming the least-recently-used READY buffer
+ * outside of the read-ahead windows, when none are free
+ */
+static struct xnvme_prefetch_buf *
+buf_get(struct xnvme_prefetch *pf)
+{
+	struct xnvme_prefetch_buf *lru = NULL;
+
+	for (uint32_t i = 0; i < pf->nbufs; ++i) {
+		struct xnvme_prefetch_buf *buf = &pf->bufs[i];
+
+		switch (buf->state) {
+		case XNVME_PREFETCH_BUF_FREE:
+			return buf;
+
+		case XNVME_PREFETCH_BUF_ERROR:
+			buf_release(pf, buf, 0);
+			return buf;
+
+		case XNVME_PREFETCH_BUF_READY:
+			if ((!lru || (buf->tick < lru->tick)) &&
+			    (!buf_in_window(pf, buf))) {
+				lru = buf;
+			}
+			break;
+		}
+	}
+
+	if (lru) {
+		buf_release(pf, lru, 0);
+	}
+
+	return lru;
+}
+
+static struct xnvme_prefetch_stream *
+stream_lookup(struct xnvme_prefetch *pf, uint32_t nsid, uint64_t slba,
+	      int *seq)
+{
+	struct xnvme_prefetch_stream *lru = &pf->streams[0];
+
+	for (int i = 0; i < XNVME_PREFETCH_NSTREAMS; ++i) {
+		struct xnvme_prefetch_stream *stream = &pf->streams[i];
+
+		if (stream->tick && (stream->nsid == nsid) &&
+		    (stream->next == slba)) {
+			*seq = 1;
+			return stream;
+		}
+		if (stream->tick < lru->tick) {
+			lru = stream;
+		}
+	}
+
+	*seq = 0;
+	lru->nsid = nsid;
+	lru->window = 0;
+
+	return lru;
+}
+
+/**
+ * Issue read-ahead for the given stream, within its window, as long as free
+ * buffers are available
+ */
+static int
+stream_readahead(struct xnvme_prefetch *pf,
+		 struct xnvme_prefetch_stream *stream)
+{
+	const uint64_t limit = stream->next +
+			       (uint64_t)stream->window * pf->buf_nlb;
+
+	while ((stream->ra_next < limit) && (stream->ra_next < pf->nlbas)) {
+		struct xnvme_prefetch_buf *buf = NULL;
+		uint64_t nlb = pf->buf_nlb;
+		int err;
+
+		if (buf_lookup(pf, stream->ra_next)) {	// Overlapping stream
+			break;
+		}
+
+		buf = buf_get(pf);
+		if (!buf) {
+			break;
+		}
+
+		if (stream->ra_next + nlb > pf->nlbas) {
+			nlb = pf->nlbas - stream->ra_next;
+		}
+
+		buf->slba = stream->ra_next;
+		buf->nlb = nlb;
+		buf->tick = pf->tick;
+		buf->state = XNVME_PREFETCH_BUF_INFLIGHT;
+
+		xnvme_req_clear(&buf->req);
+		buf->req.async.ctx = pf->ctx;
+		buf->req.async.cb = prefetch_cb;
+		buf->req.async.cb_arg = buf;
+
+		err = xnvme_cmd_read(pf->dev, stream->nsid, buf->slba,
+				     buf->nlb - 1, buf->payload, NULL,
+				     XNVME_CMD_ASYNC, &buf->req);
+		switch (err) {
+		case 0:
+			break;
+
+		case -EBUSY:
+		case -EAGAIN:
+			buf->state = XNVME_PREFETCH_BUF_FREE;
+			return 0;
+
+		default:
+			XNVME_DEBUG("FAILED: xnvme_cmd_read(), err: %d", err);
+			buf->state = XNVME_PREFETCH_BUF_FREE;
+			return err;
+		}
+
+		pf->stats.prefetched += 1;
+		stream->ra_next += nlb;
+	}
+
+	return 0;
+}
+
+int
+xnvme_prefetch_read(struct xnvme_prefetch *pf, uint32_t nsid, uint64_t slba,
+		    uint16_t nlb, void *dbuf, struct xnvme_req *req)
+{
+	const uint32_t lba_nbytes = pf->dev->geo.lba_nbytes;
+	const uint64_t elba = slba + nlb + 1;
+	struct xnvme_prefetch_stream *stream;
+	struct xnvme_req local = { 0 };
+	uint8_t *payload = dbuf;
+	uint64_t lba = slba;
+	int seq, err;
+
+	if (!req) {
+		req = &local;
+	}
+
+	pf->tick += 1;
+
+	// Reap completed read-ahead, without blocking
+	err = xnvme_async_poke(pf->dev, pf->ctx, 0);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+		return err;
+	}
+
+	// Serve as much as possible from prefetched buffers
+	while (lba < elba) {
+		struct xnvme_prefetch_buf *buf = buf_lookup(pf, lba);
+		uint64_t ofz, count;
+
+		if (!buf) {
+			break;
+		}
+
+		err = buf_wait(pf, buf);
+		if (err) {
+			return err;
+		}
+		if (buf->state != XNVME_PREFETCH_BUF_READY) {
+			buf_release(pf, buf, 0);
+			break;
+		}
+
+		ofz = lba - buf->slba;
+		count = XNVME_MIN(buf->nlb - ofz, elba - lba);
+
+		memcpy(payload, buf->payload + ofz * lba_nbytes,
+		       count * lba_nbytes);
+		buf->tick = pf->tick;
+
+		if (ofz + count == buf->nlb) {
+			buf_release(pf, buf, 1);
+		}
+
+		lba += count;
+		payload += count * lba_nbytes;
+	}
+
+	// Read the remainder from the device
+	if (lba < elba) {
+		err = xnvme_cmd_read(pf->dev, nsid, lba, elba - lba - 1,
+				     payload, NULL, XNVME_CMD_SYNC, req);
+		if (err || xnvme_req_cpl_status(req)) {
+			XNVME_DEBUG("FAILED: xnvme_cmd_read(), err: %d", err);
+			return err ? err : -EIO;
+		}
+		pf->stats.misses += 1;
+	} else {
+		xnvme_req_clear(req);
+		pf->stats.hits += 1;
+	}
+
+	// Grow the window of sequential streams, reset it on others
+	stream = stream_lookup(pf, nsid, slba, &seq);
+	if (seq) {
+		stream->window = stream->window ? stream->window * 2 : 1;
+		stream->window = XNVME_MIN(stream->window, pf->nbufs);
+	} else {
+		stream->ra_next = elba;
+	}
+	stream->next = elba;
+	stream->tick = pf->tick;
+	if (stream->ra_next < elba) {
+		stream->ra_next = elba;
+	}
+
+	return stream_readahead(pf, stream);
+}
+
+int
+xnvme_prefetch_invalidate(struct xnvme_prefetch *pf, uint64_t slba,
+			  uint16_t nlb)
+{
+	const uint64_t elba = slba + nlb + 1;
+
+	for (uint32_t i = 0; i < pf->nbufs; ++i) {
+		struct xnvme_prefetch_buf *buf = &pf->bufs[i];
+		int err;
+
+		if ((buf->state == XNVME_PREFETCH_BUF_FREE) ||
+		    (buf->slba >= elba) || (buf->slba + buf->nlb <= slba)) {
+			continue;
+		}
+
+		err = buf_wait(pf, buf);
+		if (err) {
+			return err;
+		}
+
+		buf_release(pf, buf, 0);
+	}
+
+	return 0;
+}
+
+const struct xnvme_prefetch_stats *
+xnvme_prefetch_get_stats(const struct xnvme_prefetch *pf)
+{
+	return &pf->stats;
+}
+
+void
+xnvme_prefetch_term(struct xnvme_prefetch *pf)
+{
+	if (!pf) {
+		return;
+	}
+
+	if (pf->ctx) {
+		xnvme_async_wait(pf->dev, pf->ctx);
+		xnvme_async_term(pf->dev, pf->ctx);
+	}
+	for (uint32_t i = 0; i < pf->nbufs; ++i) {
+		xnvme_buf_free(pf->dev, pf->bufs[i].payload);
+	}
+
+	free(pf);
+}
+
+int
+xnvme_prefetch_init(struct xnvme_dev *dev, struct xnvme_prefetch **pf,
+		    uint16_t nbufs, uint32_t buf_nbytes)
+{
+	const struct xnvme_geo *geo = &dev->geo;
+	int err;
+
+	if ((!nbufs) || (nbufs > 4096) || (nbufs & (nbufs - 1))) {
+		XNVME_DEBUG("FAILED: invalid nbufs: %u", nbufs);
+		return -EINVAL;
+	}
+	buf_nbytes = buf_nbytes ? buf_nbytes : geo->mdts_nbytes;
+	if ((!geo->lba_nbytes) || (!buf_nbytes) ||
+	    (buf_nbytes % geo->lba_nbytes) ||
+	    (buf_nbytes / geo->lba_nbytes > UINT16_MAX + 1)) {
+		XNVME_DEBUG("FAILED: invalid buf_nbytes: %u", buf_nbytes);
+		return -EINVAL;
+	}
+
+	(*pf) = calloc(1, sizeof(**pf) + nbufs * sizeof(*(*pf)->bufs));
+	if (!(*pf)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*pf)->dev = dev;
+	(*pf)->nlbas = geo->tbytes / geo->lba_nbytes;
+	(*pf)->buf_nlb = buf_nbytes / geo->lba_nbytes;
+	(*pf)->nbufs = nbufs;
+
+	err = xnvme_async_init(dev, &(*pf)->ctx, nbufs, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		(*pf)->ctx = NULL;
+		goto failed;
+	}
+
+	for (uint32_t i = 0; i < nbufs; ++i) {
+		(*pf)->bufs[i].payload = xnvme_buf_alloc(dev, buf_nbytes, NULL);
+		if (!(*pf)->bufs[i].payload) {
+			err = -errno;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+			goto failed;
+		}
+	}
+
+	return 0;
+
+failed:
+	xnvme_prefetch_term(*pf);
+	*pf = NULL;
+
+	return err;
+}
+
+static int
+xnvme_prefetch_stats_yaml(FILE *stream,
+			  const struct xnvme_prefetch_stats *stats, int indent,
+			  const char *sep, int head)
+{
+	int wrtn = 0;
+
+	if (head) {
+		wrtn += fprintf(stream, "%*sxnvme_prefetch_stats:", indent, "");
+		indent += 2;
+	}
+	if (!stats) {
+		wrtn += fprintf(stream, " ~");
+		return wrtn;
+	}
+	if (head) {
+		wrtn += fprintf(stream, "\n");
+	}
+
+	wrtn += fprintf(stream, "%*shits: %"PRIu64"%s", indent, "",
+			stats->hits, sep);
+	wrtn += fprintf(stream, "%*smisses: %"PRIu64"%s", indent, "",
+			stats->misses, sep);
+	wrtn += fprintf(stream, "%*sprefetched: %"PRIu64"%s", indent, "",
+			stats->prefetched, sep);
+	wrtn += fprintf(stream, "%*swasted: %"PRIu64"", indent, "",
+			stats->wasted);
+
+	return wrtn;
+}
+
+int
+xnvme_prefetch_stats_fpr(FILE *stream, const struct xnvme_prefetch_stats *stats,
+			 int opts)
+{
+	int wrtn = 0;
+
+	switch (opts) {
+	case XNVME_PR_TERSE:
+		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
+		return wrtn;
+
+	case XNVME_PR_DEF:
+	case XNVME_PR_YAML:
+		break;
+	}
+
+	wrtn += xnvme_prefetch_stats_yaml(stream, stats, 0, "\n", 1);
+	wrtn += fprintf(stream, "\n");
+
+	return wrtn;
+}
+
+int
+xnvme_prefetch_stats_pr(const struct xnvme_prefetch_stats *stats, int opts)
+{
+	return xnvme_prefetch_stats_fpr(stdout, stats, opts);
+}
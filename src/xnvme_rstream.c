@@ -0,0 +1,291 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_dev.h>
+
+enum xnvme_rstream_slot_state {
+	XNVME_RSTREAM_SLOT_FREE = 0x0,
+	XNVME_RSTREAM_SLOT_INFLIGHT = 0x1,
+	XNVME_RSTREAM_SLOT_READY = 0x2,
+	XNVME_RSTREAM_SLOT_ERROR = 0x3,
+	XNVME_RSTREAM_SLOT_HELD = 0x4,	///< Handed out, not yet returned
+};
+
+struct xnvme_rstream_slot {
+	struct xnvme_rstream_chunk chunk;	///< As seen by the caller
+	uint32_t state;		///< See enum xnvme_rstream_slot_state
+	struct xnvme_rstream *rs;
+	struct xnvme_req req;
+};
+
+/**
+ * Chunks are assigned to the slots of the ring in LBA order; the n'th chunk
+ * of the range goes in slot n % nslots. Submission thus stalls on a slot held
+ * by the caller, and delivery on a slot being read, which is what keeps the
+ * chunks in order.
+ */
+struct xnvme_rstream {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;
+	uint32_t nsid;
+	uint64_t elba;		///< Last LBA of the range
+	uint64_t next;		///< Next LBA to assign to a chunk
+	uint32_t chunk_nlb;	///< NOT zero-based
+	uint64_t zone_nlb;	///< Chunks are clipped at zone boundaries, when set
+
+	uint64_t nsubmitted;	///< Number of chunks submitted
+	uint64_t ndelivered;	///< Number of chunks handed out
+	uint32_t qd;
+	uint32_t inflight;
+	int err;		///< Sticky error of the stream
+
+	uint32_t nslots;
+	struct xnvme_rstream_slot slots[];
+};
+
+static void
+rstream_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_rstream_slot *slot = cb_arg;
+
+	slot->rs->inflight -= 1;
+	slot->state = xnvme_req_cpl_status(req) ? XNVME_RSTREAM_SLOT_ERROR :
+		      XNVME_RSTREAM_SLOT_READY;
+}
+
+/**
+ * Submit reads for the following chunks of the range, as long as their slots
+ * are free
+ */
+static int
+rstream_submit(struct xnvme_rstream *rs)
+{
+	const uint32_t lba_nbytes = rs->dev->geo.lba_nbytes;
+
+	while ((rs->next <= rs->elba) && (rs->inflight < rs->qd)) {
+		struct xnvme_rstream_slot *slot;
+		uint64_t nlb;
+		int err;
+
+		slot = &rs->slots[rs->nsubmitted % rs->nslots];
+		if (slot->state != XNVME_RSTREAM_SLOT_FREE) {
+			break;
+		}
+
+		nlb = XNVME_MIN(rs->elba + 1 - rs->next, rs->chunk_nlb);
+		if (rs->zone_nlb) {
+			uint64_t zend = (rs->next / rs->zone_nlb + 1) *
+					rs->zone_nlb;
+
+			nlb = XNVME_MIN(nlb, zend - rs->next);
+		}
+
+		slot->chunk.slba = rs->next;
+		slot->chunk.nlb = nlb;
+		slot->chunk.nbytes = nlb * lba_nbytes;
+		slot->state = XNVME_RSTREAM_SLOT_INFLIGHT;
+
+		xnvme_req_clear(&slot->req);
+		slot->req.async.ctx = rs->ctx;
+		slot->req.async.cb = rstream_cb;
+		slot->req.async.cb_arg = slot;
+
+		err = xnvme_cmd_read(rs->dev, rs->nsid, slot->chunk.slba,
+				     slot->chunk.nlb - 1, slot->chunk.buf, NULL,
+				     XNVME_CMD_ASYNC, &slot->req);
+		switch (err) {
+		case 0:
+			break;
+
+		case -EBUSY:
+		case -EAGAIN:
+			slot->state = XNVME_RSTREAM_SLOT_FREE;
+			return 0;
+
+		default:
+			XNVME_DEBUG("FAILED: xnvme_cmd_read(), err: %d", err);
+			slot->state = XNVME_RSTREAM_SLOT_FREE;
+			return err < 0 ? err : -EIO;
+		}
+
+		rs->next += nlb;
+		rs->nsubmitted += 1;
+		rs->inflight += 1;
+	}
+
+	return 0;
+}
+
+int
+xnvme_rstream_next(struct xnvme_rstream *rs, struct xnvme_rstream_chunk **chunk)
+{
+	*chunk = NULL;
+
+	while (!rs->err) {
+		struct xnvme_rstream_slot *slot;
+		int err;
+
+		rs->err = rstream_submit(rs);
+		if (rs->err) {
+			break;
+		}
+
+		slot = &rs->slots[rs->ndelivered % rs->nslots];
+
+		if (rs->ndelivered == rs->nsubmitted) {
+			if (rs->next > rs->elba) {
+				return 0;
+			}
+			if (slot->state == XNVME_RSTREAM_SLOT_HELD) {
+				XNVME_DEBUG("FAILED: all chunks are held");
+				return -ENOBUFS;
+			}
+		}
+
+		switch (slot->state) {
+		case XNVME_RSTREAM_SLOT_READY:
+			slot->state = XNVME_RSTREAM_SLOT_HELD;
+			rs->ndelivered += 1;
+			*chunk = &slot->chunk;
+			return 0;
+
+		case XNVME_RSTREAM_SLOT_ERROR:
+			XNVME_DEBUG("FAILED: read of slba: 0x%016"PRIx64,
+				    slot->chunk.slba);
+			rs->err = -EIO;
+			break;
+
+		default:
+			// Being read, or resubmission after -EBUSY/-EAGAIN
+			err = xnvme_async_poke(rs->dev, rs->ctx, 0);
+			if (err < 0) {
+				XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d",
+					    err);
+				rs->err = err;
+			}
+			break;
+		}
+	}
+
+	return rs->err;
+}
+
+int
+xnvme_rstream_put(struct xnvme_rstream *rs, struct xnvme_rstream_chunk *chunk)
+{
+	struct xnvme_rstream_slot *slot = (struct xnvme_rstream_slot *)chunk;
+
+	if ((slot < rs->slots) || (slot >= rs->slots + rs->nslots) ||
+	    (slot->state != XNVME_RSTREAM_SLOT_HELD)) {
+		XNVME_DEBUG("FAILED: chunk is not held");
+		return -EINVAL;
+	}
+
+	slot->state = XNVME_RSTREAM_SLOT_FREE;
+
+	if (rs->err) {
+		return 0;
+	}
+
+	// Keep the device busy with the slot just returned
+	rs->err = rstream_submit(rs);
+
+	return rs->err;
+}
+
+void
+xnvme_rstream_term(struct xnvme_rstream *rs)
+{
+	if (!rs) {
+		return;
+	}
+
+	if (rs->ctx) {
+		xnvme_async_wait(rs->dev, rs->ctx);
+		xnvme_async_term(rs->dev, rs->ctx);
+	}
+	for (uint32_t i = 0; i < rs->nslots; ++i) {
+		xnvme_buf_free(rs->dev, rs->slots[i].chunk.buf);
+	}
+
+	free(rs);
+}
+
+int
+xnvme_rstream_init(struct xnvme_dev *dev, struct xnvme_rstream **rs,
+		   uint32_t nsid, uint64_t slba, uint64_t elba,
+		   uint32_t chunk_nbytes, uint16_t qd)
+{
+	const struct xnvme_geo *geo = &dev->geo;
+	int err;
+
+	chunk_nbytes = chunk_nbytes ? chunk_nbytes : geo->mdts_nbytes;
+	if ((!geo->lba_nbytes) || (!chunk_nbytes) ||
+	    (chunk_nbytes > geo->mdts_nbytes) ||
+	    (chunk_nbytes % geo->lba_nbytes) ||
+	    (chunk_nbytes / geo->lba_nbytes > UINT16_MAX + 1)) {
+		XNVME_DEBUG("FAILED: invalid chunk_nbytes: %u", chunk_nbytes);
+		return -EINVAL;
+	}
+	if ((slba > elba) || (elba >= geo->tbytes / geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: invalid range: [0x%016"PRIx64", "
+			    "0x%016"PRIx64"]", slba, elba);
+		return -EINVAL;
+	}
+	if (!qd) {
+		XNVME_DEBUG("FAILED: invalid qd: %u", qd);
+		return -EINVAL;
+	}
+
+	// One slot more than the queue-depth, for the chunk held by the caller
+	(*rs) = calloc(1, sizeof(**rs) + (qd + 1) * sizeof(*(*rs)->slots));
+	if (!(*rs)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*rs)->dev = dev;
+	(*rs)->nsid = nsid;
+	(*rs)->elba = elba;
+	(*rs)->next = slba;
+	(*rs)->chunk_nlb = chunk_nbytes / geo->lba_nbytes;
+	(*rs)->zone_nlb = geo->type == XNVME_GEO_ZONED ? geo->nsect : 0;
+	(*rs)->qd = qd;
+	(*rs)->nslots = qd + 1;
+
+	err = xnvme_async_init(dev, &(*rs)->ctx, qd, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		(*rs)->ctx = NULL;
+		goto failed;
+	}
+
+	for (uint32_t i = 0; i < (*rs)->nslots; ++i) {
+		struct xnvme_rstream_slot *slot = &(*rs)->slots[i];
+
+		slot->rs = *rs;
+		slot->chunk.buf = xnvme_buf_alloc(dev, chunk_nbytes, NULL);
+		if (!slot->chunk.buf) {
+			err = -errno;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+			goto failed;
+		}
+	}
+
+	err = rstream_submit(*rs);
+	if (err) {
+		XNVME_DEBUG("FAILED: rstream_submit(), err: %d", err);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	xnvme_rstream_term(*rs);
+	*rs = NULL;
+
+	return err;
+}
@@ -8,6 +8,7 @@
 #include <libxnvme_util.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
+#include <xnvme_pr.h>
 
 static long double
 bytes2double(const uint8_t bytes[], int n)
@@ -21,6 +22,83 @@ bytes2double(const uint8_t bytes[], int n)
 	return result;
 }
 
+/**
+ * Field of a record emitted as CSV or JSONL, 'u128' when set, overrides 'val'
+ */
+struct spec_pr_field {
+	const char *name;
+	uint64_t val;
+	const uint8_t *u128;
+};
+
+static void
+spec_pr_fields(struct xnvme_pr_buf *pb, const struct spec_pr_field *fields,
+	       int nfields, int opts, int head)
+{
+	if (head && (opts == XNVME_PR_CSV)) {
+		for (int i = 0; i < nfields; ++i) {
+			xnvme_pr_buf_printf(pb, "%s%s", i ? "," : "",
+					    fields[i].name);
+		}
+		xnvme_pr_buf_write(pb, "\n", 1);
+	}
+
+	if (opts == XNVME_PR_JSONL) {
+		xnvme_pr_buf_write(pb, "{", 1);
+	}
+	for (int i = 0; i < nfields; ++i) {
+		if (i) {
+			xnvme_pr_buf_write(pb, ",", 1);
+		}
+		if (opts == XNVME_PR_JSONL) {
+			xnvme_pr_buf_printf(pb, "\"%s\":", fields[i].name);
+		}
+		if (fields[i].u128) {
+			xnvme_pr_buf_printf(pb, "%.0Lf",
+					    bytes2double(fields[i].u128, 16));
+		} else {
+			xnvme_pr_buf_printf(pb, "%lu", fields[i].val);
+		}
+	}
+	xnvme_pr_buf_printf(pb, "%s\n", (opts == XNVME_PR_JSONL) ? "}" : "");
+}
+
+static int
+log_health_fpr_fields(FILE *stream,
+		      const struct xnvme_spec_log_health_entry *log, int opts)
+{
+	struct spec_pr_field fields[] = {
+		{"crit_warn", log->crit_warn, NULL},
+		{"comp_temp", log->comp_temp - 273u, NULL},
+		{"avail_spare", log->avail_spare, NULL},
+		{"avail_spare_thresh", log->avail_spare_thresh, NULL},
+		{"pct_used", log->pct_used, NULL},
+		{"eg_crit_warn_sum", log->eg_crit_warn_sum, NULL},
+		{"data_units_read", 0, log->data_units_read},
+		{"data_units_written", 0, log->data_units_written},
+		{"host_read_cmds", 0, log->host_read_cmds},
+		{"host_write_cmds", 0, log->host_write_cmds},
+		{"ctrlr_busy_time", 0, log->ctrlr_busy_time},
+		{"pwr_cycles", 0, log->pwr_cycles},
+		{"pwr_on_hours", 0, log->pwr_on_hours},
+		{"unsafe_shutdowns", 0, log->unsafe_shutdowns},
+		{"mdi_errs", 0, log->mdi_errs},
+		{"nr_err_logs", 0, log->nr_err_logs},
+		{"warn_comp_temp_time", log->warn_comp_temp_time, NULL},
+		{"crit_comp_temp_time", log->crit_comp_temp_time, NULL},
+		{"tmt1tc", log->tmt1tc, NULL},
+		{"tmt2tc", log->tmt2tc, NULL},
+		{"tttmt1", log->tttmt1, NULL},
+		{"tttmt2", log->tttmt2, NULL},
+	};
+	struct xnvme_pr_buf pb;
+
+	xnvme_pr_buf_init(&pb, stream);
+	spec_pr_fields(&pb, fields, sizeof(fields) / sizeof(*fields), opts, 1);
+
+	return xnvme_pr_buf_flush(&pb);
+}
+
 int
 xnvme_spec_log_health_fpr(FILE *stream,
 			  const struct xnvme_spec_log_health_entry *log,
@@ -33,6 +111,13 @@ xnvme_spec_log_health_fpr(FILE *stream,
 		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+		return log ? log_health_fpr_fields(stream, log, opts) : 0;
+
+	case XNVME_PR_BIN:
+		return log ? (int)fwrite(log, 1, sizeof(*log), stream) : 0;
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
@@ -154,6 +239,42 @@ xnvme_spec_log_erri_entry_pr(const struct xnvme_spec_log_erri_entry *entry,
 	return xnvme_spec_log_erri_entry_fpr(stdout, entry, opts);
 }
 
+static int
+log_erri_fpr_entries(FILE *stream, const struct xnvme_spec_log_erri_entry *log,
+		     int limit, int opts)
+{
+	struct xnvme_pr_buf pb;
+
+	xnvme_pr_buf_init(&pb, stream);
+
+	if (opts == XNVME_PR_BIN) {
+		xnvme_pr_buf_write(&pb, log, limit * sizeof(*log));
+		return xnvme_pr_buf_flush(&pb);
+	}
+
+	for (int i = 0; i < limit; ++i) {
+		const struct xnvme_spec_log_erri_entry *entry = &log[i];
+		struct spec_pr_field fields[] = {
+			{"ecnt", entry->ecnt, NULL},
+			{"sqid", entry->sqid, NULL},
+			{"cid", entry->cid, NULL},
+			{"status", entry->status.val, NULL},
+			{"eloc", entry->eloc, NULL},
+			{"lba", entry->lba, NULL},
+			{"nsid", entry->nsid, NULL},
+			{"ven_si", entry->ven_si, NULL},
+			{"trtype", entry->trtype, NULL},
+			{"cmd_si", entry->cmd_si, NULL},
+			{"trtype_si", entry->trtype_si, NULL},
+		};
+
+		spec_pr_fields(&pb, fields, sizeof(fields) / sizeof(*fields),
+			       opts, !i);
+	}
+
+	return xnvme_pr_buf_flush(&pb);
+}
+
 int
 xnvme_spec_log_erri_fpr(FILE *stream,
 			const struct xnvme_spec_log_erri_entry *log, int limit,
@@ -166,6 +287,11 @@ xnvme_spec_log_erri_fpr(FILE *stream,
 		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
+		return log ? log_erri_fpr_entries(stream, log, limit, opts) : 0;
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
@@ -209,9 +335,14 @@ xnvme_spec_idfy_ctrl_fpr(FILE *stream, const struct xnvme_spec_idfy_ctrlr *idfy,
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
 		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_BIN:
+		return idfy ? (int)fwrite(idfy, 1, sizeof(*idfy), stream) : 0;
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
@@ -322,9 +453,14 @@ xnvme_spec_idfy_ns_fpr(FILE *stream, const struct xnvme_spec_idfy_ns *idfy,
 
 	switch (opts) {
 	case XNVME_PR_TERSE:
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
 		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_BIN:
+		return idfy ? (int)fwrite(idfy, 1, sizeof(*idfy), stream) : 0;
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
@@ -351,6 +487,7 @@ xnvme_spec_idfy_ns_fpr(FILE *stream, const struct xnvme_spec_idfy_ns *idfy,
 			idfy->nsfeat.dealloc_or_unwritten_error);
 	wrtn += fprintf(stream, "    guid_never_reused: %d\n",
 			idfy->nsfeat.guid_never_reused);
+	wrtn += fprintf(stream, "    optperf: %d\n", idfy->nsfeat.optperf);
 	wrtn += fprintf(stream, "    reserved1: %d\n", idfy->nsfeat.reserved1);
 
 	wrtn += fprintf(stream, "  flbas:\n");
@@ -379,6 +516,11 @@ xnvme_spec_idfy_ns_fpr(FILE *stream, const struct xnvme_spec_idfy_ns *idfy,
 	wrtn += fprintf(stream, "  nvmcap:\n");
 	wrtn += fprintf(stream, "    - %zu\n", idfy->nvmcap[0]);
 	wrtn += fprintf(stream, "    - %zu\n", idfy->nvmcap[1]);
+	wrtn += fprintf(stream, "  npwg: %#x\n", idfy->npwg);
+	wrtn += fprintf(stream, "  npwa: %#x\n", idfy->npwa);
+	wrtn += fprintf(stream, "  npdg: %#x\n", idfy->npdg);
+	wrtn += fprintf(stream, "  npda: %#x\n", idfy->npda);
+	wrtn += fprintf(stream, "  nows: %#x\n", idfy->nows);
 	wrtn += fprintf(stream, "  nguid: [");
 	for (int i = 0; i < 16; ++i) {
 		if (i) {
@@ -598,6 +740,8 @@ xnvme_spec_csi_str(enum xnvme_spec_csi csi)
 	switch (csi) {
 	case XNVME_SPEC_CSI_LBLK:
 		return "XNVME_SPEC_CSI_LBLK";
+	case XNVME_SPEC_CSI_KV:
+		return "XNVME_SPEC_CSI_KV";
 	case XNVME_SPEC_CSI_ZONED:
 		return "XNVME_SPEC_CSI_ZONED";
 
@@ -268,14 +268,14 @@ xnvmec_int2opt(int opt) {
 
 	case XNVMEC_OPT_COUNT:
 	case XNVMEC_OPT_OFFSET:
+	case XNVMEC_OPT_INTERVAL:
 
 	case XNVMEC_OPT_OPCODE:
 	case XNVMEC_OPT_FLAGS:
 	case XNVMEC_OPT_ALL:
+	case XNVMEC_OPT_PR:
 		return val;
 
-	case XNVMEC_OPT_UNUSED01:
-	case XNVMEC_OPT_UNUSED02:
 	case XNVMEC_OPT_UNUSED03:
 	case XNVMEC_OPT_UNUSED04:
 	case XNVMEC_OPT_UNUSED05:
@@ -297,6 +297,7 @@ enum xnvmec_opt_value_type {
 	XNVMEC_OPT_VTYPE_NUM = 0x2,
 	XNVMEC_OPT_VTYPE_HEX = 0x3,
 	XNVMEC_OPT_VTYPE_FILE = 0x4,
+	XNVMEC_OPT_VTYPE_STR = 0x5,
 };
 
 const char *
@@ -311,6 +312,8 @@ xnvmec_opt_value_type_str(int vtype)
 		return "0xNUM";
 	case XNVMEC_OPT_VTYPE_FILE:
 		return "FILE";
+	case XNVMEC_OPT_VTYPE_STR:
+		return "STR";
 	}
 
 	return "ENOSYS";
@@ -392,6 +395,7 @@ static struct xnvmec_opt_attr xnvmec_opts[] = {
 	{XNVMEC_OPT_OPCODE,	XNVMEC_OPT_VTYPE_HEX,	"opcode",	"Command opcode"},
 	{XNVMEC_OPT_FLAGS,	XNVMEC_OPT_VTYPE_HEX,	"flags",	"Command flags"},
 	{XNVMEC_OPT_ALL,	XNVMEC_OPT_VTYPE_HEX,	"all",		"Select / Affect all"},
+	{XNVMEC_OPT_PR,		XNVMEC_OPT_VTYPE_STR,	"pr",		"Output format: yaml, csv, jsonl, or bin"},
 
 	{XNVMEC_OPT_SEED,	XNVMEC_OPT_VTYPE_NUM,	"seed",		"Use given 'NUM' as random seed"},
 	{XNVMEC_OPT_LIMIT,	XNVMEC_OPT_VTYPE_NUM,	"limit",	"Restrict amount to 'NUM'"},
@@ -399,6 +403,7 @@ static struct xnvmec_opt_attr xnvmec_opts[] = {
 
 	{XNVMEC_OPT_COUNT,	XNVMEC_OPT_VTYPE_NUM,	"count",	"Use given 'NUM' as count"},
 	{XNVMEC_OPT_OFFSET,	XNVMEC_OPT_VTYPE_NUM,	"offset",	"Use given 'NUM' as offset"},
+	{XNVMEC_OPT_INTERVAL,	XNVMEC_OPT_VTYPE_NUM,	"interval",	"Use given 'NUM' as interval in milliseconds"},
 
 	{XNVMEC_OPT_CLEAR,	XNVMEC_OPT_VTYPE_HEX,	"clear",	"Clear something..."},
 
@@ -425,10 +430,21 @@ xnvmec_opt_attr_by_opt(enum xnvmec_opt opt, struct xnvmec_opt_attr *attrs)
 	return NULL;
 }
 
+/**
+ * Informational output is suppressed when printing machine-readable output,
+ * that is, when given '--pr' with a format other than yaml
+ */
+static int g_pinf_quiet;
+
 void
 xnvmec_pinf(const char *format, ...)
 {
 	va_list args;
+
+	if (g_pinf_quiet) {
+		return;
+	}
+
 	va_start(args, format);
 
 	printf("# ");
@@ -587,6 +603,29 @@ xnvmec_usage(struct xnvmec *cli)
 	}
 }
 
+static int
+xnvmec_pr_from_str(const char *str, uint32_t *pr)
+{
+	static const struct {
+		const char *name;
+		enum xnvme_pr pr;
+	} formats[] = {
+		{"yaml", XNVME_PR_YAML},
+		{"csv", XNVME_PR_CSV},
+		{"jsonl", XNVME_PR_JSONL},
+		{"bin", XNVME_PR_BIN},
+	};
+
+	for (size_t i = 0; str && (i < sizeof(formats) / sizeof(*formats)); ++i) {
+		if (!strcmp(str, formats[i].name)) {
+			*pr = formats[i].pr;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
 int
 xnvmec_assign_arg(struct xnvmec *cli, int optval, char *arg,
 		  enum xnvmec_opt_type opt_type)
@@ -613,6 +652,7 @@ xnvmec_assign_arg(struct xnvmec *cli, int optval, char *arg,
 		switch (attr->vtype) {
 		case XNVMEC_OPT_VTYPE_URI:
 		case XNVMEC_OPT_VTYPE_FILE:
+		case XNVMEC_OPT_VTYPE_STR:
 			break;
 
 		case XNVMEC_OPT_VTYPE_NUM:
@@ -831,6 +871,14 @@ xnvmec_assign_arg(struct xnvmec *cli, int optval, char *arg,
 	case XNVMEC_OPT_ALL:
 		args->all = arg ? num : 1;
 		break;
+	case XNVMEC_OPT_PR:
+		if (xnvmec_pr_from_str(arg, &args->pr)) {
+			XNVME_DEBUG("FAILED: invalid pr: '%s'", arg);
+			errno = EINVAL;
+			return -1;
+		}
+		g_pinf_quiet = args->pr != XNVME_PR_YAML;
+		break;
 	case XNVMEC_OPT_STATUS:
 		args->status = arg ? num : 1;
 		break;
@@ -853,9 +901,10 @@ xnvmec_assign_arg(struct xnvmec *cli, int optval, char *arg,
 	case XNVMEC_OPT_OFFSET:
 		args->offset = arg ? num : 1;
 		break;
+	case XNVMEC_OPT_INTERVAL:
+		args->interval = num;
+		break;
 
-	case XNVMEC_OPT_UNUSED01:
-	case XNVMEC_OPT_UNUSED02:
 	case XNVMEC_OPT_UNUSED03:
 	case XNVMEC_OPT_UNUSED04:
 	case XNVMEC_OPT_UNUSED05:
@@ -0,0 +1,461 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libxnvme.h>
+#include <libxnvme_util.h>
+#include <libxnvmec.h>
+
+/**
+ * A chunk in transit, the ring of chunks has one more entry than the
+ * queue-depth, such that the file-transfer of one chunk overlaps with the
+ * device-transfer of the others
+ */
+struct xfer_chunk {
+	struct xnvme_req req;
+	void *buf;
+	uint64_t slba;
+	uint32_t nlb;		///< NOT zero-based
+	int inflight;
+};
+
+struct xfer {
+	struct xnvme_dev *dev;
+	const struct xnvme_geo *geo;
+	uint32_t nsid;
+	uint64_t slba;		///< First LBA of the transfer
+	uint64_t elba;		///< Last LBA of the transfer
+	uint64_t next;		///< Next LBA to assign to a chunk
+	uint32_t chunk_nlb;
+
+	int fd;
+	struct xnvme_async_ctx *ctx;
+	uint32_t qd;
+	uint32_t inflight;
+	uint32_t ecount;
+
+	struct xfer_chunk *chunks;
+	uint32_t nchunks;
+};
+
+static void
+xfer_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xfer *xfer = cb_arg;
+	struct xfer_chunk *chunk = (struct xfer_chunk *)req;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		xfer->ecount += 1;
+	}
+
+	chunk->inflight = 0;
+	xfer->inflight -= 1;
+}
+
+/**
+ * Assign the next range to the chunk; chunks are clipped at zone boundaries,
+ * since a command must not cross them
+ */
+static int
+xfer_chunk_assign(struct xfer *xfer, struct xfer_chunk *chunk)
+{
+	uint64_t nlb;
+
+	if (xfer->next > xfer->elba) {
+		return 0;
+	}
+
+	nlb = xfer->elba + 1 - xfer->next;
+	if (nlb > xfer->chunk_nlb) {
+		nlb = xfer->chunk_nlb;
+	}
+	if (xfer->geo->type == XNVME_GEO_ZONED) {
+		uint64_t zend = (xfer->next / xfer->geo->nsect + 1) *
+				xfer->geo->nsect;
+
+		if (nlb > zend - xfer->next) {
+			nlb = zend - xfer->next;
+		}
+	}
+
+	chunk->slba = xfer->next;
+	chunk->nlb = nlb;
+	xfer->next += nlb;
+
+	return 1;
+}
+
+static int
+xfer_chunk_wait(struct xfer *xfer, struct xfer_chunk *chunk)
+{
+	while (chunk->inflight) {
+		int err = xnvme_async_poke(xfer->dev, xfer->ctx, 0);
+
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			return err;
+		}
+	}
+
+	return xfer->ecount ? -EIO : 0;
+}
+
+static int
+xfer_chunk_submit(struct xfer *xfer, struct xfer_chunk *chunk, uint8_t opcode)
+{
+	int err;
+
+	// Respect the queue-depth, the ring holds one chunk more than that
+	while (xfer->inflight >= xfer->qd) {
+		err = xnvme_async_poke(xfer->dev, xfer->ctx, 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			return err;
+		}
+	}
+
+	chunk->inflight = 1;
+	xfer->inflight += 1;
+
+	for (;;) {
+		switch (opcode) {
+		case XNVME_SPEC_OPC_READ:
+			err = xnvme_cmd_read(xfer->dev, xfer->nsid, chunk->slba,
+					     chunk->nlb - 1, chunk->buf, NULL,
+					     XNVME_CMD_ASYNC, &chunk->req);
+			break;
+		default:
+			err = xnvme_cmd_write(xfer->dev, xfer->nsid,
+					      chunk->slba, chunk->nlb - 1,
+					      chunk->buf, NULL,
+					      XNVME_CMD_ASYNC, &chunk->req);
+			break;
+		}
+
+		switch (err) {
+		case 0:
+			return 0;
+
+		case -EBUSY:
+		case -EAGAIN:
+			xnvme_async_poke(xfer->dev, xfer->ctx, 0);
+			continue;
+
+		default:
+			XNVME_DEBUG("FAILED: submission, err: %d", err);
+			chunk->inflight = 0;
+			xfer->inflight -= 1;
+			return err < 0 ? err : -EIO;
+		}
+	}
+}
+
+/**
+ * Transfer file data with O_DIRECT when possible; the file-system decides
+ * which offsets and lengths it accepts, so on EINVAL fall back to buffered IO
+ */
+static ssize_t
+xfer_file_io(struct xfer *xfer, void *buf, size_t nbytes, off_t offset,
+	     int write)
+{
+	size_t ndone = 0;
+
+	while (ndone < nbytes) {
+		ssize_t res;
+
+		if (write) {
+			res = pwrite(xfer->fd, (uint8_t *)buf + ndone,
+				     nbytes - ndone, offset + ndone);
+		} else {
+			res = pread(xfer->fd, (uint8_t *)buf + ndone,
+				    nbytes - ndone, offset + ndone);
+		}
+		if ((res < 0) && (errno == EINVAL) &&
+		    (fcntl(xfer->fd, F_GETFL) & O_DIRECT)) {
+			int flags = fcntl(xfer->fd, F_GETFL) & ~O_DIRECT;
+
+			if (fcntl(xfer->fd, F_SETFL, flags)) {
+				return -errno;
+			}
+			continue;
+		}
+		if (res < 0) {
+			return -errno;
+		}
+		if (!res) {
+			break;
+		}
+
+		ndone += res;
+	}
+
+	return ndone;
+}
+
+static int
+xfer_init(struct xfer *xfer, struct xnvme_dev *dev, uint32_t nsid,
+	  uint64_t slba, uint64_t nlb, uint32_t qd)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint32_t unit_nlb;
+	int err;
+
+	memset(xfer, 0, sizeof(*xfer));
+	xfer->fd = -1;
+
+	if ((!qd) || (!geo->lba_nbytes) || (geo->mdts_nbytes < geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: invalid qd: %u or geometry", qd);
+		return -EINVAL;
+	}
+
+	xfer->dev = dev;
+	xfer->geo = geo;
+	xfer->nsid = nsid;
+	xfer->slba = slba;
+	xfer->elba = slba + nlb;
+	xfer->next = slba;
+	xfer->chunk_nlb = geo->mdts_nbytes / geo->lba_nbytes;
+	if (xfer->chunk_nlb > UINT16_MAX + 1) {
+		xfer->chunk_nlb = UINT16_MAX + 1;
+	}
+	// A multiple of the optimal write size, or else of the preferred write
+	// granularity, when it fits, such that writes to the device are whole
+	unit_nlb = geo->nows + 1;
+	if ((!geo->nows) || (unit_nlb > xfer->chunk_nlb)) {
+		unit_nlb = geo->npwg + 1;
+	}
+	if (unit_nlb <= xfer->chunk_nlb) {
+		xfer->chunk_nlb -= xfer->chunk_nlb % unit_nlb;
+	}
+	xfer->qd = qd;
+	xfer->nchunks = qd + 1;
+
+	err = xnvme_async_init(dev, &xfer->ctx, qd, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		xfer->ctx = NULL;
+		return err;
+	}
+
+	xfer->chunks = calloc(xfer->nchunks, sizeof(*xfer->chunks));
+	if (!xfer->chunks) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	for (uint32_t i = 0; i < xfer->nchunks; ++i) {
+		struct xfer_chunk *chunk = &xfer->chunks[i];
+
+		chunk->req.async.ctx = xfer->ctx;
+		chunk->req.async.cb = xfer_cb;
+		chunk->req.async.cb_arg = xfer;
+
+		chunk->buf = xnvme_buf_alloc(dev, geo->mdts_nbytes, NULL);
+		if (!chunk->buf) {
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+			return -errno;
+		}
+	}
+
+	return 0;
+}
+
+static int
+xfer_term(struct xfer *xfer, int err)
+{
+	if (xfer->ctx) {
+		for (uint32_t i = 0; i < xfer->nchunks; ++i) {
+			xfer_chunk_wait(xfer, &xfer->chunks[i]);
+		}
+		xnvme_async_term(xfer->dev, xfer->ctx);
+	}
+	for (uint32_t i = 0; xfer->chunks && (i < xfer->nchunks); ++i) {
+		xnvme_buf_free(xfer->dev, xfer->chunks[i].buf);
+	}
+	free(xfer->chunks);
+
+	if ((xfer->fd >= 0) && close(xfer->fd) && !err) {
+		err = -errno;
+	}
+
+	return err;
+}
+
+int
+xnvmec_dev_to_file(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		   uint64_t nlb, uint32_t qd, const char *path)
+{
+	struct xfer xfer;
+	int err;
+
+	err = xfer_init(&xfer, dev, nsid, slba, nlb, qd);
+	if (err) {
+		XNVME_DEBUG("FAILED: xfer_init(), err: %d", err);
+		goto exit;
+	}
+
+	xfer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if ((xfer.fd < 0) && (errno == EINVAL)) {
+		xfer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (xfer.fd < 0) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: open(%s), err: %d", path, err);
+		goto exit;
+	}
+
+	// Fill the pipeline, leaving one chunk for the file-transfer
+	for (uint32_t i = 0; i < qd; ++i) {
+		struct xfer_chunk *chunk = &xfer.chunks[i];
+
+		if (!xfer_chunk_assign(&xfer, chunk)) {
+			break;
+		}
+		err = xfer_chunk_submit(&xfer, chunk, XNVME_SPEC_OPC_READ);
+		if (err) {
+			XNVME_DEBUG("FAILED: xfer_chunk_submit(), err: %d", err);
+			goto exit;
+		}
+	}
+
+	for (uint64_t idx = 0; ; ++idx) {
+		struct xfer_chunk *chunk = &xfer.chunks[idx % xfer.nchunks];
+		struct xfer_chunk *refill = &xfer.chunks[(idx + qd) %
+							 xfer.nchunks];
+		size_t nbytes;
+		ssize_t res;
+
+		if (!chunk->nlb) {
+			break;
+		}
+
+		err = xfer_chunk_wait(&xfer, chunk);
+		if (err) {
+			XNVME_DEBUG("FAILED: xfer_chunk_wait(), err: %d", err);
+			goto exit;
+		}
+
+		// Keep the device busy while this chunk goes to the file
+		refill->nlb = 0;
+		if (xfer_chunk_assign(&xfer, refill)) {
+			err = xfer_chunk_submit(&xfer, refill,
+						XNVME_SPEC_OPC_READ);
+			if (err) {
+				XNVME_DEBUG("FAILED: xfer_chunk_submit(), err: %d",
+					    err);
+				goto exit;
+			}
+		}
+
+		nbytes = (size_t)chunk->nlb * xfer.geo->lba_nbytes;
+		res = xfer_file_io(&xfer, chunk->buf, nbytes,
+				   (chunk->slba - slba) * xfer.geo->lba_nbytes, 1);
+		if (res != (ssize_t)nbytes) {
+			err = res < 0 ? res : -EIO;
+			XNVME_DEBUG("FAILED: xfer_file_io(), err: %d", err);
+			goto exit;
+		}
+		chunk->nlb = 0;
+	}
+
+exit:
+	return xfer_term(&xfer, err);
+}
+
+int
+xnvmec_dev_from_file(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		     uint32_t qd, const char *path, size_t *nbytes)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	struct xfer xfer = { 0 };
+	struct stat st;
+	uint64_t nlb;
+	int fd;
+	int err;
+
+	xfer.fd = -1;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if ((fd < 0) && (errno == EINVAL)) {
+		fd = open(path, O_RDONLY);
+	}
+	if (fd < 0) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: open(%s), err: %d", path, err);
+		return err;
+	}
+	if (fstat(fd, &st)) {
+		err = -errno;
+		XNVME_DEBUG("FAILED: fstat(), err: %d", err);
+		close(fd);
+		return err;
+	}
+	if ((!st.st_size) || (!geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: empty file or invalid geometry");
+		close(fd);
+		return -EINVAL;
+	}
+
+	// The last LBA is zero-padded when the file is not a multiple of it
+	nlb = (st.st_size + geo->lba_nbytes - 1) / geo->lba_nbytes;
+
+	err = xfer_init(&xfer, dev, nsid, slba, nlb - 1, qd);
+	xfer.fd = fd;
+	if (err) {
+		XNVME_DEBUG("FAILED: xfer_init(), err: %d", err);
+		goto exit;
+	}
+
+	for (uint64_t idx = 0; ; ++idx) {
+		struct xfer_chunk *chunk = &xfer.chunks[idx % xfer.nchunks];
+		size_t chunk_nbytes;
+		ssize_t res;
+
+		err = xfer_chunk_wait(&xfer, chunk);
+		if (err) {
+			XNVME_DEBUG("FAILED: xfer_chunk_wait(), err: %d", err);
+			goto exit;
+		}
+		if (!xfer_chunk_assign(&xfer, chunk)) {
+			break;
+		}
+
+		// Read from the file while the other chunks are on the device
+		chunk_nbytes = (size_t)chunk->nlb * geo->lba_nbytes;
+		res = xfer_file_io(&xfer, chunk->buf, chunk_nbytes,
+				   (chunk->slba - slba) * geo->lba_nbytes, 0);
+		if (res < 0) {
+			err = res;
+			XNVME_DEBUG("FAILED: xfer_file_io(), err: %d", err);
+			goto exit;
+		}
+		memset((uint8_t *)chunk->buf + res, 0, chunk_nbytes - res);
+
+		err = xfer_chunk_submit(&xfer, chunk, XNVME_SPEC_OPC_WRITE);
+		if (err) {
+			XNVME_DEBUG("FAILED: xfer_chunk_submit(), err: %d", err);
+			goto exit;
+		}
+	}
+
+	err = xnvme_async_wait(dev, xfer.ctx);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d", err);
+		goto exit;
+	}
+	err = xfer.ecount ? -EIO : 0;
+
+	if (nbytes && !err) {
+		*nbytes = nlb * geo->lba_nbytes;
+	}
+
+exit:
+	return xfer_term(&xfer, err);
+}
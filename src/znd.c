@@ -7,6 +7,7 @@
 #include <libznd.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
+#include <xnvme_pr.h>
 #include <xnvme_spec.h>
 
 /**
@@ -179,6 +180,319 @@ znd_report_from_dev(struct xnvme_dev *dev, uint64_t slba, size_t limit, uint8_t
 	return report;
 }
 
+enum znd_report_iter_state {
+	ZND_REPORT_ITER_IDLE = 0,
+	ZND_REPORT_ITER_INFLIGHT,
+	ZND_REPORT_ITER_READY,
+	ZND_REPORT_ITER_FAILED,
+};
+
+/**
+ * A chunk of the report, the result of a single Management Receive command
+ */
+struct znd_report_chunk {
+	uint8_t *dbuf;
+	struct xnvme_req req;
+	enum znd_report_iter_state state;
+	int err;
+};
+
+struct znd_report_iter {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;	///< NULL when chunks are fetched sync.
+	uint32_t nsid;
+	enum znd_recv_action action;
+	enum znd_recv_action_sf sf;
+
+	size_t zd_nbytes;
+	size_t zrent_nbytes;
+	size_t dbuf_nentries_max;
+	size_t dbuf_nbytes;
+
+	uint64_t nlbas;		///< LBAs covered by zones of the namespace
+	uint64_t slba;		///< Where the next chunk should start reporting
+	int eor;		///< No more chunks to fetch
+
+	struct znd_report_chunk chunks[2];
+	uint32_t cur;		///< Index of the chunk being consumed
+	uint64_t idx;		///< Index of the next entry in the current chunk
+};
+
+static void
+znd_report_iter_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct znd_report_chunk *chunk = cb_arg;
+
+	chunk->err = xnvme_req_cpl_status(req) ? -EIO : 0;
+	chunk->state = chunk->err ? ZND_REPORT_ITER_FAILED : ZND_REPORT_ITER_READY;
+}
+
+/**
+ * Fetch the chunk starting at iter->slba into the given chunk, asynchronously
+ * when possible. Fetching falls back to sync. when the backend cannot do
+ * Management Receive via its asynchronous interface.
+ */
+static int
+znd_report_iter_fetch(struct znd_report_iter *iter,
+		      struct znd_report_chunk *chunk)
+{
+	int err;
+
+	memset(&chunk->req, 0, sizeof(chunk->req));
+	chunk->err = 0;
+
+	if (iter->ctx) {
+		chunk->req.async.ctx = iter->ctx;
+		chunk->req.async.cb = znd_report_iter_cb;
+		chunk->req.async.cb_arg = chunk;
+		chunk->state = ZND_REPORT_ITER_INFLIGHT;
+
+		err = znd_cmd_mgmt_recv(iter->dev, iter->nsid, iter->slba,
+					iter->action, iter->sf, 0x1, chunk->dbuf,
+					iter->dbuf_nbytes, XNVME_CMD_ASYNC,
+					&chunk->req);
+		if (!err) {
+			return 0;
+		}
+		if (err != -ENOSYS) {
+			XNVME_DEBUG("FAILED: znd_cmd_mgmt_recv(), err: %d", err);
+			chunk->state = ZND_REPORT_ITER_IDLE;
+			return err;
+		}
+
+		XNVME_DEBUG("INFO: async. mgmt-recv not supported, using sync.");
+		xnvme_async_term(iter->dev, iter->ctx);
+		iter->ctx = NULL;
+
+		memset(&chunk->req, 0, sizeof(chunk->req));
+	}
+
+	err = znd_cmd_mgmt_recv(iter->dev, iter->nsid, iter->slba, iter->action,
+				iter->sf, 0x1, chunk->dbuf, iter->dbuf_nbytes,
+				XNVME_CMD_SYNC, &chunk->req);
+	if (err || xnvme_req_cpl_status(&chunk->req)) {
+		XNVME_DEBUG("FAILED: znd_cmd_mgmt_recv(), err: %d", err);
+		chunk->err = err ? err : -EIO;
+		chunk->state = ZND_REPORT_ITER_FAILED;
+		return 0;
+	}
+	chunk->state = ZND_REPORT_ITER_READY;
+
+	return 0;
+}
+
+/**
+ * Wait for the current chunk, then start fetching the one following it into
+ * the other buffer, such that it is received while the current is consumed
+ */
+static int
+znd_report_iter_advance(struct znd_report_iter *iter)
+{
+	struct znd_report_chunk *chunk = &iter->chunks[iter->cur];
+	struct znd_report_chunk *next = &iter->chunks[!iter->cur];
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(iter->dev);
+	struct znd_rprt_hdr *hdr = (void *)chunk->dbuf;
+	const struct znd_descr *last;
+
+	while (chunk->state == ZND_REPORT_ITER_INFLIGHT) {
+		int ret = xnvme_async_poke(iter->dev, iter->ctx, 0);
+
+		if (ret < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", ret);
+			return ret;
+		}
+	}
+	if (chunk->state == ZND_REPORT_ITER_FAILED) {
+		return chunk->err;
+	}
+	if (hdr->nzones > iter->dbuf_nentries_max) {
+		XNVME_DEBUG("FAILED: invalid hdr->nzones: %zu", hdr->nzones);
+		return -EIO;
+	}
+
+	// A partial chunk means that the end of the namespace was reached
+	if (hdr->nzones < iter->dbuf_nentries_max) {
+		iter->eor = 1;
+		return 0;
+	}
+
+	last = (void *)(chunk->dbuf + sizeof(*hdr) +
+			(hdr->nzones - 1) * iter->zrent_nbytes);
+	iter->slba = last->zslba + geo->nsect;
+	if (iter->slba >= iter->nlbas) {
+		iter->eor = 1;
+		return 0;
+	}
+
+	return znd_report_iter_fetch(iter, next);
+}
+
+int
+znd_report_iter_init(struct xnvme_dev *dev, uint64_t slba,
+		     enum znd_recv_action_sf sf, uint8_t extended,
+		     size_t chunk_limit, struct znd_report_iter **iter)
+{
+	const struct xnvme_spec_idfy_ns *nvm = (void *)xnvme_dev_get_ns(dev);
+	const struct znd_idfy_ns *zns = (void *)xnvme_dev_get_ns_css(dev);
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	size_t zdext_nbytes;
+	int err;
+
+	if ((!nvm) || (!zns) || (geo->type != XNVME_GEO_ZONED)) {
+		XNVME_DEBUG("FAILED: not a zoned namespace");
+		return -EINVAL;
+	}
+	zdext_nbytes = zns->lbafe[nvm->flbas.format].zdes * 64;
+	if (extended && (!zdext_nbytes)) {
+		XNVME_DEBUG("FAILED: device does not support extended report");
+		return -ENOSYS;
+	}
+
+	(*iter) = calloc(1, sizeof(**iter));
+	if (!(*iter)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	(*iter)->dev = dev;
+	(*iter)->nsid = xnvme_dev_get_nsid(dev);
+	(*iter)->action = extended ? ZND_RECV_EREPORT : ZND_RECV_REPORT;
+	(*iter)->sf = sf;
+	(*iter)->zd_nbytes = sizeof(struct znd_descr);
+	(*iter)->zrent_nbytes = (*iter)->zd_nbytes;
+	(*iter)->zrent_nbytes += extended ? zdext_nbytes : 0;
+	(*iter)->nlbas = geo->nzone * geo->nsect;
+	(*iter)->slba = slba;
+
+	// Bound each chunk by MDTS, the given limit, and the number of zones
+	if (geo->mdts_nbytes < sizeof(struct znd_rprt_hdr) +
+	    (*iter)->zrent_nbytes) {
+		XNVME_DEBUG("FAILED: mdts too small for a report");
+		err = -EINVAL;
+		goto failed;
+	}
+	(*iter)->dbuf_nentries_max = (geo->mdts_nbytes -
+				      sizeof(struct znd_rprt_hdr)) /
+				     (*iter)->zrent_nbytes;
+	if (chunk_limit && ((*iter)->dbuf_nentries_max > chunk_limit)) {
+		(*iter)->dbuf_nentries_max = chunk_limit;
+	}
+	if ((*iter)->dbuf_nentries_max > geo->nzone) {
+		(*iter)->dbuf_nentries_max = geo->nzone;
+	}
+	(*iter)->dbuf_nbytes = sizeof(struct znd_rprt_hdr) +
+			       (*iter)->dbuf_nentries_max * (*iter)->zrent_nbytes;
+
+	for (int i = 0; i < 2; ++i) {
+		(*iter)->chunks[i].dbuf = xnvme_buf_alloc(dev,
+					  (*iter)->dbuf_nbytes, NULL);
+		if (!(*iter)->chunks[i].dbuf) {
+			err = -errno;
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), err: %d", err);
+			goto failed;
+		}
+	}
+
+	// Prefetching is an optimization, thus sync. is fine when async. is not
+	err = xnvme_async_init(dev, &(*iter)->ctx, 2, 0x0);
+	if (err) {
+		XNVME_DEBUG("INFO: xnvme_async_init(), err: %d, using sync.", err);
+		(*iter)->ctx = NULL;
+	}
+
+	if (slba >= (*iter)->nlbas) {
+		(*iter)->eor = 1;
+		(*iter)->chunks[0].state = ZND_REPORT_ITER_IDLE;
+		return 0;
+	}
+
+	err = znd_report_iter_fetch(*iter, &(*iter)->chunks[0]);
+	if (err) {
+		XNVME_DEBUG("FAILED: znd_report_iter_fetch(), err: %d", err);
+		goto failed;
+	}
+	err = znd_report_iter_advance(*iter);
+	if (err) {
+		XNVME_DEBUG("FAILED: znd_report_iter_advance(), err: %d", err);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	znd_report_iter_term(*iter);
+	*iter = NULL;
+
+	return err;
+}
+
+int
+znd_report_iter_next(struct znd_report_iter *iter,
+		     const struct znd_descr **descr, const void **dext)
+{
+	struct znd_report_chunk *chunk = &iter->chunks[iter->cur];
+	struct znd_rprt_hdr *hdr = (void *)chunk->dbuf;
+	uint8_t *entry;
+	int err;
+
+	*descr = NULL;
+	if (dext) {
+		*dext = NULL;
+	}
+
+	while ((chunk->state != ZND_REPORT_ITER_READY) ||
+	       (iter->idx >= hdr->nzones)) {
+		if ((chunk->state != ZND_REPORT_ITER_READY) || iter->eor) {
+			return 0;
+		}
+
+		// Current chunk is consumed; move on to the prefetched one
+		chunk->state = ZND_REPORT_ITER_IDLE;
+		iter->cur = !iter->cur;
+		iter->idx = 0;
+
+		chunk = &iter->chunks[iter->cur];
+		hdr = (void *)chunk->dbuf;
+		if (chunk->state == ZND_REPORT_ITER_IDLE) {
+			return 0;
+		}
+
+		err = znd_report_iter_advance(iter);
+		if (err) {
+			XNVME_DEBUG("FAILED: znd_report_iter_advance(), err: %d",
+				    err);
+			chunk->state = ZND_REPORT_ITER_IDLE;
+			return err;
+		}
+	}
+
+	entry = chunk->dbuf + sizeof(*hdr) + iter->idx * iter->zrent_nbytes;
+	iter->idx += 1;
+
+	*descr = (void *)entry;
+	if (dext && (iter->action == ZND_RECV_EREPORT)) {
+		*dext = entry + iter->zd_nbytes;
+	}
+
+	return 0;
+}
+
+void
+znd_report_iter_term(struct znd_report_iter *iter)
+{
+	if (!iter) {
+		return;
+	}
+
+	if (iter->ctx) {
+		xnvme_async_wait(iter->dev, iter->ctx);
+		xnvme_async_term(iter->dev, iter->ctx);
+	}
+	for (int i = 0; i < 2; ++i) {
+		xnvme_buf_free(iter->dev, iter->chunks[i].dbuf);
+	}
+	free(iter);
+}
+
 int
 znd_report_find_arbitrary(const struct znd_report *report, enum znd_state state,
 			  uint64_t *zlba, int opts)
@@ -594,9 +908,37 @@ znd_descr_fpr_yaml(FILE *stream, const struct znd_descr *descr, int indent,
 	return wrtn;
 }
 
+#define ZND_DESCR_CSV_HEAD "zslba,wp,zcap,zt,zs,za\n"
+
+/**
+ * Emit the given descriptor as a CSV row, JSON object, or as stored
+ */
+static int
+znd_descr_pr_buf(struct xnvme_pr_buf *pb, const struct znd_descr *descr,
+		 int opts)
+{
+	switch (opts) {
+	case XNVME_PR_CSV:
+		return xnvme_pr_buf_printf(pb, "%lu,%lu,%lu,%u,%u,%u\n",
+					   descr->zslba, descr->wp, descr->zcap,
+					   descr->zt, descr->zs, descr->za.val);
+
+	case XNVME_PR_JSONL:
+		return xnvme_pr_buf_printf(pb, "{\"zslba\":%lu,\"wp\":%lu,"
+					   "\"zcap\":%lu,\"zt\":%u,\"zs\":%u,"
+					   "\"za\":%u}\n", descr->zslba,
+					   descr->wp, descr->zcap, descr->zt,
+					   descr->zs, descr->za.val);
+
+	default:
+		return xnvme_pr_buf_write(pb, descr, sizeof(*descr));
+	}
+}
+
 int
 znd_descr_fpr(FILE *stream, const struct znd_descr *descr, int opts)
 {
+	struct xnvme_pr_buf pb;
 	int wrtn = 0;
 
 	switch (opts) {
@@ -607,6 +949,19 @@ znd_descr_fpr(FILE *stream, const struct znd_descr *descr, int opts)
 	case XNVME_PR_TERSE:
 		wrtn += fprintf(stream, "# ENOSYS: opts(%x)", opts);
 		return wrtn;
+
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
+		if (!descr) {
+			return 0;
+		}
+		xnvme_pr_buf_init(&pb, stream);
+		if (opts == XNVME_PR_CSV) {
+			xnvme_pr_buf_printf(&pb, ZND_DESCR_CSV_HEAD);
+		}
+		znd_descr_pr_buf(&pb, descr, opts);
+		return xnvme_pr_buf_flush(&pb);
 	}
 
 	wrtn += fprintf(stream, "znd_descr:");
@@ -711,6 +1066,38 @@ znd_rprt_hdr_pr(const struct znd_rprt_hdr *hdr, int opts)
 	return znd_rprt_hdr_fpr(stdout, hdr, opts);
 }
 
+/**
+ * Emit only the entries of the report; CSV and JSONL without the descriptor
+ * extensions, BIN with the entries as retrieved from the device
+ */
+static int
+znd_report_fpr_entries(FILE *stream, const struct znd_report *report,
+		       int opts)
+{
+	struct xnvme_pr_buf pb;
+
+	if (!report) {
+		return 0;
+	}
+
+	xnvme_pr_buf_init(&pb, stream);
+
+	if (opts == XNVME_PR_BIN) {
+		xnvme_pr_buf_write(&pb, report->storage,
+				   report->nentries * report->zrent_nbytes);
+		return xnvme_pr_buf_flush(&pb);
+	}
+
+	if (opts == XNVME_PR_CSV) {
+		xnvme_pr_buf_printf(&pb, ZND_DESCR_CSV_HEAD);
+	}
+	for (uint32_t idx = 0; idx < report->nentries; ++idx) {
+		znd_descr_pr_buf(&pb, ZND_REPORT_DESCR(report, idx), opts);
+	}
+
+	return xnvme_pr_buf_flush(&pb);
+}
+
 int
 znd_report_fpr(FILE *stream, const struct znd_report *report, int opts)
 {
@@ -721,6 +1108,11 @@ znd_report_fpr(FILE *stream, const struct znd_report *report, int opts)
 		wrtn += fprintf(stream, "# ENOSYS: opts(0x%x)", opts);
 		return wrtn;
 
+	case XNVME_PR_CSV:
+	case XNVME_PR_JSONL:
+	case XNVME_PR_BIN:
+		return znd_report_fpr_entries(stream, report, opts);
+
 	case XNVME_PR_DEF:
 	case XNVME_PR_YAML:
 		break;
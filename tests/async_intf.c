@@ -1,6 +1,7 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
+#include <errno.h>
 #include <libxnvmec.h>
 
 #define XNVME_TESTS_QDEPTH_MAX 512
@@ -83,6 +84,563 @@ test_init_term(struct xnvmec *cli)
 	return 0;
 }
 
+/**
+ * Setup for the round-trip tests: 'nlb' LBAs per command, at most eight, and
+ * 'ncmds' commands, the queue-depth
+ */
+static int
+boilerplate(struct xnvmec *cli, uint32_t *nsid, uint64_t *nlb,
+	    size_t *nbytes, uint32_t *ncmds)
+{
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint64_t qd = cli->args.qdepth;
+
+	if ((!qd) || (qd > XNVME_TESTS_QDEPTH_MAX) || (qd & (qd - 1))) {
+		XNVME_DEBUG("FAILED: invalid qdepth(%zu)", qd);
+		return -EINVAL;
+	}
+
+	*nsid = xnvme_dev_get_nsid(cli->args.dev);
+	*nlb = XNVME_MIN(geo->mdts_nbytes / geo->lba_nbytes, 8);
+	*nbytes = (*nlb) * geo->lba_nbytes;
+	*ncmds = qd;
+
+	xnvmec_pinf("nsid: 0x%x", *nsid);
+	xnvmec_pinf("slba: 0x%016lx", cli->args.slba);
+	xnvmec_pinf("nlb: %zu", *nlb);
+	xnvmec_pinf("ncmds: %u", *ncmds);
+
+	return 0;
+}
+
+/**
+ * Fill the given buffer with a repeating sequence of letters, with the first
+ * eight bytes of each LBA set to its address, such that misplaced data is
+ * detected
+ */
+static void
+buf_fill_lba(struct xnvme_dev *dev, uint8_t *buf, uint64_t slba, uint64_t nlb)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+
+	xnvmec_buf_fill(buf, nlb * geo->lba_nbytes, "anum");
+	for (uint64_t i = 0; i < nlb; ++i) {
+		uint64_t lba = slba + i;
+
+		memcpy(buf + i * geo->lba_nbytes, &lba, sizeof(lba));
+	}
+}
+
+/**
+ * Write 'nlb' LBAs from the given buffer, starting at 'slba', synchronously,
+ * in commands of the maximum-data-transfer-size
+ */
+static int
+write_sync(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba, uint64_t nlb,
+	   uint8_t *buf)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint64_t mdts_naddr = XNVME_MIN(geo->mdts_nbytes / geo->lba_nbytes, 256);
+
+	for (uint64_t ofz = 0; ofz < nlb; ofz += mdts_naddr) {
+		uint64_t cnlb = XNVME_MIN(nlb - ofz, mdts_naddr);
+		struct xnvme_req req = { 0 };
+		int err;
+
+		err = xnvme_cmd_write(dev, nsid, slba + ofz, cnlb - 1,
+				      buf + ofz * geo->lba_nbytes, NULL,
+				      XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("xnvme_cmd_write()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+static int
+buf_verify(const void *expected, const void *actual, size_t nbytes)
+{
+	if (xnvmec_buf_diff(expected, actual, nbytes)) {
+		xnvmec_buf_diff_pr(expected, actual, nbytes, XNVME_PR_DEF);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void
+cb_count(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	uint32_t *ncpl = cb_arg;
+
+	*ncpl += 1;
+}
+
+static void
+link_rw(struct xnvme_async_link *link, uint8_t opcode, uint32_t nsid,
+	uint64_t slba, uint64_t nlb, void *buf, size_t nbytes, uint32_t *ncpl)
+{
+	memset(link, 0, sizeof(*link));
+	link->cmd.common.opcode = opcode;
+	link->cmd.common.nsid = nsid;
+	link->cmd.lblk.slba = slba;
+	link->cmd.lblk.nlb = nlb - 1;
+	link->dbuf = buf;
+	link->dbuf_nbytes = nbytes;
+	link->req.async.cb = cb_count;
+	link->req.async.cb_arg = ncpl;
+}
+
+static int
+chain_run(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+	  struct xnvme_async_link *links, uint32_t nlinks, uint32_t *ncpl)
+{
+	int err;
+
+	*ncpl = 0;
+	err = xnvme_async_chain(dev, ctx, links, nlinks);
+	if (err) {
+		xnvmec_perr("xnvme_async_chain()", err);
+		return err;
+	}
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		return err;
+	}
+	if (*ncpl != nlinks) {
+		XNVME_DEBUG("FAILED: ncpl(%u) != nlinks(%u)", *ncpl, nlinks);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * 0) Chain: write 'A', read, write 'B', read; of the same LBAs
+ * 1) Verify that the reads return 'A' and 'B' respectively, that is, that the
+ *    links executed in order
+ * 2) Chain: write 'A', read beyond the namespace, write 'B'
+ * 3) Verify that the read fails, that the second write completes with
+ *    abort-requested, and that the LBAs contain 'A', that is, that the second
+ *    write did not execute
+ */
+static int
+test_chain(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint64_t slba = cli->args.slba, nlb, nsze;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_async_link links[4];
+	uint8_t *abuf = NULL, *bbuf = NULL, *rbuf[2] = { 0 };
+	struct xnvme_req req = { 0 };
+	uint32_t nsid, ncmds, ncpl;
+	size_t nbytes;
+	int err;
+
+	err = boilerplate(cli, &nsid, &nlb, &nbytes, &ncmds);
+	if (err) {
+		return err;
+	}
+	nsze = geo->tbytes / geo->lba_nbytes;
+
+	abuf = xnvme_buf_alloc(dev, nbytes, NULL);
+	bbuf = xnvme_buf_alloc(dev, nbytes, NULL);
+	rbuf[0] = xnvme_buf_alloc(dev, nbytes, NULL);
+	rbuf[1] = xnvme_buf_alloc(dev, nbytes, NULL);
+	if (!(abuf && bbuf && rbuf[0] && rbuf[1])) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	buf_fill_lba(dev, abuf, slba, nlb);
+	memset(bbuf, '!', nbytes);
+
+	err = xnvme_async_init(dev, &ctx, ncmds, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Chain: write 'A', read, write 'B', read");
+	xnvmec_buf_clear(rbuf[0], nbytes);
+	xnvmec_buf_clear(rbuf[1], nbytes);
+	link_rw(&links[0], XNVME_SPEC_OPC_WRITE, nsid, slba, nlb, abuf, nbytes,
+		&ncpl);
+	link_rw(&links[1], XNVME_SPEC_OPC_READ, nsid, slba, nlb, rbuf[0],
+		nbytes, &ncpl);
+	link_rw(&links[2], XNVME_SPEC_OPC_WRITE, nsid, slba, nlb, bbuf, nbytes,
+		&ncpl);
+	link_rw(&links[3], XNVME_SPEC_OPC_READ, nsid, slba, nlb, rbuf[1],
+		nbytes, &ncpl);
+
+	err = chain_run(dev, ctx, links, 4, &ncpl);
+	if (err) {
+		goto exit;
+	}
+	for (int i = 0; i < 4; ++i) {
+		if (xnvme_req_cpl_status(&links[i].req)) {
+			XNVME_DEBUG("FAILED: link: %d", i);
+			xnvme_req_pr(&links[i].req, XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+	}
+	err = buf_verify(abuf, rbuf[0], nbytes);
+	err = err ? err : buf_verify(bbuf, rbuf[1], nbytes);
+	if (err) {
+		xnvmec_perr("links executed out of order", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Chain: write 'A', read beyond the namespace, write 'B'");
+	link_rw(&links[0], XNVME_SPEC_OPC_WRITE, nsid, slba, nlb, abuf, nbytes,
+		&ncpl);
+	link_rw(&links[1], XNVME_SPEC_OPC_READ, nsid, nsze, nlb, rbuf[0],
+		nbytes, &ncpl);
+	link_rw(&links[2], XNVME_SPEC_OPC_WRITE, nsid, slba, nlb, bbuf, nbytes,
+		&ncpl);
+
+	err = chain_run(dev, ctx, links, 3, &ncpl);
+	if (err) {
+		goto exit;
+	}
+	if (xnvme_req_cpl_status(&links[0].req)) {
+		XNVME_DEBUG("FAILED: the first link failed");
+		xnvme_req_pr(&links[0].req, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+	if (!xnvme_req_cpl_status(&links[1].req)) {
+		XNVME_DEBUG("FAILED: read beyond the namespace succeeded");
+		err = -EIO;
+		goto exit;
+	}
+	if ((links[2].req.cpl.status.sct) ||
+	    (links[2].req.cpl.status.sc != XNVME_SPEC_SC_ABORT_REQ)) {
+		XNVME_DEBUG("FAILED: link following the failure not aborted");
+		xnvme_req_pr(&links[2].req, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvmec_buf_clear(rbuf[0], nbytes);
+	err = xnvme_cmd_read(dev, nsid, slba, nlb - 1, rbuf[0], NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	err = buf_verify(abuf, rbuf[0], nbytes);
+	if (err) {
+		xnvmec_perr("aborted link was executed", err);
+		goto exit;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, abuf);
+	xnvme_buf_free(dev, bbuf);
+	xnvme_buf_free(dev, rbuf[0]);
+	xnvme_buf_free(dev, rbuf[1]);
+
+	return err;
+}
+
+/**
+ * 0) Write 'qdepth' x 'nlb' LBAs from 'slba' synchronously
+ * 1) Read them with a read per 'nlb' LBAs, all outstanding at once, into
+ *    buffers selected from a group of 'qdepth' buffers
+ * 2) Verify the content of the selected buffers and hand them back
+ */
+static int
+test_bufgrp(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint64_t slba = cli->args.slba, nlb;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_bufgrp *grp = NULL;
+	struct xnvme_req reqs[XNVME_TESTS_QDEPTH_MAX] = { 0 };
+	uint8_t *wbuf = NULL;
+	uint32_t nsid, ncmds, ncpl = 0;
+	size_t nbytes;
+	int err;
+
+	err = boilerplate(cli, &nsid, &nlb, &nbytes, &ncmds);
+	if (err) {
+		return err;
+	}
+
+	wbuf = xnvme_buf_alloc(dev, ncmds * nbytes, NULL);
+	if (!wbuf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	buf_fill_lba(dev, wbuf, slba, ncmds * nlb);
+
+	err = write_sync(dev, nsid, slba, ncmds * nlb, wbuf);
+	if (err) {
+		goto exit;
+	}
+
+	err = xnvme_async_init(dev, &ctx, ncmds, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_bufgrp_init(dev, ctx, ncmds, nbytes, &grp);
+	if (err) {
+		xnvmec_perr("xnvme_bufgrp_init()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < ncmds; ++i) {
+		reqs[i].async.cb = cb_count;
+		reqs[i].async.cb_arg = &ncpl;
+
+		err = xnvme_bufgrp_read(grp, nsid, slba + i * nlb, nlb - 1,
+					&reqs[i]);
+		if (err) {
+			xnvmec_perr("xnvme_bufgrp_read()", err);
+			goto exit;
+		}
+	}
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	err = 0;
+
+	for (uint32_t i = 0; i < ncmds; ++i) {
+		if (xnvme_req_cpl_status(&reqs[i]) || (!reqs[i].async.dbuf)) {
+			XNVME_DEBUG("FAILED: read: %u", i);
+			xnvme_req_pr(&reqs[i], XNVME_PR_DEF);
+			err = -EIO;
+		}
+		if ((!err) && reqs[i].async.dbuf) {
+			err = buf_verify(wbuf + i * nbytes, reqs[i].async.dbuf,
+					 nbytes);
+		}
+		if (reqs[i].async.dbuf) {
+			xnvme_bufgrp_put(grp, reqs[i].async.dbuf);
+			reqs[i].async.dbuf = NULL;
+		}
+		if (err) {
+			goto exit;
+		}
+	}
+	if (ncpl != ncmds) {
+		XNVME_DEBUG("FAILED: ncpl(%u) != ncmds(%u)", ncpl, ncmds);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (grp) {
+		xnvme_bufgrp_term(grp);
+	}
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, wbuf);
+
+	return err;
+}
+
+/**
+ * 0) Write 'qdepth' x 'nlb' LBAs from 'slba' synchronously
+ * 1) Read them as a single multi-get batch, with the items in reverse order
+ * 2) Verify the content of each item
+ */
+static int
+test_mget(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint64_t slba = cli->args.slba, nlb;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_mget *mg = NULL;
+	struct xnvme_mget_item items[XNVME_TESTS_QDEPTH_MAX] = { 0 };
+	uint8_t *wbuf = NULL, *rbuf = NULL;
+	uint32_t nsid, ncmds;
+	size_t nbytes;
+	int err;
+
+	err = boilerplate(cli, &nsid, &nlb, &nbytes, &ncmds);
+	if (err) {
+		return err;
+	}
+
+	wbuf = xnvme_buf_alloc(dev, ncmds * nbytes, NULL);
+	rbuf = xnvme_buf_alloc(dev, ncmds * nbytes, NULL);
+	if (!(wbuf && rbuf)) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	buf_fill_lba(dev, wbuf, slba, ncmds * nlb);
+	xnvmec_buf_clear(rbuf, ncmds * nbytes);
+
+	err = write_sync(dev, nsid, slba, ncmds * nlb, wbuf);
+	if (err) {
+		goto exit;
+	}
+
+	err = xnvme_async_init(dev, &ctx, ncmds, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_mget_init(dev, ctx, &mg, ncmds);
+	if (err) {
+		xnvmec_perr("xnvme_mget_init()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < ncmds; ++i) {
+		uint32_t j = ncmds - 1 - i;
+
+		items[i].slba = slba + j * nlb;
+		items[i].nlb = nlb - 1;
+		items[i].dbuf = rbuf + j * nbytes;
+	}
+
+	err = xnvme_mget_read(mg, nsid, items, ncmds);
+	if (err) {
+		xnvmec_perr("xnvme_mget_read()", err);
+		goto exit;
+	}
+	err = buf_verify(wbuf, rbuf, ncmds * nbytes);
+	if (err) {
+		xnvmec_perr("buf_verify()", err);
+		goto exit;
+	}
+
+exit:
+	if (mg) {
+		xnvme_mget_term(mg);
+	}
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
+
+/**
+ * 0) Write 4 x 'qdepth' x 'nlb' LBAs from 'slba' synchronously
+ * 1) Read them via a read-stream of 'nlb' LBA chunks and 'qdepth'
+ * 2) Verify that the chunks arrive in LBA order, cover the range, and that
+ *    their content is as written
+ *
+ * Also verifies that a chunk larger than the mdts is rejected
+ */
+static int
+test_rstream(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint64_t slba = cli->args.slba, nlb, naddr, next;
+	struct xnvme_rstream *rs = NULL;
+	uint8_t *wbuf = NULL;
+	uint32_t nsid, ncmds;
+	size_t nbytes;
+	int err;
+
+	err = boilerplate(cli, &nsid, &nlb, &nbytes, &ncmds);
+	if (err) {
+		return err;
+	}
+	naddr = 4 * ncmds * nlb;
+
+	wbuf = xnvme_buf_alloc(dev, naddr * geo->lba_nbytes, NULL);
+	if (!wbuf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	buf_fill_lba(dev, wbuf, slba, naddr);
+
+	err = write_sync(dev, nsid, slba, naddr, wbuf);
+	if (err) {
+		goto exit;
+	}
+
+	// A chunk larger than a single command can transfer is rejected
+	err = xnvme_rstream_init(dev, &rs, nsid, slba, slba + naddr - 1,
+				 geo->mdts_nbytes + geo->lba_nbytes, ncmds);
+	if (err != -EINVAL) {
+		XNVME_DEBUG("FAILED: chunk_nbytes > mdts, err: %d", err);
+		err = -EIO;
+		goto exit;
+	}
+
+	err = xnvme_rstream_init(dev, &rs, nsid, slba, slba + naddr - 1,
+				 nbytes, ncmds);
+	if (err) {
+		xnvmec_perr("xnvme_rstream_init()", err);
+		goto exit;
+	}
+
+	for (next = slba;;) {
+		struct xnvme_rstream_chunk *chunk = NULL;
+
+		err = xnvme_rstream_next(rs, &chunk);
+		if (err) {
+			xnvmec_perr("xnvme_rstream_next()", err);
+			goto exit;
+		}
+		if (!chunk) {
+			break;
+		}
+		if ((chunk->slba != next) ||
+		    (chunk->nbytes != chunk->nlb * geo->lba_nbytes)) {
+			XNVME_DEBUG("FAILED: chunk.slba: 0x%lx, expected: 0x%lx",
+				    chunk->slba, next);
+			err = -EIO;
+			goto exit;
+		}
+
+		err = buf_verify(wbuf + (chunk->slba - slba) * geo->lba_nbytes,
+				 chunk->buf, chunk->nbytes);
+		if (err) {
+			xnvmec_perr("buf_verify()", err);
+			goto exit;
+		}
+		next += chunk->nlb;
+
+		err = xnvme_rstream_put(rs, chunk);
+		if (err) {
+			xnvmec_perr("xnvme_rstream_put()", err);
+			goto exit;
+		}
+	}
+	if (next != slba + naddr) {
+		XNVME_DEBUG("FAILED: range ended at: 0x%lx", next);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (rs) {
+		xnvme_rstream_term(rs);
+	}
+	xnvme_buf_free(dev, wbuf);
+
+	return err;
+}
+
 //
 // Command-Line Interface (CLI) definition
 //
@@ -97,6 +655,42 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_CLEAR, XNVMEC_LFLG},
 		}
 	},
+	{
+		"chain",
+		"Verify order and abort of a chain of commands at 'slba'",
+		"Verify order and abort of a chain of commands at 'slba'", test_chain, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
+	{
+		"bufgrp",
+		"Read 'qdepth' commands, at 'slba', via a buffer-group",
+		"Read 'qdepth' commands, at 'slba', via a buffer-group", test_bufgrp, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
+	{
+		"mget",
+		"Read 'qdepth' commands, at 'slba', as a multi-get batch",
+		"Read 'qdepth' commands, at 'slba', as a multi-get batch", test_mget, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
+	{
+		"rstream",
+		"Read 4 x 'qdepth' chunks, at 'slba', via a read-stream",
+		"Read 4 x 'qdepth' chunks, at 'slba', via a read-stream", test_rstream, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
 };
 
 static struct xnvmec cli = {
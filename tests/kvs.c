@@ -0,0 +1,406 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <errno.h>
+#include <libkvs.h>
+#include <libxnvmec.h>
+
+#define XNVME_TESTS_KVS_COUNT_MAX 4096
+#define XNVME_TESTS_KVS_VBUF_NBYTES (16 * 1024)
+
+static void
+kv_key(uint64_t idx, const char *prefix, char *key)
+{
+	snprintf(key, KVS_KEY_NBYTES_MAX + 1, "%s%08zx", prefix, idx);
+}
+
+/**
+ * Value of key 'idx', from 512 bytes to just below 12KiB, thus one to three
+ * units, filled with a sequence depending on the key
+ */
+static uint32_t
+kv_val(uint64_t idx, uint8_t *vbuf)
+{
+	uint32_t vlen = 512 + (idx * 2749) % (12 * 1024 - 512);
+
+	for (uint32_t i = 0; i < vlen; ++i) {
+		vbuf[i] = (idx * 31 + i) & 0xFF;
+	}
+
+	return vlen;
+}
+
+static int
+kv_status(struct xnvme_req *req)
+{
+	return (req->cpl.status.sct << 8) | req->cpl.status.sc;
+}
+
+static int
+kv_store_all(struct xnvme_dev *dev, uint32_t nsid, const char *prefix,
+	     uint64_t count, uint8_t *vbuf)
+{
+	for (uint64_t idx = 0; idx < count; ++idx) {
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+		uint32_t vlen = kv_val(idx, vbuf);
+		int err;
+
+		kv_key(idx, prefix, key);
+		err = kvs_cmd_store(dev, nsid, key, strlen(key), vbuf, vlen,
+				    0x0, XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("kvs_cmd_store()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Retrieve the keys [first, count[ with a stride of 'step' and verify their
+ * values and their value-size, as returned in cdw0
+ */
+static int
+kv_verify_all(struct xnvme_dev *dev, uint32_t nsid, const char *prefix,
+	      uint64_t first, uint64_t count, uint64_t step, uint8_t *vbuf,
+	      uint8_t *rbuf)
+{
+	for (uint64_t idx = first; idx < count; idx += step) {
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+		uint32_t vlen = kv_val(idx, vbuf);
+		int err;
+
+		kv_key(idx, prefix, key);
+		xnvmec_buf_clear(rbuf, XNVME_TESTS_KVS_VBUF_NBYTES);
+		err = kvs_cmd_retrieve(dev, nsid, key, strlen(key), rbuf,
+				       XNVME_TESTS_KVS_VBUF_NBYTES,
+				       XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("kvs_cmd_retrieve()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			return err ? err : -EIO;
+		}
+		if (req.cpl.cdw0 != vlen) {
+			XNVME_DEBUG("FAILED: key: %s, cdw0: %u, vlen: %u", key,
+				    req.cpl.cdw0, vlen);
+			return -EIO;
+		}
+		if (xnvmec_buf_diff(vbuf, rbuf, vlen)) {
+			xnvmec_pinf("key: %s", key);
+			xnvmec_buf_diff_pr(vbuf, rbuf, vlen, XNVME_PR_DEF);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * 0) Delete keys left by a previous run
+ * 1) Store 'count' keys with values of one to three units
+ * 2) Retrieve and verify all of them
+ * 3) Verify that a store with must-not-exist of an existing key fails
+ * 4) Delete the keys with an even index
+ * 5) Verify that exist and retrieve report the deleted keys as not existing
+ * 6) Verify that list returns exactly the remaining keys, in order
+ * 7) Retrieve and verify the remaining keys, with an odd index
+ */
+static int
+test_io(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint64_t count = cli->args.count;
+	const char *prefix = "kvs-io-";
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint8_t *vbuf = NULL, *rbuf = NULL;
+	uint32_t ofz = 0, nlisted = 0;
+	int err;
+
+	if ((!count) || (count > XNVME_TESTS_KVS_COUNT_MAX)) {
+		XNVME_DEBUG("FAILED: count(%zu) out-of-bounds for test", count);
+		return -EINVAL;
+	}
+
+	vbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+	rbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+	if (!(vbuf && rbuf)) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Deleting keys of a previous run");
+	for (uint64_t idx = 0; idx < XNVME_TESTS_KVS_COUNT_MAX; ++idx) {
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+
+		kv_key(idx, prefix, key);
+		kvs_cmd_delete(dev, nsid, key, strlen(key), XNVME_CMD_SYNC,
+			       &req);
+	}
+
+	xnvmec_pinf("Storing and retrieving %zu keys", count);
+	err = kv_store_all(dev, nsid, prefix, count, vbuf);
+	err = err ? err : kv_verify_all(dev, nsid, prefix, 0, count, 1,
+					vbuf, rbuf);
+	if (err) {
+		goto exit;
+	}
+
+	{
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+
+		kv_key(0, prefix, key);
+		kvs_cmd_store(dev, nsid, key, strlen(key), vbuf, 512,
+			      KVS_STORE_OPT_MUST_NOT_EXIST, XNVME_CMD_SYNC,
+			      &req);
+		if (kv_status(&req) != ((0x1 << 8) | KVS_SC_KEY_EXISTS)) {
+			XNVME_DEBUG("FAILED: store of existing key");
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+	}
+
+	xnvmec_pinf("Deleting the keys with an even index");
+	for (uint64_t idx = 0; idx < count; idx += 2) {
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+
+		kv_key(idx, prefix, key);
+		err = kvs_cmd_delete(dev, nsid, key, strlen(key),
+				     XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("kvs_cmd_delete()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+	}
+	for (uint64_t idx = 0; idx < count; ++idx) {
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+		int expected = (0x1 << 8) | KVS_SC_KEY_NOT_EXISTS;
+
+		expected = (idx % 2) ? 0 : expected;
+		kv_key(idx, prefix, key);
+		kvs_cmd_exist(dev, nsid, key, strlen(key), XNVME_CMD_SYNC,
+			      &req);
+		if (kv_status(&req) != expected) {
+			XNVME_DEBUG("FAILED: exist, key: %s", key);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+		if (idx % 2) {
+			continue;
+		}
+
+		memset(&req, 0, sizeof(req));
+		kvs_cmd_retrieve(dev, nsid, key, strlen(key), rbuf,
+				 XNVME_TESTS_KVS_VBUF_NBYTES, XNVME_CMD_SYNC,
+				 &req);
+		if (kv_status(&req) != expected) {
+			XNVME_DEBUG("FAILED: retrieve of deleted key: %s", key);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+	}
+
+	xnvmec_pinf("Listing the remaining keys");
+	{
+		char key[KVS_KEY_NBYTES_MAX + 1];
+		struct xnvme_req req = { 0 };
+
+		kv_key(0, prefix, key);
+		err = kvs_cmd_list(dev, nsid, key, strlen(key), rbuf,
+				   XNVME_TESTS_KVS_VBUF_NBYTES, XNVME_CMD_SYNC,
+				   &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("kvs_cmd_list()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+	}
+	for (uint64_t idx = 1; idx < count; idx += 2) {
+		char expected[KVS_KEY_NBYTES_MAX + 1];
+		char key[KVS_KEY_NBYTES_MAX + 1] = { 0 };
+		int klen;
+
+		klen = kvs_list_next(rbuf, XNVME_TESTS_KVS_VBUF_NBYTES, &ofz,
+				     key);
+		if (klen < 0) {
+			err = klen;
+			xnvmec_perr("kvs_list_next()", err);
+			goto exit;
+		}
+		if (!klen) {
+			break;	// The buffer is full
+		}
+
+		kv_key(idx, prefix, expected);
+		if (strcmp(expected, key)) {
+			XNVME_DEBUG("FAILED: listed: '%s', expected: '%s'",
+				    key, expected);
+			err = -EIO;
+			goto exit;
+		}
+		++nlisted;
+	}
+	if (!nlisted) {
+		XNVME_DEBUG("FAILED: no keys listed");
+		err = -EIO;
+		goto exit;
+	}
+	xnvmec_pinf("nlisted: %u", nlisted);
+
+	err = kv_verify_all(dev, nsid, prefix, 1, count, 2, vbuf, rbuf);
+	if (err) {
+		goto exit;
+	}
+
+exit:
+	xnvme_buf_free(dev, vbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
+
+/**
+ * 0) Store 'count' keys, overwriting keys of a previous run
+ * 1) Flush, thus writing a checkpoint of the index
+ * 2) Close and re-open the device
+ * 3) Retrieve and verify all of the keys
+ * 4) Store them again, close without flushing, re-open, and verify them once
+ *    more; close writes a checkpoint as well
+ */
+static int
+test_reopen(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint64_t count = cli->args.count;
+	const char *prefix = "kvs-ro-";
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint8_t *vbuf = NULL, *rbuf = NULL;
+	int err = 0;
+
+	if ((!count) || (count > XNVME_TESTS_KVS_COUNT_MAX)) {
+		XNVME_DEBUG("FAILED: count(%zu) out-of-bounds for test", count);
+		return -EINVAL;
+	}
+
+	for (int pass = 0; pass < 2; ++pass) {
+		vbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+		rbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+		if (!(vbuf && rbuf)) {
+			err = -errno;
+			xnvmec_perr("xnvme_buf_alloc()", err);
+			goto exit;
+		}
+
+		xnvmec_pinf("Storing %zu keys", count);
+		err = kv_store_all(dev, nsid, prefix, count, vbuf);
+		if (err) {
+			goto exit;
+		}
+
+		if (!pass) {
+			struct xnvme_spec_cmd cmd = { 0 };
+			struct xnvme_req req = { 0 };
+
+			xnvmec_pinf("Flushing");
+			cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+			cmd.common.nsid = nsid;
+			err = xnvme_cmd_pass(dev, &cmd, NULL, 0, NULL, 0,
+					     XNVME_CMD_SYNC, &req);
+			if (err || xnvme_req_cpl_status(&req)) {
+				xnvmec_perr("xnvme_cmd_pass(flush)", err);
+				xnvme_req_pr(&req, XNVME_PR_DEF);
+				err = err ? err : -EIO;
+				goto exit;
+			}
+		}
+
+		xnvme_buf_free(dev, vbuf);
+		xnvme_buf_free(dev, rbuf);
+		vbuf = rbuf = NULL;
+
+		xnvmec_pinf("Re-opening");
+		xnvme_dev_close(dev);
+		dev = cli->args.dev = xnvme_dev_open(cli->args.uri);
+		if (!dev) {
+			err = -errno;
+			xnvmec_perr("xnvme_dev_open()", err);
+			goto exit;
+		}
+
+		vbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+		rbuf = xnvme_buf_alloc(dev, XNVME_TESTS_KVS_VBUF_NBYTES, NULL);
+		if (!(vbuf && rbuf)) {
+			err = -errno;
+			xnvmec_perr("xnvme_buf_alloc()", err);
+			goto exit;
+		}
+
+		xnvmec_pinf("Retrieving %zu keys", count);
+		err = kv_verify_all(dev, nsid, prefix, 0, count, 1, vbuf,
+				    rbuf);
+		if (err) {
+			goto exit;
+		}
+
+		xnvme_buf_free(dev, vbuf);
+		xnvme_buf_free(dev, rbuf);
+		vbuf = rbuf = NULL;
+	}
+
+exit:
+	if (dev) {
+		xnvme_buf_free(dev, vbuf);
+		xnvme_buf_free(dev, rbuf);
+	}
+
+	return err;
+}
+
+//
+// Command-Line Interface (CLI) definition
+//
+static struct xnvmec_sub subs[] = {
+	{
+		"io",
+		"Store, retrieve, delete, exist and list 'count' keys",
+		"Store, retrieve, delete, exist and list 'count' keys", test_io, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LREQ},
+		}
+	},
+	{
+		"reopen",
+		"Verify that 'count' keys persist when re-opening the device",
+		"Verify that 'count' keys persist when re-opening the device", test_reopen, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LREQ},
+		}
+	},
+};
+
+static struct xnvmec cli = {
+	.title = "Test Key-Value Command Set",
+	.descr_short = "Test Key-Value Command Set",
+	.subs = subs,
+	.nsubs = sizeof subs / sizeof(*subs),
+};
+
+int
+main(int argc, char **argv)
+{
+	return xnvmec(&cli, argc, argv, XNVMEC_INIT_DEV_OPEN);
+}
@@ -1,6 +1,9 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <errno.h>
 #include <liblblk.h>
 #include <libxnvmec.h>
@@ -292,6 +295,388 @@ exit:
 }
 
 
+/**
+ * 0) Fill wbuf with a repeating sequence of letters A to Z
+ * 1) Write wbuf at slba, then overwrite its first half with '!'
+ * 2) Flush, close, and re-open the device
+ * 3) Read at slba into rbuf
+ * 4) Verify that the content of rbuf is the same as wbuf
+ *
+ * On devices retaining data across opens, e.g. a backend stacked upon a
+ * 'sim' model with a 'data.file'
+ */
+static int
+test_reopen(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr;
+	size_t buf_nbytes;
+	uint8_t *wbuf = NULL, *rbuf = NULL, *expected = NULL;
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Writing payload, and overwriting its first half");
+	xnvmec_buf_fill(wbuf, buf_nbytes, "anum");
+	err = xnvme_cmd_write(dev, nsid, rng_slba, mdts_naddr - 1, wbuf, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	memset(wbuf, '!', (mdts_naddr / 2) * geo->lba_nbytes);
+	err = xnvme_cmd_write(dev, nsid, rng_slba, (mdts_naddr / 2) - 1, wbuf,
+			      NULL, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+	cmd.common.nsid = nsid;
+	err = xnvme_cmd_pass(dev, &cmd, NULL, 0, NULL, 0, XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_pass(flush)", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	// The buffers are of the device, the payload is kept in plain memory
+	expected = malloc(buf_nbytes);
+	if (!expected) {
+		err = -errno;
+		xnvmec_perr("malloc()", err);
+		goto exit;
+	}
+	memcpy(expected, wbuf, buf_nbytes);
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+	wbuf = NULL;
+	rbuf = NULL;
+
+	xnvmec_pinf("Re-opening the device");
+	xnvme_dev_close(dev);
+	dev = cli->args.dev = xnvme_dev_open(cli->args.uri);
+	if (!dev) {
+		err = -errno;
+		xnvmec_perr("xnvme_dev_open()", err);
+		goto exit;
+	}
+	rbuf = xnvme_buf_alloc(dev, buf_nbytes, NULL);
+	if (!rbuf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Reading payload");
+	xnvmec_buf_clear(rbuf, buf_nbytes);
+	err = xnvme_cmd_read(dev, nsid, rng_slba, mdts_naddr - 1, rbuf, NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing payload and rbuf");
+	if (xnvmec_buf_diff(expected, rbuf, buf_nbytes)) {
+		xnvmec_buf_diff_pr(expected, rbuf, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (dev) {
+		xnvme_buf_free(dev, wbuf);
+		xnvme_buf_free(dev, rbuf);
+	}
+	free(expected);
+
+	return err;
+}
+
+/**
+ * Fill, or verify, 'naddr' LBAs from 'slba' with a pattern of the LBA and the
+ * pass writing it; returns the number of mismatching words
+ */
+static size_t
+overwrite_pattern(uint8_t *buf, size_t lba_nbytes, uint64_t slba,
+		  uint64_t naddr, uint64_t pass, int verify)
+{
+	size_t ndiff = 0;
+
+	for (uint64_t i = 0; i < naddr; ++i) {
+		uint64_t *words = (void *)(buf + i * lba_nbytes);
+
+		for (size_t w = 0; w < lba_nbytes / sizeof(*words); ++w) {
+			uint64_t word = ((slba + i) << 16) ^ (pass << 8) ^ w;
+
+			if (!verify) {
+				words[w] = word;
+			} else if (words[w] != word) {
+				ndiff += 1;
+			}
+		}
+	}
+
+	return ndiff;
+}
+
+static uint64_t
+gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * 0) Write the range [slba, elba], by default the entire namespace, 'count'
+ *    times, default 3, in mdts-sized chunks, each pass in a strided order such
+ *    that overwritten data is spread over many zones
+ * 1) Re-open the device
+ * 2) Verify that the range holds the payload of the last pass
+ *
+ * On a device remapping writes, e.g. 'hftl', the passes beyond the first
+ * exhaust the free space, thus garbage-collection must reclaim it, and the
+ * re-open restores the mapping from the checkpoints
+ */
+static int
+test_overwrite(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t nsze = geo->tbytes / geo->lba_nbytes;
+	uint64_t rng_slba = cli->given[XNVMEC_OPT_SLBA] ? cli->args.slba : 0;
+	uint64_t rng_elba = cli->given[XNVMEC_OPT_ELBA] ? cli->args.elba :
+			    nsze - 1;
+	uint64_t npasses = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 3;
+	uint64_t mdts_naddr = XNVME_MIN(geo->mdts_nbytes / geo->lba_nbytes,
+					256);
+	uint64_t nchunks, stride;
+	size_t buf_nbytes = mdts_naddr * geo->lba_nbytes;
+	struct xnvme_req req = { 0 };
+	uint8_t *buf = NULL;
+	size_t ndiff = 0;
+	int err = 0;
+
+	if ((rng_slba > rng_elba) || (rng_elba >= nsze) || (!npasses)) {
+		err = -EINVAL;
+		xnvmec_perr("Invalid range: [rng_slba,rng_elba] or count", err);
+		return err;
+	}
+	nchunks = (rng_elba - rng_slba + mdts_naddr) / mdts_naddr;
+	stride = nchunks / 3 + 1;
+	while (gcd(stride, nchunks) != 1) {
+		stride += 1;
+	}
+
+	xnvmec_pinf("range: { slba: 0x%016lx, elba: 0x%016lx }, npasses: %zu",
+		    rng_slba, rng_elba, npasses);
+
+	buf = xnvme_buf_alloc(dev, buf_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		return err;
+	}
+
+	for (uint64_t pass = 0; pass < npasses; ++pass) {
+		xnvmec_pinf("Writing pass: %zu", pass);
+
+		for (uint64_t i = 0; i < nchunks; ++i) {
+			uint64_t slba = rng_slba + ((i * stride) % nchunks) *
+					mdts_naddr;
+			uint64_t naddr = XNVME_MIN(rng_elba - slba + 1,
+						   mdts_naddr);
+
+			overwrite_pattern(buf, geo->lba_nbytes, slba, naddr,
+					  pass, 0);
+			err = xnvme_cmd_write(dev, nsid, slba, naddr - 1, buf,
+					      NULL, XNVME_CMD_SYNC, &req);
+			if (err || xnvme_req_cpl_status(&req)) {
+				xnvmec_perr("xnvme_cmd_write()", err);
+				xnvme_req_pr(&req, XNVME_PR_DEF);
+				err = err ? err : -EIO;
+				goto exit;
+			}
+		}
+	}
+
+	xnvmec_pinf("Re-opening the device");
+	xnvme_buf_free(dev, buf);
+	buf = NULL;
+	xnvme_dev_close(dev);
+	dev = cli->args.dev = xnvme_dev_open(cli->args.uri);
+	if (!dev) {
+		err = -errno;
+		xnvmec_perr("xnvme_dev_open()", err);
+		goto exit;
+	}
+	buf = xnvme_buf_alloc(dev, buf_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Verifying the payload of pass: %zu", npasses - 1);
+	for (uint64_t slba = rng_slba; slba <= rng_elba; slba += mdts_naddr) {
+		uint64_t naddr = XNVME_MIN(rng_elba - slba + 1, mdts_naddr);
+
+		xnvmec_buf_clear(buf, buf_nbytes);
+		err = xnvme_cmd_read(dev, nsid, slba, naddr - 1, buf, NULL,
+				     XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("xnvme_cmd_read()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+		ndiff += overwrite_pattern(buf, geo->lba_nbytes, slba, naddr,
+					   npasses - 1, 1);
+	}
+	if (ndiff) {
+		err = -EIO;
+		xnvmec_perr("payload differs", err);
+		goto exit;
+	}
+
+exit:
+	if (dev) {
+		xnvme_buf_free(dev, buf);
+	}
+
+	return err;
+}
+
+/**
+ * 0) Fill a file with a payload of 4 x mdts + 3 LBAs, less half an LBA
+ * 1) Import it to [slba, ...] via xnvmec_dev_from_file()
+ * 2) Export the same range to another file via xnvmec_dev_to_file()
+ * 3) Verify that the export is the payload, with the last LBA zero-padded
+ *
+ * On devices retaining data, e.g. 'sim' with 'data=1'
+ */
+static int
+test_xfer(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	char ipath[] = "/tmp/xnvme_tests_lblk.XXXXXX";
+	char opath[] = "/tmp/xnvme_tests_lblk.XXXXXX";
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr, naddr;
+	size_t buf_nbytes, file_nbytes, nbytes = 0;
+	uint8_t *wbuf = NULL, *rbuf = NULL, *expected = NULL, *actual = NULL;
+	int ifd = -1, ofd = -1;
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+	naddr = 4 * mdts_naddr + 3;
+	buf_nbytes = naddr * geo->lba_nbytes;
+	file_nbytes = buf_nbytes - geo->lba_nbytes / 2;
+
+	ifd = mkstemp(ipath);
+	ofd = mkstemp(opath);
+	if ((ifd < 0) || (ofd < 0)) {
+		err = -errno;
+		xnvmec_perr("mkstemp()", err);
+		goto exit;
+	}
+
+	expected = calloc(1, buf_nbytes);
+	actual = calloc(1, buf_nbytes);
+	if ((!expected) || (!actual)) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+	xnvmec_buf_fill(expected, file_nbytes, "anum");
+
+	err = xnvmec_buf_to_file(expected, file_nbytes, ipath);
+	if (err) {
+		xnvmec_perr("xnvmec_buf_to_file()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Importing nbytes: %zu to slba: 0x%016lx", file_nbytes,
+		    rng_slba);
+	err = xnvmec_dev_from_file(dev, nsid, rng_slba, 4, ipath, &nbytes);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_from_file()", err);
+		goto exit;
+	}
+	if (nbytes != buf_nbytes) {
+		err = -EIO;
+		xnvmec_perr("nbytes != naddr * lba_nbytes", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Exporting naddr: %zu from slba: 0x%016lx", naddr,
+		    rng_slba);
+	err = xnvmec_dev_to_file(dev, nsid, rng_slba, naddr - 1, 4, opath);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_to_file()", err);
+		goto exit;
+	}
+	err = xnvmec_buf_from_file(actual, buf_nbytes, opath);
+	if (err) {
+		xnvmec_perr("xnvmec_buf_from_file()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing import and export");
+	if (xnvmec_buf_diff(expected, actual, buf_nbytes)) {
+		xnvmec_buf_diff_pr(expected, actual, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (ifd >= 0) {
+		close(ifd);
+		unlink(ipath);
+	}
+	if (ofd >= 0) {
+		close(ofd);
+		unlink(opath);
+	}
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+	free(expected);
+	free(actual);
+
+	return err;
+}
+
 //
 // Command-Line Interface (CLI) definition
 //
@@ -307,6 +692,16 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
 		}
 	},
+	{
+		"reopen",
+		"Verify that what was written is read after re-opening",
+		"Verify that what was written is read after re-opening",
+		test_reopen, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
 	{
 		"scopy",
 		"Basic Verification of the Simple-Copy Command",
@@ -316,6 +711,27 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
 		}
 	},
+	{
+		"overwrite",
+		"Verify what was written last, after overwrites and re-opening",
+		"Verify what was written last, after overwrites and re-opening",
+		test_overwrite, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+		}
+	},
+	{
+		"xfer",
+		"Verify a round-trip of a file import and export",
+		"Verify a round-trip of a file import and export",
+		test_xfer, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
 };
 
 static struct xnvmec cli = {
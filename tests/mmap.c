@@ -0,0 +1,231 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <libxnvmec.h>
+
+#define XNVME_TESTS_MMAP_RESIDENT 256	///< Bound on resident blocks
+#define XNVME_TESTS_MMAP_NBLKS (4 * XNVME_TESTS_MMAP_RESIDENT)
+
+/**
+ * Fill, or verify, the payload of a single LBA; each word carries the LBA, its
+ * index, and the generation of the payload
+ */
+static size_t
+lba_pattern(uint8_t *buf, uint64_t lba, size_t nbytes, uint64_t gen,
+	    int verify)
+{
+	uint64_t *words = (void *)buf;
+	size_t ndiff = 0;
+
+	for (size_t i = 0; i < nbytes / sizeof(*words); ++i) {
+		uint64_t word = (lba << 24) ^ (gen << 56) ^ i;
+
+		if (!verify) {
+			words[i] = word;
+		} else if (words[i] != word) {
+			ndiff += 1;
+		}
+	}
+
+	return ndiff;
+}
+
+/**
+ * Write or read 'nlb' LBAs from 'slba' synchronously, in commands of at most
+ * mdts
+ */
+static int
+rw_sync(struct xnvme_dev *dev, int write, uint64_t slba, uint64_t nlb,
+	uint8_t *buf)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t mdts_naddr = geo->mdts_nbytes / geo->lba_nbytes;
+
+	for (uint64_t ofz = 0; ofz < nlb; ofz += mdts_naddr) {
+		uint64_t naddr = XNVME_MIN(mdts_naddr, nlb - ofz);
+		uint8_t *dbuf = buf + ofz * geo->lba_nbytes;
+		struct xnvme_req req = { 0 };
+		int err;
+
+		err = write ?
+		      xnvme_cmd_write(dev, nsid, slba + ofz, naddr - 1, dbuf,
+				      NULL, XNVME_CMD_SYNC, &req) :
+		      xnvme_cmd_read(dev, nsid, slba + ofz, naddr - 1, dbuf,
+				     NULL, XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("xnvme_cmd_{write,read}()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * 0) Write a pattern to 4 x 256 blocks, a block being a page or an LBA when
+ *    larger, at 'slba'
+ * 1) Map the range with a bound of 256 resident blocks
+ * 2) Verify the view, forwards and then backwards, thus faulting, reading
+ *    ahead and evicting
+ * 3) Modify every third block via the view, then xnvme_msync()
+ * 4) Unmap, read back the range via the device, and verify that the modified
+ *    blocks, and only those, are changed
+ */
+static int
+test_rdwr(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint64_t slba = cli->args.slba;
+	uint64_t blk_nbytes = XNVME_MAX((uint64_t)sysconf(_SC_PAGESIZE),
+					(uint64_t)geo->lba_nbytes);
+	uint64_t blk_nlb = blk_nbytes / geo->lba_nbytes;
+	uint64_t nlb = XNVME_TESTS_MMAP_NBLKS * blk_nlb;
+	size_t nbytes = nlb * geo->lba_nbytes;
+	const struct xnvme_mmap_stats *stats;
+	struct xnvme_mmap *map = NULL;
+	uint8_t *buf = NULL, *addr;
+	size_t ndiff = 0;
+	int err;
+
+	if ((!geo->lba_nbytes) || (slba + nlb > geo->tbytes / geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: range exceeds the device, slba: 0x%lx",
+			    slba);
+		return -EINVAL;
+	}
+
+	buf = xnvme_buf_alloc(dev, nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		return err;
+	}
+
+	xnvmec_pinf("Writing nlb: %zu at slba: 0x%016lx", nlb, slba);
+	for (uint64_t i = 0; i < nlb; ++i) {
+		lba_pattern(buf + i * geo->lba_nbytes, slba + i,
+			    geo->lba_nbytes, 0, 0);
+	}
+	err = rw_sync(dev, 1, slba, nlb, buf);
+	if (err) {
+		goto exit;
+	}
+
+	xnvmec_pinf("Mapping with resident_nbytes: %zu",
+		    XNVME_TESTS_MMAP_RESIDENT * blk_nbytes);
+	err = xnvme_mmap(dev, &map, slba, nlb,
+			 XNVME_TESTS_MMAP_RESIDENT * blk_nbytes,
+			 XNVME_MMAP_RDWR);
+	if (err) {
+		xnvmec_perr("xnvme_mmap()", err);
+		map = NULL;
+		goto exit;
+	}
+	addr = xnvme_mmap_get_addr(map);
+
+	xnvmec_pinf("Verifying the view, forwards and backwards");
+	for (uint64_t i = 0; i < nlb; ++i) {
+		ndiff += lba_pattern(addr + i * geo->lba_nbytes, slba + i,
+				     geo->lba_nbytes, 0, 1);
+	}
+	for (uint64_t i = nlb; i-- > 0;) {
+		ndiff += lba_pattern(addr + i * geo->lba_nbytes, slba + i,
+				     geo->lba_nbytes, 0, 1);
+	}
+	if (ndiff) {
+		XNVME_DEBUG("FAILED: view differs, ndiff: %zu", ndiff);
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Modifying every third block, and syncing");
+	for (uint64_t blk = 0; blk < XNVME_TESTS_MMAP_NBLKS; blk += 3) {
+		for (uint64_t i = blk * blk_nlb; i < (blk + 1) * blk_nlb; ++i) {
+			lba_pattern(addr + i * geo->lba_nbytes, slba + i,
+				    geo->lba_nbytes, 1, 0);
+		}
+	}
+	err = xnvme_msync(map, 0, 0);
+	if (err) {
+		xnvmec_perr("xnvme_msync()", err);
+		goto exit;
+	}
+
+	stats = xnvme_mmap_get_stats(map);
+	xnvmec_pinf("faults: %zu, hits: %zu, prefetched: %zu, evicted: %zu, "
+		    "written: %zu", stats->faults, stats->hits,
+		    stats->prefetched, stats->evicted, stats->written);
+	if ((!stats->evicted) ||
+	    (stats->written < (XNVME_TESTS_MMAP_NBLKS + 2) / 3)) {
+		XNVME_DEBUG("FAILED: nothing evicted, or blocks not written");
+		err = -EIO;
+		goto exit;
+	}
+
+	err = xnvme_munmap(map);
+	map = NULL;
+	if (err) {
+		xnvmec_perr("xnvme_munmap()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Reading back via the device");
+	xnvmec_buf_clear(buf, nbytes);
+	err = rw_sync(dev, 0, slba, nlb, buf);
+	if (err) {
+		goto exit;
+	}
+	for (uint64_t i = 0; i < nlb; ++i) {
+		uint64_t gen = ((i / blk_nlb) % 3) ? 0 : 1;
+
+		ndiff += lba_pattern(buf + i * geo->lba_nbytes, slba + i,
+				     geo->lba_nbytes, gen, 1);
+	}
+	if (ndiff) {
+		XNVME_DEBUG("FAILED: device differs, ndiff: %zu", ndiff);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (map) {
+		xnvme_munmap(map);
+	}
+	xnvme_buf_free(dev, buf);
+
+	return err;
+}
+
+//
+// Command-Line Interface (CLI) definition
+//
+static struct xnvmec_sub subs[] = {
+	{
+		"rdwr",
+		"Verify reads, writes, and msync via a view at 'slba'",
+		"Verify reads, writes, and msync via a view at 'slba'",
+		test_rdwr, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+		}
+	},
+};
+
+static struct xnvmec cli = {
+	.title = "Test xNVMe Memory-Mapped Views",
+	.descr_short = "Test xNVMe Memory-Mapped Views",
+	.subs = subs,
+	.nsubs = sizeof subs / sizeof(*subs),
+};
+
+int
+main(int argc, char **argv)
+{
+	return xnvmec(&cli, argc, argv, XNVMEC_INIT_DEV_OPEN);
+}
@@ -0,0 +1,447 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <errno.h>
+#include <libxnvmec.h>
+
+#define XNVME_TESTS_QDEPTH_MAX 512
+#define XNVME_TESTS_SIM_STEP 10000	///< Step of test_run() in nanoseconds
+
+struct cb_args {
+	struct xnvme_dev *dev;
+	uint64_t times[XNVME_TESTS_QDEPTH_MAX];	///< Clock at completion
+	uint32_t ncpl;
+	uint32_t nerr;
+};
+
+static void
+cb_time(struct xnvme_req *req, void *cb_arg)
+{
+	struct cb_args *cargs = cb_arg;
+	uint64_t now = 0;
+
+	xnvme_sim_get_time(cargs->dev, &now);
+	cargs->times[cargs->ncpl] = now;
+	cargs->ncpl += 1;
+	cargs->nerr += xnvme_req_cpl_status(req) ? 1 : 0;
+}
+
+static int
+get_stats(struct xnvme_dev *dev, struct xnvme_sim_stats *stats)
+{
+	int err;
+
+	err = xnvme_sim_get_stats(dev, stats);
+	if (err) {
+		xnvmec_perr("xnvme_sim_get_stats()", err);
+	}
+
+	return err;
+}
+
+/**
+ * Verify that synchronous commands advance the clock and are accounted for,
+ * by writing, reading, and flushing 'nlb' LBAs at 'slba'
+ */
+static int
+test_clock(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t slba = cli->args.slba;
+	uint64_t nlb = XNVME_MIN(geo->mdts_nbytes / geo->lba_nbytes, 8);
+	size_t nbytes = nlb * geo->lba_nbytes;
+	struct xnvme_sim_stats stats[4] = { 0 };
+	struct xnvme_spec_cmd cmd = { 0 };
+	struct xnvme_req req = { 0 };
+	uint8_t *buf = NULL;
+	int err;
+
+	buf = xnvme_buf_alloc(dev, nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	xnvmec_buf_fill(buf, nbytes, "anum");
+
+	err = get_stats(dev, &stats[0]);
+	if (err) {
+		goto exit;
+	}
+
+	err = xnvme_cmd_write(dev, nsid, slba, nlb - 1, buf, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	err = get_stats(dev, &stats[1]);
+	if (err) {
+		goto exit;
+	}
+
+	memset(&req, 0, sizeof(req));
+	err = xnvme_cmd_read(dev, nsid, slba, nlb - 1, buf, NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	err = get_stats(dev, &stats[2]);
+	if (err) {
+		goto exit;
+	}
+
+	memset(&req, 0, sizeof(req));
+	cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+	cmd.common.nsid = nsid;
+	err = xnvme_cmd_pass(dev, &cmd, NULL, 0, NULL, 0, XNVME_CMD_SYNC,
+			     &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_pass(flush)", err);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+	err = get_stats(dev, &stats[3]);
+	if (err) {
+		goto exit;
+	}
+
+	xnvme_sim_stats_pr(&stats[3], XNVME_PR_DEF);
+
+	if ((stats[1].nwrites != stats[0].nwrites + 1) ||
+	    (stats[1].write_nbytes != stats[0].write_nbytes + nbytes) ||
+	    (stats[2].nreads != stats[1].nreads + 1) ||
+	    (stats[2].read_nbytes != stats[1].read_nbytes + nbytes) ||
+	    (stats[3].nflushes != stats[2].nflushes + 1)) {
+		XNVME_DEBUG("FAILED: commands are not accounted for");
+		err = -EIO;
+		goto exit;
+	}
+	for (int i = 1; i < 4; ++i) {
+		if (stats[i].now <= stats[i - 1].now) {
+			XNVME_DEBUG("FAILED: clock did not advance, i: %d", i);
+			err = -EIO;
+			goto exit;
+		}
+	}
+	if (stats[2].busy <= stats[0].busy) {
+		XNVME_DEBUG("FAILED: channels were not busy");
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	xnvme_buf_free(dev, buf);
+
+	return err;
+}
+
+/**
+ * Verify open-loop progress via xnvme_sim_run(): 'qdepth' reads are submitted
+ * at once, and the clock is then advanced in steps of XNVME_TESTS_SIM_STEP;
+ * after each step the clock must be at the step, and the commands completed
+ * must have completed by it, in order of completion time
+ */
+static int
+test_run(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t slba = cli->args.slba;
+	uint64_t qd = cli->args.qdepth;
+	uint64_t step = XNVME_TESTS_SIM_STEP;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req reqs[XNVME_TESTS_QDEPTH_MAX] = { 0 };
+	struct cb_args cargs = { 0 };
+	uint64_t now = 0, until;
+	uint8_t *buf = NULL;
+	uint32_t nsteps = 0;
+	int err;
+
+	if ((!qd) || (qd > XNVME_TESTS_QDEPTH_MAX) || (qd & (qd - 1))) {
+		XNVME_DEBUG("FAILED: invalid qdepth(%zu)", qd);
+		return -EINVAL;
+	}
+	cargs.dev = dev;
+
+	buf = xnvme_buf_alloc(dev, qd * geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+
+	err = xnvme_sim_get_time(dev, &now);
+	if (err) {
+		xnvmec_perr("xnvme_sim_get_time()", err);
+		goto exit;
+	}
+
+	for (uint64_t i = 0; i < qd; ++i) {
+		reqs[i].async.ctx = ctx;
+		reqs[i].async.cb = cb_time;
+		reqs[i].async.cb_arg = &cargs;
+
+		err = xnvme_cmd_read(dev, nsid, slba + i, 0,
+				     buf + i * geo->lba_nbytes, NULL,
+				     XNVME_CMD_ASYNC, &reqs[i]);
+		if (err) {
+			xnvmec_perr("xnvme_cmd_read()", err);
+			goto exit;
+		}
+	}
+
+	for (until = now + step; cargs.ncpl < qd; until += step, ++nsteps) {
+		uint32_t ncpl = cargs.ncpl;
+		int ret;
+
+		ret = xnvme_sim_run(dev, ctx, until);
+		if (ret < 0) {
+			err = ret;
+			xnvmec_perr("xnvme_sim_run()", err);
+			goto exit;
+		}
+		if ((uint32_t)ret != cargs.ncpl - ncpl) {
+			XNVME_DEBUG("FAILED: ret: %d, ncpl: %u", ret,
+				    cargs.ncpl - ncpl);
+			err = -EIO;
+			goto exit;
+		}
+
+		err = xnvme_sim_get_time(dev, &now);
+		if (err) {
+			xnvmec_perr("xnvme_sim_get_time()", err);
+			goto exit;
+		}
+		if (now != until) {
+			XNVME_DEBUG("FAILED: now: %zu != until: %zu", now,
+				    until);
+			err = -EIO;
+			goto exit;
+		}
+		for (uint32_t i = ncpl; i < cargs.ncpl; ++i) {
+			if ((cargs.times[i] > until) ||
+			    (i && (cargs.times[i] < cargs.times[i - 1]))) {
+				XNVME_DEBUG("FAILED: completion out of order");
+				err = -EIO;
+				goto exit;
+			}
+		}
+	}
+	xnvmec_pinf("nsteps: %u, now: %zu", nsteps, now);
+
+	if (cargs.nerr) {
+		XNVME_DEBUG("FAILED: nerr: %u", cargs.nerr);
+		err = -EIO;
+		goto exit;
+	}
+
+	err = xnvme_sim_run(dev, NULL, until + step);
+	if (err < 0) {
+		xnvmec_perr("xnvme_sim_run()", err);
+		goto exit;
+	}
+	err = xnvme_sim_get_time(dev, &now);
+	if (err || (now != until + step)) {
+		XNVME_DEBUG("FAILED: clock not advanced without context");
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, buf);
+
+	return err;
+}
+
+/**
+ * Submit 'count' reads and writes, of pseudo-random LBAs, in batches of
+ * 'qdepth' commands, waiting for each batch to complete
+ */
+static int
+workload(struct xnvme_dev *dev, uint64_t count, uint64_t qd, uint8_t *buf)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint64_t nsze = geo->tbytes / geo->lba_nbytes;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req reqs[XNVME_TESTS_QDEPTH_MAX] = { 0 };
+	struct cb_args cargs = { 0 };
+	uint64_t lcg = 0x2545F4914F6CDD1DULL;
+	int err;
+
+	cargs.dev = dev;
+
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		return err;
+	}
+
+	for (uint64_t i = 0; i < count; i += qd) {
+		cargs.ncpl = 0;
+
+		for (uint64_t j = 0; (j < qd) && (i + j < count); ++j) {
+			uint64_t slba;
+
+			lcg = lcg * 6364136223846793005ULL + 1;
+			slba = (lcg >> 16) % nsze;
+
+			memset(&reqs[j], 0, sizeof(reqs[j]));
+			reqs[j].async.ctx = ctx;
+			reqs[j].async.cb = cb_time;
+			reqs[j].async.cb_arg = &cargs;
+
+			err = (lcg >> 62) ?
+			      xnvme_cmd_read(dev, nsid, slba, 0,
+					     buf + j * geo->lba_nbytes, NULL,
+					     XNVME_CMD_ASYNC, &reqs[j]) :
+			      xnvme_cmd_write(dev, nsid, slba, 0,
+					      buf + j * geo->lba_nbytes, NULL,
+					      XNVME_CMD_ASYNC, &reqs[j]);
+			if (err) {
+				xnvmec_perr("xnvme_cmd_{read,write}()", err);
+				goto exit;
+			}
+		}
+
+		err = xnvme_async_wait(dev, ctx);
+		if (err < 0) {
+			xnvmec_perr("xnvme_async_wait()", err);
+			goto exit;
+		}
+		err = 0;
+	}
+	if (cargs.nerr) {
+		XNVME_DEBUG("FAILED: nerr: %u", cargs.nerr);
+		err = -EIO;
+	}
+
+exit:
+	xnvme_async_term(dev, ctx);
+
+	return err;
+}
+
+/**
+ * Verify that the simulation is deterministic: the same workload is run on
+ * the device, and on a second instance opened with the same uri, the
+ * resulting clock and statistics must be identical
+ */
+static int
+test_seed(struct xnvmec *cli)
+{
+	struct xnvme_dev *devs[2] = { cli->args.dev, NULL };
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint64_t count = cli->args.count;
+	uint64_t qd = cli->args.qdepth;
+	struct xnvme_sim_stats stats[2] = { 0 };
+	uint8_t *bufs[2] = { 0 };
+	int err;
+
+	if ((!qd) || (qd > XNVME_TESTS_QDEPTH_MAX) || (qd & (qd - 1))) {
+		XNVME_DEBUG("FAILED: invalid qdepth(%zu)", qd);
+		return -EINVAL;
+	}
+
+	devs[1] = xnvme_dev_open(cli->args.uri);
+	if (!devs[1]) {
+		err = -errno;
+		xnvmec_perr("xnvme_dev_open()", err);
+		return err;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		bufs[i] = xnvme_buf_alloc(devs[i], qd * geo->lba_nbytes, NULL);
+		if (!bufs[i]) {
+			err = -errno;
+			xnvmec_perr("xnvme_buf_alloc()", err);
+			goto exit;
+		}
+		xnvmec_buf_fill(bufs[i], qd * geo->lba_nbytes, "anum");
+
+		err = workload(devs[i], count, qd, bufs[i]);
+		if (err) {
+			goto exit;
+		}
+		err = get_stats(devs[i], &stats[i]);
+		if (err) {
+			goto exit;
+		}
+		xnvme_sim_stats_pr(&stats[i], XNVME_PR_DEF);
+	}
+
+	if (memcmp(&stats[0], &stats[1], sizeof(stats[0]))) {
+		XNVME_DEBUG("FAILED: the runs differ");
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	for (int i = 0; i < 2; ++i) {
+		xnvme_buf_free(devs[i], bufs[i]);
+	}
+	xnvme_dev_close(devs[1]);
+
+	return err;
+}
+
+//
+// Command-Line Interface (CLI) definition
+//
+static struct xnvmec_sub subs[] = {
+	{
+		"clock",
+		"Verify clock and statistics of sync. commands at 'slba'",
+		"Verify clock and statistics of sync. commands at 'slba'", test_clock, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+		}
+	},
+	{
+		"run",
+		"Verify open-loop progress of 'qdepth' reads at 'slba'",
+		"Verify open-loop progress of 'qdepth' reads at 'slba'", test_run, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
+	{
+		"seed",
+		"Verify that two runs of 'count' commands are identical",
+		"Verify that two runs of 'count' commands are identical", test_seed, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LREQ},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LREQ},
+		}
+	},
+};
+
+static struct xnvmec cli = {
+	.title = "Test xNVMe Simulated Device",
+	.descr_short = "Test xNVMe Simulated Device",
+	.subs = subs,
+	.nsubs = sizeof subs / sizeof(*subs),
+};
+
+int
+main(int argc, char **argv)
+{
+	return xnvmec(&cli, argc, argv, XNVMEC_INIT_DEV_OPEN);
+}
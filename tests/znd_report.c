@@ -0,0 +1,158 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <libznd.h>
+#include <libxnvmec.h>
+
+/**
+ * Iterate from the zone at index 'zidx' with chunks of 'chunk_limit'
+ * descriptors, and compare each descriptor with the same entry of 'rprt';
+ * then verify that the iterator stays at the end of the report
+ */
+static int
+iter_verify(struct xnvme_dev *dev, const struct znd_report *rprt,
+	    uint64_t zidx, size_t chunk_limit)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	struct znd_report_iter *iter = NULL;
+	const struct znd_descr *descr;
+	uint64_t idx = zidx;
+	int err;
+
+	xnvmec_pinf("Iterating from zidx: %zu, chunk_limit: %zu", zidx,
+		    chunk_limit);
+
+	err = znd_report_iter_init(dev, zidx * geo->nsect, ZND_RECV_SF_ALL, 0,
+				   chunk_limit, &iter);
+	if (err) {
+		xnvmec_perr("znd_report_iter_init()", err);
+		return err;
+	}
+
+	for (;;) {
+		err = znd_report_iter_next(iter, &descr, NULL);
+		if (err) {
+			xnvmec_perr("znd_report_iter_next()", err);
+			goto exit;
+		}
+		if (!descr) {
+			break;
+		}
+		if ((idx >= rprt->nentries) ||
+		    memcmp(descr, ZND_REPORT_DESCR(rprt, idx), sizeof(*descr))) {
+			xnvmec_pinf("Mismatch at idx: %zu", idx);
+			znd_descr_pr(descr, XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+		idx += 1;
+	}
+	if (idx != rprt->nentries) {
+		xnvmec_pinf("Iterator ended at idx: %zu, expected: %u", idx,
+			    rprt->nentries);
+		err = -EIO;
+		goto exit;
+	}
+
+	// Once ended, the iterator must remain so
+	for (int i = 0; i < 2; ++i) {
+		err = znd_report_iter_next(iter, &descr, NULL);
+		if (err || descr) {
+			xnvmec_pinf("Iterator did not remain ended, err: %d", err);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+	}
+
+exit:
+	znd_report_iter_term(iter);
+
+	return err;
+}
+
+/**
+ * Compare the output of the report iterator with znd_report_from_dev(), with
+ * chunks of a single descriptor, a full chunk ending the report, and of
+ * 'limit' descriptors, defaulting to 3, thus switching chunks several times
+ * and, in general, ending on a partial chunk. Starting at the first zone, in
+ * the middle of the namespace, and past the last zone.
+ *
+ * Run via a backend whose async. path does not serve Management Receive, e.g.
+ * laio, to cover the fallback to sync. fetching of chunks
+ */
+static int
+test_iter(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	size_t limits[2] = { 1, cli->args.limit ? cli->args.limit : 3 };
+	struct znd_report *rprt = NULL;
+	int err = 0;
+
+	if (geo->type != XNVME_GEO_ZONED) {
+		xnvmec_pinf("Invalid device: not zoned");
+		return -EINVAL;
+	}
+
+	rprt = znd_report_from_dev(dev, 0x0, 0, 0);
+	if (!rprt) {
+		err = -errno;
+		xnvmec_perr("znd_report_from_dev()", err);
+		return err;
+	}
+	xnvmec_pinf("nentries: %u", rprt->nentries);
+	if (rprt->nentries <= limits[1]) {
+		xnvmec_pinf("Too few zones for chunk_limit: %zu", limits[1]);
+		err = -EINVAL;
+		goto exit;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		err = iter_verify(dev, rprt, 0, limits[i]);
+		if (err) {
+			goto exit;
+		}
+		err = iter_verify(dev, rprt, rprt->nentries / 2, limits[i]);
+		if (err) {
+			goto exit;
+		}
+		err = iter_verify(dev, rprt, rprt->nentries, limits[i]);
+		if (err) {
+			goto exit;
+		}
+	}
+
+exit:
+	xnvme_buf_virt_free(rprt);
+
+	return err;
+}
+
+//
+// Command-Line Interface (CLI) definition
+//
+static struct xnvmec_sub subs[] = {
+	{
+		"iter",
+		"Compare the report iterator with a full report",
+		"Compare the report iterator with a full report", test_iter, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_LIMIT, XNVMEC_LOPT},
+		}
+	},
+};
+
+static struct xnvmec cli = {
+	.title = "Test Zoned Report Iteration",
+	.descr_short = "Test Zoned Report Iteration",
+	.subs = subs,
+	.nsubs = sizeof subs / sizeof(*subs),
+};
+
+int
+main(int argc, char **argv)
+{
+	return xnvmec(&cli, argc, argv, XNVMEC_INIT_DEV_OPEN);
+}
@@ -300,6 +300,22 @@ _dev_open(struct thread_data *td, struct fio_file *f)
 	fwrap->ssw = xnvme_dev_get_ssw(fwrap->dev);
 	fwrap->lba_nbytes = fwrap->geo->lba_nbytes;
 
+	// Writes straddling the preferred write boundaries of the device hurt
+	// latency and endurance, thus warn about the given block-size / align
+	{
+		const uint64_t pwg_nbytes = (fwrap->geo->npwg + 1) *
+					    fwrap->lba_nbytes;
+		const uint64_t pwa_nbytes = (fwrap->geo->npwa + 1) *
+					    fwrap->lba_nbytes;
+
+		if ((td->o.min_bs[DDIR_WRITE] % pwg_nbytes) ||
+		    (td->o.ba[DDIR_WRITE] % pwa_nbytes)) {
+			log_info("xnvme_fioe: init(): bs/ba not aligned to "
+				 "npwg: %zu / npwa: %zu bytes\n",
+				 pwg_nbytes, pwa_nbytes);
+		}
+	}
+
 	fwrap->fio_file = f;
 	fwrap->fio_file->filetype = FIO_TYPE_BLOCK;
 	fwrap->fio_file->real_file_size = fwrap->geo->tbytes;
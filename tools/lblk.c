@@ -2,9 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <libxnvme.h>
 #include <libxnvmec.h>
 
+#define DEFAULT_QD 8
+
 // TODO: only show namespaces of logical block type
 static int
 sub_enumerate(struct xnvmec *cli)
@@ -173,6 +176,10 @@ sub_write(struct xnvmec *cli)
 
 	xnvmec_pinf("Writing nsid: 0x%x, slba: 0x%016x, nlb: %zu",
 		    nsid, slba, nlb);
+	if ((slba % (geo->npwa + 1)) || ((nlb + 1) % (geo->npwg + 1))) {
+		xnvmec_pinf("Write is not aligned to npwa: %u / npwg: %u",
+			    geo->npwa, geo->npwg);
+	}
 
 	xnvmec_pinf("Alloc/fill dbuf, dbuf_nbytes: %zu", dbuf_nbytes);
 	dbuf = xnvme_buf_alloc(dev, dbuf_nbytes, NULL);
@@ -218,6 +225,71 @@ exit:
 	return err;
 }
 
+static int
+sub_export(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	const uint32_t qd = cli->args.qdepth ? cli->args.qdepth : DEFAULT_QD;
+	const uint64_t slba = cli->args.slba;
+	const uint64_t nlb = cli->args.nlb;
+	uint32_t nsid = cli->args.nsid;
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+
+	xnvmec_pinf("Exporting nsid: 0x%x, slba: 0x%016"PRIx64", nlb: %"PRIu64", qd: %u, to: '%s'",
+		    nsid, slba, nlb, qd, cli->args.data_output);
+
+	xnvmec_timer_start(cli);
+
+	err = xnvmec_dev_to_file(dev, nsid, slba, nlb, qd,
+				 cli->args.data_output);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_to_file()", err);
+		return err;
+	}
+
+	xnvmec_timer_stop(cli);
+	xnvmec_timer_bw_pr(cli, "wall-clock", (nlb + 1) * geo->lba_nbytes);
+
+	return 0;
+}
+
+static int
+sub_import(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const uint32_t qd = cli->args.qdepth ? cli->args.qdepth : DEFAULT_QD;
+	const uint64_t slba = cli->args.slba;
+	uint32_t nsid = cli->args.nsid;
+	size_t nbytes = 0;
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+
+	xnvmec_pinf("Importing nsid: 0x%x, slba: 0x%016"PRIx64", qd: %u, from: '%s'",
+		    nsid, slba, qd, cli->args.data_input);
+
+	xnvmec_timer_start(cli);
+
+	err = xnvmec_dev_from_file(dev, nsid, slba, qd, cli->args.data_input,
+				   &nbytes);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_from_file()", err);
+		return err;
+	}
+
+	xnvmec_timer_stop(cli);
+	xnvmec_timer_bw_pr(cli, "wall-clock", nbytes);
+
+	return 0;
+}
+
 static int
 sub_write_zeroes(struct xnvmec *XNVME_UNUSED(cli))
 {
@@ -281,6 +353,29 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_META_INPUT, XNVMEC_LOPT},
 		}
 	},
+	{
+		"export", "Stream a range of logical blocks to a file",
+		"Stream a range of logical blocks to a file, pipelining reads "
+		"of at most MDTS with file-writes", sub_export, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_NLB, XNVMEC_LREQ},
+			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LREQ},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"import", "Stream a file to logical blocks",
+		"Stream a file to logical blocks, pipelining file-reads with "
+		"writes of at most MDTS", sub_import, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_DATA_INPUT, XNVMEC_LREQ},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
 	{
 		"write-zeros", "Set a range of logical blocks to zero",
 		"Set a range of logical blocks to zero", sub_write_zeroes, {
@@ -2,7 +2,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <time.h>
 #include <libxnvme.h>
+#include <libznd.h>
 #include <libxnvmec.h>
 
 static int
@@ -19,7 +22,7 @@ sub_enumerate(struct xnvmec *cli)
 		goto exit;
 	}
 
-	xnvme_enumeration_pr(listing, XNVME_PR_DEF);
+	xnvme_enumeration_pr(listing, cli->args.pr);
 
 exit:
 	free(listing);
@@ -182,7 +185,7 @@ sub_log_health(struct xnvmec *cli)
 		goto exit;
 	}
 
-	xnvme_spec_log_health_pr(log, XNVME_PR_DEF);
+	xnvme_spec_log_health_pr(log, cli->args.pr);
 
 exit:
 	xnvme_buf_free(dev, log);
@@ -233,8 +236,8 @@ sub_log_erri(struct xnvmec *cli)
 		goto exit;
 	}
 
-	printf("# %d error log page entries:\n", log_nentries);
-	xnvme_spec_log_erri_pr(log, log_nentries, XNVME_PR_DEF);
+	xnvmec_pinf("%d error log page entries:", log_nentries);
+	xnvme_spec_log_erri_pr(log, log_nentries, cli->args.pr);
 
 exit:
 	xnvme_buf_free(dev, log);
@@ -559,6 +562,410 @@ exit:
 	return err;
 }
 
+enum monitor_metric {
+	MONITOR_CRIT_WARN = 0,
+	MONITOR_TEMP,
+	MONITOR_PCT_USED,
+	MONITOR_DUR,
+	MONITOR_DUW,
+	MONITOR_MDI_ERRS,
+	MONITOR_NR_ERR_LOGS,
+	MONITOR_ERRI_NEW,
+	MONITOR_ZONE_CHANGES,
+	MONITOR_NMETRICS,
+};
+
+static const struct {
+	const char *name;
+	const char *type;
+	const char *help;
+	int delta;		///< Also emit the difference to the previous sample
+} monitor_metrics[] = {
+	{"xnvme_critical_warning", "gauge", "Critical Warning", 0},
+	{"xnvme_temperature_kelvin", "gauge", "Composite Temperature", 1},
+	{"xnvme_percentage_used", "gauge", "Percentage Used", 0},
+	{"xnvme_data_units_read_total", "counter", "Data Units Read", 1},
+	{"xnvme_data_units_written_total", "counter", "Data Units Written", 1},
+	{"xnvme_media_errors_total", "counter", "Media and Data Integrity Errors", 1},
+	{"xnvme_error_log_entries_total", "counter", "Error Information Log Entries", 0},
+	{"xnvme_error_log_entries_new", "gauge", "Error-log entries since previous sample", 0},
+	{"xnvme_zone_changes", "gauge", "Changed Zone List identifiers since previous sample", 0},
+};
+
+/**
+ * Binary record emitted per device and sample when --data-output is given
+ */
+struct monitor_rec {
+	uint64_t ts_ns;			///< CLOCK_REALTIME in nanoseconds
+	uint16_t devidx;		///< Index of the device being monitored
+	uint8_t crit_warn;
+	uint8_t pct_used;
+	uint16_t temp;			///< Composite Temperature in Kelvin
+	int16_t temp_delta;
+	uint32_t errs_new;		///< Error-log entries since previous sample
+	uint32_t zone_changes;		///< 0xFFFF when more than 511 zones changed
+	uint64_t dur_delta;		///< Data Units Read
+	uint64_t duw_delta;		///< Data Units Written
+	uint64_t mdi_delta;		///< Media and Data Integrity Errors
+};
+XNVME_STATIC_ASSERT(sizeof(struct monitor_rec) == 48, "Incorrect size")
+
+struct monitor_dev {
+	struct xnvme_dev *dev;
+	const char *uri;
+	uint32_t nsid;
+	int owned;			///< Opened by the monitor, thus closed by it
+
+	struct xnvme_spec_log_health_entry *health;
+	struct xnvme_spec_log_erri_entry *erri;
+	uint32_t erri_nentries;
+	struct znd_changes *changes;
+
+	uint64_t erri_ecnt;		///< Highest error count seen
+	uint64_t nsamples;
+	uint64_t cur[MONITOR_NMETRICS];
+	uint64_t prev[MONITOR_NMETRICS];
+	int valid;			///< Whether 'cur' holds the current sample
+};
+
+/**
+ * Returns the lower 64 bits of the given 128-bit little-endian counter
+ */
+static inline uint64_t
+monitor_u128_lo(const uint8_t *val)
+{
+	uint64_t lo = 0;
+
+	for (int i = 7; i >= 0; --i) {
+		lo = (lo << 8) | val[i];
+	}
+
+	return lo;
+}
+
+static int
+monitor_dev_setup(struct monitor_dev *mdev)
+{
+	// NOTE: The Error Log Page Entries (elpe) is a zero-based value
+	mdev->erri_nentries = (uint32_t) xnvme_dev_get_ctrlr(mdev->dev)->elpe + 1;
+	mdev->nsid = xnvme_dev_get_nsid(mdev->dev);
+
+	mdev->health = xnvme_buf_alloc(mdev->dev, sizeof(*mdev->health), NULL);
+	if (!mdev->health) {
+		return -errno;
+	}
+	mdev->erri = xnvme_buf_alloc(mdev->dev, mdev->erri_nentries *
+				     sizeof(*mdev->erri), NULL);
+	if (!mdev->erri) {
+		return -errno;
+	}
+	if (xnvme_dev_get_geo(mdev->dev)->type == XNVME_GEO_ZONED) {
+		mdev->changes = xnvme_buf_alloc(mdev->dev,
+						sizeof(*mdev->changes), NULL);
+		if (!mdev->changes) {
+			return -errno;
+		}
+	}
+
+	return 0;
+}
+
+static void
+monitor_dev_teardown(struct monitor_dev *mdev)
+{
+	if (!mdev->dev) {
+		return;
+	}
+
+	xnvme_buf_free(mdev->dev, mdev->health);
+	xnvme_buf_free(mdev->dev, mdev->erri);
+	xnvme_buf_free(mdev->dev, mdev->changes);
+
+	if (mdev->owned) {
+		xnvme_dev_close(mdev->dev);
+	}
+}
+
+/**
+ * Retrieve the logs of the given device, buffers are allocated up-front such
+ * that a sample amounts to two or three Get Log Page commands on the admin
+ * queue and nothing else
+ */
+static int
+monitor_dev_sample(struct monitor_dev *mdev)
+{
+	const struct xnvme_spec_log_health_entry *health = mdev->health;
+	uint64_t *cur = mdev->cur;
+	uint64_t ecnt = mdev->erri_ecnt;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	memcpy(mdev->prev, mdev->cur, sizeof(mdev->prev));
+	mdev->valid = 0;
+
+	err = xnvme_cmd_log(mdev->dev, XNVME_SPEC_LOG_HEALTH, 0x0, 0x0,
+			    mdev->nsid, 0, mdev->health,
+			    sizeof(*mdev->health), &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_log(XNVME_SPEC_LOG_HEALTH)", err);
+		return err ? err : -EIO;
+	}
+
+	memset(&req, 0, sizeof(req));
+	err = xnvme_cmd_log(mdev->dev, XNVME_SPEC_LOG_ERRI, 0x0, 0x0,
+			    mdev->nsid, 0, mdev->erri,
+			    mdev->erri_nentries * sizeof(*mdev->erri), &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_log(XNVME_SPEC_LOG_ERRI)", err);
+		return err ? err : -EIO;
+	}
+
+	cur[MONITOR_ZONE_CHANGES] = 0;
+	if (mdev->changes) {
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_log(mdev->dev, ZND_CMD_LOG_CHANGES, 0x0, 0x0,
+				    mdev->nsid, 0, mdev->changes,
+				    sizeof(*mdev->changes), &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("xnvme_cmd_log(ZND_CMD_LOG_CHANGES)", err);
+			return err ? err : -EIO;
+		}
+		cur[MONITOR_ZONE_CHANGES] = mdev->changes->nidents;
+	}
+
+	cur[MONITOR_CRIT_WARN] = health->crit_warn;
+	cur[MONITOR_TEMP] = health->comp_temp;
+	cur[MONITOR_PCT_USED] = health->pct_used;
+	cur[MONITOR_DUR] = monitor_u128_lo(health->data_units_read);
+	cur[MONITOR_DUW] = monitor_u128_lo(health->data_units_written);
+	cur[MONITOR_MDI_ERRS] = monitor_u128_lo(health->mdi_errs);
+	cur[MONITOR_NR_ERR_LOGS] = monitor_u128_lo(health->nr_err_logs);
+
+	cur[MONITOR_ERRI_NEW] = 0;
+	for (uint32_t i = 0; i < mdev->erri_nentries; ++i) {
+		uint64_t entry_ecnt = mdev->erri[i].ecnt;
+
+		ecnt = entry_ecnt > ecnt ? entry_ecnt : ecnt;
+		if (mdev->nsamples && (entry_ecnt > mdev->erri_ecnt)) {
+			cur[MONITOR_ERRI_NEW] += 1;
+		}
+	}
+	mdev->erri_ecnt = ecnt;
+
+	if (!mdev->nsamples) {
+		memcpy(mdev->prev, mdev->cur, sizeof(mdev->prev));
+	}
+	mdev->nsamples += 1;
+	mdev->valid = 1;
+
+	return 0;
+}
+
+static void
+monitor_emit_prometheus(struct monitor_dev *mdevs, uint32_t nmdevs)
+{
+	for (int m = 0; m < MONITOR_NMETRICS; ++m) {
+		printf("# HELP %s %s\n", monitor_metrics[m].name,
+		       monitor_metrics[m].help);
+		printf("# TYPE %s %s\n", monitor_metrics[m].name,
+		       monitor_metrics[m].type);
+		for (uint32_t i = 0; i < nmdevs; ++i) {
+			if (!mdevs[i].valid) {
+				continue;
+			}
+			printf("%s{uri=\"%s\"} %"PRIu64"\n",
+			       monitor_metrics[m].name, mdevs[i].uri,
+			       mdevs[i].cur[m]);
+		}
+
+		if (!monitor_metrics[m].delta) {
+			continue;
+		}
+
+		printf("# HELP %s_delta %s since previous sample\n",
+		       monitor_metrics[m].name, monitor_metrics[m].help);
+		printf("# TYPE %s_delta gauge\n", monitor_metrics[m].name);
+		for (uint32_t i = 0; i < nmdevs; ++i) {
+			if (!mdevs[i].valid) {
+				continue;
+			}
+			printf("%s_delta{uri=\"%s\"} %"PRId64"\n",
+			       monitor_metrics[m].name, mdevs[i].uri,
+			       (int64_t)(mdevs[i].cur[m] - mdevs[i].prev[m]));
+		}
+	}
+	fflush(stdout);
+}
+
+static int
+monitor_emit_binary(FILE *stream, struct monitor_dev *mdevs, uint32_t nmdevs,
+		    uint64_t ts_ns)
+{
+	for (uint32_t i = 0; i < nmdevs; ++i) {
+		const uint64_t *cur = mdevs[i].cur;
+		const uint64_t *prev = mdevs[i].prev;
+		struct monitor_rec rec = { 0 };
+
+		if (!mdevs[i].valid) {
+			continue;
+		}
+
+		rec.ts_ns = ts_ns;
+		rec.devidx = i;
+		rec.crit_warn = cur[MONITOR_CRIT_WARN];
+		rec.pct_used = cur[MONITOR_PCT_USED];
+		rec.temp = cur[MONITOR_TEMP];
+		rec.temp_delta = cur[MONITOR_TEMP] - prev[MONITOR_TEMP];
+		rec.errs_new = cur[MONITOR_ERRI_NEW];
+		rec.zone_changes = cur[MONITOR_ZONE_CHANGES];
+		rec.dur_delta = cur[MONITOR_DUR] - prev[MONITOR_DUR];
+		rec.duw_delta = cur[MONITOR_DUW] - prev[MONITOR_DUW];
+		rec.mdi_delta = cur[MONITOR_MDI_ERRS] - prev[MONITOR_MDI_ERRS];
+
+		if (fwrite(&rec, sizeof(rec), 1, stream) != 1) {
+			return -EIO;
+		}
+	}
+
+	return fflush(stream) ? -errno : 0;
+}
+
+static int
+sub_monitor(struct xnvmec *cli)
+{
+	uint64_t interval_ms = cli->args.interval ? cli->args.interval : 1000;
+	uint64_t count = cli->args.count;
+	struct xnvme_enumeration *listing = NULL;
+	struct monitor_dev *mdevs = NULL;
+	uint32_t nmdevs = 0;
+	FILE *stream = NULL;
+	struct timespec next;
+	int err = 0;
+
+	if (cli->args.dev && cli->given[XNVMEC_OPT_ALL]) {
+		xnvmec_pinf("Provide either --uri or --all, not both");
+		return -EINVAL;
+	}
+
+	if (cli->args.dev) {
+		nmdevs = 1;
+	} else if (cli->given[XNVMEC_OPT_ALL]) {
+		err = xnvme_enumerate(&listing, NULL, 0x0);
+		if (err) {
+			xnvmec_perr("xnvme_enumerate()", err);
+			goto exit;
+		}
+		nmdevs = listing->nentries;
+	}
+	if (!nmdevs) {
+		xnvmec_pinf("No devices to monitor, provide --uri or --all");
+		err = -EINVAL;
+		goto exit;
+	}
+
+	mdevs = calloc(nmdevs, sizeof(*mdevs));
+	if (!mdevs) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < nmdevs; ++i) {
+		struct monitor_dev *mdev = &mdevs[i];
+
+		if (listing) {
+			mdev->uri = listing->entries[i].uri;
+			mdev->dev = xnvme_dev_open(mdev->uri);
+			if (!mdev->dev) {
+				err = -errno;
+				xnvmec_perr("xnvme_dev_open()", err);
+				goto exit;
+			}
+			mdev->owned = 1;
+		} else {
+			mdev->uri = cli->args.uri;
+			mdev->dev = cli->args.dev;
+		}
+
+		err = monitor_dev_setup(mdev);
+		if (err) {
+			xnvmec_perr("monitor_dev_setup()", err);
+			goto exit;
+		}
+	}
+
+	if (cli->args.data_output) {
+		stream = fopen(cli->args.data_output, "wb");
+		if (!stream) {
+			err = -errno;
+			xnvmec_perr("fopen()", err);
+			goto exit;
+		}
+		xnvmec_pinf("Writing records of %zu bytes to: '%s'",
+			    sizeof(struct monitor_rec), cli->args.data_output);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (uint64_t sample = 0; (!count) || (sample < count); ++sample) {
+		struct timespec now;
+		int nfailed = 0;
+
+		for (uint32_t i = 0; i < nmdevs; ++i) {
+			if (monitor_dev_sample(&mdevs[i])) {
+				nfailed += 1;
+			}
+		}
+		if (nfailed == (int)nmdevs) {
+			xnvmec_pinf("Sampling failed for all devices");
+			err = -EIO;
+			goto exit;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (stream) {
+			err = monitor_emit_binary(stream, mdevs, nmdevs,
+						  now.tv_sec * 1000000000ULL +
+						  now.tv_nsec);
+			if (err) {
+				xnvmec_perr("monitor_emit_binary()", err);
+				goto exit;
+			}
+		} else {
+			monitor_emit_prometheus(mdevs, nmdevs);
+		}
+
+		if (count && (sample + 1 == count)) {
+			break;
+		}
+
+		// Absolute deadlines, such that the sampling-time does not
+		// accumulate as drift
+		next.tv_sec += interval_ms / 1000;
+		next.tv_nsec += (interval_ms % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_sec += 1;
+			next.tv_nsec -= 1000000000;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				       NULL) == EINTR) {
+			;
+		}
+	}
+
+exit:
+	if (stream) {
+		fclose(stream);
+	}
+	for (uint32_t i = 0; mdevs && (i < nmdevs); ++i) {
+		monitor_dev_teardown(&mdevs[i]);
+	}
+	free(mdevs);
+	free(listing);
+
+	return err;
+}
+
 //
 // Command-Line Interface (CLI) definition
 //
@@ -568,6 +975,7 @@ static struct xnvmec_sub subs[] = {
 		"Enumerate devices on the system", sub_enumerate, {
 			{XNVMEC_OPT_SYS_URI, XNVMEC_LOPT},
 			{XNVMEC_OPT_FLAGS, XNVMEC_LOPT},
+			{XNVMEC_OPT_PR, XNVMEC_LOPT},
 		}
 	},
 	{
@@ -630,6 +1038,7 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
 			{XNVMEC_OPT_LIMIT, XNVMEC_LOPT},
 			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LOPT},
+			{XNVMEC_OPT_PR, XNVMEC_LOPT},
 		}
 	},
 	{
@@ -638,6 +1047,24 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_URI, XNVMEC_POSA},
 			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
 			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LOPT},
+			{XNVMEC_OPT_PR, XNVMEC_LOPT},
+		}
+	},
+	{
+		"monitor", "Periodically sample health, error and zone-change logs",
+		"Periodically sample the S.M.A.R.T. / Health, error-information "
+		"and, for zoned namespaces, the changed-zone-list logs of the "
+		"device given by --uri, or of all devices on the system with "
+		"--all. Counters and their deltas since the previous sample are "
+		"emitted in the Prometheus text format on stdout, or as binary "
+		"records to --data-output. --count samples are taken, forever "
+		"when not given, every --interval milliseconds, default 1000.",
+		sub_monitor, {
+			{XNVMEC_OPT_URI, XNVMEC_LOPT},
+			{XNVMEC_OPT_ALL, XNVMEC_LFLG},
+			{XNVMEC_OPT_INTERVAL, XNVMEC_LOPT},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LOPT},
 		}
 	},
 	{
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <libznd.h>
 #include <libxnvmec.h>
 
+#define DEFAULT_QD 8
+
 // TODO: Have this enumeration only show zoned namespaces
 static int
 cmd_enumerate(struct xnvmec *cli)
@@ -149,7 +152,7 @@ cmd_report(struct xnvmec *cli)
 		goto exit;
 	}
 
-	znd_report_pr(report, XNVME_PR_DEF);
+	znd_report_pr(report, cli->args.pr);
 	err = 0;
 
 	if (cli->args.data_output) {
@@ -493,6 +496,74 @@ cmd_mgmt(struct xnvmec *cli)
 	return _cmd_mgmt(cli, cli->args.action);
 }
 
+static int
+cmd_export(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	const uint32_t qd = cli->args.qdepth ? cli->args.qdepth : DEFAULT_QD;
+	const uint64_t slba = cli->args.slba;
+	const uint64_t nlb = cli->args.nlb;
+	uint32_t nsid = cli->args.nsid;
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+
+	xnvmec_pinf("Exporting nsid: 0x%x, slba: 0x%016"PRIx64", nlb: %"PRIu64", qd: %u, to: '%s'",
+		    nsid, slba, nlb, qd, cli->args.data_output);
+
+	xnvmec_timer_start(cli);
+
+	err = xnvmec_dev_to_file(dev, nsid, slba, nlb, qd,
+				 cli->args.data_output);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_to_file()", err);
+		return err;
+	}
+
+	xnvmec_timer_stop(cli);
+	xnvmec_timer_bw_pr(cli, "wall-clock", (nlb + 1) * geo->lba_nbytes);
+
+	return 0;
+}
+
+/**
+ * Writes to a zone must arrive in order, thus a single write is in flight,
+ * overlapping with reading the next chunk from the file
+ */
+static int
+cmd_import(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const uint64_t slba = cli->args.slba;
+	uint32_t nsid = cli->args.nsid;
+	size_t nbytes = 0;
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+
+	xnvmec_pinf("Importing nsid: 0x%x, slba: 0x%016"PRIx64", from: '%s'",
+		    nsid, slba, cli->args.data_input);
+
+	xnvmec_timer_start(cli);
+
+	err = xnvmec_dev_from_file(dev, nsid, slba, 1, cli->args.data_input,
+				   &nbytes);
+	if (err) {
+		xnvmec_perr("xnvmec_dev_from_file()", err);
+		return err;
+	}
+
+	xnvmec_timer_stop(cli);
+	xnvmec_timer_bw_pr(cli, "wall-clock", nbytes);
+
+	return 0;
+}
+
 static int
 cmd_mgmt_open(struct xnvmec *cli)
 {
@@ -554,6 +625,7 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
 			{XNVMEC_OPT_LIMIT, XNVMEC_LOPT},
 			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LOPT},
+			{XNVMEC_OPT_PR, XNVMEC_LOPT},
 		}
 	},
 	{
@@ -604,6 +676,29 @@ static struct xnvmec_sub subs[] = {
 			{XNVMEC_OPT_META_INPUT, XNVMEC_LOPT},
 		}
 	},
+	{
+		"export", "Stream a range of logical blocks to a file",
+		"Stream a range of logical blocks to a file, pipelining reads "
+		"of at most MDTS with file-writes", cmd_export, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_NLB, XNVMEC_LREQ},
+			{XNVMEC_OPT_DATA_OUTPUT, XNVMEC_LREQ},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"import", "Stream a file to zones",
+		"Stream a file to zones, starting at the write-pointer 'slba', "
+		"overlapping file-reads with writes of at most MDTS",
+		cmd_import, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
+			{XNVMEC_OPT_DATA_INPUT, XNVMEC_LREQ},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+		}
+	},
 	{
 		"mgmt-open", "Open a Zone",
 		"Open a Zone", cmd_mgmt_open, {